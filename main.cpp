@@ -9,10 +9,492 @@
  * - อัพเดทสถานะการส่งผ่าน UART
  */
 
+#ifndef HAL_HOST
 #include <Arduino.h>
 #include <WiFi.h>
 #include <HTTPClient.h>
-#include <ArduinoJson.h>   // ✅ ใช้สำหรับ parse JSON
+#else
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#endif
+
+// === Hardware Abstraction Layer (HAL) ===
+// ลอจิกควบคุมทั้งหมดเรียกฮาร์ดแวร์ผ่านฟังก์ชัน hal_* เท่านั้น
+// เมื่อ compile ด้วย -DHAL_HOST ฟังก์ชันเหล่านี้เป็นเพียงการประกาศ และต้องมี implementation
+// จากฝั่ง host: tools/host_hal.h (เวลาเสมือน IR เสมือน flash ในหน่วยความจำ และ Serial2 ผ่าน PTY) build ด้วย tools/Makefile
+#define HAL_FLASH_PARTITION "spiffs"    // partition ที่ใช้เก็บ journal ของคิว (ไม่ได้ใช้ SPIFFS)
+#define HAL_FLASH_SECTOR 4096          // ขนาด sector ที่ลบได้ทีละครั้ง
+
+#ifndef HAL_HOST
+#include <esp_partition.h>
+#define HAL_INLINE inline __attribute__((always_inline))
+
+// --- เวลา ---
+HAL_INLINE uint32_t hal_millis() { return millis(); }
+HAL_INLINE uint32_t hal_micros() { return micros(); }
+HAL_INLINE uint32_t hal_cycles() { return ESP.getCycleCount(); }   // ตัวนับรอบสัญญาณนาฬิกา CPU
+HAL_INLINE uint32_t hal_cpu_mhz() { return ESP.getCpuFreqMHz(); }
+HAL_INLINE uint32_t hal_free_heap() { return ESP.getFreeHeap(); }   // ไบต์ที่ heap เหลือ (ใช้ตรวจการจองหน่วยความจำ)
+
+// --- GPIO ---
+HAL_INLINE void hal_pin_mode(uint8_t pin, uint8_t mode) { pinMode(pin, mode); }
+HAL_INLINE int hal_digital_read(uint8_t pin) { return digitalRead(pin); }
+HAL_INLINE void hal_digital_write(uint8_t pin, uint8_t level) { digitalWrite(pin, level); }
+HAL_INLINE void hal_attach_interrupt(uint8_t pin, void (*isr)(void), int mode) {
+  attachInterrupt(digitalPinToInterrupt(pin), isr, mode);
+}
+HAL_INLINE uint32_t hal_analog_read_mv(uint8_t pin) { return analogReadMilliVolts(pin); }  // ADC1 เท่านั้น (ADC2 ใช้ไม่ได้ขณะเปิด WiFi)
+
+// --- PWM ---
+HAL_INLINE void hal_pwm_setup(uint8_t pin, uint8_t channel, uint32_t freq, uint8_t bits) {
+  ledcSetup(channel, freq, bits);
+  ledcAttachPin(pin, channel);
+}
+HAL_INLINE void hal_pwm_write(uint8_t channel, uint32_t duty) { ledcWrite(channel, duty); }
+
+// --- UART ไป Raspberry Pi (Serial2: RX=16, TX=17) ---
+HAL_INLINE void hal_pi_begin(uint32_t baud) { Serial2.begin(baud, SERIAL_8N1, 16, 17); }
+HAL_INLINE int hal_pi_available() { return Serial2.available(); }
+HAL_INLINE size_t hal_pi_read_bytes(uint8_t *buf, size_t len) { return Serial2.read(buf, len); }
+HAL_INLINE size_t hal_pi_write(const uint8_t *data, size_t len) { return Serial2.write(data, len); }
+
+// --- Serial สำหรับ debug/trace (USB) ---
+HAL_INLINE void hal_debug_begin(uint32_t baud) { Serial.begin(baud); }
+HAL_INLINE int hal_debug_room() { return Serial.availableForWrite(); }   // จำนวนไบต์ที่เขียนได้โดยไม่บล็อก
+HAL_INLINE size_t hal_debug_write(const uint8_t *data, size_t len) { return Serial.write(data, len); }
+
+// --- FreeRTOS task ---
+typedef TaskHandle_t hal_task_t;
+HAL_INLINE bool hal_task_create(void (*fn)(void *), const char *name, uint32_t stack,
+                                uint8_t priority, uint8_t core, hal_task_t *handle) {
+  return xTaskCreatePinnedToCore(fn, name, stack, NULL, priority, handle, core) == pdPASS;
+}
+HAL_INLINE void hal_task_wait(uint32_t timeout_ms) {   // รอ notify หรือจนหมดเวลา
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout_ms));
+}
+HAL_INLINE void hal_task_notify_from_isr(hal_task_t task) {
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(task, &woken);
+  if (woken) portYIELD_FROM_ISR();
+}
+HAL_INLINE uint8_t hal_core_id() { return xPortGetCoreID(); }
+
+// --- Flash (partition HAL_FLASH_PARTITION) ---
+HAL_INLINE const esp_partition_t *hal_flash_partition() {
+  static const esp_partition_t *part =
+      esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, HAL_FLASH_PARTITION);
+  return part;
+}
+HAL_INLINE bool hal_flash_read(uint32_t offset, void *data, size_t len) {
+  return hal_flash_partition() && esp_partition_read(hal_flash_partition(), offset, data, len) == ESP_OK;
+}
+HAL_INLINE bool hal_flash_write(uint32_t offset, const void *data, size_t len) {
+  return hal_flash_partition() && esp_partition_write(hal_flash_partition(), offset, data, len) == ESP_OK;
+}
+HAL_INLINE bool hal_flash_erase(uint32_t offset) {   // ลบหนึ่ง sector (ได้ค่า 0xFF)
+  return hal_flash_partition() && esp_partition_erase_range(hal_flash_partition(), offset, HAL_FLASH_SECTOR) == ESP_OK;
+}
+HAL_INLINE uint32_t hal_flash_size() {              // ขนาด partition (ไบต์) - 0 หากไม่มี partition
+  return hal_flash_partition() ? hal_flash_partition()->size : 0;
+}
+#else
+#define HAL_INLINE inline
+#define IRAM_ATTR
+#define LOW 0
+#define HIGH 1
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define RISING 0x01
+#define CHANGE 0x03
+typedef void *hal_task_t;
+uint32_t hal_millis();
+uint32_t hal_micros();
+uint32_t hal_cycles();
+uint32_t hal_cpu_mhz();
+uint32_t hal_free_heap();
+void hal_pin_mode(uint8_t pin, uint8_t mode);
+int hal_digital_read(uint8_t pin);
+void hal_digital_write(uint8_t pin, uint8_t level);
+void hal_attach_interrupt(uint8_t pin, void (*isr)(void), int mode);
+uint32_t hal_analog_read_mv(uint8_t pin);
+void hal_pwm_setup(uint8_t pin, uint8_t channel, uint32_t freq, uint8_t bits);
+void hal_pwm_write(uint8_t channel, uint32_t duty);
+void hal_pi_begin(uint32_t baud);
+int hal_pi_available();
+size_t hal_pi_read_bytes(uint8_t *buf, size_t len);  // อ่านเท่าที่มี ไม่รอ
+size_t hal_pi_write(const uint8_t *data, size_t len);
+void hal_debug_begin(uint32_t baud);
+int hal_debug_room();
+size_t hal_debug_write(const uint8_t *data, size_t len);
+bool hal_task_create(void (*fn)(void *), const char *name, uint32_t stack,
+                     uint8_t priority, uint8_t core, hal_task_t *handle);
+void hal_task_wait(uint32_t timeout_ms);
+void hal_task_notify_from_isr(hal_task_t task);
+uint8_t hal_core_id();
+bool hal_flash_read(uint32_t offset, void *data, size_t len);
+bool hal_flash_write(uint32_t offset, const void *data, size_t len);
+bool hal_flash_erase(uint32_t offset);
+uint32_t hal_flash_size();
+#endif
+
+// === Ring buffer แบบ lock-free (single-producer/single-consumer) ===
+// ใช้ส่งข้อมูลระหว่าง ISR/task โดยผู้เขียนแก้ head เท่านั้น และผู้อ่านแก้ tail เท่านั้น
+template <typename T, uint32_t N>
+struct SpscRing {
+  static_assert((N & (N - 1)) == 0, "SpscRing capacity must be a power of two");
+
+  T items[N];
+  volatile uint32_t head;      // เขียนโดยผู้ส่งเท่านั้น
+  volatile uint32_t tail;      // เขียนโดยผู้รับเท่านั้น
+
+  HAL_INLINE bool push(const T &item) {
+    uint32_t h = head;
+    if (h - tail >= N) return false;             // เต็ม
+    items[h & (N - 1)] = item;
+    __sync_synchronize();                        // เขียนข้อมูลให้เสร็จก่อนเลื่อน head
+    head = h + 1;
+    return true;
+  }
+
+  HAL_INLINE bool pop(T &item) {
+    uint32_t t = tail;
+    if (t == head) return false;                 // ว่าง
+    __sync_synchronize();                        // อ่าน head ก่อนอ่านข้อมูล
+    item = items[t & (N - 1)];
+    __sync_synchronize();
+    tail = t + 1;
+    return true;
+  }
+};
+
+// === บันทึกเหตุการณ์แบบ binary (trace) ===
+// แต่ละเหตุการณ์คือ record ขนาดคงที่ (รหัส, เวลา, ค่าประกอบ 2 ค่า) เขียนลง ring buffer ใน RAM
+// แล้ว task comms ทยอยส่งออกทาง Serial เฉพาะเมื่อ TX FIFO มีที่ว่าง จึงไม่บล็อก task real-time
+// รูปแบบบนสาย: [TRACE_SYNC][id][time_us:4][a:4][b:4] (little-endian) แปลงเป็นข้อความด้วย tools/trace_decode.py
+// แต่ละ core มี ring ของตัวเอง (มีผู้เขียนเพียง task เดียวต่อ core) และระดับที่สูงกว่า TRACE_LEVEL ถูกตัดทิ้งตอน compile
+#define TRACE_LEVEL_OFF 0
+#define TRACE_LEVEL_WARN 1     // ข้อผิดพลาดและเหตุการณ์ผิดปกติ
+#define TRACE_LEVEL_INFO 2     // เหตุการณ์ของพัสดุ
+#define TRACE_LEVEL_DEBUG 3    // รายละเอียดคิวและข้อความ
+#ifndef TRACE_LEVEL
+#define TRACE_LEVEL TRACE_LEVEL_INFO
+#endif
+#ifdef RECORD_INPUTS
+#define TRACE_CAPACITY 1024    // จำนวน record ต่อ core (ต้องเป็นเลขยกกำลัง 2) - เผื่อ record ของ input
+#define DEBUG_BAUD 921600      // ความเร็ว Serial debug (ต้องส่ง input ทั้งหมดทัน)
+#else
+#define TRACE_CAPACITY 128     // จำนวน record ต่อ core (ต้องเป็นเลขยกกำลัง 2)
+#define DEBUG_BAUD 115200      // ความเร็ว Serial debug
+#endif
+#define TRACE_SYNC 0xA5        // ไบต์เริ่มต้นของแต่ละ record บนสาย
+#define TRACE_FRAME_SIZE 14    // ขนาด record บนสาย (ไบต์)
+
+enum TraceId {                 // ต้องตรงกับ TRACE_EVENTS ใน tools/trace_decode.py
+  TR_TRACE_DROPPED,            // a=จำนวน record ที่ทิ้ง b=core
+  TR_QUEUE_FULL,               // คิวพัสดุเต็ม a=จำนวน b=สายพาน
+  TR_QUEUE_INVALID,            // a=seq b=สายพาน
+  TR_QUEUE_EMPTY,              // a=สายพาน
+  TR_TRACKING_DUPLICATE,       // a=seq เดิม b=seq ที่อ่านซ้ำ
+  TR_COMMS_FULL,               // a=CommsMsgType
+  TR_PI_MSG_SHORT,             // a=ชนิดข้อความ b=ความยาว
+  TR_QR_RESULT,                // a=seq b=dorm
+  TR_RT_FULL,                  // a=seq
+  TR_QR_STALE,                 // a=seq b=สายพาน
+  TR_QR_TIMEOUT,               // a=seq b=สายพาน
+  TR_STATUS_SENT,              // a=batch b=จำนวนเหตุการณ์
+  TR_STATUS_FULL,
+  TR_STATUS_RETRY,             // a=batch
+  TR_STATUS_TOO_LONG,
+  TR_PI_FRAME,                 // a=ความยาว payload b=ชนิดข้อความ
+  TR_PI_FRAME_BAD,             // a=PiFrameError b=ความยาว (PI_FRAME_TYPE: ชนิดข้อความ)
+  TR_BELT_MOVE,                // a=ทิศทาง b=สายพาน
+  TR_QUEUE_SLOT,               // a=seq b=dorm
+  TR_THROUGHPUT,               // a=parcels/min x100 รวมทุกสายพาน b=โหมดสแกนต่อเนื่อง
+  TR_PUSH_BOX,                 // a=seq b=dorm
+  TR_PUSH_DORM,                // a=ประตู b=dorm
+  TR_PUSH_NO_FORM,             // a=seq b=dorm
+  TR_GATE,                     // a=ประตู b=seq
+  TR_PARCEL_LOST,              // a=seq b=สายพาน
+  TR_INTAKE,                   // a=seq b=โหมดสแกนต่อเนื่อง
+  TR_GATE_UNEXPECTED,          // a=ประตู b=สายพาน
+  TR_QR_LATE,                  // สายพานหยุดรอผล QR a=สายพาน
+  TR_RT_STATS,                 // a=เวลาทำงานสูงสุดต่อรอบ (us) b=latency สูงสุดของ IR (us)
+  TR_IR_DROPPED,               // a=จำนวน event ที่ทิ้ง (สะสม)
+  TR_METRICS_TOO_LONG,         // a=ขนาด buffer
+  TR_JOURNAL_RESTORED,         // a=จำนวนพัสดุที่กู้คืน b=generation
+  TR_JOURNAL_COMPACT,          // a=generation b=จำนวนพัสดุใน snapshot
+  TR_JOURNAL_ERROR,            // a=offset ที่อ่าน/เขียน/ลบไม่สำเร็จ
+  TR_JOURNAL_FULL,             // a=JournalType ที่ทิ้ง b=seq
+  TR_RECENT_FULL,              // a=จำนวนหมายเลขในชุดที่พบล่าสุด
+  TR_DORM_SYNC_REQUEST,        // a=version ของตารางหอพักปัจจุบัน
+  TR_DORM_SYNC_DONE,           // a=จำนวนรายการ b=version
+  TR_DORM_DELTA,               // a=จำนวนรายการที่เปลี่ยน b=version
+  TR_DORM_SYNC_ERROR,          // a=part ที่ได้รับ b=part ที่รอ
+  TR_DORM_CACHE_FULL,          // a=ความจุของตารางหอพัก
+  TR_LANE_THROUGHPUT,          // a=สายพาน b=parcels/min x100
+  TR_PUSHER_STROKE,            // a=มอเตอร์ (ติดลบ=ดึงกลับ) b=เวลาถึงปลายทาง (ms)
+  TR_PUSHER_MISS,              // ไม่พบปลายทาง a=มอเตอร์ b=ทิศทาง (1=ผลัก, -1=ดึงกลับ)
+  TR_PUSHER_FEEDBACK_LOST,     // กลับไปใช้เวลาคงที่ a=มอเตอร์ b=จำนวนครั้งที่ไม่พบติดกัน
+  TR_PUSHER_BASELINE,          // a=มอเตอร์ b=ผลักออก (ms) | ดึงกลับ (ms) << 16
+  TR_PUSHER_WORN,              // a=มอเตอร์ b=เวลา stroke เทียบ baseline (%)
+  TR_TRACKING_TOO_LONG,        // ผล QR ยาวเกิน TRACKING_MAX_LEN a=seq b=ความยาว
+  TR_INTAKE_BUSY,              // IR หลักตรวจพบระหว่างสแกนพัสดุก่อนหน้า (ไม่รับ) a=seq ที่กำลังสแกน b=สายพาน
+  TR_STATUS_RESTORED,          // a=จำนวนเหตุการณ์สถานะที่ยังไม่ได้รับ ack b=generation
+  TR_REC_IR,                   // RECORD_INPUTS: time=เวลาขอบ a=sensor b=ระดับ
+  TR_REC_PI,                   // RECORD_INPUTS: ไบต์จาก Pi a=len|ไบต์ 0-2 b=ไบต์ 3-6
+  TR_REC_FEEDBACK,             // RECORD_INPUTS: feedback มอเตอร์ผลักที่อ่านได้ a=ประตู*2+input b=ระดับ
+  TR_COUNT
+};
+
+struct TraceRecord {
+  uint32_t time_us;            // เวลาที่เกิดเหตุการณ์ (micros)
+  int32_t a;                   // ค่าประกอบที่ 1
+  int32_t b;                   // ค่าประกอบที่ 2
+  uint8_t id;                  // TraceId
+};
+
+SpscRing<TraceRecord, TRACE_CAPACITY> trace_rings[2];  // แยกตาม core
+volatile uint32_t trace_dropped[2];  // จำนวน record ที่ทิ้งเพราะ ring เต็ม (เขียนโดยผู้เขียน ring เท่านั้น)
+uint32_t trace_dropped_reported[2];  // จำนวนที่รายงานแล้ว (task comms)
+
+/**
+ * ฟังก์ชันบันทึกเหตุการณ์พร้อมเวลาที่กำหนดลง ring ของ core ปัจจุบัน (ไม่บล็อก)
+ */
+inline void trace_emit_at(uint8_t id, uint32_t time_us, int32_t a, int32_t b) {
+  TraceRecord rec;
+  rec.time_us = time_us;
+  rec.a = a;
+  rec.b = b;
+  rec.id = id;
+  uint8_t core = hal_core_id() & 1;
+  if (!trace_rings[core].push(rec)) trace_dropped[core]++;
+}
+
+/**
+ * ฟังก์ชันบันทึกเหตุการณ์ลง ring ของ core ปัจจุบัน (ไม่บล็อก)
+ */
+inline void trace_emit(uint8_t id, int32_t a, int32_t b) {
+  trace_emit_at(id, hal_micros(), a, b);
+}
+
+#if TRACE_LEVEL >= TRACE_LEVEL_WARN
+#define TRACE_WARN(id, a, b) trace_emit(id, a, b)
+#else
+#define TRACE_WARN(id, a, b) do {} while (0)
+#endif
+#if TRACE_LEVEL >= TRACE_LEVEL_INFO
+#define TRACE_INFO(id, a, b) trace_emit(id, a, b)
+#else
+#define TRACE_INFO(id, a, b) do {} while (0)
+#endif
+#if TRACE_LEVEL >= TRACE_LEVEL_DEBUG
+#define TRACE_DEBUG(id, a, b) trace_emit(id, a, b)
+#else
+#define TRACE_DEBUG(id, a, b) do {} while (0)
+#endif
+
+/**
+ * ฟังก์ชันเขียนค่า 32 บิตแบบ little-endian ลง buffer
+ */
+inline void trace_put_u32(uint8_t *buf, uint32_t v) {
+  buf[0] = v;
+  buf[1] = v >> 8;
+  buf[2] = v >> 16;
+  buf[3] = v >> 24;
+}
+
+/**
+ * ฟังก์ชันส่ง record ออกทาง Serial เท่าที่ TX FIFO รับได้โดยไม่บล็อก (task comms)
+ */
+void trace_drain() {
+  for (uint8_t core = 0; core < 2; core++) {
+    uint32_t dropped = trace_dropped[core] - trace_dropped_reported[core];
+    if (dropped > 0) {
+      trace_dropped_reported[core] += dropped;
+      TRACE_WARN(TR_TRACE_DROPPED, dropped, core);
+    }
+
+    TraceRecord rec;
+    while (hal_debug_room() >= TRACE_FRAME_SIZE && trace_rings[core].pop(rec)) {
+      uint8_t frame[TRACE_FRAME_SIZE];
+      frame[0] = TRACE_SYNC;
+      frame[1] = rec.id;
+      trace_put_u32(frame + 2, rec.time_us);
+      trace_put_u32(frame + 6, rec.a);
+      trace_put_u32(frame + 10, rec.b);
+      hal_debug_write(frame, TRACE_FRAME_SIZE);
+    }
+  }
+}
+
+// === บันทึก input สำหรับ replay บน host (RECORD_INPUTS) ===
+// เมื่อ compile ด้วย -DRECORD_INPUTS ขอบสัญญาณ IR ดิบ (ก่อน debounce) ทุกไบต์ที่รับจาก Pi และค่า feedback
+// ของมอเตอร์ผลักทุกครั้งที่อ่านได้ค่าใหม่ ถูกส่งออกใน stream ของ trace (ไม่ขึ้นกับ TRACE_LEVEL)
+// ซึ่งเป็น input ทั้งหมดของลอจิกควบคุม
+// tools/trace_decode.py --record แยกเป็นไฟล์ .rec แล้ว tools/replay.cpp รันลอจิกเดิมซ้ำบน host
+// หาก ring เต็มจะมี TR_TRACE_DROPPED ใน stream และการ replay จะไม่ตรงกับเหตุการณ์จริง
+#ifdef RECORD_INPUTS
+/**
+ * ฟังก์ชันบันทึกขอบสัญญาณ IR ที่ ISR จับได้ (task real-time)
+ */
+inline void record_ir(uint8_t sensor, uint8_t level, uint32_t time_us) {
+  trace_emit_at(TR_REC_IR, time_us, sensor, level);
+}
+
+/**
+ * ฟังก์ชันบันทึกไบต์ที่รับจาก Pi ทีละไม่เกิน 7 ไบต์ต่อ record (task comms)
+ */
+void record_pi(const uint8_t *data, size_t len, uint32_t time_us) {
+  while (len > 0) {
+    uint8_t n = len < 7 ? len : 7;
+    uint8_t chunk[8] = { n };
+    memcpy(chunk + 1, data, n);
+    trace_emit_at(TR_REC_PI, time_us, (int32_t)(chunk[0] | chunk[1] << 8 | chunk[2] << 16 | (uint32_t)chunk[3] << 24),
+                  (int32_t)(chunk[4] | chunk[5] << 8 | chunk[6] << 16 | (uint32_t)chunk[7] << 24));
+    data += n;
+    len -= n;
+  }
+}
+
+/**
+ * ฟังก์ชันบันทึกค่า feedback ของมอเตอร์ผลักที่เปลี่ยนไปจากครั้งก่อน (task real-time)
+ * @param input ประตู*2 + (0=ปลายทางผลักออก/SENSE, 1=ปลายทางดึงกลับ)
+ */
+inline void record_feedback(uint8_t input, uint8_t level, uint32_t time_us) {
+  trace_emit_at(TR_REC_FEEDBACK, time_us, input, level);
+}
+#else
+#define record_ir(sensor, level, time_us) do {} while (0)
+#define record_pi(data, len, time_us) do {} while (0)
+#define record_feedback(input, level, time_us) do {} while (0)
+#endif
+
+// === วัด latency ของแต่ละขั้นตอน (histogram ขนาดคงที่) ===
+// แต่ละ probe มี histogram แบบ log-linear (4 ช่องย่อยต่อช่วงยกกำลัง 2, คลาดเคลื่อน < 25%)
+// ช่วงสั้นวัดด้วยตัวนับรอบ CPU (หน่วย ns) ช่วงยาวข้ามฟังก์ชันวัดด้วย micros (หน่วย us)
+// แต่ละ histogram มีผู้เขียนเพียง task เดียว ส่วน task comms อ่านแล้วส่งสรุปไป Pi ทุก METRICS_PERIOD_MS
+// การเริ่มช่วงใหม่ทำโดยเพิ่ม metrics_epoch แล้วผู้เขียนจะล้าง histogram ก่อนบันทึกค่าถัดไป
+#define METRICS_BUCKETS 124    // 8 ช่องแรกเป็นค่าตรง + 4 ช่องต่อช่วงยกกำลัง 2 จนถึง 2^32
+#define METRICS_PERIOD_MS 10000 // ช่วงเวลาสรุปและส่ง metrics
+
+enum MetricId {
+  METRIC_QR_RESPONSE,          // IR หลัก → ได้ผล QR ใน task real-time (us)
+  METRIC_QR_HANDOFF,           // task comms ได้รับผล QR → เติมลงคิว (us)
+  METRIC_QR_REQUEST,           // requestQRFromPi (ns)
+  METRIC_ENQUEUE,              // enqueue (ns)
+  METRIC_DEQUEUE,              // dequeueAt (ns)
+  METRIC_PUSH_BOX,             // push_box (ns)
+  METRIC_GATE_TO_PUSH,         // IR ประตู → สั่งมอเตอร์ผลัก (us)
+  METRIC_IR_EDGE,              // ขอบสัญญาณ IR → เริ่มประมวลผล (us)
+  METRIC_RT_LOOP,              // เวลาทำงานหนึ่งรอบของ task real-time (ns)
+  METRIC_RT_PERIOD,            // ช่วงห่างระหว่างรอบของ task real-time (us)
+  METRIC_PUSHER_CYCLE,         // มอเตอร์ผลักเริ่มผลัก → พร้อมใช้งาน (ms)
+  METRIC_COUNT
+};
+
+struct MetricInfo {
+  const char *name;            // ชื่อใน metrics message
+  const char *unit;            // หน่วยของค่า
+};
+
+constexpr MetricInfo METRICS[METRIC_COUNT] = {
+  { "qr_response", "us" },
+  { "qr_handoff",  "us" },
+  { "qr_request",  "ns" },
+  { "enqueue",     "ns" },
+  { "dequeue",     "ns" },
+  { "push_box",    "ns" },
+  { "gate_to_push","us" },
+  { "ir_edge",     "us" },
+  { "rt_loop",     "ns" },
+  { "rt_period",   "us" },
+  { "pusher_cycle","ms" },
+};
+
+struct LatencyHist {
+  uint32_t epoch;              // ช่วงที่ข้อมูลนี้เป็นของ
+  uint32_t count;              // จำนวนค่าในช่วงนี้
+  uint32_t min;
+  uint32_t max;
+  uint16_t buckets[METRICS_BUCKETS];
+};
+
+LatencyHist metrics[METRIC_COUNT];
+volatile uint32_t metrics_epoch = 1;   // เพิ่มโดย task comms เมื่อส่งสรุปแล้ว
+uint32_t metrics_cycles_per_us = 240;  // ตั้งค่าใน setup()
+
+/**
+ * ฟังก์ชันหาช่องของค่าใน histogram
+ */
+inline uint8_t metrics_bucket(uint32_t v) {
+  if (v < 8) return v;
+  uint8_t msb = 31 - __builtin_clz(v);
+  return 8 + (msb - 3) * 4 + ((v >> (msb - 2)) & 3);
+}
+
+/**
+ * ฟังก์ชันหาค่าสูงสุดของช่องใน histogram
+ */
+inline uint32_t metrics_bucket_max(uint8_t b) {
+  if (b < 8) return b;
+  uint8_t msb = (b - 8) / 4 + 3;
+  uint64_t lower = (uint64_t)(4 + (b - 8) % 4) << (msb - 2);
+  uint64_t upper = lower + (1ULL << (msb - 2)) - 1;
+  return upper > 0xFFFFFFFFULL ? 0xFFFFFFFFUL : (uint32_t)upper;
+}
+
+/**
+ * ฟังก์ชันบันทึกค่าลง histogram (เรียกจาก task ที่เป็นเจ้าของ probe เท่านั้น)
+ * @param id probe (MetricId)
+ * @param value ค่าที่วัดได้ตามหน่วยของ probe
+ */
+void metrics_record(uint8_t id, uint32_t value) {
+  LatencyHist &h = metrics[id];
+  if (h.epoch != metrics_epoch) {                // เริ่มช่วงใหม่
+    memset(h.buckets, 0, sizeof(h.buckets));
+    h.count = 0;
+    h.min = 0xFFFFFFFF;
+    h.max = 0;
+    h.epoch = metrics_epoch;
+  }
+  uint16_t &bucket = h.buckets[metrics_bucket(value)];
+  if (bucket < 0xFFFF) bucket++;
+  h.count++;
+  if (value < h.min) h.min = value;
+  if (value > h.max) h.max = value;
+}
+
+/**
+ * ฟังก์ชันบันทึกช่วงเวลาที่วัดด้วยตัวนับรอบ CPU (แปลงเป็น ns)
+ */
+inline void metrics_record_cycles(uint8_t id, uint32_t cycles) {
+  metrics_record(id, (uint32_t)((uint64_t)cycles * 1000 / metrics_cycles_per_us));
+}
+
+// จับเวลาภายในฟังก์ชัน: PROBE_BEGIN(x); ... PROBE_END(METRIC_..., x);
+#define PROBE_BEGIN(name) uint32_t probe_##name = hal_cycles()
+#define PROBE_END(id, name) metrics_record_cycles(id, hal_cycles() - probe_##name)
+
+/**
+ * ฟังก์ชันหาค่า percentile จาก histogram (ค่าสูงสุดของช่อง จำกัดไม่เกิน min/max จริง)
+ * @param pct percentile (0-100)
+ */
+uint32_t metrics_percentile(const LatencyHist &h, uint8_t pct) {
+  uint32_t target = ((uint64_t)h.count * pct + 99) / 100;
+  uint32_t seen = 0;
+  for (uint8_t b = 0; b < METRICS_BUCKETS; b++) {
+    seen += h.buckets[b];
+    if (seen >= target && seen > 0) {
+      uint32_t v = metrics_bucket_max(b);
+      if (v < h.min) return h.min;
+      return v > h.max ? h.max : v;
+    }
+  }
+  return h.max;
+}
 
 // === กำหนดขา GPIO สำหรับ IR Sensor ===
 #define IR_DIGITAL_PIN 34      // IR sensor หลักตรวจจับพัสดุ
@@ -35,516 +517,2945 @@
 #define MOTOR2_IN_A 33         // มอเตอร์ผลัก 3 - ขา A
 #define MOTOR2_IN_B 32         // มอเตอร์ผลัก 3 - ขา B
 
-#define MAX_DORM 10            // จำนวนสูงสุดของพัสดุในคิว
+// === กำหนดขาสวิตช์ปลายทาง (limit switch) ของมอเตอร์ผลัก ===
+// บอร์ดปัจจุบันยังไม่ได้ติดตั้งสวิตช์ (GATES ใช้ PUSHER_FB_NONE) - ขาเหล่านี้สำรองไว้สำหรับประตูที่ติดตั้งแล้ว
+// สวิตช์ต่อลง GND (active low) ขา 5 และ 15 เป็น strapping pin จึงใช้กับสวิตช์ปลายทางผลักออก
+// ซึ่งเปิดวงจรอยู่ตอน boot (มอเตอร์ดึงกลับสุด) - ใช้ current sense ไม่ได้เพราะขา ADC1 ถูกใช้กับ IR หมดแล้ว
+#define PUSHER0_END_OUT 5      // มอเตอร์ผลัก 1 - ผลักออกสุด
+#define PUSHER0_END_IN 4       // มอเตอร์ผลัก 1 - ดึงกลับสุด
+#define PUSHER1_END_OUT 15     // มอเตอร์ผลัก 2 - ผลักออกสุด
+#define PUSHER1_END_IN 14      // มอเตอร์ผลัก 2 - ดึงกลับสุด
+#define PUSHER2_END_OUT 21     // มอเตอร์ผลัก 3 - ผลักออกสุด
+#define PUSHER2_END_IN 22      // มอเตอร์ผลัก 3 - ดึงกลับสุด
 
-// === ตัวแปร Flag สำหรับตรวจจับสัญญาณ IR ===
-bool flag = false;             // Flag สำหรับ IR sensor หลัก
-bool flagG1 = false;           // Flag สำหรับ IR sensor ประตู 1
-bool flagG2 = false;           // Flag สำหรับ IR sensor ประตู 2
-bool flagG3 = false;           // Flag สำหรับ IR sensor ประตู 3
+// === ตารางสายพาน (lane) และประตู ===
+// แต่ละสายพานมี IR หลัก มอเตอร์สายพาน คิวพัสดุ และชุดประตูของตัวเอง (ช่วง first_gate..+gate_count ใน GATES)
+// ทุกสายพานทำงานใน task real-time เดียวกัน และไม่มีสายพานใดรออีกสายพานหนึ่ง
+// LANE_LAYOUT เลือกผังตอน compile: 1 = สายพานจริงหนึ่งเส้น, 2/4 = ผังสำหรับ host simulator (-DHAL_HOST)
+// HOST_LAYOUT (host เท่านั้น) แทนผังทั้งหมดด้วยไฟล์ใน tools/layouts/ เช่นสายพานเดียวที่มี 8 หรือ 16 ประตู
+// หรือสายพานจริงที่ติดตั้งสวิตช์ปลายทางแล้ว
+// ผัง 2/4 ใช้ขาเสมือน (VPIN) เพราะ ESP32 มี GPIO ไม่พอสำหรับหลายสายพานหากไม่มี I/O expander
+#ifndef LANE_LAYOUT
+#define LANE_LAYOUT 1
+#endif
+#if LANE_LAYOUT != 1 && !defined(HAL_HOST)
+#error "LANE_LAYOUT 2/4 uses virtual pins and is for the host simulator only"
+#endif
+#define VPIN(lane, n) (100 + (lane) * 32 + (n)) // ขาเสมือนของ host simulator
 
-// === ระบบ FIFO Queue สำหรับเก็บข้อมูลพัสดุ ===
-int dorm[MAX_DORM];            // Array เก็บหมายเลขหอพัก
-String tracking_number[MAX_DORM]; // Array เก็บหมายเลขติดตาม
-int size = 0;                  // ขนาดปัจจุบันของคิว
+struct LaneConfig {
+  uint8_t intake_pin;          // ขา IR หลักของสายพาน
+  uint8_t belt_in1;            // ขาทิศทางมอเตอร์สายพาน (ขา 1)
+  uint8_t belt_in2;            // ขาทิศทางมอเตอร์สายพาน (ขา 2)
+  uint8_t belt_ena;            // ขาความเร็วมอเตอร์สายพาน (PWM)
+  uint8_t pwm_channel;         // PWM channel ของขา ENA
+  uint8_t first_gate;          // ประตูแรกของสายพานใน GATES
+  uint8_t gate_count;          // จำนวนประตูของสายพาน (ประตูสุดท้ายคือปลายสายพาน)
+};
 
-// === เก็บจำนวนพัสดุที่ผ่านแต่ละประตู ===
-int gate_count[3] = {0,0,0};   // [ประตู1, ประตู2, ประตู3]
+// แต่ละประตูกำหนดขา IR, ขามอเตอร์ผลัก, เวลาผลัก/ดึงกลับ, feedback ปลายทางของมอเตอร์ผลัก (ไม่บังคับ),
+// ระยะจาก IR หลักของสายพาน และชุดหอพักที่รับ (bitmask ของหมายเลขหอพัก 0-63) เรียงตามสายพานแล้วตามลำดับบนสายพาน
+// เมื่อมี feedback มอเตอร์หยุดทันทีที่ถึงปลายทาง และเวลาผลัก/ดึงกลับในตารางเป็นเพียงเวลาสูงสุด
+// ประตูสุดท้ายของแต่ละสายพานเป็นปลายสายพาน พัสดุที่ไม่ถูกผลักจะถูกนำออกจากคิวที่ประตูนี้
+// การเพิ่มประตูหรือหอพักทำได้โดยแก้ตารางนี้เพียงที่เดียว
+struct GateConfig {
+  uint8_t ir_pin;              // ขา IR sensor ของประตู
+  uint8_t motor_in_a;          // ขา A ของมอเตอร์ผลัก
+  uint8_t motor_in_b;          // ขา B ของมอเตอร์ผลัก
+  uint16_t extend_ms;          // ระยะเวลาผลักออก (มิลลิวินาที) - สูงสุดเมื่อมี feedback
+  uint16_t retract_ms;         // ระยะเวลาดึงกลับ (มิลลิวินาที) - สูงสุดเมื่อมี feedback
+  uint8_t feedback;            // PusherFeedback
+  uint8_t sense_out;           // PUSHER_FB_LIMIT: สวิตช์ผลักออกสุด / PUSHER_FB_CURRENT: ขา ADC ของ SENSE (L298N)
+  uint8_t sense_in;            // PUSHER_FB_LIMIT: สวิตช์ดึงกลับสุด
+  uint16_t position_mm;        // ระยะจาก IR หลักถึง IR ประตู (มิลลิเมตร)
+  uint64_t dorm_mask;          // ชุดหอพักที่ประตูนี้รับ
+};
 
-int camera_gate_count = 0;     // นับจำนวนการถ่ายภาพ
+enum PusherFeedback {
+  PUSHER_FB_NONE,              // ไม่มี feedback - ใช้เวลาคงที่ในตาราง
+  PUSHER_FB_LIMIT,             // สวิตช์ปลายทางสองตัว (active low)
+  PUSHER_FB_CURRENT            // กระแสมอเตอร์จากขา SENSE สูงขึ้นเมื่อชนปลายทาง (ADC1)
+};
+#define NO_PIN 0xFF            // ไม่ได้ใช้ขานี้
 
 /**
- * ฟังก์ชันเพิ่มพัสดุเข้าคิว (FIFO)
- * @param value หมายเลขหอพัก
- * @param trackingNum หมายเลขติดตามพัสดุ
+ * ฟังก์ชันสร้าง bitmask ของหอพัก (ใช้ได้ตอน compile)
  */
-void enqueue(int value, String trackingNum) {
-  if (size < MAX_DORM) {
-    dorm[size] = value;                    // เพิ่มหมายเลขหอพัก
-    tracking_number[size] = trackingNum;   // เพิ่มหมายเลขติดตาม
-    size++;                                // เพิ่มขนาดคิว
-  } else {
-    Serial.println("Queue full, cannot enqueue");
-  }
+constexpr uint64_t dorm_bit(int dorm) {
+  return (dorm >= 0 && dorm < 64) ? (1ULL << dorm) : 0;
 }
 
+#if defined(HOST_LAYOUT)
+// ผังจากไฟล์สำหรับ host benchmark (เช่น -DHOST_LAYOUT='"tools/layouts/gates8.h"') ซึ่งกำหนด LANES และ GATES
+#ifndef HAL_HOST
+#error "HOST_LAYOUT is for host builds only"
+#endif
+#include HOST_LAYOUT
+#elif LANE_LAYOUT == 1
+constexpr LaneConfig LANES[] = {
+  // intake          in1  in2  ena  pwm  first_gate  gate_count
+  { IR_DIGITAL_PIN,  IN1, IN2, ENA, 0,   0,          3 },
+};
+
+// ยังไม่มีสวิตช์ปลายทาง: ใช้เวลาคงที่ เมื่อติดตั้งสวิตช์ที่ประตูใดแล้วจึงเปลี่ยนประตูนั้นเป็น
+// PUSHER_FB_LIMIT พร้อมขา PUSHERn_END_OUT / PUSHERn_END_IN (ดู tools/layouts/limit_switches.h)
+constexpr GateConfig GATES[] = {
+  // ir_pin            motor_in_a   motor_in_b   extend  retract  feedback        sense_out  sense_in  position  dorm_mask
+  { IR_DIGITAL_PING1,  MOTOR0_IN_A, MOTOR0_IN_B, 1800,   1700,    PUSHER_FB_NONE, NO_PIN,    NO_PIN,   300,      dorm_bit(10) },  // ประตู 1 - หอพัก 10
+  { IR_DIGITAL_PING2,  MOTOR1_IN_A, MOTOR1_IN_B, 1800,   1700,    PUSHER_FB_NONE, NO_PIN,    NO_PIN,   550,      dorm_bit(2)  },  // ประตู 2 - หอพัก 2
+  { IR_DIGITAL_PING3,  MOTOR2_IN_A, MOTOR2_IN_B, 1800,   1650,    PUSHER_FB_NONE, NO_PIN,    NO_PIN,   800,      dorm_bit(6)  },  // ประตู 3 - หอพัก 6
+};
+#else
+// host simulator: ทุกสายพานมีประตูชุดเดียวกับสายพานจริง แต่ประตู 2 ใช้ current sense เพื่อทดสอบทั้งสองแบบ
+#define SIM_LANE(l) { VPIN(l, 0), VPIN(l, 1), VPIN(l, 2), VPIN(l, 3), l, (l) * 3, 3 }
+#define SIM_GATES(l) \
+  { VPIN(l, 4),  VPIN(l, 5),  VPIN(l, 6),  1800, 1700, PUSHER_FB_LIMIT,   VPIN(l, 13), VPIN(l, 14), 300, dorm_bit(10) }, \
+  { VPIN(l, 7),  VPIN(l, 8),  VPIN(l, 9),  1800, 1700, PUSHER_FB_CURRENT, VPIN(l, 15), NO_PIN,      550, dorm_bit(2)  }, \
+  { VPIN(l, 10), VPIN(l, 11), VPIN(l, 12), 1800, 1650, PUSHER_FB_LIMIT,   VPIN(l, 16), VPIN(l, 17), 800, dorm_bit(6)  }
+#if LANE_LAYOUT == 2
+constexpr LaneConfig LANES[] = { SIM_LANE(0), SIM_LANE(1) };
+constexpr GateConfig GATES[] = { SIM_GATES(0), SIM_GATES(1) };
+#elif LANE_LAYOUT == 4
+constexpr LaneConfig LANES[] = { SIM_LANE(0), SIM_LANE(1), SIM_LANE(2), SIM_LANE(3) };
+constexpr GateConfig GATES[] = { SIM_GATES(0), SIM_GATES(1), SIM_GATES(2), SIM_GATES(3) };
+#else
+#error "LANE_LAYOUT must be 1, 2 or 4"
+#endif
+#endif
+
+constexpr int NUM_LANES = sizeof(LANES) / sizeof(LANES[0]);  // จำนวนสายพาน
+constexpr int NUM_GATES = sizeof(GATES) / sizeof(GATES[0]);  // จำนวนประตูของทุกสายพาน
+
 /**
- * ฟังก์ชันนำพัสดุออกจากคิวตำแหน่งแรก (FIFO)
- * @return หมายเลขหอพักที่นำออก หรือ -1 หากคิวว่าง
+ * ฟังก์ชันตรวจสอบว่าช่วงประตูของสายพานต่อกันครบทุกประตู (ใช้ได้ตอน compile)
  */
-int dequeue() {
-  if (size > 0) {
-    int first = dorm[0];                         // เก็บค่าแรก
-    String firstTrackingNumber = tracking_number[0];
-    
-    // เลื่อนข้อมูลทั้งหมดไปข้างหน้า
-    for (int i = 1; i < size; i++) {
-      dorm[i - 1] = dorm[i];
-      tracking_number[i - 1] = tracking_number[i];
-    }
-    size--;                                      // ลดขนาดคิว
-    return first;
-  } else {
-    Serial.println("Queue empty");
-    return -1;
-  }
+constexpr bool lanes_cover_gates(int lane, int gate) {
+  return lane == NUM_LANES ? gate == NUM_GATES
+                           : LANES[lane].first_gate == gate && LANES[lane].gate_count > 0 &&
+                             lanes_cover_gates(lane + 1, gate + LANES[lane].gate_count);
 }
 
+static_assert(lanes_cover_gates(0, 0), "LANES must cover GATES in order");
+static_assert(NUM_LANES <= 8, "lane id must fit in 3 bits (journal, trace)");
+
 /**
- * ฟังก์ชันนำพัสดุออกจากตำแหน่งที่กำหนด
- * @param index ตำแหน่งที่ต้องการนำออก
- * @return หมายเลขหอพักที่นำออก หรือ -1 หากผิดพลาด
+ * ฟังก์ชันหาประตูสุดท้าย (ปลายสายพาน) ของสายพาน
  */
-int dequeueAt(int index) {
-  if (index < 0 || index >= size) {
-    Serial.println("Invalid index");
-    return -1;  // error
+constexpr int lane_last_gate(int lane) {
+  return LANES[lane].first_gate + LANES[lane].gate_count - 1;
+}
+
+/**
+ * ฟังก์ชันหาสายพานของประตู
+ * @param gate ลำดับประตูใน GATES (0-based)
+ */
+inline uint8_t gate_lane(int gate) {
+  uint8_t lane = 0;
+  while (lane + 1 < NUM_LANES && gate >= LANES[lane + 1].first_gate) lane++;
+  return lane;
+}
+
+/**
+ * ฟังก์ชันตรวจสอบว่าประตูรับพัสดุของหอพักนี้หรือไม่
+ * @param gate ลำดับประตู (0-based)
+ * @param dorm หมายเลขหอพัก
+ */
+inline bool gate_accepts(int gate, int dorm) {
+  return (GATES[gate].dorm_mask & dorm_bit(dorm)) != 0;
+}
+
+#define MAX_DORM 10            // จำนวนสูงสุดของพัสดุในคิว
+#define QUEUE_CAPACITY 16      // จำนวนช่องของ ring buffer (ต้องเป็นเลขยกกำลัง 2 และ >= MAX_DORM)
+#define QUEUE_MASK (QUEUE_CAPACITY - 1)
+#define QR_PENDING -3          // หมายเลขหอพักชั่วคราวระหว่างรอผล QR จาก Pi
+#define TRACKING_MAX_LEN 39    // ความยาวสูงสุดของหมายเลขติดตาม (USPS IMpb พร้อมรหัสไปรษณีย์ 38 ตัว) ที่ยาวกว่านี้ถูกปฏิเสธ
+
+// === ระบบจับขอบสัญญาณ IR ด้วย Interrupt ===
+// ISR บันทึกขอบสัญญาณพร้อมเวลา (micros) ลงใน ring buffer แบบ single-producer/single-consumer
+// แล้ว task real-time เป็นผู้อ่านและกรอง debounce ทีละ sensor
+#define NUM_IR_SENSORS (NUM_LANES + NUM_GATES) // IR หลักของทุกสายพาน + IR ของทุกประตู
+#define IR_EVENT_CAPACITY 64   // ขนาด ring buffer ของ event (ต้องเป็นเลขยกกำลัง 2)
+#define IR_DEBOUNCE_US 20000   // ค่า debounce เริ่มต้น (ไมโครวินาที)
+
+enum IrSensor {
+  IR_SENSOR_MAIN = 0,          // IR sensor หลักของสายพานแรก (สายพานถัดไปคือ IR_SENSOR_MAIN + lane)
+  IR_SENSOR_G1 = NUM_LANES     // IR sensor ประตูแรก (ประตูถัดไปคือ IR_SENSOR_G1 + gate)
+};
+
+struct IrEvent {
+  uint32_t time_us;            // เวลาที่เกิดขอบสัญญาณ (micros)
+  uint8_t sensor;              // หมายเลข sensor (IrSensor)
+  uint8_t level;               // ระดับสัญญาณหลังเกิดขอบ (LOW = มีพัสดุ)
+};
+
+/**
+ * ฟังก์ชันหาขา GPIO ของ sensor (ใช้ได้ตอน compile)
+ */
+constexpr uint8_t ir_pin(int sensor) {
+  return sensor < IR_SENSOR_G1 ? LANES[sensor].intake_pin : GATES[sensor - IR_SENSOR_G1].ir_pin;
+}
+
+uint32_t ir_debounce_us[NUM_IR_SENSORS]; // ค่า debounce ของแต่ละ sensor (ตั้งค่าใน setup())
+
+SpscRing<IrEvent, IR_EVENT_CAPACITY> ir_events;  // ISR → task real-time
+volatile uint32_t ir_event_dropped = 0; // จำนวน event ที่ทิ้งเพราะ buffer เต็ม
+hal_task_t rt_task_handle = NULL;       // task ที่ถูกปลุกเมื่อมีขอบสัญญาณใหม่
+
+uint8_t ir_state[NUM_IR_SENSORS];      // ระดับสัญญาณหลัง debounce
+uint32_t ir_last_edge_us[NUM_IR_SENSORS]; // เวลาขอบสัญญาณล่าสุดที่ยอมรับ
+uint32_t ir_raw_us[NUM_IR_SENSORS];    // เวลาของ event ล่าสุดจาก ISR (รวมที่ถูก debounce กรองทิ้ง)
+uint8_t ir_raw_level[NUM_IR_SENSORS];  // ระดับของ event ล่าสุดจาก ISR
+uint32_t ir_sampled_us[NUM_IR_SENSORS]; // เวลาล่าสุดที่อ่านขาแล้วยังตรงกับ ir_state
+
+/**
+ * ฟังก์ชันบันทึกขอบสัญญาณลง ring buffer (เรียกจาก ISR)
+ */
+void IRAM_ATTR ir_capture(uint8_t sensor) {
+  IrEvent ev;
+  ev.time_us = hal_micros();
+  ev.sensor = sensor;
+  ev.level = hal_digital_read(ir_pin(sensor));
+  if (!ir_events.push(ev)) {
+    ir_event_dropped++;                          // buffer เต็ม
+    return;
   }
+  if (rt_task_handle) hal_task_notify_from_isr(rt_task_handle);  // ปลุก task real-time ทันที
+}
 
-  int removed = dorm[index];                     // เก็บค่าที่จะลบ
+/**
+ * ISR ของแต่ละ sensor - สร้างจาก template ตามจำนวน sensor
+ */
+template <uint8_t SENSOR>
+void IRAM_ATTR ir_isr() { ir_capture(SENSOR); }
 
-  // เลื่อนข้อมูลหลังจากตำแหน่งที่ลบมาข้างหน้า
-  for (int i = index + 1; i < size + 1; i++) {
-    dorm[i - 1] = dorm[i];
-    tracking_number[i - 1] = tracking_number[i];
+/**
+ * ฟังก์ชันเปิด Interrupt ให้ sensor 0 ถึง COUNT-1 (คลี่ออกตอน compile)
+ */
+template <uint8_t COUNT>
+struct IrAttach {
+  static void run() {
+    IrAttach<COUNT - 1>::run();
+    hal_attach_interrupt(ir_pin(COUNT - 1), ir_isr<COUNT - 1>, CHANGE);
   }
+};
 
-  size--;                                        // ลดขนาดคิว
-  return removed;
+template <>
+struct IrAttach<0> {
+  static void run() {}
+};
+
+/**
+ * ฟังก์ชันกรองขอบสัญญาณด้วย debounce
+ * @return true หากเป็นขอบสัญญาณที่เปลี่ยนระดับจริง
+ */
+bool ir_accept(uint8_t sensor, uint8_t level, uint32_t time_us) {
+  if (level == ir_state[sensor]) return false;                            // ไม่ได้เปลี่ยนระดับ
+  if (time_us - ir_last_edge_us[sensor] < ir_debounce_us[sensor]) return false; // ยังอยู่ในช่วง debounce
+  ir_state[sensor] = level;
+  ir_last_edge_us[sensor] = time_us;
+  return true;
 }
 
 /**
- * ฟังก์ชันจัดเรียงคิวใหม่เมื่อมีการซ้ำ
- * ใช้สำหรับกรณีที่อ่าน QR Code ซ้ำ
+ * ฟังก์ชันอ่านขอบสัญญาณ IR ถัดไปที่ผ่าน debounce แล้ว
+ * เมื่อ buffer ว่างจะตรวจระดับสัญญาณจริงอีกครั้ง เผื่อขอบสุดท้ายถูกกรองทิ้งระหว่าง debounce
+ * @param ev ตัวแปรรับ event
+ * @return true หากมี event
  */
-int requeue_lastvalue() {
-  if (size > 0) {
-    // ตรวจสอบว่าหมายเลขติดตามตัวสุดท้ายกับตัวก่อนหน้าเหมือนกันหรือไม่
-    if (tracking_number[size - 2] == tracking_number[size - 1]) {
-      dorm[size] = dorm[size - 2];                           // คัดลอกข้อมูล
-      tracking_number[size] = tracking_number[size - 2];
-      dorm[size - 2] = -2;                                   // ทำเครื่องหมายว่าลบแล้ว
-      tracking_number[size - 2] = "No tracking number";
-    } else {
-      Serial.println("Tracking number mismatch");
-      return -1;
+bool ir_next_edge(IrEvent &ev) {
+  while (ir_events.pop(ev)) {
+    record_ir(ev.sensor, ev.level, ev.time_us);
+    ir_raw_us[ev.sensor] = ev.time_us;
+    ir_raw_level[ev.sensor] = ev.level;
+    if (ir_accept(ev.sensor, ev.level, ev.time_us)) return true;
+  }
+
+  uint32_t now = hal_micros();
+  for (uint8_t i = 0; i < NUM_IR_SENSORS; i++) {
+    uint8_t level = hal_digital_read(ir_pin(i));
+    if (level == ir_state[i]) {
+      ir_sampled_us[i] = now;
+      continue;
     }
+    if (!ir_accept(i, level, now)) continue;
+    // ขอบจริงเกิดก่อนหน้านี้: ใช้เวลาของ ISR หากขอบสุดท้ายใน ring ตรงกับระดับของขา
+    // มิฉะนั้น (event หายเพราะ ring เต็ม) ใช้เวลาล่าสุดที่ขายังอยู่ระดับเดิม
+    ev.time_us = ir_raw_level[i] == level && ir_raw_us[i] - ir_sampled_us[i] < now - ir_sampled_us[i] ?
+                 ir_raw_us[i] : ir_sampled_us[i];
+    ev.sensor = i;
+    ev.level = level;
+    ir_last_edge_us[i] = ev.time_us;
+    return true;
   }
+  return false;
 }
 
 /**
- * ฟังก์ชันส่งคำสั่งอ่าน QR Code ไป Raspberry Pi ผ่าน UART
- * แทนการใช้ HTTP request
- * @return ข้อมูล JSON ที่ได้รับจาก Raspberry Pi
+ * ฟังก์ชันคัดลอกหมายเลขติดตามลง buffer ขนาดคงที่
  */
-String requestQRFromPi() {
-  Serial2.println("READ_QR");                    // ส่งคำสั่งไป Pi
-  unsigned long start = millis();
-  String response = "";
+void tracking_copy(char *dst, const char *src) {
+  strncpy(dst, src, TRACKING_MAX_LEN);
+  dst[TRACKING_MAX_LEN] = '\0';
+}
 
-  // รอรับข้อมูลจาก Pi สูงสุด 5 วินาที
-  while (millis() - start < 5000) {
-    if (Serial2.available()) {
-      char c = Serial2.read();
-      if (c == '\n') break;                      // จบข้อความ
-      response += c;
-    }
+// === หมายเลขติดตามแบบความยาวคงที่พร้อม hash ===
+// เก็บในช่องของคิวโดยตรง (ไม่จองหน่วยความจำ heap) และคำนวณ hash ครั้งเดียวตอนกำหนดค่า
+// hash = 0 หมายถึงไม่มีหมายเลขติดตาม (ว่าง หรืออ่าน QR ไม่ได้)
+#define TRACKING_NONE "No tracking number"       // ค่าเมื่อไม่ทราบหมายเลขติดตาม
+#define TRACKING_UNREAD "No QR code detected"    // ค่าที่ Pi ส่งมาเมื่ออ่าน QR ไม่ได้
+
+struct TrackingId {
+  uint32_t hash;               // FNV-1a ของ text (0 = ไม่มีหมายเลขติดตาม)
+  char text[TRACKING_MAX_LEN + 1];
+};
+
+/**
+ * ฟังก์ชันคำนวณ hash (FNV-1a 32 บิต) ของหมายเลขติดตาม ไม่คืนค่า 0
+ */
+uint32_t tracking_hash(const char *text) {
+  uint32_t h = 2166136261u;
+  for (; *text; text++) {
+    h ^= (uint8_t)*text;
+    h *= 16777619u;
   }
+  return h ? h : 1;
+}
 
-  return response;
+/**
+ * ฟังก์ชันกำหนดหมายเลขติดตามและคำนวณ hash
+ */
+void tracking_set(TrackingId &id, const char *text) {
+  tracking_copy(id.text, text);
+  bool known = id.text[0] && strcmp(id.text, TRACKING_NONE) != 0 && strcmp(id.text, TRACKING_UNREAD) != 0;
+  id.hash = known ? tracking_hash(id.text) : 0;
 }
 
 /**
- * ฟังก์ชันอัพเดทสถานะการส่งพัสดุไปยังเซิร์ฟเวอร์ผ่าน UART
- * @param trackingNumber หมายเลขติดตามพัสดุ
- * @param status สถานะใหม่
+ * ฟังก์ชันเปรียบเทียบหมายเลขติดตาม (เทียบ hash ก่อน แล้วจึงเทียบข้อความ)
  */
-void updateTrackingStatusOnServer(String trackingNumber, const char *status) {
-  // สร้าง JSON message
-  String payload = "{";
-  payload += "\"type\":\"update_status\",";
-  payload += "\"trackingNumber\":\"" + trackingNumber + "\",";
-  payload += "\"status\":\"" + String(status) + "\"";
-  payload += "}\n";   // newline = end of message
+inline bool tracking_equal(const TrackingId &a, const TrackingId &b) {
+  return a.hash == b.hash && strcmp(a.text, b.text) == 0;
+}
 
-  // ส่งไป Raspberry Pi ผ่าน UART
-  Serial2.print(payload);
+// === บันทึกคิวลง flash (journal) เพื่อกู้คืนหลังไฟดับหรือรีเซ็ต ===
+// task real-time ส่ง record การเปลี่ยนแปลงของคิวผ่าน journal_queue ให้ task comms เขียนต่อท้าย sector ปัจจุบัน
+// แต่ละ sector เริ่มด้วย snapshot ของทุกคิว (J_SECTOR แล้วต่อสายพาน: J_BELT, J_SLOT..., J_SNAPSHOT_END) ตามด้วย record การเปลี่ยนแปลง
+// เมื่อ sector เต็มจะเขียน snapshot ใหม่ลง sector ถัดไป (compaction) วนใช้ทุก sector ของ partition เพื่อกระจายการสึกหรอ
+// sector เดิมยังอยู่จนกว่าจะถูกใช้ซ้ำ หากไฟดับระหว่าง compaction จึงกู้คืนจาก sector เดิมได้
+// ทุก record มี CRC - record ที่เขียนไม่ครบ (ไฟดับระหว่างเขียน) ถือเป็นจุดสิ้นสุดของ log
+// สายพานไม่บันทึกตำแหน่งระหว่างเดิน แต่บันทึกช่วงการเดิน (J_BELT) เมื่อเริ่ม หยุด หรือ duty เป้าหมายของโปรไฟล์เปลี่ยน
+// ตอนกู้คืนคำนวณตำแหน่งจากจุดเริ่มช่วง duty และการ ramp จนถึงเวลาของ J_BELT ล่าสุด (ประมาณ 6 record ต่อพัสดุ)
+// ระยะที่สายพานเดินหลัง record สุดท้ายจึงหายไป - ตำแหน่งที่กู้คืนไม่เคยเลยตำแหน่งจริง
+// คิวสถานะขาออกมี log ของตัวเอง (J_STATUS / J_STATUS_ACK) ในส่วนท้ายของ partition เพราะ snapshot ของคิวพัสดุเต็ม sector พอดี
+#define JOURNAL_MAGIC 0x4A52   // "JR" - ค่าเริ่มต้นของ record ที่ถูกต้อง (flash ที่ลบแล้วเป็น 0xFFFF)
+#define JOURNAL_VERSION 2      // J_SECTOR.dorm - ก่อน version 2 J_BELT เป็นตำแหน่งอย่างเดียว
+#define JOURNAL_RECORD_SIZE 56
+#define JOURNAL_RECORDS_PER_SECTOR (HAL_FLASH_SECTOR / JOURNAL_RECORD_SIZE)
+#define JOURNAL_QUEUE_CAPACITY 64 // ขนาดคิว record ระหว่าง task (ต้องเป็นเลขยกกำลัง 2)
+#define JOURNAL_LOG_QUEUE 0    // J_SECTOR.lane ของ log คิวพัสดุ
+#define JOURNAL_LOG_STATUS 1   // J_SECTOR.lane ของ log คิวสถานะ
 
-  Serial.println("📡 Sent update via UART: " + payload);
-}
+enum JournalType {
+  J_SECTOR = 1,                // seq=generation dorm=JOURNAL_VERSION lane=JOURNAL_LOG_*
+  J_SLOT,                      // snapshot ของพัสดุหนึ่งชิ้น: seq dorm tracking gate mm=ตำแหน่งตอนผ่าน IR หลัก
+  J_SNAPSHOT_END,              // seq=queue_tail mm=ตำแหน่งสายพาน (snapshot สมบูรณ์เมื่อถึงสายพานสุดท้าย)
+  J_ENQUEUE,                   // seq mm=ตำแหน่งตอนผ่าน IR หลัก
+  J_QR,                        // seq dorm tracking
+  J_GATE,                      // seq gate
+  J_DEQUEUE,                   // seq
+  J_BELT,                      // ช่วงการเดิน: seq=เวลา (millis) gate=ทิศทาง dorm=duty | duty เป้าหมาย << 8
+  J_STATUS,                    // log สถานะ: seq=ลำดับในคิวสถานะ gate=รหัสสถานะ dorm tracking
+  J_STATUS_ACK                 // log สถานะ: seq=status_head ใหม่ (J_SNAPSHOT_END ของ log สถานะก็เช่นกัน)
+};
+
+struct JournalRecord {
+  uint16_t magic;              // JOURNAL_MAGIC
+  uint8_t type : 5;            // JournalType
+  uint8_t lane : 3;            // สายพาน (record เดิมก่อนมีหลายสายพานเป็น 0)
+  int8_t gate;                 // ประตูล่าสุดที่พัสดุผ่าน
+  uint32_t seq;                // seq ของพัสดุ (J_SECTOR = generation)
+  float mm;                    // ตำแหน่งสายพาน ณ เวลาบันทึก (J_SLOT/J_ENQUEUE = ตำแหน่งตอนผ่าน IR หลัก)
+  int16_t dorm;                // หมายเลขหอพัก (J_BELT: duty)
+  uint16_t crc;                // CRC-16/CCITT ของ record (คำนวณขณะ crc = 0)
+  char tracking_number[TRACKING_MAX_LEN + 1]; // หมายเลขติดตาม
+};
+
+static_assert(sizeof(JournalRecord) == JOURNAL_RECORD_SIZE, "JournalRecord layout changed");
+
+SpscRing<JournalRecord, JOURNAL_QUEUE_CAPACITY> journal_queue;  // real-time → comms
 
 /**
- * ฟังก์ชันควบคุมการเคลื่อนไหวของสายพาน
- * @param fb_move ทิศทางการเคลื่อนไหว (-1=ถอยหลัง, 0=หยุด, 1=เดินหน้า)
+ * ฟังก์ชันส่ง record การเปลี่ยนแปลงของคิวไปเขียนลง flash (task real-time)
+ * @param lane สายพานของคิว
+ * @param type ชนิด record (JournalType)
+ * @param seq seq ของพัสดุ
+ * @param dorm หมายเลขหอพัก
+ * @param tracking หมายเลขติดตาม (NULL หากไม่เกี่ยว)
+ * @param gate ประตูล่าสุด
+ * @param mm ตำแหน่ง (ดู JournalRecord)
  */
-void convayer_move(int fb_move) {
-  switch (fb_move) {
-    case -1: // ถอยหลัง
-      digitalWrite(IN1, LOW);
-      digitalWrite(IN2, HIGH);
-      ledcWrite(0, 255);                         // ความเร็วเต็มที่
-      Serial.println("backward");
-      break;
+void journal_log(uint8_t lane, uint8_t type, uint32_t seq, int dorm, const char *tracking, int8_t gate, float mm) {
+  JournalRecord rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.type = type;
+  rec.lane = lane;
+  rec.seq = seq;
+  rec.dorm = dorm;
+  rec.gate = gate;
+  rec.mm = mm;
+  if (tracking) tracking_copy(rec.tracking_number, tracking);
+  if (!journal_queue.push(rec)) {
+    TRACE_WARN(TR_JOURNAL_FULL, type, seq);
+  }
+}
 
-    case 0: // หยุด
-      digitalWrite(IN1, LOW);
-      digitalWrite(IN2, LOW);
-      ledcWrite(0, 0);                           // ความเร็ว 0
-      Serial.println("stop");
-      break;
+// === ระบบ FIFO Queue (ring buffer) สำหรับเก็บข้อมูลพัสดุ ===
+// แต่ละช่องอ้างอิงด้วยลำดับ (seq) ที่เพิ่มขึ้นเรื่อยๆ ตำแหน่งจริงคือ seq & QUEUE_MASK
+// การนำออกกลางคิวจะทำเครื่องหมาย (tombstone) ไว้แทนการเลื่อนข้อมูล
+struct ParcelSlot {
+  int dorm;                    // หมายเลขหอพัก (QR_PENDING = รอผลจาก Pi)
+  TrackingId tracking_number;  // หมายเลขติดตาม
+  bool active;                 // false = ถูกนำออกแล้ว (tombstone)
+  unsigned long triggered_at;  // เวลาที่ IR หลักตรวจพบ (millis)
+  uint32_t triggered_us;       // เวลาที่ IR หลักตรวจพบ (micros) สำหรับวัด latency
+  float intake_mm;             // ตำแหน่งสายพาน (odometer) ตอนผ่าน IR หลัก
+  int8_t last_gate;            // ประตูล่าสุดที่ตรวจพบพัสดุนี้ (-1 = ยังไม่ถึงประตูใด)
+};
 
-    case 1: // เดินหน้า
-      digitalWrite(IN1, HIGH);
-      digitalWrite(IN2, LOW);
-      ledcWrite(0, 255);                         // ความเร็วเต็มที่
-      Serial.println("forward");
-      break;
-  }
+enum IntakeState {
+  INTAKE_IDLE,                 // รอพัสดุใหม่
+  INTAKE_SETTLING,             // หยุดสายพานรอให้พัสดุนิ่ง
+  INTAKE_CAPTURING             // ส่งคำขอแล้ว รอ Pi เก็บภาพ
+};
+
+// สถานะของสายพานหนึ่งเส้น - ทุกฟังก์ชันของคิว การสแกน และสายพานรับสายพานที่ต้องการเป็นพารามิเตอร์
+struct Lane {
+  uint8_t id;                  // ลำดับใน LANES
+  ParcelSlot queue[QUEUE_CAPACITY];
+  uint32_t queue_head;         // seq ของช่องแรกที่ยังไม่ถูกคืน
+  uint32_t queue_tail;         // seq ของช่องถัดไปที่จะเขียน
+  int size;                    // จำนวนพัสดุที่ยังอยู่ในคิว (ไม่นับ tombstone)
+
+  IntakeState intake_state;    // ขั้นตอนการสแกนพัสดุใหม่
+  unsigned long intake_since;  // เวลาเริ่มสถานะปัจจุบัน (millis)
+  uint32_t intake_seq;         // seq ของพัสดุที่กำลังสแกน
+
+  float belt_speed_mm_s;       // ความเร็วปัจจุบัน (ติดลบเมื่อถอยหลัง)
+  float belt_odometer_mm;      // ตำแหน่งสายพาน ณ belt_odometer_us
+  uint32_t belt_odometer_us;   // เวลาที่อัพเดท odometer ล่าสุด (micros)
+  uint32_t belt_odometer_pulses; // พัลส์ของ encoder ณ belt_odometer_mm (BELT_ENCODER_PIN)
+  int8_t belt_encoder_sign;    // ทิศที่ใช้นับพัลส์ - ทิศล่าสุดที่สั่งเดิน รวมช่วงไหลหลังหยุด (BELT_ENCODER_PIN)
+  int belt_direction;          // ทิศทางปัจจุบัน (-1=ถอยหลัง, 0=หยุด, 1=เดินหน้า)
+  float belt_duty;             // duty ปัจจุบันระหว่างการ ramp
+  uint8_t belt_duty_applied;   // duty ที่เขียนลง PWM ล่าสุด
+  unsigned long belt_ramp_ms;  // เวลาที่ ramp ล่าสุด (millis)
+  uint8_t belt_target;         // duty เป้าหมายของโปรไฟล์ (บันทึก J_BELT เมื่อเปลี่ยน)
+  bool belt_held;              // สายพานถูกหยุดไว้ระหว่างการผลักหรือการสแกน
+
+  uint32_t gate_edge_us;       // เวลาที่ IR ประตูล่าสุดตรวจพบ (micros) สำหรับวัด latency
+  uint32_t parcels_completed;  // จำนวนพัสดุที่ออกจากสายพานแล้ว (ผลักหรือเลยปลายสายพาน)
+  uint32_t throughput_window_count; // จำนวน ณ ต้นช่วงเวลาวัดอัตรา
+};
+
+Lane lanes[NUM_LANES];         // ทุกสายพาน (id ตั้งค่าใน setup())
+
+int camera_gate_count = 0;     // นับจำนวนการถ่ายภาพ
+
+float belt_position_at(const Lane &lane, uint32_t time_us);  // ส่วนตำแหน่งสายพาน (odometer)
+
+/**
+ * ฟังก์ชันส่ง record ที่ใช้ตำแหน่งสายพานปัจจุบัน (task real-time)
+ */
+inline void journal_log_now(const Lane &lane, uint8_t type, uint32_t seq) {
+  journal_log(lane.id, type, seq, 0, NULL, -1, belt_position_at(lane, hal_micros()));
 }
 
 /**
- * ฟังก์ชันควบคุมมอเตอร์ผลักพัสดุ
- * @param fb_move ทิศทางการเคลื่อนไหว (1=ผลัก, -1=ดึงกลับ, 0=หยุด)
- * @param time_ms ระยะเวลาการเคลื่อนไหว (มิลลิวินาที)
- * @param motor_id หมายเลขมอเตอร์ (1-3)
+ * ฟังก์ชันเปรียบเทียบลำดับ seq (รองรับกรณี uint32_t วนรอบ)
+ * @return true หาก a มาก่อน b
  */
-void motor_move(int fb_move, int time_ms, int motor_id) {
-  int IN_A, IN_B;
+inline bool seq_before(uint32_t a, uint32_t b) {
+  return (int32_t)(a - b) < 0;
+}
 
-  // เลือกขา GPIO ตามหมายเลขมอเตอร์
-  switch (motor_id) {
-    case 1: IN_A = MOTOR0_IN_A; IN_B = MOTOR0_IN_B; break;
-    case 2: IN_A = MOTOR1_IN_A; IN_B = MOTOR1_IN_B; break;
-    case 3: IN_A = MOTOR2_IN_A; IN_B = MOTOR2_IN_B; break;
-    default: return;  // หมายเลขมอเตอร์ไม่ถูกต้อง
-  }
+/**
+ * ฟังก์ชันเข้าถึงช่องในคิวจาก seq
+ */
+inline ParcelSlot &queue_slot(Lane &lane, uint32_t seq) {
+  return lane.queue[seq & QUEUE_MASK];
+}
 
-  // ควบคุมทิศทางการหมุน
-  switch (fb_move) {
-    case 1: // หมุนไปข้างหน้า / ตามเข็มนาฬิกา
-      digitalWrite(IN_A, HIGH);
-      digitalWrite(IN_B, LOW);
-      break;
-    case -1: // หมุนถอยหลัง / ทวนเข็มนาฬิกา
-      digitalWrite(IN_A, LOW);
-      digitalWrite(IN_B, HIGH);
-      break;
-    case 0: // หยุด
-      digitalWrite(IN_A, LOW);
-      digitalWrite(IN_B, LOW);
-      break;
-    default: return;
-  }
+inline const ParcelSlot &queue_slot(const Lane &lane, uint32_t seq) {
+  return lane.queue[seq & QUEUE_MASK];
+}
 
-  delay(time_ms);                                // รอตามเวลาที่กำหนด
+/**
+ * ฟังก์ชันตรวจสอบว่า seq ยังอยู่ในช่วงของคิว
+ */
+inline bool queue_contains(const Lane &lane, uint32_t seq) {
+  return !seq_before(seq, lane.queue_head) && seq_before(seq, lane.queue_tail);
+}
 
-  // หยุดมอเตอร์หลังจากเคลื่อนไหวเสร็จ
-  digitalWrite(IN_A, LOW);
-  digitalWrite(IN_B, LOW);
+/**
+ * ฟังก์ชันหา seq ของพัสดุที่ยังอยู่ในคิวตั้งแต่ตำแหน่ง from เป็นต้นไป
+ * @return seq ของพัสดุ หรือ queue_tail หากไม่มี
+ */
+uint32_t queue_next_active(const Lane &lane, uint32_t from) {
+  if (seq_before(from, lane.queue_head)) from = lane.queue_head;
+  while (from != lane.queue_tail && !queue_slot(lane, from).active) from++;
+  return from;
 }
 
 /**
- * ฟังก์ชันแสดงสถานะของคิว (สำหรับ Debug)
+ * ฟังก์ชันคืนช่องที่เป็น tombstone ที่หัวคิว
  */
-void show_queue() {
-  Serial.print("Dorm contents: ");
-  for (int i = 0; i < size + 1; i++) {
-    Serial.println(dorm[i]);
-    Serial.println(" ");
+void queue_reclaim(Lane &lane) {
+  while (lane.queue_head != lane.queue_tail && !queue_slot(lane, lane.queue_head).active) {
+    tracking_set(queue_slot(lane, lane.queue_head).tracking_number, "");
+    lane.queue_head++;
   }
-  Serial.println();
 }
 
 /**
- * ฟังก์ชันผลักพัสดุออกจากสายพานไปยังหอพักที่กำหนด
- * @param dorm_box หมายเลขประตู/หอพัก (1, 2, 3)
- */
-void push_box(int dorm_box){
-  Serial.println("push Box-------------------");
-  Serial.println(gate_count[dorm_box - 1]);
-  Serial.println(dorm[gate_count[dorm_box - 1] - 1]);
-  show_queue();
-  
-  switch (dorm_box)
-  {
-  case 1: // ประตู 1 - หอพัก 10
-    if (dorm[gate_count[dorm_box - 1] - 1] == 10){
-      convayer_move(0);                          // หยุดสายพาน
-      
-      // สร้างข้อความสถานะ
-      char * status = (char *)malloc(20 * sizeof(char));
-      sprintf(status, "delivered to dorm %d", dorm[gate_count[dorm_box - 1] - 1]);
-      
-      // อัพเดทสถานะ
-      updateTrackingStatusOnServer(tracking_number[gate_count[dorm_box - 1] - 1], status);
-      
-      Serial.print("push dorm: ");
-      Serial.println(dequeueAt(gate_count[dorm_box - 1] - 1));
-      gate_count[dorm_box - 1] = gate_count[dorm_box - 1] - 1;
-      
-      show_queue();                              // แสดงสถานะคิว
-      
-      // ผลักพัสดุด้วยมอเตอร์
-      motor_move(1,1800,dorm_box);               // ผลักออก 1.8 วินาที
-      motor_move(-1,1700,dorm_box);              // ดึงกลับ 1.7 วินาที  
-      motor_move(0,50,dorm_box);                 // หยุด 0.05 วินาที
-      convayer_move(1);                          // เริ่มสายพานอีกครั้ง
-    }
-    break;
-
-  case 2: // ประตู 2 - หอพัก 2
-    if (dorm[gate_count[dorm_box-1] - 1] == 2){
-      convayer_move(0);                          // หยุดสายพาน
-      
-      // สร้างข้อความสถานะ
-      char * status = (char *)malloc(20 * sizeof(char));
-      sprintf(status, "delivered to dorm %d", dorm[gate_count[dorm_box - 1] - 1]);
-      
-      // อัพเดทสถานะ
-      updateTrackingStatusOnServer(tracking_number[gate_count[dorm_box - 1] - 1], status);
-      
-      Serial.print("push dorm: ");
-      Serial.println(dequeueAt(gate_count[dorm_box - 1] - 1));
-      
-      // อัพเดทตัวนับของทุกประตูที่อยู่ก่อนหน้า
-      gate_count[dorm_box - 1] = gate_count[dorm_box - 1] - 1;
-      gate_count[dorm_box - 2] = gate_count[dorm_box - 2] - 1;
-      
-      show_queue();                              // แสดงสถานะคิว
-      
-      // ผลักพัสดุด้วยมอเตอร์
-      motor_move(1,1800,dorm_box);               // ผลักออก 1.8 วินาที
-      motor_move(-1,1700,dorm_box);              // ดึงกลับ 1.7 วินาที
-      motor_move(0,50,dorm_box);                 // หยุด 0.05 วินาที
-      convayer_move(1);                          // เริ่มสายพานอีกครั้ง
-      Serial.println(dorm[0]);
-    }
-    break;
-
-  case 3: // ประตู 3 - หอพัก 6
-    if (dorm[gate_count[dorm_box-1] - 1] == 6){
-      convayer_move(0);                          // หยุดสายพาน
-      
-      // สร้างข้อความสถานะ
-      char * status = (char *)malloc(20 * sizeof(char));
-      sprintf(status, "delivered to dorm %d", dorm[gate_count[dorm_box - 1] - 1]);
-      
-      // อัพเดทสถานะ
-      updateTrackingStatusOnServer(tracking_number[gate_count[dorm_box - 1] - 1], status);
-      
-      Serial.print("push dorm: ");
-      Serial.println(dequeueAt(gate_count[dorm_box - 1] - 1));
-      
-      // อัพเดทตัวนับของทุกประตูที่อยู่ก่อนหน้า
-      gate_count[dorm_box - 1] = gate_count[dorm_box - 1] - 1;
-      gate_count[dorm_box - 2] = gate_count[dorm_box - 2] - 1;
-      gate_count[dorm_box - 3] = gate_count[dorm_box - 3] - 1;
-      
-      show_queue();                              // แสดงสถานะคิว
-      
-      // ผลักพัสดุด้วยมอเตอร์
-      motor_move(1,1800,dorm_box);               // ผลักออก 1.8 วินาที
-      motor_move(-1,1650,dorm_box);              // ดึงกลับ 1.65 วินาที
-      motor_move(0,50,dorm_box);                 // หยุด 0.05 วินาที
-      convayer_move(1);                          // เริ่มสายพานอีกครั้ง
-    }
-    else {
-      // กรณีพัสดุไม่ใช่ของหอพักนี้ - ส่งต่อไป
-      Serial.print("push box no form: ");
-      Serial.println(dequeueAt(gate_count[dorm_box - 1] - 1));
-      
-      // อัพเดทตัวนับของทุกประตูที่อยู่ก่อนหน้า
-      gate_count[dorm_box - 1] = gate_count[dorm_box - 1] - 1;
-      gate_count[dorm_box - 2] = gate_count[dorm_box - 2] - 1;
-      gate_count[dorm_box - 3] = gate_count[dorm_box - 3] - 1;
-      
-      show_queue();                              // แสดงสถานะคิว
-      Serial.println();
-      Serial.println("No box for this dorm");
-    }
-    break;
-  
-  default:
-    break;
+ * ฟังก์ชันเพิ่มพัสดุเข้าคิว (FIFO)
+ * @param lane สายพานของคิว
+ * @param value หมายเลขหอพัก
+ * @param trackingNum หมายเลขติดตามพัสดุ
+ * @return true หากเพิ่มสำเร็จ (seq ของพัสดุคือ queue_tail - 1)
+ */
+bool enqueue(Lane &lane, int value, const char *trackingNum) {
+  if (lane.size < MAX_DORM && lane.queue_tail - lane.queue_head < QUEUE_CAPACITY) {
+    PROBE_BEGIN(enqueue);
+    ParcelSlot &slot = queue_slot(lane, lane.queue_tail);
+    slot.dorm = value;                     // เพิ่มหมายเลขหอพัก
+    tracking_set(slot.tracking_number, trackingNum); // เพิ่มหมายเลขติดตาม
+    slot.active = true;
+    slot.triggered_at = hal_millis();
+    slot.triggered_us = hal_micros();
+    slot.intake_mm = 0;
+    slot.last_gate = -1;
+    lane.queue_tail++;
+    lane.size++;                           // เพิ่มขนาดคิว
+    PROBE_END(METRIC_ENQUEUE, enqueue);
+    return true;
+  } else {
+    TRACE_WARN(TR_QUEUE_FULL, lane.size, lane.id);
+    return false;
   }
 }
 
 /**
- * ฟังก์ชัน Setup - ทำงานครั้งเดียวเมื่อเริ่มต้น
+ * ฟังก์ชันนำพัสดุออกจากตำแหน่งที่กำหนด
+ * ทำเครื่องหมาย tombstone แทนการเลื่อนข้อมูล จึงใช้เวลาคงที่
+ * @param lane สายพานของคิว
+ * @param seq ลำดับของพัสดุที่ต้องการนำออก
+ * @return หมายเลขหอพักที่นำออก หรือ -1 หากผิดพลาด
  */
-void setup() {
-  // เริ่มต้น Serial communication
-  Serial.begin(115200);                         // Serial หลักสำหรับ debug
-  Serial2.begin(115200, SERIAL_8N1, 16, 17);   // Serial2 สำหรับติดต่อ Raspberry Pi (RX=16, TX=17)
+int dequeueAt(Lane &lane, uint32_t seq) {
+  if (!queue_contains(lane, seq) || !queue_slot(lane, seq).active) {
+    TRACE_WARN(TR_QUEUE_INVALID, seq, lane.id);
+    return -1;  // error
+  }
 
-  // ตั้งค่าขา IR Sensor เป็น INPUT
-  pinMode(IR_DIGITAL_PIN, INPUT);               // IR sensor หลัก
-  pinMode(IR_DIGITAL_PING1, INPUT);             // IR sensor ประตู 1
-  pinMode(IR_DIGITAL_PING2, INPUT);             // IR sensor ประตู 2
-  pinMode(IR_DIGITAL_PING3, INPUT);             // IR sensor ประตู 3
+  PROBE_BEGIN(dequeue);
+  journal_log_now(lane, J_DEQUEUE, seq);
+  ParcelSlot &slot = queue_slot(lane, seq);
+  int removed = slot.dorm;                       // เก็บค่าที่จะลบ
+  slot.active = false;                           // ทำเครื่องหมายว่าลบแล้ว
+  lane.size--;                                   // ลดขนาดคิว
+
+  queue_reclaim(lane);                           // คืนช่องว่างที่หัวคิว
+  PROBE_END(METRIC_DEQUEUE, dequeue);
+  return removed;
+}
+
+/**
+ * ฟังก์ชันนำพัสดุออกจากคิวตำแหน่งแรก (FIFO)
+ * @return หมายเลขหอพักที่นำออก หรือ -1 หากคิวว่าง
+ */
+int dequeue(Lane &lane) {
+  uint32_t seq = queue_next_active(lane, lane.queue_head);
+  if (seq != lane.queue_tail) {
+    return dequeueAt(lane, seq);
+  } else {
+    TRACE_WARN(TR_QUEUE_EMPTY, lane.id, 0);
+    return -1;
+  }
+}
+
+// === ตรวจจับการอ่าน QR ซ้ำ (ชุดหมายเลขติดตามที่พบล่าสุด) ===
+// ตาราง hash แบบ open addressing (linear probing) เก็บ hash → seq ล่าสุดของหมายเลขที่พบภายใน RECENT_WINDOW_MS
+// พัสดุที่อ่านซ้ำได้ไม่ว่าจะอยู่ตำแหน่งใดในคิวจะถูกตรวจพบใน O(1)
+// รายการที่หมดอายุถูกลบด้วยการเลื่อนรายการถัดไปกลับ (backward shift) จึงไม่มี tombstone สะสม
+#define RECENT_TABLE_SIZE 128  // จำนวนช่องของตาราง (ต้องเป็นเลขยกกำลัง 2)
+#define RECENT_TABLE_MASK (RECENT_TABLE_SIZE - 1)
+#define RECENT_MAX_LOAD 96     // จำนวนรายการสูงสุด (load factor 75%)
+#define RECENT_WINDOW_MS 60000 // อายุของรายการ
+#define RECENT_SWEEP_MS 1000   // ช่วงเวลาลบรายการที่หมดอายุ
 
-  // ตั้งค่าขามอเตอร์สายพานเป็น OUTPUT
-  pinMode(IN1, OUTPUT);
-  pinMode(IN2, OUTPUT);
+struct RecentEntry {
+  uint32_t hash;               // hash ของหมายเลขติดตาม (0 = ช่องว่าง)
+  uint32_t seq;                // seq ล่าสุดที่พบหมายเลขนี้
+  uint8_t lane;                // สายพานของ seq
+  unsigned long seen_at;       // เวลาที่พบล่าสุด (millis)
+};
 
-  // ตั้งค่าขามอเตอร์ผลัก 1 เป็น OUTPUT
-  pinMode(MOTOR0_IN_A, OUTPUT);
-  pinMode(MOTOR0_IN_B, OUTPUT);
-  digitalWrite(MOTOR0_IN_A, LOW);               // ตั้งค่าเริ่มต้นเป็น LOW
-  digitalWrite(MOTOR0_IN_B, LOW);
+RecentEntry recent_table[RECENT_TABLE_SIZE];
+uint16_t recent_count = 0;     // จำนวนรายการในตาราง
+unsigned long recent_swept_at = 0;
 
-  // ตั้งค่าขามอเตอร์ผลัก 2 เป็น OUTPUT
-  pinMode(MOTOR1_IN_A, OUTPUT);
-  pinMode(MOTOR1_IN_B, OUTPUT);
-  digitalWrite(MOTOR1_IN_A, LOW);               // ตั้งค่าเริ่มต้นเป็น LOW
-  digitalWrite(MOTOR1_IN_B, LOW);
+/**
+ * ฟังก์ชันหาช่องของ hash ในตาราง
+ * @return ตำแหน่งช่อง หรือ -1 หากไม่พบ
+ */
+int recent_find(uint32_t hash) {
+  for (uint16_t i = hash & RECENT_TABLE_MASK; recent_table[i].hash != 0; i = (i + 1) & RECENT_TABLE_MASK) {
+    if (recent_table[i].hash == hash) return i;
+  }
+  return -1;
+}
 
-  // ตั้งค่าขามอเตอร์ผลัก 3 เป็น OUTPUT
-  pinMode(MOTOR2_IN_A, OUTPUT);
-  pinMode(MOTOR2_IN_B, OUTPUT);
-  digitalWrite(MOTOR2_IN_A, LOW);               // ตั้งค่าเริ่มต้นเป็น LOW
-  digitalWrite(MOTOR2_IN_B, LOW);
+/**
+ * ฟังก์ชันลบรายการ แล้วเลื่อนรายการในสายเดียวกันกลับมาแทนช่องว่าง
+ */
+void recent_erase(uint16_t i) {
+  for (uint16_t j = (i + 1) & RECENT_TABLE_MASK; recent_table[j].hash != 0; j = (j + 1) & RECENT_TABLE_MASK) {
+    uint16_t home = recent_table[j].hash & RECENT_TABLE_MASK;
+    bool stays = (i <= j) ? (home > i && home <= j) : (home > i || home <= j);  // home อยู่ใน (i, j]
+    if (!stays) {
+      recent_table[i] = recent_table[j];
+      i = j;
+    }
+  }
+  recent_table[i].hash = 0;
+  recent_count--;
+}
 
-  // ตั้งค่า PWM สำหรับควบคุมความเร็วมอเตอร์สายพาน
-  ledcSetup(0, 5000, 8);                       // Channel 0, ความถี่ 5kHz, ความละเอียด 8 บิต
-  ledcAttachPin(ENA, 0);                       // เชื่อมต่อขา ENA กับ PWM channel 0
+/**
+ * ฟังก์ชันลบรายการที่หมดอายุ (เรียกจาก task real-time)
+ * @param now เวลาปัจจุบัน (millis)
+ */
+void recent_sweep(unsigned long now) {
+  if (now - recent_swept_at < RECENT_SWEEP_MS) return;
+  recent_swept_at = now;
 
-  convayer_move(0);                            // หยุดสายพานเริ่มต้น
-  convayer_move(1);                            // เริ่มการทำงานสายพาน
+  for (uint16_t i = 0; i < RECENT_TABLE_SIZE; ) {
+    if (recent_table[i].hash != 0 && now - recent_table[i].seen_at >= RECENT_WINDOW_MS) {
+      recent_erase(i);                           // ตรวจช่องเดิมอีกครั้ง เพราะอาจมีรายการเลื่อนเข้ามา
+    } else {
+      i++;
+    }
+  }
 }
 
 /**
- * ฟังก์ชัน Loop หลัก - ทำงานแบบวนซ้ำ
+ * ฟังก์ชันตรวจสอบการอ่าน QR ซ้ำ และบันทึกหมายเลขติดตามของพัสดุ
+ * หากหมายเลขเดียวกันยังอยู่ในคิว (ของสายพานใดก็ได้) ถือว่าเป็นพัสดุชิ้นเดียวกันที่ถูกตรวจพบสองครั้ง
+ * จะทำเครื่องหมายช่องก่อนหน้าว่าไม่ทราบหอพัก (ช่องล่าสุดใช้ส่งพัสดุต่อ)
+ * @param lane สายพานของพัสดุ
+ * @param seq ลำดับของพัสดุที่เพิ่งได้รับผล QR
+ * @return true หากพบการอ่านซ้ำ
  */
-void loop() {
-  // อ่านค่าจาก IR Sensor ทั้งหมด
-  int IRCamera = digitalRead(IR_DIGITAL_PIN) ^ HIGH;    // IR หลัก (invert signal)
-  int IRCameraG1 = (digitalRead(IR_DIGITAL_PING1) ^ HIGH) * 1;  // IR ประตู 1
-  int IRCameraG2 = (digitalRead(IR_DIGITAL_PING2) ^ HIGH) * 2;  // IR ประตู 2  
-  int IRCameraG3 = (digitalRead(IR_DIGITAL_PING3) ^ HIGH) * 3;  // IR ประตู 3
-  int IRCameraBB = IRCameraG1 + IRCameraG2 + IRCameraG3;        // รวมค่า IR ทั้งหมด
-
-  // ตรวจสอบว่ามีพัสดุในคิวหรือไม่
-  if (dorm[0] != 0){
-
-    // === ตรวจสอบ IR Sensor ประตู 1 ===
-    if ((IRCameraG1 == 1) && flagG1 && (gate_count[0] + 1 > gate_count[1]) && (gate_count[0] + 1 > gate_count[2]) && (gate_count[0] + 1 <= size)){
-      flagG1 = false;                           // รีเซ็ต flag
-      gate_count[0] = gate_count[0] + 1;        // เพิ่มตัวนับประตู 1
-      
-      // แสดงสถานะตัวนับทุกประตู
-      Serial.print("Gate 1: ");
-      Serial.println(gate_count[0]);
-      Serial.print("Gate 2: ");
-      Serial.println(gate_count[1]);
-      Serial.print("Gate 3: ");
-      Serial.println(gate_count[2]);
-      
-      push_box(1);                              // ผลักพัสดุที่ประตู 1
-    }
-    else if ((IRCameraG1 == 0) && (flagG1 == false)){
-      flagG1 = true;                            // ตั้ง flag เมื่อไม่มีสัญญาณ
-    }
-  
-    // === ตรวจสอบ IR Sensor ประตู 2 ===
-    if (IRCameraG2 == 2 && flagG2 && (gate_count[1] + 1 <= gate_count[0]) && (gate_count[1] + 1 > gate_count[2])){
-      flagG2 = false;                           // รีเซ็ต flag
-      gate_count[1] = gate_count[1] + 1;        // เพิ่มตัวนับประตู 2
-      
-      // แสดงสถานะตัวนับทุกประตู
-      Serial.print("Gate 1: ");
-      Serial.println(gate_count[0]);
-      Serial.print("Gate 2: ");
-      Serial.println(gate_count[1]);
-      Serial.print("Gate 3: ");
-      Serial.println(gate_count[2]);
-      
-      push_box(2);                              // ผลักพัสดุที่ประตู 2
-    }
-    else if ((IRCameraG2 == 0) && (flagG2 == false)){
-      flagG2 = true;                            // ตั้ง flag เมื่อไม่มีสัญญาณ
-    }
-  
-    // === ตรวจสอบ IR Sensor ประตู 3 ===
-    if (IRCameraG3 == 3 && flagG3 && (gate_count[2] + 1 <= gate_count[0]) && (gate_count[2] + 1 <= gate_count[1])){
-      flagG3 = false;                           // รีเซ็ต flag
-      gate_count[2] = gate_count[2] + 1;        // เพิ่มตัวนับประตู 3
-      
-      // แสดงสถานะตัวนับทุกประตู
-      Serial.print("Gate 1: ");
-      Serial.println(gate_count[0]);
-      Serial.print("Gate 2: ");
-      Serial.println(gate_count[1]);
-      Serial.print("Gate 3: ");
-      Serial.println(gate_count[2]);
-      
-      push_box(3);                              // ผลักพัสดุที่ประตู 3
-    }
-    else if ((IRCameraG3 == 0) && (flagG3 == false)){
-      flagG3 = true;                            // ตั้ง flag เมื่อไม่มีสัญญาณ
-    }
-  }
-
-  // === ตรวจสอบ IR Sensor หลักสำหรับตรวจจับพัสดุใหม่ ===
-  if (IRCamera == HIGH && flag) {
-    convayer_move(0);                           // หยุดสายพานทันที
-    
-    // รีเซ็ตระบบหากไม่มี IR ที่ประตูใดๆ ทำงานและคิวว่าง
-    if ((IR_DIGITAL_PING1 == LOW) && (IR_DIGITAL_PING2 == LOW) && (IR_DIGITAL_PING3 == LOW) && (size == 0)) {
-      // ล้างข้อมูลในคิวทั้งหมด
-      for (int i = 0; i < MAX_DORM; i++) {
-        dorm[i] = 0;
-        tracking_number[i] = "";
-      }
-      // รีเซ็ตตัวนับประตูทั้งหมด
-      gate_count[0] = 0;
-      gate_count[1] = 0;
-      gate_count[2] = 0;
-    }
-    
-    flag = false;                               // รีเซ็ต flag
-    Serial.println("IR Triggered! Sending request to Raspberry Pi...");
-    delay(300);                                 // รอให้พัสดุอยู่ในตำแหน่งที่เสถียร
-    
-    // ส่งคำสั่งอ่าน QR Code ไป Raspberry Pi ผ่าน UART
-    String response = requestQRFromPi();        // 👈 ขอข้อมูลจาก Pi ผ่าน Serial
-    Serial.println("Response from Pi: " + response);
-
-    // ตรวจสอบว่าได้รับข้อมูลหรือไม่
-    if (response.length() > 0) {
-      // สร้าง JSON document สำหรับ parse ข้อมูล
-      StaticJsonDocument<256> doc;
-      DeserializationError error = deserializeJson(doc, response);
-
-      // ตรวจสอบว่า parse JSON สำเร็จหรือไม่
-      if (!error) {
-        // ดึงข้อมูลจาก JSON
-        int mappedLabel = doc["mapped_label"] | -2;         // หมายเลขหอพัก (-2 หากไม่มีข้อมูล)
-        String trackingNumber = doc["qr_text"] | "No tracking number";  // หมายเลขติดตาม
-
-        // แสดงข้อมูลที่ได้รับ
-        Serial.print("Tracking Number: ");
-        Serial.println(trackingNumber);
-        Serial.print("Mapped Label: ");
-        Serial.println(mappedLabel);
-
-        // เพิ่มข้อมูลเข้าคิว (ไม่ว่าจะเป็นค่าใดก็ตาม)
-        enqueue(mappedLabel, trackingNumber);
-        requeue_lastvalue();                    // จัดการกรณีที่อ่านซ้ำ
-        
-        // แสดงสถานะคิว
-        Serial.print("Queue size: ");
-        Serial.println(size);
-        show_queue();
-      } else {
-        Serial.println("JSON parse failed!");  // แสดงข้อผิดพลาดหาก parse ไม่สำเร็จ
-      }
+bool recent_check(Lane &lane, uint32_t seq) {
+  const TrackingId &id = queue_slot(lane, seq).tracking_number;
+  if (id.hash == 0) return false;                // ไม่มีหมายเลขติดตาม
+
+  unsigned long now = hal_millis();
+  int i = recent_find(id.hash);
+  if (i < 0) {
+    if (recent_count >= RECENT_MAX_LOAD) {
+      TRACE_WARN(TR_RECENT_FULL, recent_count, 0);
+      return false;
     }
-    convayer_move(1);                           // เริ่มสายพานอีกครั้ง
-  } 
-  else if ((IRCamera == LOW) && (flag == false)) {
-    flag = true;                                // ตั้ง flag เมื่อไม่มีพัสดุ
+    for (i = id.hash & RECENT_TABLE_MASK; recent_table[i].hash != 0; i = (i + 1) & RECENT_TABLE_MASK) {}
+    recent_table[i].hash = id.hash;
+    recent_table[i].seq = seq;
+    recent_table[i].lane = lane.id;
+    recent_table[i].seen_at = now;
+    recent_count++;
+    return false;
   }
 
-  delay(50);                                    // หน่วงเวลา 50ms ก่อนวนซ้ำ
-}
\ No newline at end of file
+  RecentEntry &entry = recent_table[i];
+  uint32_t prev = entry.seq;
+  Lane &prev_lane = lanes[entry.lane];
+  entry.seq = seq;
+  entry.lane = lane.id;
+  entry.seen_at = now;
+
+  // ตรวจสอบว่าพัสดุก่อนหน้ายังอยู่ในคิวและหมายเลขตรงกันจริง (ไม่ใช่ hash ชนกัน)
+  if ((&prev_lane == &lane && prev == seq) || !queue_contains(prev_lane, prev)) return false;
+  ParcelSlot &prev_slot = queue_slot(prev_lane, prev);
+  if (!prev_slot.active || !tracking_equal(prev_slot.tracking_number, id)) return false;
+
+  prev_slot.dorm = -2;                           // ทำเครื่องหมายว่าลบแล้ว
+  tracking_set(prev_slot.tracking_number, TRACKING_NONE);
+  journal_log(prev_lane.id, J_QR, prev, -2, TRACKING_NONE, -1, belt_position_at(prev_lane, hal_micros()));
+  TRACE_INFO(TR_TRACKING_DUPLICATE, prev, seq);
+  return true;
+}
+
+// === ข้อความระหว่าง task real-time และ task comms ===
+// task real-time (core 1) เป็นเจ้าของคิวพัสดุ IR สายพาน และมอเตอร์ผลัก
+// task comms (core 0) เป็นเจ้าของ Serial2 และคิวสถานะขาออก
+// ทั้งสองสื่อสารกันผ่าน SpscRing เท่านั้น
+#define TASK_QUEUE_CAPACITY 16 // ขนาดคิวระหว่าง task (ต้องเป็นเลขยกกำลัง 2)
+
+enum CommsMsgType {
+  COMMS_QR_REQUEST,            // ขอผล QR ของพัสดุ seq บนสายพาน lane
+  COMMS_STATUS                 // อัพเดทสถานะพัสดุ
+};
+
+struct CommsMsg {
+  uint8_t type;                // CommsMsgType
+  uint8_t code;                // รหัสสถานะ (COMMS_STATUS)
+  uint8_t lane;                // สายพาน (COMMS_QR_REQUEST)
+  bool timestamped;            // ส่งเวลาที่ IR ตรวจพบไปด้วย (โหมดสแกนต่อเนื่อง)
+  int dorm;                    // หมายเลขหอพัก (COMMS_STATUS)
+  uint32_t seq;                // ลำดับของพัสดุในคิว (COMMS_QR_REQUEST)
+  uint32_t time_us;            // เวลาที่ IR ตรวจพบ (COMMS_QR_REQUEST)
+  char tracking_number[TRACKING_MAX_LEN + 1]; // หมายเลขติดตาม (COMMS_STATUS)
+};
+
+struct QrResult {
+  uint8_t lane;                // สายพาน
+  uint32_t seq;                // ลำดับของพัสดุในคิวของสายพาน
+  uint32_t received_us;        // เวลาที่ task comms ได้รับผล (micros)
+  int dorm;                    // หมายเลขหอพัก (-1/-2 = ไม่ทราบ)
+  char tracking_number[TRACKING_MAX_LEN + 1]; // หมายเลขติดตาม
+};
+
+SpscRing<CommsMsg, TASK_QUEUE_CAPACITY> rt_to_comms;   // real-time → comms
+SpscRing<QrResult, TASK_QUEUE_CAPACITY> comms_to_rt;   // comms → real-time
+
+// === กรอบข้อความไบนารีกับ Pi (COBS + CRC16) ===
+// ทั้งสองทิศทางบน Serial2 ส่งเป็นกรอบ: COBS(payload) ตามด้วยไบต์ 0x00 เป็นตัวคั่น
+// payload = [ชนิดข้อความ:1][เนื้อหา][CRC-16/CCITT ของชนิดและเนื้อหา:2] ตัวเลขทุกตัวเป็น little-endian
+// COBS ทำให้ไม่มี 0x00 ภายในกรอบ ไบต์ที่เสียจึงทำให้ทิ้งเพียงกรอบเดียว แล้วเริ่มกรอบถัดไปได้ทันที
+// ฝั่งรับถอด COBS ทับ buffer เดิมแล้วอ่านฟิลด์จาก buffer โดยตรง ไม่มีการ parse ข้อความหรือคัดลอก
+// รูปแบบเนื้อหา (ต้องตรงกับ qr_server.py):
+//   ESP32 → Pi  MSG_QR_REQUEST    lane:1 seq:4 age_ms:4 (PI_NO_AGE = เก็บภาพทันที)
+//               MSG_STATUS_BATCH  batch:2 count:1 {code:1 dorm:2 len:1 tracking}...
+//               MSG_METRICS       window_ms:4 count:1 {len:1 name len:1 unit n:4 min:4 p50:4 p99:4 max:4}...
+//               MSG_DORM_SYNC     version:4
+//   Pi → ESP32  MSG_QR_RESULT     lane:1 seq:4 len:1 qr_text (len 0 = Pi เกิดข้อผิดพลาด)
+//               MSG_ACK           batch:2
+//               MSG_DORM_FULL     version:4 part:2 parts:2 {hash:4 dorm:1}...
+//               MSG_DORM_DELTA    base:4 version:4 {hash:4 dorm:1}...
+#define PI_BAUD 115200         // ความเร็ว Serial2 (ต้องตรงกับ SERIAL_BAUD ใน qr_server.py)
+#define PI_FRAME_MAX 1024      // ความยาว payload สูงสุด (รวมชนิดและ CRC)
+#define PI_WIRE_MAX (PI_FRAME_MAX + PI_FRAME_MAX / 254 + 2) // ความยาวสูงสุดบนสาย (COBS + ตัวคั่น)
+#define PI_NO_AGE 0xFFFFFFFFu  // MSG_QR_REQUEST: ไม่มีเวลาที่ IR ตรวจพบ
+
+enum PiMsgType {
+  MSG_QR_REQUEST = 0x01,
+  MSG_STATUS_BATCH = 0x02,
+  MSG_METRICS = 0x03,
+  MSG_DORM_SYNC = 0x04,
+  MSG_QR_RESULT = 0x81,
+  MSG_ACK = 0x82,
+  MSG_DORM_FULL = 0x83,
+  MSG_DORM_DELTA = 0x84
+};
+
+enum PiFrameError {
+  PI_FRAME_OVERFLOW = 1,       // ยาวเกิน buffer รับ
+  PI_FRAME_COBS,               // รหัส COBS ไม่ถูกต้อง
+  PI_FRAME_CRC,                // CRC ไม่ตรง
+  PI_FRAME_TYPE                // ไม่รู้จักชนิดข้อความ
+};
+
+struct PiFrame {               // payload ที่กำลังสร้าง (buffer จองไว้ล่วงหน้า)
+  uint8_t data[PI_FRAME_MAX];
+  size_t len;
+  bool overflow;               // เนื้อหาเกิน PI_FRAME_MAX
+};
+
+PiFrame pi_frame;              // ใช้โดย task comms เท่านั้น
+uint8_t pi_tx_buf[PI_WIRE_MAX];
+
+/**
+ * ฟังก์ชันคำนวณ CRC-16/CCITT (poly 0x1021, ค่าเริ่มต้น 0xFFFF)
+ */
+uint16_t crc16_ccitt(const uint8_t *data, size_t len) {
+  uint16_t crc = 0xFFFF;
+  while (len--) {
+    crc ^= (uint16_t)*data++ << 8;
+    for (uint8_t i = 0; i < 8; i++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+/**
+ * ฟังก์ชันอ่านตัวเลข 16 บิตแบบ little-endian จาก buffer
+ */
+inline uint16_t rd_u16(const uint8_t *p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+/**
+ * ฟังก์ชันอ่านตัวเลข 32 บิตแบบ little-endian จาก buffer
+ */
+inline uint32_t rd_u32(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**
+ * ฟังก์ชันเพิ่มข้อมูลต่อท้าย payload (เว้นที่ 2 ไบต์สำหรับ CRC)
+ */
+void frame_bytes(PiFrame &f, const void *src, size_t n) {
+  if (f.len + n > PI_FRAME_MAX - 2) {
+    f.overflow = true;
+    return;
+  }
+  memcpy(f.data + f.len, src, n);
+  f.len += n;
+}
+
+void frame_u8(PiFrame &f, uint8_t v) {
+  frame_bytes(f, &v, 1);
+}
+
+void frame_u16(PiFrame &f, uint16_t v) {
+  uint8_t b[2] = {(uint8_t)v, (uint8_t)(v >> 8)};
+  frame_bytes(f, b, 2);
+}
+
+void frame_u32(PiFrame &f, uint32_t v) {
+  uint8_t b[4] = {(uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24)};
+  frame_bytes(f, b, 4);
+}
+
+/**
+ * ฟังก์ชันเพิ่มสตริงแบบ [len:1][ข้อความ] (ตัดที่ 255 ไบต์)
+ */
+void frame_str(PiFrame &f, const char *str) {
+  size_t n = strlen(str);
+  if (n > 255) n = 255;
+  frame_u8(f, (uint8_t)n);
+  frame_bytes(f, str, n);
+}
+
+/**
+ * ฟังก์ชันเริ่มสร้าง payload ใหม่
+ * @param type ชนิดข้อความ (PiMsgType)
+ */
+void frame_begin(PiFrame &f, uint8_t type) {
+  f.len = 0;
+  f.overflow = false;
+  frame_u8(f, type);
+}
+
+/**
+ * ฟังก์ชันปิด payload ด้วย CRC แล้วเข้ารหัส COBS พร้อมตัวคั่นลง buffer ปลายทาง
+ * @param out buffer ปลายทาง
+ * @param cap ขนาด buffer
+ * @return ความยาวบนสาย หรือ 0 หากข้อมูลเกิน
+ */
+size_t frame_encode(PiFrame &f, uint8_t *out, size_t cap) {
+  if (f.overflow) return 0;
+  uint16_t crc = crc16_ccitt(f.data, f.len);
+  f.data[f.len++] = (uint8_t)crc;                // เว้นที่ไว้แล้วใน frame_bytes
+  f.data[f.len++] = (uint8_t)(crc >> 8);
+  if (f.len + f.len / 254 + 2 > cap) return 0;
+
+  size_t code_pos = 0, pos = 1;
+  uint8_t code = 1;
+  for (size_t i = 0; i < f.len; i++) {
+    if (f.data[i] == 0) {                        // ปิดช่วงที่ไม่มีศูนย์
+      out[code_pos] = code;
+      code_pos = pos++;
+      code = 1;
+    } else {
+      out[pos++] = f.data[i];
+      if (++code == 0xFF) {                      // ช่วงยาวสุด 254 ไบต์
+        out[code_pos] = code;
+        code_pos = pos++;
+        code = 1;
+      }
+    }
+  }
+  out[code_pos] = code;
+  out[pos++] = 0;                                // ตัวคั่นกรอบ
+  return pos;
+}
+
+/**
+ * ฟังก์ชันส่ง payload ที่สร้างไว้ไป Pi (task comms)
+ * @return ความยาวบนสาย หรือ 0 หากข้อมูลเกิน
+ */
+size_t frame_send(PiFrame &f) {
+  size_t len = frame_encode(f, pi_tx_buf, sizeof(pi_tx_buf));
+  if (len > 0) hal_pi_write(pi_tx_buf, len);
+  return len;
+}
+
+/**
+ * ฟังก์ชันถอดรหัส COBS ทับ buffer เดิม (ผลลัพธ์สั้นกว่าข้อมูลเข้าเสมอ)
+ * @param buf ข้อมูลหนึ่งกรอบ (ไม่รวมตัวคั่น)
+ * @param len ความยาวข้อมูล
+ * @return ความยาว payload หรือ 0 หากรหัสไม่ถูกต้อง
+ */
+size_t cobs_decode(uint8_t *buf, size_t len) {
+  size_t in = 0, out = 0;
+  while (in < len) {
+    uint8_t code = buf[in++];
+    if (code == 0 || in + code - 1 > len) return 0;
+    for (uint8_t i = 1; i < code; i++) buf[out++] = buf[in++];
+    if (code < 0xFF && in < len) buf[out++] = 0;
+  }
+  return out;
+}
+
+// === ตารางหอพักบนอุปกรณ์ (tracking hash → หอพัก) ===
+// Pi ส่งตาราง hash ของหมายเลขติดตามที่ยังไม่ส่งถึง → หมายเลขหอพัก มาเก็บไว้ ESP32 หาหอพักเองได้ทันที
+// ที่ได้ข้อความ QR โดย Pi ไม่ต้องค้นฐานข้อมูลก่อนตอบ ตารางเรียงตาม hash และค้นด้วย binary search
+// (8192 รายการ = 13 ครั้งเปรียบเทียบ) เก็บเป็น array คู่ขนานเพื่อใช้ 5 ไบต์ต่อรายการ
+// โปรโตคอล (รูปแบบกรอบดูที่ส่วนกรอบข้อความไบนารี):
+//   ESP32 → Pi  MSG_DORM_SYNC   ขอตารางทั้งหมด (ตอนเริ่มต้น หรือ delta ไม่ต่อเนื่อง)
+//   Pi → ESP32  MSG_DORM_FULL   ตารางทั้งหมดแบ่งเป็นหลาย part เรียงตาม hash
+//   Pi → ESP32  MSG_DORM_DELTA  การเปลี่ยนแปลงจาก version base (หอพัก DORM_DELETE = ลบ)
+// hash ที่หมายเลขติดตามต่างกันแต่ชนกัน Pi ส่งเป็น DORM_AMBIGUOUS จึงถือว่าไม่ทราบหอพัก
+// ตารางเป็นของ task comms เท่านั้น (รับข้อความ sync และค้นหอพักตอนได้ผล QR)
+// MSG_DORM_FULL ถูกรับลงตารางสำรอง แล้วสลับเป็นตารางที่ใช้ค้นเมื่อได้ part สุดท้าย
+// ระหว่าง sync ใหม่ (หรือเมื่อ part หาย) จึงยังค้นจากตารางเดิมที่ครบได้
+#ifndef DORM_CACHE_CAPACITY
+#define DORM_CACHE_CAPACITY 8192 // จำนวนรายการสูงสุด (40 KB ต่อตาราง x 2)
+#endif
+#define DORM_DELETE 0xFF       // รายการ delta: ลบ hash ออกจากตาราง
+#define DORM_AMBIGUOUS 0xFE    // hash ชนกันมากกว่าหนึ่งหมายเลขติดตาม
+#define DORM_ENTRY_SIZE 5      // ขนาดรายการในกรอบ (hash:4 dorm:1)
+#define DORM_SYNC_RETRY_MS 5000 // ขอตารางซ้ำหากยังไม่ได้รับครบ
+
+struct DormTable {
+  uint32_t hash[DORM_CACHE_CAPACITY];  // hash เรียงจากน้อยไปมาก
+  uint8_t dorm[DORM_CACHE_CAPACITY];   // หมายเลขหอพักของ hash เดียวกัน
+  uint16_t size;
+};
+
+DormTable dorm_tables[2];
+DormTable *dorm_cache = &dorm_tables[0];   // ตารางที่ใช้ค้น
+DormTable *dorm_staging = &dorm_tables[1]; // ตารางที่กำลังรับจาก MSG_DORM_FULL
+uint32_t dorm_cache_version = 0;   // version ของตารางที่ครบแล้ว (0 = ยังไม่มี)
+bool dorm_cache_ready = false;     // ได้รับตารางครบทุก part แล้ว
+uint32_t dorm_full_version = 0;    // version ที่กำลังรับแบบทั้งตาราง
+int dorm_full_next_part = -1;      // part ถัดไปที่รอ (-1 = ไม่ได้รับอยู่)
+unsigned long dorm_sync_requested_at = 0;
+bool dorm_sync_requested = false;
+
+/**
+ * ฟังก์ชันหาตำแหน่งแรกที่ hash >= ค่าที่ต้องการ (binary search)
+ * @param table ตารางที่ค้น
+ * @param hash hash ของหมายเลขติดตาม
+ * @return ตำแหน่งใน table.hash (เท่ากับ table.size หากมากกว่าทุกรายการ)
+ */
+uint16_t dorm_cache_lower_bound(const DormTable &table, uint32_t hash) {
+  uint16_t lo = 0, hi = table.size;
+  while (lo < hi) {
+    uint16_t mid = (lo + hi) / 2;
+    if (table.hash[mid] < hash) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+/**
+ * ฟังก์ชันหาหมายเลขหอพักจากหมายเลขติดตามด้วยตารางบนอุปกรณ์
+ * @param text หมายเลขติดตามที่อ่านได้จาก QR
+ * @return หมายเลขหอพัก, -1 หากไม่พบ/hash ชนกัน, -2 หากไม่มี QR
+ */
+int dorm_lookup(const char *text) {
+  TrackingId id;
+  tracking_set(id, text);
+  if (id.hash == 0) return -2;                   // อ่าน QR ไม่ได้
+  const DormTable &table = *dorm_cache;
+  uint16_t i = dorm_cache_lower_bound(table, id.hash);
+  if (i == table.size || table.hash[i] != id.hash) return -1;
+  return table.dorm[i] == DORM_AMBIGUOUS ? -1 : table.dorm[i];
+}
+
+/**
+ * ฟังก์ชันเพิ่ม แก้ไข หรือลบรายการในตาราง (รักษาลำดับ hash)
+ * @param table ตารางที่แก้ไข
+ * @param hash hash ของหมายเลขติดตาม
+ * @param dorm หมายเลขหอพัก หรือ DORM_DELETE
+ */
+void dorm_cache_put(DormTable &table, uint32_t hash, uint8_t dorm) {
+  uint16_t i = dorm_cache_lower_bound(table, hash);
+  bool found = i < table.size && table.hash[i] == hash;
+  if (dorm == DORM_DELETE) {
+    if (!found) return;
+    memmove(&table.hash[i], &table.hash[i + 1], (table.size - i - 1) * sizeof(uint32_t));
+    memmove(&table.dorm[i], &table.dorm[i + 1], table.size - i - 1);
+    table.size--;
+    return;
+  }
+  if (!found) {
+    if (table.size >= DORM_CACHE_CAPACITY) {
+      TRACE_WARN(TR_DORM_CACHE_FULL, DORM_CACHE_CAPACITY, 0);  // พัสดุนี้จะถือว่าไม่ทราบหอพัก
+      return;
+    }
+    memmove(&table.hash[i + 1], &table.hash[i], (table.size - i) * sizeof(uint32_t));
+    memmove(&table.dorm[i + 1], &table.dorm[i], table.size - i);
+    table.hash[i] = hash;
+    table.size++;
+  }
+  table.dorm[i] = dorm;
+}
+
+/**
+ * ฟังก์ชันขอตารางหอพักทั้งหมดจาก Pi
+ */
+void dorm_sync_request() {
+  frame_begin(pi_frame, MSG_DORM_SYNC);
+  frame_u32(pi_frame, dorm_cache_ready ? dorm_cache_version : 0);
+  frame_send(pi_frame);
+  TRACE_INFO(TR_DORM_SYNC_REQUEST, dorm_cache_version, 0);
+  dorm_sync_requested = true;
+  dorm_sync_requested_at = hal_millis();
+}
+
+/**
+ * ฟังก์ชันรับตารางหอพักทั้งตารางทีละ part ลงตารางสำรอง (task comms)
+ * ระหว่างรับยังค้นจากตารางเดิม แล้วสลับเป็นตารางใหม่เมื่อได้รับครบทุก part
+ * @param body เนื้อหาของ MSG_DORM_FULL
+ * @param len ความยาวเนื้อหา
+ */
+void dorm_handle_full(const uint8_t *body, size_t len) {
+  if (len < 8) {
+    TRACE_WARN(TR_PI_MSG_SHORT, MSG_DORM_FULL, len);
+    return;
+  }
+  uint32_t version = rd_u32(body);
+  int part = rd_u16(body + 4);
+  int parts = rd_u16(body + 6);
+
+  if (part == 0) {                               // เริ่มตารางใหม่
+    dorm_staging->size = 0;
+    dorm_full_version = version;
+    dorm_full_next_part = 0;
+  }
+  if (part != dorm_full_next_part || version != dorm_full_version) {
+    TRACE_WARN(TR_DORM_SYNC_ERROR, part, dorm_full_next_part);
+    dorm_full_next_part = -1;                    // part หาย - dorm_sync_update จะขอใหม่ทั้งหมด
+    return;
+  }
+  dorm_sync_requested_at = hal_millis();         // ยังได้รับต่อเนื่อง - ไม่ต้องขอซ้ำ
+
+  DormTable &table = *dorm_staging;
+  for (size_t pos = 8; pos + DORM_ENTRY_SIZE <= len; pos += DORM_ENTRY_SIZE) {
+    uint32_t hash = rd_u32(body + pos);
+    uint8_t dorm = body[pos + 4];
+    if (dorm == DORM_DELETE) continue;
+    if (table.size > 0 && hash <= table.hash[table.size - 1]) {
+      dorm_cache_put(table, hash, dorm);         // ไม่เรียงตามที่คาด - แทรกตามตำแหน่ง
+    } else if (table.size < DORM_CACHE_CAPACITY) {
+      table.hash[table.size] = hash;             // ปกติ: ต่อท้าย
+      table.dorm[table.size] = dorm;
+      table.size++;
+    } else {
+      TRACE_WARN(TR_DORM_CACHE_FULL, DORM_CACHE_CAPACITY, 0);
+    }
+  }
+
+  dorm_full_next_part++;
+  if (dorm_full_next_part >= parts) {            // ได้รับครบ - ใช้ตารางใหม่
+    dorm_staging = dorm_cache;
+    dorm_cache = &table;
+    dorm_cache_version = version;
+    dorm_cache_ready = true;
+    dorm_sync_requested = false;
+    dorm_full_next_part = -1;
+    TRACE_INFO(TR_DORM_SYNC_DONE, table.size, version);
+  }
+}
+
+/**
+ * ฟังก์ชันรับการเปลี่ยนแปลงของตารางหอพัก (task comms)
+ * @param body เนื้อหาของ MSG_DORM_DELTA
+ * @param len ความยาวเนื้อหา
+ */
+void dorm_handle_delta(const uint8_t *body, size_t len) {
+  if (len < 8) {
+    TRACE_WARN(TR_PI_MSG_SHORT, MSG_DORM_DELTA, len);
+    return;
+  }
+  uint32_t base = rd_u32(body);
+  if (!dorm_cache_ready || base != dorm_cache_version) {
+    if (!dorm_sync_requested) dorm_sync_request();  // delta ไม่ต่อเนื่อง - ขอตารางทั้งหมด
+    return;
+  }
+
+  uint16_t changes = 0;
+  for (size_t pos = 8; pos + DORM_ENTRY_SIZE <= len; pos += DORM_ENTRY_SIZE) {
+    dorm_cache_put(*dorm_cache, rd_u32(body + pos), body[pos + 4]);
+    changes++;
+  }
+  dorm_cache_version = rd_u32(body + 4);
+  TRACE_INFO(TR_DORM_DELTA, changes, dorm_cache_version);
+}
+
+/**
+ * ฟังก์ชันตรวจสอบว่าต้องขอตารางหอพักหรือไม่ (task comms)
+ * @param now เวลาปัจจุบัน (millis)
+ */
+void dorm_sync_update(unsigned long now) {
+  if (dorm_cache_ready && !dorm_sync_requested) return;  // ตารางครบและไม่ได้รอ sync ใหม่
+  if (!dorm_sync_requested || now - dorm_sync_requested_at >= DORM_SYNC_RETRY_MS) {
+    dorm_sync_request();
+  }
+}
+
+// === โปรโตคอลขอผล QR แบบไม่บล็อกผ่าน UART ===
+// คำสั่ง:  MSG_QR_REQUEST lane, seq, age_ms  โดย seq คือลำดับของพัสดุในคิวของสายพาน lane
+//          Pi ใช้กล้องของสายพาน lane (หนึ่งกล้องต่อสายพาน)
+//          age_ms = PI_NO_AGE: Pi เก็บภาพทันที
+//          age_ms อื่น (โหมดสแกนต่อเนื่อง) คือเวลาที่ผ่านไปตั้งแต่ IR ตรวจพบ
+//          Pi จะเลือกภาพที่ดีที่สุดรอบเวลานั้นจากภาพที่กล้องเก็บไว้
+// คำตอบ:  MSG_QR_RESULT lane, seq, qr_text  ESP32 หาหอพักจากตารางบนอุปกรณ์
+// ส่งคำขอได้หลายรายการพร้อมกันจากทุกสายพาน และจับคู่คำตอบกลับไปยังช่องในคิวด้วย lane และ seq
+#define QR_SETTLE_MS 300       // รอให้พัสดุนิ่งก่อนส่งคำขอ
+#define QR_CAPTURE_MS 150      // เวลาหยุดสายพานให้ Pi เก็บภาพหลังส่งคำขอ
+#define QR_TIMEOUT_MS 5000     // หมดเวลารอผล QR (นับจากเวลาที่ IR ตรวจพบ)
+#define QR_STOP_MARGIN_MM 40.0f // โหมดต่อเนื่อง: หยุดสายพานเมื่อพัสดุที่ยังไม่มีผล QR อยู่ห่างประตูแรกน้อยกว่านี้
+#define SCAN_CONTINUOUS_DEFAULT false // โหมดเริ่มต้น (true = สแกนโดยไม่หยุดสายพาน)
+
+bool scan_continuous = SCAN_CONTINUOUS_DEFAULT;  // โหมดสแกนปัจจุบัน (ทุกสายพาน)
+
+/**
+ * ฟังก์ชันส่งคำสั่งอ่าน QR Code พร้อมเวลาที่ IR ตรวจพบ (โหมดสแกนต่อเนื่อง)
+ * @param lane สายพาน (กล้องที่ใช้)
+ * @param seq ลำดับของพัสดุในคิว
+ * @param age_ms เวลาที่ผ่านไปตั้งแต่ IR ตรวจพบ (มิลลิวินาที) หรือ PI_NO_AGE
+ */
+void requestQRFromPi(uint8_t lane, uint32_t seq, uint32_t age_ms) {
+  PROBE_BEGIN(request);
+  frame_begin(pi_frame, MSG_QR_REQUEST);
+  frame_u8(pi_frame, lane);
+  frame_u32(pi_frame, seq);
+  frame_u32(pi_frame, age_ms);
+  frame_send(pi_frame);                          // ส่งคำสั่งไป Pi
+  PROBE_END(METRIC_QR_REQUEST, request);
+}
+
+/**
+ * ฟังก์ชันส่งคำสั่งอ่าน QR Code ไป Raspberry Pi ผ่าน UART (ไม่รอคำตอบ)
+ * @param lane สายพาน (กล้องที่ใช้)
+ * @param seq ลำดับของพัสดุในคิว
+ */
+void requestQRFromPi(uint8_t lane, uint32_t seq) {
+  requestQRFromPi(lane, seq, PI_NO_AGE);         // เก็บภาพทันที
+}
+
+/**
+ * ฟังก์ชันขอผล QR ของพัสดุ (task real-time) - task comms จะเป็นผู้ส่งไป Pi
+ * @param lane สายพานของพัสดุ
+ * @param seq ลำดับของพัสดุในคิว
+ * @param timestamped ส่งเวลาที่ IR ตรวจพบไปด้วยหรือไม่
+ * @param time_us เวลาที่ IR ตรวจพบ (micros)
+ */
+void qr_request(const Lane &lane, uint32_t seq, bool timestamped, uint32_t time_us) {
+  CommsMsg msg;
+  msg.type = COMMS_QR_REQUEST;
+  msg.lane = lane.id;
+  msg.seq = seq;
+  msg.timestamped = timestamped;
+  msg.time_us = time_us;
+  if (!rt_to_comms.push(msg)) {
+    TRACE_WARN(TR_COMMS_FULL, COMMS_QR_REQUEST, seq);  // จะหมดเวลาและถูกทำเครื่องหมายว่าไม่ทราบหอพัก
+  }
+}
+
+/**
+ * ฟังก์ชันจัดการผล QR ที่ได้รับจาก Pi (task comms)
+ * @param body เนื้อหาของ MSG_QR_RESULT
+ * @param len ความยาวเนื้อหา
+ */
+void qr_handle_response(const uint8_t *body, size_t len) {
+  if (len < 6 || len < 6u + body[5]) {
+    TRACE_WARN(TR_PI_MSG_SHORT, MSG_QR_RESULT, len);
+    return;
+  }
+  if (body[0] >= NUM_LANES) {
+    TRACE_WARN(TR_QR_STALE, rd_u32(body + 1), body[0]);  // ไม่มีสายพานนี้
+    return;
+  }
+
+  // อ่านฟิลด์จากกรอบโดยตรง
+  QrResult result;
+  result.lane = body[0];
+  result.seq = rd_u32(body + 1);
+  result.received_us = hal_micros();
+  size_t text_len = body[5];
+  if (text_len == 0) {
+    tracking_copy(result.tracking_number, TRACKING_NONE);  // Pi เกิดข้อผิดพลาด
+    result.dorm = -2;
+  } else if (text_len > TRACKING_MAX_LEN) {
+    // ไม่ตัดให้สั้นลง - หมายเลขที่ถูกตัดอาจตรงกับพัสดุอื่นในตารางหอพัก
+    TRACE_WARN(TR_TRACKING_TOO_LONG, result.seq, text_len);
+    tracking_copy(result.tracking_number, TRACKING_NONE);
+    result.dorm = -1;                                      // มี QR แต่ไม่ทราบหอพัก
+  } else {
+    memcpy(result.tracking_number, body + 6, text_len);    // หมายเลขติดตาม
+    result.tracking_number[text_len] = '\0';
+    result.dorm = dorm_lookup(result.tracking_number);     // หมายเลขหอพักจากตาราง
+  }
+
+  TRACE_INFO(TR_QR_RESULT, result.seq, result.dorm);
+  if (!comms_to_rt.push(result)) {
+    TRACE_WARN(TR_RT_FULL, result.seq, 0);
+  }
+}
+
+/**
+ * ฟังก์ชันเติมผล QR ลงช่องในคิว (task real-time)
+ * @param result ผล QR ที่ได้รับจาก task comms
+ */
+void qr_apply_result(const QrResult &result) {
+  // จับคู่คำตอบกับช่องในคิวของสายพาน
+  Lane &lane = lanes[result.lane];
+  uint32_t seq = result.seq;
+  if (!queue_contains(lane, seq) || !queue_slot(lane, seq).active || queue_slot(lane, seq).dorm != QR_PENDING) {
+    TRACE_WARN(TR_QR_STALE, seq, lane.id);       // หมดเวลาไปแล้วหรือพัสดุออกจากคิวแล้ว
+    return;
+  }
+
+  uint32_t now_us = hal_micros();
+  metrics_record(METRIC_QR_HANDOFF, now_us - result.received_us);
+  ParcelSlot &slot = queue_slot(lane, seq);
+  metrics_record(METRIC_QR_RESPONSE, now_us - slot.triggered_us);
+  slot.dorm = result.dorm;
+  tracking_set(slot.tracking_number, result.tracking_number);
+  journal_log(lane.id, J_QR, seq, result.dorm, result.tracking_number, -1, belt_position_at(lane, hal_micros()));
+  recent_check(lane, seq);                       // จัดการกรณีที่อ่านซ้ำ
+}
+
+/**
+ * ฟังก์ชันตรวจสอบคำขอที่หมดเวลา และทำเครื่องหมายว่าไม่ทราบหอพัก
+ * @param lane สายพานของคิว
+ * @param now เวลาปัจจุบัน (millis)
+ */
+void qr_check_timeouts(Lane &lane, unsigned long now) {
+  for (uint32_t seq = lane.queue_head; seq != lane.queue_tail; seq++) {
+    ParcelSlot &slot = queue_slot(lane, seq);
+    if (slot.active && slot.dorm == QR_PENDING && now - slot.triggered_at >= QR_TIMEOUT_MS) {
+      slot.dorm = -2;                            // ไม่ทราบหอพัก
+      tracking_set(slot.tracking_number, TRACKING_NONE);
+      journal_log(lane.id, J_QR, seq, -2, TRACKING_NONE, -1, belt_position_at(lane, hal_micros()));
+      TRACE_WARN(TR_QR_TIMEOUT, seq, lane.id);
+    }
+  }
+}
+
+// === ring ของ sector ใน flash สำหรับ journal (task comms / setup) ===
+// log แต่ละชุดใช้ช่วง sector ของตัวเองใน partition และวนเขียนแบบเดียวกัน:
+// sector เริ่มด้วย J_SECTOR (generation) ตามด้วย snapshot ของสถานะ แล้วจึงเป็น record การเปลี่ยนแปลง
+struct JournalLog {
+  uint8_t id;                  // JOURNAL_LOG_* (บันทึกใน J_SECTOR.lane)
+  uint16_t first;              // sector แรกของ log ใน partition (ตั้งใน journal_partition)
+  uint16_t sectors;            // จำนวน sector ของ log
+  uint16_t sector;             // sector ปัจจุบัน (นับจาก first)
+  uint16_t count;              // จำนวน record ใน sector ปัจจุบัน
+  uint32_t generation;         // เพิ่มขึ้นทุกครั้งที่ compaction
+  bool next_erased;            // sector ถัดไปถูกลบไว้ล่วงหน้าแล้ว
+};
+
+/**
+ * ฟังก์ชันคำนวณตำแหน่งของ record ใน partition
+ * @param log log ที่อ่าน/เขียน
+ * @param sector sector นับจาก log.first
+ * @param index ลำดับ record ใน sector
+ */
+uint32_t journal_offset(const JournalLog &log, uint16_t sector, uint16_t index) {
+  return (uint32_t)(log.first + sector) * HAL_FLASH_SECTOR + index * JOURNAL_RECORD_SIZE;
+}
+
+/**
+ * ฟังก์ชันตรวจสอบ record ที่อ่านจาก flash
+ */
+bool journal_valid(const JournalRecord &rec) {
+  if (rec.magic != JOURNAL_MAGIC) return false;  // ว่าง (0xFFFF) หรือเสีย
+  JournalRecord copy = rec;
+  copy.crc = 0;
+  return crc16_ccitt((const uint8_t *)&copy, sizeof(copy)) == rec.crc;
+}
+
+/**
+ * ฟังก์ชันเขียน record ต่อท้าย sector ปัจจุบันของ log
+ */
+void journal_append(JournalLog &log, JournalRecord &rec) {
+  rec.magic = JOURNAL_MAGIC;
+  rec.crc = 0;
+  rec.crc = crc16_ccitt((const uint8_t *)&rec, sizeof(rec));
+
+  uint32_t offset = journal_offset(log, log.sector, log.count);
+  if (!hal_flash_write(offset, &rec, sizeof(rec))) {
+    TRACE_WARN(TR_JOURNAL_ERROR, offset, 0);
+  }
+  log.count++;
+}
+
+/**
+ * ฟังก์ชันเริ่ม sector ถัดไปของ log (compaction) ด้วย J_SECTOR - ผู้เรียกเขียน snapshot ต่อ
+ * @param rec J_SECTOR ที่ผู้เรียกเติม dorm/mm ไว้แล้ว
+ */
+void journal_begin_sector(JournalLog &log, JournalRecord &rec) {
+  uint16_t next = (log.sector + 1) % log.sectors;
+  if (!log.next_erased && !hal_flash_erase(journal_offset(log, next, 0))) {
+    TRACE_WARN(TR_JOURNAL_ERROR, journal_offset(log, next, 0), 0);
+  }
+  log.next_erased = false;
+  log.sector = next;
+  log.count = 0;
+  log.generation++;
+
+  rec.type = J_SECTOR;
+  rec.lane = log.id;
+  rec.seq = log.generation;
+  journal_append(log, rec);
+}
+
+/**
+ * ฟังก์ชันลบ sector ถัดไปของ log ล่วงหน้า (เรียกเมื่อไม่มีพัสดุบนสายพาน)
+ */
+void journal_erase_ahead(JournalLog &log) {
+  if (log.next_erased) return;
+  log.next_erased = hal_flash_erase(journal_offset(log, (log.sector + 1) % log.sectors, 0));
+}
+
+/**
+ * ฟังก์ชันอ่าน sector และสร้างสถานะจาก snapshot และ record ที่ตามมา
+ * @param apply ฟังก์ชันเปลี่ยนสถานะตาม record ของ log นี้
+ * @param last_lane J_SNAPSHOT_END.lane ที่ปิด snapshot
+ * @return true หาก snapshot ของ sector นี้สมบูรณ์
+ */
+template <typename State>
+bool journal_replay(const JournalLog &log, uint16_t sector, State &st, void (*apply)(State &, const JournalRecord &),
+                    uint8_t last_lane) {
+  bool complete = false;
+  JournalRecord rec;
+  for (uint16_t count = 0; count < JOURNAL_RECORDS_PER_SECTOR; count++) {
+    if (!hal_flash_read(journal_offset(log, sector, count), &rec, sizeof(rec)) || !journal_valid(rec)) break;  // สิ้นสุด log
+    if (count == 0 && rec.type != J_SECTOR) break;
+    apply(st, rec);
+    if (rec.type == J_SNAPSHOT_END && rec.lane == last_lane) complete = true;
+  }
+  return complete;
+}
+
+/**
+ * ฟังก์ชันกู้คืนสถานะจาก sector ที่มี generation สูงสุดและ snapshot สมบูรณ์ (ถอยไป sector ก่อนหน้าหากไม่สมบูรณ์)
+ * ตั้ง sector ปัจจุบันและ generation ของ log ให้ snapshot ถัดไปใหม่กว่าทุก sector ที่มีอยู่
+ * @return false หากไม่มี journal ที่ใช้ได้ (สถานะไม่ถูกกำหนด)
+ */
+template <typename State>
+bool journal_load(JournalLog &log, State &st, void (*apply)(State &, const JournalRecord &), uint8_t last_lane) {
+  log.sector = log.sectors - 1;
+  uint32_t limit = 0xFFFFFFFF;
+  uint32_t newest_gen = 0;                       // generation สูงสุดที่พบ (รวม sector ที่ไม่สมบูรณ์)
+  bool restored = false;
+  for (uint16_t attempt = 0; attempt < log.sectors && !restored; attempt++) {
+    int best = -1;
+    uint32_t best_gen = 0;
+    JournalRecord rec;
+    for (uint16_t i = 0; i < log.sectors; i++) {
+      if (!hal_flash_read(journal_offset(log, i, 0), &rec, sizeof(rec)) || !journal_valid(rec)) continue;
+      if (rec.type != J_SECTOR || rec.lane != log.id) continue;
+      if (rec.seq > newest_gen) newest_gen = rec.seq;
+      if (rec.seq >= limit) continue;
+      if (best < 0 || rec.seq > best_gen) {
+        best = i;
+        best_gen = rec.seq;
+      }
+    }
+    if (best < 0) break;                         // ไม่มี journal
+    limit = best_gen;
+
+    if (journal_replay(log, best, st, apply, last_lane)) {
+      log.sector = best;
+      restored = true;
+    }
+  }
+  log.generation = newest_gen;
+  log.next_erased = false;
+  return restored;
+}
+
+// === คิวสถานะขาออกแบบรวมชุด (batch) พร้อมการยืนยัน (ack) ===
+// เหตุการณ์สถานะถูกเก็บในคิวจนกว่า Pi จะยืนยัน แล้วส่งรวมเป็นชุดเดียวใน MSG_STATUS_BATCH
+// Pi ตอบกลับ MSG_ACK พร้อมหมายเลขชุดหลังบันทึกลงฐานข้อมูลสำเร็จ หากไม่ได้รับจะส่งซ้ำ
+// กรอบถูกเข้ารหัสลง buffer ที่จองไว้ล่วงหน้าและเก็บไว้ส่งซ้ำ ไม่มีการจองหน่วยความจำ heap
+// เหตุการณ์และ ack ถูกบันทึกลง log สถานะใน flash (status_journal) เหตุการณ์ที่ยังไม่ได้รับ ack จึงถูกส่งอีกครั้งหลังรีเซ็ต
+#define STATUS_QUEUE_CAPACITY 32 // ขนาดคิวสถานะ (ต้องเป็นเลขยกกำลัง 2)
+#define STATUS_QUEUE_MASK (STATUS_QUEUE_CAPACITY - 1)
+#define STATUS_BATCH_MAX 8     // จำนวนเหตุการณ์สูงสุดต่อชุด (ส่งทันทีเมื่อครบ)
+#define STATUS_FLUSH_MS 500    // ส่งชุดเมื่อเหตุการณ์เก่าสุดรอนานเกินนี้
+#define STATUS_RETRY_MS 1000   // ส่งซ้ำหากไม่ได้รับ ack ภายในเวลานี้
+#define STATUS_MSG_BUFFER 384  // ขนาด buffer กรอบสถานะ (รองรับ STATUS_BATCH_MAX เหตุการณ์ละ 43 ไบต์)
+#define STATUS_JOURNAL_SHARE 8 // log สถานะใช้ 1/8 ของ partition journal (อย่างน้อย 2 sector)
+
+enum StatusCode {
+  STATUS_DELIVERED = 1         // ส่งถึงหอพักแล้ว ("delivered to dorm <n>")
+};
+
+struct StatusEvent {
+  char tracking_number[TRACKING_MAX_LEN + 1]; // หมายเลขติดตาม
+  uint8_t code;                // รหัสสถานะ (StatusCode)
+  int dorm;                    // หมายเลขหอพัก
+  unsigned long queued_at;     // เวลาที่เข้าคิว (millis)
+};
+
+StatusEvent status_queue[STATUS_QUEUE_CAPACITY];
+uint32_t status_head = 0;      // เหตุการณ์เก่าสุดที่ยังไม่ได้รับ ack
+uint32_t status_tail = 0;      // ตำแหน่งถัดไปที่จะเขียน
+uint32_t status_inflight = 0;  // จำนวนเหตุการณ์ในชุดที่ส่งไปแล้วรอ ack
+uint16_t status_batch_id = 0;  // หมายเลขชุดล่าสุดที่ส่ง
+unsigned long status_sent_at = 0; // เวลาที่ส่งชุดล่าสุด (millis)
+size_t status_msg_len = 0;     // ความยาวกรอบของชุดที่รอ ack
+
+uint8_t status_msg_buf[STATUS_MSG_BUFFER];  // buffer ที่จองไว้ล่วงหน้าสำหรับกรอบสถานะ
+
+JournalLog status_journal = { JOURNAL_LOG_STATUS, 0, 2, 1, JOURNAL_RECORDS_PER_SECTOR, 0, false };
+
+static_assert(STATUS_QUEUE_CAPACITY + 2 <= JOURNAL_RECORDS_PER_SECTOR, "status snapshot must fit in one sector");
+
+#ifdef HEAP_CHECK
+int32_t status_heap_delta = 0; // ผลรวมหน่วยความจำ heap ที่ลดลงระหว่างส่งสถานะ (ควรเป็น 0)
+#endif
+
+/**
+ * ฟังก์ชันเข้ารหัสชุดเหตุการณ์สถานะลง buffer ที่กำหนด
+ * @param buf buffer ปลายทาง
+ * @param cap ขนาด buffer
+ * @param batch หมายเลขชุด
+ * @param first seq ของเหตุการณ์แรกในคิวสถานะ
+ * @param count จำนวนเหตุการณ์
+ * @return ความยาวกรอบ หรือ 0 หาก buffer ไม่พอ
+ */
+size_t encode_status_batch(uint8_t *buf, size_t cap, uint16_t batch, uint32_t first, uint32_t count) {
+  frame_begin(pi_frame, MSG_STATUS_BATCH);
+  frame_u16(pi_frame, batch);
+  frame_u8(pi_frame, (uint8_t)count);
+  for (uint32_t i = 0; i < count; i++) {
+    const StatusEvent &ev = status_queue[(first + i) & STATUS_QUEUE_MASK];
+    frame_u8(pi_frame, ev.code);
+    frame_u16(pi_frame, (uint16_t)(int16_t)ev.dorm);
+    frame_str(pi_frame, ev.tracking_number);
+  }
+  return frame_encode(pi_frame, buf, cap);
+}
+
+/**
+ * ฟังก์ชันส่งชุดสถานะที่รอ ack ไปยัง Pi
+ */
+void status_transmit(unsigned long now) {
+  hal_pi_write(status_msg_buf, status_msg_len);
+  status_sent_at = now;
+  TRACE_INFO(TR_STATUS_SENT, status_batch_id, status_inflight);
+}
+
+/**
+ * ฟังก์ชันเติม record ของ log สถานะ
+ * @param type J_STATUS (เหตุการณ์ที่ seq) J_STATUS_ACK หรือ J_SNAPSHOT_END (seq = status_head)
+ */
+void status_journal_record(JournalRecord &rec, uint8_t type, uint32_t seq) {
+  memset(&rec, 0, sizeof(rec));
+  rec.type = type;
+  rec.seq = seq;
+  if (type != J_STATUS) return;
+  const StatusEvent &ev = status_queue[seq & STATUS_QUEUE_MASK];
+  rec.gate = (int8_t)ev.code;
+  rec.dorm = ev.dorm;
+  tracking_copy(rec.tracking_number, ev.tracking_number);
+}
+
+/**
+ * ฟังก์ชันเขียน snapshot ของคิวสถานะลง sector ถัดไปของ log สถานะ (compaction)
+ */
+void status_journal_compact() {
+  JournalRecord rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.dorm = JOURNAL_VERSION;
+  journal_begin_sector(status_journal, rec);
+  for (uint32_t seq = status_head; seq != status_tail; seq++) {
+    status_journal_record(rec, J_STATUS, seq);
+    journal_append(status_journal, rec);
+  }
+  status_journal_record(rec, J_SNAPSHOT_END, status_head);
+  journal_append(status_journal, rec);
+}
+
+/**
+ * ฟังก์ชันบันทึกการเปลี่ยนแปลงของคิวสถานะลง flash (task comms - เรียกหลังเปลี่ยนคิวแล้ว)
+ */
+void status_journal_log(uint8_t type, uint32_t seq) {
+  if (status_journal.count >= JOURNAL_RECORDS_PER_SECTOR) {
+    status_journal_compact();                    // snapshot รวมผลของ record นี้แล้ว
+    return;
+  }
+  JournalRecord rec;
+  status_journal_record(rec, type, seq);
+  journal_append(status_journal, rec);
+}
+
+/**
+ * ฟังก์ชันอัพเดทสถานะการส่งพัสดุไปยังเซิร์ฟเวอร์ (task real-time)
+ * ส่งต่อให้ task comms ผ่านคิว แล้วจะถูกส่งรวมเป็นชุดโดย status_update()
+ * @param trackingNumber หมายเลขติดตามพัสดุ
+ * @param code รหัสสถานะ (StatusCode)
+ * @param dorm หมายเลขหอพัก
+ */
+void updateTrackingStatusOnServer(const char *trackingNumber, uint8_t code, int dorm) {
+  CommsMsg msg;
+  msg.type = COMMS_STATUS;
+  msg.code = code;
+  msg.dorm = dorm;
+  tracking_copy(msg.tracking_number, trackingNumber);
+  if (!rt_to_comms.push(msg)) {
+    TRACE_WARN(TR_COMMS_FULL, COMMS_STATUS, dorm);
+  }
+}
+
+/**
+ * ฟังก์ชันเพิ่มเหตุการณ์สถานะลงคิวขาออก (task comms)
+ * หากหมายเลขติดตามเดียวกันยังรอส่งอยู่ จะแทนที่ด้วยสถานะใหม่
+ * @param trackingNumber หมายเลขติดตามพัสดุ
+ * @param code รหัสสถานะ (StatusCode)
+ * @param dorm หมายเลขหอพัก
+ */
+void status_enqueue(const char *trackingNumber, uint8_t code, int dorm) {
+  // รวมกับเหตุการณ์ที่ยังไม่ได้ส่ง (ไม่แตะชุดที่รอ ack)
+  for (uint32_t i = status_head + status_inflight; i != status_tail; i++) {
+    StatusEvent &ev = status_queue[i & STATUS_QUEUE_MASK];
+    if (strncmp(ev.tracking_number, trackingNumber, TRACKING_MAX_LEN) == 0) {
+      ev.code = code;
+      ev.dorm = dorm;
+      status_journal_log(J_STATUS, i);
+      return;
+    }
+  }
+
+  if (status_tail - status_head >= STATUS_QUEUE_CAPACITY) {
+    TRACE_WARN(TR_STATUS_FULL, dorm, 0);
+    return;
+  }
+
+  StatusEvent &ev = status_queue[status_tail & STATUS_QUEUE_MASK];
+  tracking_copy(ev.tracking_number, trackingNumber);
+  ev.code = code;
+  ev.dorm = dorm;
+  ev.queued_at = hal_millis();
+  status_tail++;
+  status_journal_log(J_STATUS, status_tail - 1);
+}
+
+/**
+ * ฟังก์ชันส่งชุดสถานะเมื่อถึงเงื่อนไข และส่งซ้ำหากไม่ได้รับ ack (task comms)
+ * @param now เวลาปัจจุบัน (millis)
+ */
+void status_update(unsigned long now) {
+  // มีชุดที่รอ ack อยู่ - ส่งซ้ำเมื่อหมดเวลา
+  if (status_inflight > 0) {
+    if (now - status_sent_at >= STATUS_RETRY_MS) {
+      TRACE_WARN(TR_STATUS_RETRY, status_batch_id, 0);
+      status_transmit(now);
+    }
+    return;
+  }
+
+  uint32_t pending = status_tail - status_head;
+  if (pending == 0) return;
+  if (pending < STATUS_BATCH_MAX &&
+      now - status_queue[status_head & STATUS_QUEUE_MASK].queued_at < STATUS_FLUSH_MS) return;
+
+  uint32_t count = pending < STATUS_BATCH_MAX ? pending : STATUS_BATCH_MAX;
+
+#ifdef HEAP_CHECK
+  uint32_t heap_before = hal_free_heap();
+#endif
+
+  // สร้างกรอบสถานะ
+  size_t len = encode_status_batch(status_msg_buf, STATUS_MSG_BUFFER, status_batch_id + 1, status_head, count);
+  if (len == 0) {
+    TRACE_WARN(TR_STATUS_TOO_LONG, status_head, 0);
+    status_head++;                               // ทิ้งเหตุการณ์ที่เข้ารหัสไม่ได้
+    status_journal_log(J_STATUS_ACK, status_head);
+    return;
+  }
+
+  status_batch_id++;
+  status_inflight = count;
+  status_msg_len = len;
+  status_transmit(now);                          // ส่งไป Raspberry Pi ผ่าน UART
+
+#ifdef HEAP_CHECK
+  status_heap_delta += (int32_t)(heap_before - hal_free_heap());
+#endif
+}
+
+/**
+ * ฟังก์ชันรับ ack ของชุดสถานะจาก Pi
+ * @param batch หมายเลขชุดที่ยืนยัน
+ */
+void status_ack(uint16_t batch) {
+  if (status_inflight == 0 || batch != status_batch_id) return;  // ack ซ้ำหรือเก่า
+  status_head += status_inflight;
+  status_inflight = 0;
+  status_journal_log(J_STATUS_ACK, status_head);
+}
+
+struct StatusJournalState {
+  StatusEvent events[STATUS_QUEUE_CAPACITY];     // ตำแหน่งจริงคือ seq & STATUS_QUEUE_MASK เหมือนคิวสถานะ
+  uint32_t head;
+  uint32_t tail;
+};
+
+/**
+ * ฟังก์ชันเปลี่ยนสำเนาของคิวสถานะตาม record ของ log สถานะ (ตอนกู้คืน)
+ */
+void status_journal_apply(StatusJournalState &st, const JournalRecord &rec) {
+  switch (rec.type) {
+    case J_SECTOR:
+      memset(&st, 0, sizeof(st));
+      break;
+    case J_STATUS: {
+      StatusEvent &ev = st.events[rec.seq & STATUS_QUEUE_MASK];
+      tracking_copy(ev.tracking_number, rec.tracking_number);
+      ev.code = (uint8_t)rec.gate;
+      ev.dorm = rec.dorm;
+      if ((int32_t)(rec.seq + 1 - st.tail) > 0) st.tail = rec.seq + 1;  // เหตุการณ์ที่รวมแล้วมี seq เดิม
+      break;
+    }
+    case J_SNAPSHOT_END:
+    case J_STATUS_ACK:
+      st.head = rec.seq;
+      if ((int32_t)(st.head - st.tail) > 0) st.tail = st.head;
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+ * ฟังก์ชันกู้คืนคิวสถานะจาก flash (เรียกจาก journal_restore)
+ * ชุดที่ส่งไปก่อนรีเซ็ตแต่ยังไม่ได้รับ ack ถูกส่งใหม่เป็นชุดใหม่ - Pi บันทึกสถานะซ้ำได้โดยไม่เปลี่ยนผล
+ */
+void status_restore() {
+  StatusJournalState st;
+  if (!journal_load(status_journal, st, status_journal_apply, 0)) {
+    memset(&st, 0, sizeof(st));
+  }
+  memcpy(status_queue, st.events, sizeof(status_queue));
+  status_head = st.head;
+  status_tail = st.tail;
+  status_inflight = 0;
+  for (uint32_t seq = status_head; seq != status_tail; seq++) {
+    status_queue[seq & STATUS_QUEUE_MASK].queued_at = hal_millis();
+  }
+
+  TRACE_INFO(TR_STATUS_RESTORED, status_tail - status_head, status_journal.generation);
+  status_journal_compact();                      // เริ่ม sector ใหม่จากสถานะที่กู้คืน
+}
+
+// === รับข้อความจาก Pi แบบไม่บล็อก ===
+uint8_t pi_rx_buf[PI_WIRE_MAX];  // buffer รับกรอบจาก Pi (ถอดรหัสทับในที่เดิม)
+size_t pi_rx_len = 0;
+bool pi_rx_overflow = false;     // กำลังทิ้งกรอบที่ยาวเกิน รอตัวคั่นถัดไป
+
+/**
+ * ฟังก์ชันจัดการกรอบจาก Pi หนึ่งกรอบ
+ * @param frame ข้อมูลกรอบที่เข้ารหัส COBS (ไม่รวมตัวคั่น) - ถูกถอดรหัสทับ
+ * @param len ความยาวข้อมูล
+ */
+void pi_handle_frame(uint8_t *frame, size_t len) {
+  size_t n = cobs_decode(frame, len);
+  if (n == 0) {
+    TRACE_WARN(TR_PI_FRAME_BAD, PI_FRAME_COBS, len);
+    return;
+  }
+  if (n < 3 || crc16_ccitt(frame, n - 2) != rd_u16(frame + n - 2)) {
+    TRACE_WARN(TR_PI_FRAME_BAD, PI_FRAME_CRC, n);  // ข้อมูลเสียระหว่างทาง
+    return;
+  }
+
+  uint8_t type = frame[0];
+  const uint8_t *body = frame + 1;
+  size_t body_len = n - 3;
+  TRACE_DEBUG(TR_PI_FRAME, n, type);
+
+  switch (type) {
+    case MSG_QR_RESULT:
+      qr_handle_response(body, body_len);        // ผล QR
+      break;
+    case MSG_ACK:
+      if (body_len >= 2) status_ack(rd_u16(body));  // ยืนยันชุดสถานะ
+      else TRACE_WARN(TR_PI_MSG_SHORT, type, body_len);
+      break;
+    case MSG_DORM_FULL:
+      dorm_handle_full(body, body_len);          // ตารางหอพักทั้งตาราง
+      break;
+    case MSG_DORM_DELTA:
+      dorm_handle_delta(body, body_len);         // การเปลี่ยนแปลงของตารางหอพัก
+      break;
+    default:
+      TRACE_WARN(TR_PI_FRAME_BAD, PI_FRAME_TYPE, type);
+      break;
+  }
+}
+
+/**
+ * ฟังก์ชันรับข้อความจาก task real-time แล้วส่งต่อ (task comms)
+ */
+void comms_drain() {
+  CommsMsg msg;
+  while (rt_to_comms.pop(msg)) {
+    switch (msg.type) {
+      case COMMS_QR_REQUEST:
+        if (msg.timestamped) {
+          requestQRFromPi(msg.lane, msg.seq, (hal_micros() - msg.time_us) / 1000);
+        } else {
+          requestQRFromPi(msg.lane, msg.seq);
+        }
+        break;
+      case COMMS_STATUS:
+        status_enqueue(msg.tracking_number, msg.code, msg.dorm);
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+/**
+ * ฟังก์ชันอ่านข้อมูลจาก Pi ที่มีอยู่ใน UART โดยไม่รอ
+ */
+void pi_poll() {
+  int avail;
+  while ((avail = hal_pi_available()) > 0) {
+    if (pi_rx_len == PI_WIRE_MAX) {              // ไม่พบตัวคั่นใน buffer เต็ม - ทิ้งกรอบนี้
+      TRACE_WARN(TR_PI_FRAME_BAD, PI_FRAME_OVERFLOW, pi_rx_len);
+      pi_rx_len = 0;
+      pi_rx_overflow = true;
+    }
+    size_t room = PI_WIRE_MAX - pi_rx_len;
+    size_t got = hal_pi_read_bytes(pi_rx_buf + pi_rx_len, (size_t)avail < room ? avail : room);
+    if (got == 0) break;
+    record_pi(pi_rx_buf + pi_rx_len, got, hal_micros());
+
+    // แยกกรอบตามตัวคั่น แล้วเลื่อนข้อมูลที่ยังไม่ครบกรอบไปต้น buffer
+    size_t start = 0;
+    for (size_t i = pi_rx_len; i < pi_rx_len + got; i++) {
+      if (pi_rx_buf[i] != 0) continue;
+      if (!pi_rx_overflow && i > start) pi_handle_frame(pi_rx_buf + start, i - start);
+      pi_rx_overflow = false;
+      start = i + 1;
+    }
+    pi_rx_len = pi_rx_len + got - start;
+    memmove(pi_rx_buf, pi_rx_buf + start, pi_rx_len);
+  }
+}
+
+// === ตำแหน่งสายพาน (odometer) ===
+// ตำแหน่งของพัสดุคำนวณจากระยะที่สายพานเคลื่อนไปตั้งแต่พัสดุผ่าน IR หลัก
+// ใช้เวลาที่สายพานเดิน x ความเร็ว หรือนับพัลส์จาก encoder หากกำหนด BELT_ENCODER_PIN
+// encoder ไม่บอกทิศ: พัลส์ของแต่ละช่วงถูกสะสมตามทิศที่สั่งเดินล่าสุด (ช่วงใหม่เริ่มทุกครั้งที่ belt_apply เปลี่ยน duty)
+#define BELT_SPEED_MM_S 120.0f // ความเร็วสายพานที่ PWM เต็ม (มิลลิเมตร/วินาที) - ต้องวัดจริง
+#define GATE_TOLERANCE_MM 60.0f // ระยะคลาดเคลื่อนที่ยอมรับเมื่อจับคู่พัสดุกับประตู
+// #define BELT_ENCODER_PIN 19  // ขา encoder ของล้อสายพาน (ไม่บังคับ)
+// #define BELT_MM_PER_PULSE 1.0f // ระยะต่อหนึ่งพัลส์ของ encoder
+
+#if defined(BELT_ENCODER_PIN) && LANE_LAYOUT != 1
+#error "BELT_ENCODER_PIN supports a single lane only"
+#endif
+
+#ifdef BELT_ENCODER_PIN
+volatile uint32_t belt_encoder_pulses = 0;  // จำนวนพัลส์จาก encoder (สายพานแรก)
+
+void IRAM_ATTR belt_encoder_isr() { belt_encoder_pulses++; }
+#endif
+
+/**
+ * ฟังก์ชันคำนวณตำแหน่งสายพาน ณ เวลาที่กำหนด
+ * @param lane สายพาน
+ * @param time_us เวลา (micros)
+ */
+float belt_position_at(const Lane &lane, uint32_t time_us) {
+#ifdef BELT_ENCODER_PIN
+  (void)time_us;
+  int32_t pulses = (int32_t)(belt_encoder_pulses - lane.belt_odometer_pulses);  // encoder ไม่บอกทิศ
+  return lane.belt_odometer_mm + lane.belt_encoder_sign * pulses * BELT_MM_PER_PULSE;
+#else
+  int32_t dt = (int32_t)(time_us - lane.belt_odometer_us);  // ติดลบได้หาก event เกิดก่อนการอัพเดทล่าสุด
+  return lane.belt_odometer_mm + lane.belt_speed_mm_s * dt * 1e-6f;
+#endif
+}
+
+/**
+ * ฟังก์ชันสะสมระยะทางสายพานจนถึงปัจจุบัน (เรียกก่อนเปลี่ยนความเร็ว)
+ */
+void belt_odometer_update(Lane &lane) {
+  uint32_t now = hal_micros();
+#ifdef BELT_ENCODER_PIN
+  uint32_t pulses = belt_encoder_pulses;         // อ่านครั้งเดียว - ISR เพิ่มค่าได้ตลอด
+  lane.belt_odometer_mm += lane.belt_encoder_sign * (int32_t)(pulses - lane.belt_odometer_pulses) * BELT_MM_PER_PULSE;
+  lane.belt_odometer_pulses = pulses;
+#else
+  lane.belt_odometer_mm = belt_position_at(lane, now);
+#endif
+  lane.belt_odometer_us = now;
+}
+
+// === โปรไฟล์ความเร็วสายพาน (soft-start และลดความเร็วก่อนถึงประตู) ===
+// การเร่ง/ลดความเร็วทำทีละน้อยใน belt_update() ที่เรียกจาก task real-time โดยไม่บล็อก
+// การหยุดยังคงหยุดทันทีเพื่อให้พัสดุหยุดตรงหน้าประตู
+// แต่ละสายพานมี PWM channel ของตัวเอง การหยุดสายพานหนึ่งไม่กระทบสายพานอื่น
+// ค่าทั้งหมดกำหนดทับได้ตอน compile (tools/bench_belt.cpp build แบบเดิมที่เร่งเต็มทันทีด้วยค่าเหล่านี้)
+#ifndef BELT_DUTY_CRUISE
+#define BELT_DUTY_CRUISE 255   // duty ปกติ
+#endif
+#ifndef BELT_DUTY_SLOW
+#define BELT_DUTY_SLOW 140     // duty เมื่อพัสดุกำลังเข้าใกล้ประตูที่ต้องผลัก
+#endif
+#ifndef BELT_DUTY_MIN
+#define BELT_DUTY_MIN 90       // duty เริ่มต้นที่มอเตอร์เริ่มหมุนได้
+#endif
+#ifndef BELT_RAMP_DUTY_PER_MS
+#define BELT_RAMP_DUTY_PER_MS 0.5f // อัตราเปลี่ยน duty (ต่อมิลลิวินาที)
+#endif
+#ifndef BELT_SLOW_ZONE_MM
+#define BELT_SLOW_ZONE_MM 80.0f // ระยะก่อนถึงประตูที่เริ่มลดความเร็ว
+#endif
+
+/**
+ * ฟังก์ชันเขียน duty ลง PWM และอัพเดทความเร็วที่ใช้คำนวณตำแหน่ง
+ */
+void belt_apply(Lane &lane, uint8_t duty) {
+  belt_odometer_update(lane);                    // ปิดช่วงความเร็วเดิมก่อนเปลี่ยน
+  lane.belt_speed_mm_s = lane.belt_direction * BELT_SPEED_MM_S * duty / 255.0f;
+  lane.belt_duty_applied = duty;
+  hal_pwm_write(LANES[lane.id].pwm_channel, duty);
+}
+
+/**
+ * ฟังก์ชันเลือก duty เป้าหมายตามตำแหน่งพัสดุ
+ * ลดความเร็วเมื่อมีพัสดุที่ต้องผลักอยู่ในระยะ BELT_SLOW_ZONE_MM ก่อนถึงประตู
+ */
+uint8_t belt_profile_duty(const Lane &lane) {
+  float belt_mm = belt_position_at(lane, hal_micros());
+  int last_gate = lane_last_gate(lane.id);
+
+  for (uint32_t seq = lane.queue_head; seq != lane.queue_tail; seq++) {
+    const ParcelSlot &slot = queue_slot(lane, seq);
+    if (!slot.active) continue;
+
+    float pos_mm = belt_mm - slot.intake_mm;
+    int first = slot.last_gate >= 0 ? slot.last_gate + 1 : LANES[lane.id].first_gate;
+    for (int g = first; g <= last_gate; g++) {
+      if (!gate_accepts(g, slot.dorm)) continue;
+      float to_gate = GATES[g].position_mm - pos_mm;
+      if (to_gate >= -GATE_TOLERANCE_MM && to_gate <= BELT_SLOW_ZONE_MM) return BELT_DUTY_SLOW;
+      break;                                     // สนใจเฉพาะประตูที่จะผลักจริง
+    }
+  }
+  return BELT_DUTY_CRUISE;
+}
+
+/**
+ * ฟังก์ชันบันทึกจุดเริ่มช่วงการเดินของสายพานลง journal (task real-time)
+ * ภายในช่วงเดียวกัน duty ramp เข้าหา belt_target ด้วยอัตราคงที่ ตำแหน่งจึงคำนวณจากเวลาได้ (journal_belt_mm)
+ */
+void journal_belt_log(const Lane &lane) {
+  int packed = (uint8_t)lane.belt_duty | lane.belt_target << 8;
+  journal_log(lane.id, J_BELT, hal_millis(), packed, NULL, lane.belt_direction, belt_position_at(lane, hal_micros()));
+}
+
+/**
+ * ฟังก์ชันปรับ duty ของสายพานเข้าหาเป้าหมายทีละน้อย (เรียกจาก task real-time)
+ * @param lane สายพาน
+ * @param now เวลาปัจจุบัน (millis)
+ */
+void belt_update(Lane &lane, unsigned long now) {
+  unsigned long dt = now - lane.belt_ramp_ms;
+  lane.belt_ramp_ms = now;
+  if (lane.belt_direction == 0) return;
+
+  uint8_t target = belt_profile_duty(lane);
+  if (target != lane.belt_target) {
+    lane.belt_target = target;
+    journal_belt_log(lane);                      // เริ่มช่วงใหม่ที่ ramp เข้าหาเป้าหมายใหม่
+  }
+  float step = BELT_RAMP_DUTY_PER_MS * dt;
+  if (lane.belt_duty < target) {
+    lane.belt_duty = lane.belt_duty + step > target ? target : lane.belt_duty + step;
+  } else if (lane.belt_duty > target) {
+    lane.belt_duty = lane.belt_duty - step < target ? target : lane.belt_duty - step;
+  }
+
+  uint8_t duty = (uint8_t)lane.belt_duty;
+  if (duty != lane.belt_duty_applied) belt_apply(lane, duty);
+}
+
+/**
+ * ฟังก์ชันควบคุมการเคลื่อนไหวของสายพาน
+ * การเดินหน้า/ถอยหลังเริ่มจาก BELT_DUTY_MIN แล้ว ramp ขึ้นใน belt_update()
+ * @param lane สายพาน
+ * @param fb_move ทิศทางการเคลื่อนไหว (-1=ถอยหลัง, 0=หยุด, 1=เดินหน้า)
+ */
+void convayer_move(Lane &lane, int fb_move) {
+  if (fb_move != 0 && fb_move == lane.belt_direction) return;  // กำลังเคลื่อนที่ทิศนี้อยู่แล้ว
+
+  const LaneConfig &cfg = LANES[lane.id];
+  lane.belt_direction = 0;
+  belt_apply(lane, 0);                           // หยุดก่อนเปลี่ยนทิศทาง
+
+  switch (fb_move) {
+    case -1: // ถอยหลัง
+      hal_digital_write(cfg.belt_in1, LOW);
+      hal_digital_write(cfg.belt_in2, HIGH);
+      TRACE_DEBUG(TR_BELT_MOVE, -1, lane.id);
+      break;
+
+    case 0: // หยุด
+      hal_digital_write(cfg.belt_in1, LOW);
+      hal_digital_write(cfg.belt_in2, LOW);
+      lane.belt_duty = 0;                        // ความเร็ว 0
+      lane.belt_target = 0;
+      TRACE_DEBUG(TR_BELT_MOVE, 0, lane.id);
+      journal_belt_log(lane);                    // บันทึกตำแหน่งที่สายพานหยุด
+      return;
+
+    case 1: // เดินหน้า
+      hal_digital_write(cfg.belt_in1, HIGH);
+      hal_digital_write(cfg.belt_in2, LOW);
+      TRACE_DEBUG(TR_BELT_MOVE, 1, lane.id);
+      break;
+
+    default:
+      return;
+  }
+
+  // soft-start จาก duty ต่ำสุด
+  lane.belt_direction = fb_move;
+  lane.belt_encoder_sign = fb_move;              // belt_apply(0) ด้านบนปิดช่วงของทิศเดิมแล้ว
+  lane.belt_duty = BELT_DUTY_MIN;
+  lane.belt_ramp_ms = hal_millis();
+  belt_apply(lane, BELT_DUTY_MIN);
+  lane.belt_target = belt_profile_duty(lane);
+  journal_belt_log(lane);
+}
+
+/**
+ * ฟังก์ชันควบคุมทิศทางมอเตอร์ผลักพัสดุ (ไม่รอเวลา)
+ * @param fb_move ทิศทางการเคลื่อนไหว (1=ผลัก, -1=ดึงกลับ, 0=หยุด)
+ * @param motor_id หมายเลขมอเตอร์ (1-NUM_GATES)
+ */
+void motor_move(int fb_move, int motor_id) {
+  if (motor_id < 1 || motor_id > NUM_GATES) return;  // หมายเลขมอเตอร์ไม่ถูกต้อง
+
+  // เลือกขา GPIO ตามตารางประตู
+  int IN_A = GATES[motor_id - 1].motor_in_a;
+  int IN_B = GATES[motor_id - 1].motor_in_b;
+
+  // ควบคุมทิศทางการหมุน
+  switch (fb_move) {
+    case 1: // หมุนไปข้างหน้า / ตามเข็มนาฬิกา
+      hal_digital_write(IN_A, HIGH);
+      hal_digital_write(IN_B, LOW);
+      break;
+    case -1: // หมุนถอยหลัง / ทวนเข็มนาฬิกา
+      hal_digital_write(IN_A, LOW);
+      hal_digital_write(IN_B, HIGH);
+      break;
+    case 0: // หยุด
+      hal_digital_write(IN_A, LOW);
+      hal_digital_write(IN_B, LOW);
+      break;
+    default: return;
+  }
+}
+
+// === State machine ของมอเตอร์ผลักแต่ละตัว (ผลักออก → ดึงกลับ → หยุด) ===
+// มอเตอร์ที่มี feedback (GateConfig.feedback) เปลี่ยนขั้นทันทีที่ถึงปลายทาง แทนการรอเวลาคงที่ในตาราง
+// เวลาที่วัดได้ถูกเรียนรู้แยกตามมอเตอร์และทิศทาง (baseline จาก stroke แรก ๆ แล้วติดตามด้วย EWMA)
+// เพื่อแจ้งเตือนเมื่อมอเตอร์ช้าลง หาก feedback ไม่ทำงานติดกันหลายครั้งจะกลับไปใช้เวลาคงที่จนกว่าจะรีเซ็ต
+#define PUSHER_BRAKE_MS 50     // เวลาหยุดมอเตอร์หลังดึงกลับ (มิลลิวินาที)
+#define PUSHER_CLEAR_MM 60.0f  // ระหว่างดึงกลับ พัสดุที่อยู่ห่างประตูน้อยกว่านี้ต้องรอให้ก้านผลักพ้นสายพาน
+#define PUSHER_BLANK_MS 80     // ไม่อ่าน feedback ช่วงแรกของ stroke (กระแส inrush ตอนเริ่มหมุน)
+#define PUSHER_END_US 2000     // ต้องพบปลายทางต่อเนื่องนานเท่านี้ (micros) - กรองสวิตช์เด้งและสัญญาณรบกวน
+                               // นับตามเวลาไม่ใช่จำนวนครั้งที่อ่าน เพราะ task real-time ตื่นถี่กว่า 1 ms เมื่อมีขอบ IR
+#define PUSHER_STALL_MV 1200   // PUSHER_FB_CURRENT: แรงดันที่ขา SENSE เมื่อมอเตอร์ชนปลายทาง - ต้องวัดจริง
+#define PUSHER_FEEDBACK_FAULTS 3 // จำนวน stroke ติดกันที่ไม่พบปลายทางก่อนเลิกใช้ feedback
+#define PUSHER_BASELINE_STROKES 8 // จำนวน stroke แรกที่ใช้เป็น baseline ของมอเตอร์
+#define PUSHER_LEARN_RATE 0.125f // น้ำหนักของ stroke ล่าสุดใน EWMA
+#define PUSHER_WORN_PCT 130    // แจ้งเตือนเมื่อเวลา stroke เกิน baseline เท่านี้ (%)
+#define PUSHER_WORN_CLEAR_PCT 115 // ล้างการแจ้งเตือนเมื่อกลับมาต่ำกว่านี้ (%)
+
+enum PusherState {
+  PUSHER_IDLE,                 // ว่าง
+  PUSHER_EXTEND,               // กำลังผลักออก
+  PUSHER_RETRACT,              // กำลังดึงกลับ
+  PUSHER_BRAKE                 // หยุดพักก่อนพร้อมใช้งาน
+};
+
+struct Pusher {
+  PusherState state;           // สถานะปัจจุบัน
+  unsigned long phase_start;   // เวลาเริ่มสถานะปัจจุบัน (millis)
+  unsigned long cycle_start;   // เวลาเริ่มผลัก (millis)
+  unsigned long extend_ms;     // ระยะเวลาผลักออก (สูงสุดเมื่อมี feedback)
+  unsigned long retract_ms;    // ระยะเวลาดึงกลับ (สูงสุดเมื่อมี feedback)
+  uint8_t pending;             // จำนวนคำสั่งผลักที่รออยู่
+  bool feedback_ok;            // ใช้ feedback ได้ (false = ใช้เวลาคงที่)
+  bool stroke_feedback;        // stroke ปัจจุบันหยุดด้วย feedback
+  bool end_seen;               // พบปลายทางต่อเนื่องตั้งแต่ end_since_us ใน stroke ปัจจุบัน
+  uint32_t end_since_us;       // เวลาที่พบปลายทางครั้งแรกของช่วงต่อเนื่อง (micros)
+  uint8_t misses[2];           // จำนวน stroke ติดกันที่ไม่พบปลายทาง [ผลักออก, ดึงกลับ]
+  uint8_t sense_level[2];      // ค่า feedback ล่าสุดที่อ่านได้ (สำหรับ RECORD_INPUTS)
+  uint16_t strokes[2];         // จำนวน stroke ที่วัดได้ [ผลักออก, ดึงกลับ] (หยุดนับที่ baseline)
+  float baseline_ms[2];        // เวลา stroke เฉลี่ยของ PUSHER_BASELINE_STROKES ครั้งแรก
+  float learned_ms[2];         // เวลา stroke ล่าสุดแบบ EWMA
+  bool worn;                   // แจ้งเตือนว่ามอเตอร์ช้าลงแล้ว
+};
+
+Pusher pushers[NUM_GATES];     // [มอเตอร์1, มอเตอร์2, ...] ของทุกสายพาน
+
+/**
+ * ฟังก์ชันอ่าน feedback ว่ามอเตอร์ผลักถึงปลายทางของทิศทางปัจจุบันหรือไม่ (ค่าดิบ ยังไม่กรอง)
+ * @param gate ลำดับประตู (0-based)
+ * @param state PUSHER_EXTEND หรือ PUSHER_RETRACT
+ */
+bool pusher_at_end(int gate, PusherState state) {
+  const GateConfig &cfg = GATES[gate];
+  Pusher &p = pushers[gate];
+  uint8_t input = 0;
+  uint8_t level;
+  if (cfg.feedback == PUSHER_FB_CURRENT) {
+    level = hal_analog_read_mv(cfg.sense_out) >= PUSHER_STALL_MV;  // ชนปลายทางทั้งสองทิศทาง
+  } else {
+    input = state == PUSHER_EXTEND ? 0 : 1;
+    level = hal_digital_read(input == 0 ? cfg.sense_out : cfg.sense_in);
+  }
+  if (level != p.sense_level[input]) {
+    p.sense_level[input] = level;
+    record_feedback(gate * 2 + input, level, hal_micros());
+  }
+  return cfg.feedback == PUSHER_FB_CURRENT ? level : level == LOW;
+}
+
+/**
+ * ฟังก์ชันนับ stroke ที่ไม่พบปลายทาง และเลิกใช้ feedback เมื่อไม่พบติดกันหลายครั้ง
+ * (สวิตช์เสีย/ไม่ได้ต่อ หรือมอเตอร์ติดขัด)
+ */
+void pusher_miss(int gate) {
+  Pusher &p = pushers[gate];
+  int dir = p.state == PUSHER_EXTEND ? 0 : 1;
+  TRACE_WARN(TR_PUSHER_MISS, gate + 1, dir == 0 ? 1 : -1);
+  if (++p.misses[dir] >= PUSHER_FEEDBACK_FAULTS && p.feedback_ok) {
+    p.feedback_ok = false;                       // กลับไปใช้เวลาคงที่ในตาราง (ทั้งสองทิศทาง)
+    TRACE_WARN(TR_PUSHER_FEEDBACK_LOST, gate + 1, p.misses[dir]);
+  }
+}
+
+/**
+ * ฟังก์ชันเรียนรู้เวลา stroke ที่วัดได้ และแจ้งเตือนเมื่อมอเตอร์ช้าลงเทียบกับ baseline
+ * @param gate ลำดับประตู (0-based)
+ * @param stroke_ms เวลาตั้งแต่เริ่ม stroke จนถึงปลายทาง
+ */
+void pusher_learn(int gate, unsigned long stroke_ms) {
+  Pusher &p = pushers[gate];
+  int dir = p.state == PUSHER_EXTEND ? 0 : 1;
+  p.misses[dir] = 0;
+  TRACE_DEBUG(TR_PUSHER_STROKE, dir == 0 ? gate + 1 : -(gate + 1), stroke_ms);
+
+  if (p.strokes[dir] < PUSHER_BASELINE_STROKES) {
+    p.strokes[dir]++;
+    p.baseline_ms[dir] += (stroke_ms - p.baseline_ms[dir]) / p.strokes[dir];  // ค่าเฉลี่ยสะสม
+    p.learned_ms[dir] = p.baseline_ms[dir];
+    if (p.strokes[dir] == PUSHER_BASELINE_STROKES && p.strokes[1 - dir] == PUSHER_BASELINE_STROKES) {
+      TRACE_INFO(TR_PUSHER_BASELINE, gate + 1, (int32_t)p.baseline_ms[0] | (int32_t)p.baseline_ms[1] << 16);
+    }
+    return;
+  }
+  p.learned_ms[dir] += (stroke_ms - p.learned_ms[dir]) * PUSHER_LEARN_RATE;
+
+  int pct = (int)(p.learned_ms[dir] * 100 / p.baseline_ms[dir]);
+  if (!p.worn && pct >= PUSHER_WORN_PCT) {
+    p.worn = true;
+    TRACE_WARN(TR_PUSHER_WORN, gate + 1, pct);
+  } else if (p.worn && p.learned_ms[0] * 100 < p.baseline_ms[0] * PUSHER_WORN_CLEAR_PCT &&
+             p.learned_ms[1] * 100 < p.baseline_ms[1] * PUSHER_WORN_CLEAR_PCT) {
+    p.worn = false;                              // กลับมาปกติ (เช่น หลังบำรุงรักษา) - แจ้งใหม่ได้
+  }
+}
+
+/**
+ * ฟังก์ชันเปลี่ยนสถานะของมอเตอร์ผลัก
+ */
+void pusher_enter(int motor_id, PusherState state, unsigned long now) {
+  Pusher &p = pushers[motor_id - 1];
+  p.state = state;
+  p.phase_start = now;
+  p.end_seen = false;
+  switch (state) {
+    case PUSHER_EXTEND:  motor_move(1, motor_id);  break;
+    case PUSHER_RETRACT: motor_move(-1, motor_id); break;
+    default:             motor_move(0, motor_id);  return;
+  }
+
+  // สวิตช์ปลายทางที่ทำงานอยู่แล้วก่อนมอเตอร์เคลื่อน = สวิตช์ค้างหรือไม่ได้ต่อ - stroke นี้ใช้เวลาคงที่
+  p.stroke_feedback = p.feedback_ok;
+  if (p.feedback_ok && GATES[motor_id - 1].feedback == PUSHER_FB_LIMIT && pusher_at_end(motor_id - 1, state)) {
+    p.stroke_feedback = false;
+    pusher_miss(motor_id - 1);
+  }
+}
+
+/**
+ * ฟังก์ชันตรวจสอบว่า stroke ปัจจุบันเสร็จแล้วหรือไม่ (ถึงปลายทาง หรือครบเวลาสูงสุด)
+ * @param gate ลำดับประตู (0-based)
+ * @param elapsed เวลาตั้งแต่เริ่ม stroke (ms)
+ * @param limit_ms เวลา stroke ในตารางประตู
+ */
+bool pusher_stroke_done(int gate, unsigned long elapsed, unsigned long limit_ms) {
+  Pusher &p = pushers[gate];
+  if (p.stroke_feedback && elapsed >= PUSHER_BLANK_MS) {
+    uint32_t now_us = hal_micros();
+    if (!pusher_at_end(gate, p.state)) {
+      p.end_seen = false;
+    } else if (!p.end_seen) {
+      p.end_seen = true;
+      p.end_since_us = now_us;
+    } else if (now_us - p.end_since_us >= PUSHER_END_US) {
+      pusher_learn(gate, elapsed - (now_us - p.end_since_us) / 1000);  // เวลาที่พบปลายทางครั้งแรก
+      return true;
+    }
+  }
+  if (elapsed < limit_ms) return false;
+  if (p.stroke_feedback) pusher_miss(gate);      // ครบเวลาแต่ไม่พบปลายทาง
+  return true;
+}
+
+/**
+ * ฟังก์ชันสั่งผลักพัสดุ (ไม่บล็อก) - การเคลื่อนไหวจริงทำใน pusher_update()
+ * @param motor_id หมายเลขมอเตอร์ (1-NUM_GATES)
+ * @param extend_ms ระยะเวลาผลักออก (มิลลิวินาที) - เวลาสูงสุดหากมี feedback
+ * @param retract_ms ระยะเวลาดึงกลับ (มิลลิวินาที) - เวลาสูงสุดหากมี feedback
+ */
+void pusher_start(int motor_id, unsigned long extend_ms, unsigned long retract_ms) {
+  if (motor_id < 1 || motor_id > NUM_GATES) return;
+  Pusher &p = pushers[motor_id - 1];
+  p.extend_ms = extend_ms;
+  p.retract_ms = retract_ms;
+  if (p.state != PUSHER_IDLE) {
+    p.pending++;                                 // มอเตอร์ยังทำงานอยู่ - รอรอบถัดไป
+    return;
+  }
+  p.cycle_start = hal_millis();
+  pusher_enter(motor_id, PUSHER_EXTEND, p.cycle_start);
+}
+
+/**
+ * ฟังก์ชันตรวจสอบว่ามอเตอร์ผลักของสายพานต้องให้สายพานหยุดรออยู่หรือไม่
+ * ระหว่างผลักออกพัสดุยังอยู่บนสายพาน เมื่อเริ่มดึงกลับ (ถึงปลายทางหรือครบเวลาผลัก) พัสดุพ้นสายพานแล้ว
+ * สายพานจึงเดินต่อได้ทันที ยกเว้นมีพัสดุรอผลักรอบถัดไป หรือพัสดุชิ้นถัดไปใกล้ประตูนั้นจนอาจชนก้านผลักที่ยังดึงกลับไม่สุด
+ */
+bool pusher_holds_belt(const Lane &lane) {
+  float belt_mm = belt_position_at(lane, hal_micros());
+  for (int i = LANES[lane.id].first_gate; i <= lane_last_gate(lane.id); i++) {
+    if (pushers[i].state == PUSHER_IDLE) continue;
+    if (pushers[i].state == PUSHER_EXTEND || pushers[i].pending > 0) return true; // พัสดุที่รอผลักรอบถัดไปออกจากคิวแล้ว
+    for (uint32_t seq = lane.queue_head; seq != lane.queue_tail; seq++) {
+      const ParcelSlot &slot = queue_slot(lane, seq);
+      float to_gate_mm = GATES[i].position_mm - (belt_mm - slot.intake_mm);
+      if (slot.active && to_gate_mm >= 0 && to_gate_mm < PUSHER_CLEAR_MM) return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * ฟังก์ชันอัพเดท state machine ของมอเตอร์ผลักทุกตัว (เรียกจาก task real-time)
+ * @param now เวลาปัจจุบัน (millis)
+ */
+void pusher_update(unsigned long now) {
+  for (int i = 0; i < NUM_GATES; i++) {
+    Pusher &p = pushers[i];
+    unsigned long elapsed = now - p.phase_start;
+    switch (p.state) {
+      case PUSHER_EXTEND:
+        if (pusher_stroke_done(i, elapsed, p.extend_ms)) pusher_enter(i + 1, PUSHER_RETRACT, now);
+        break;
+      case PUSHER_RETRACT:
+        if (pusher_stroke_done(i, elapsed, p.retract_ms)) pusher_enter(i + 1, PUSHER_BRAKE, now);
+        break;
+      case PUSHER_BRAKE:
+        if (elapsed >= PUSHER_BRAKE_MS) {
+          metrics_record(METRIC_PUSHER_CYCLE, now - p.cycle_start);
+          if (p.pending > 0) {
+            p.pending--;
+            p.cycle_start = now;
+            pusher_enter(i + 1, PUSHER_EXTEND, now);
+          } else {
+            pusher_enter(i + 1, PUSHER_IDLE, now);
+          }
+        }
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+/**
+ * ฟังก์ชันตรวจสอบว่ามีพัสดุที่ยังไม่มีผล QR กำลังจะถึงประตูแรกของสายพานหรือไม่
+ */
+bool qr_pending_at_gate(const Lane &lane) {
+  float belt_mm = belt_position_at(lane, hal_micros());
+  float stop_mm = GATES[LANES[lane.id].first_gate].position_mm - QR_STOP_MARGIN_MM;
+
+  for (uint32_t seq = lane.queue_head; seq != lane.queue_tail; seq++) {
+    const ParcelSlot &slot = queue_slot(lane, seq);
+    if (slot.active && slot.dorm == QR_PENDING && belt_mm - slot.intake_mm >= stop_mm) return true;
+  }
+  return false;
+}
+
+/**
+ * ฟังก์ชันตรวจสอบว่ามีเหตุให้สายพานต้องหยุดรออยู่หรือไม่
+ */
+bool belt_blocked(const Lane &lane) {
+  return pusher_holds_belt(lane) || lane.intake_state != INTAKE_IDLE || qr_pending_at_gate(lane);
+}
+
+/**
+ * ฟังก์ชันเริ่มสายพานอีกครั้งหากไม่มีมอเตอร์ผลักทำงานอยู่และไม่ได้กำลังสแกน
+ */
+void conveyor_resume(Lane &lane) {
+  if (belt_blocked(lane)) {
+    lane.belt_held = true;                       // รอให้มอเตอร์ผลักหรือการสแกนเสร็จก่อน
+    return;
+  }
+  lane.belt_held = false;
+  convayer_move(lane, 1);
+}
+
+/**
+ * ฟังก์ชันแสดงสถานะของคิว (สำหรับ Debug)
+ */
+void show_queue(const Lane &lane) {
+#if TRACE_LEVEL >= TRACE_LEVEL_DEBUG
+  for (uint32_t seq = lane.queue_head; seq != lane.queue_tail; seq++) {
+    if (!queue_slot(lane, seq).active) continue; // ข้าม tombstone
+    TRACE_DEBUG(TR_QUEUE_SLOT, seq, queue_slot(lane, seq).dorm);
+  }
+#else
+  (void)lane;
+#endif
+}
+
+// === วัดอัตราการส่งพัสดุ (parcels/minute) ===
+// บันทึกอัตราของแต่ละสายพาน (TR_LANE_THROUGHPUT) และอัตรารวมของทุกสายพาน (TR_THROUGHPUT)
+#define THROUGHPUT_WINDOW_MS 60000 // ช่วงเวลาที่ใช้คำนวณอัตรา
+
+unsigned long throughput_window_start = 0;
+float throughput_ppm = 0;              // อัตรารวมล่าสุด (parcels/minute)
+
+/**
+ * ฟังก์ชันคำนวณและบันทึกอัตราการส่งพัสดุทุก THROUGHPUT_WINDOW_MS
+ * @param now เวลาปัจจุบัน (millis)
+ */
+void throughput_update(unsigned long now) {
+  unsigned long elapsed = now - throughput_window_start;
+  if (elapsed < THROUGHPUT_WINDOW_MS) return;
+
+  uint32_t total = 0;
+  for (int i = 0; i < NUM_LANES; i++) {
+    Lane &lane = lanes[i];
+    uint32_t count = lane.parcels_completed - lane.throughput_window_count;
+    lane.throughput_window_count = lane.parcels_completed;
+    total += count;
+    if (NUM_LANES > 1) TRACE_INFO(TR_LANE_THROUGHPUT, i, (int32_t)(count * 6000000.0f / elapsed));
+  }
+  throughput_ppm = total * 60000.0f / elapsed;
+  throughput_window_start = now;
+
+  TRACE_INFO(TR_THROUGHPUT, (int32_t)(throughput_ppm * 100), scan_continuous);
+}
+
+/**
+ * ฟังก์ชันผลักพัสดุออกจากสายพานไปยังหอพักที่กำหนด
+ * @param lane สายพานของพัสดุ
+ * @param dorm_box หมายเลขประตู (1-NUM_GATES)
+ * @param seq ลำดับของพัสดุในคิวที่อยู่หน้าประตู
+ */
+void push_box(Lane &lane, int dorm_box, uint32_t seq){
+  PROBE_BEGIN(push);
+  const GateConfig &gate = GATES[dorm_box - 1];
+  ParcelSlot &slot = queue_slot(lane, seq);
+  TRACE_DEBUG(TR_PUSH_BOX, seq, slot.dorm);
+  show_queue(lane);
+
+  if (gate_accepts(dorm_box - 1, slot.dorm)) {
+    convayer_move(lane, 0);                      // หยุดสายพาน
+
+    // อัพเดทสถานะ
+    updateTrackingStatusOnServer(slot.tracking_number.text, STATUS_DELIVERED, slot.dorm);
+
+    int removed = dequeueAt(lane, seq);
+    TRACE_INFO(TR_PUSH_DORM, dorm_box, removed);
+    lane.parcels_completed++;
+
+    show_queue(lane);                            // แสดงสถานะคิว
+
+    // ผลักพัสดุด้วยมอเตอร์ตามเวลาในตารางประตู
+    // สายพานจะเริ่มอีกครั้งเมื่อผลักออกเสร็จ (ไม่ต้องรอดึงกลับ ดู pusher_holds_belt)
+    pusher_start(dorm_box, gate.extend_ms, gate.retract_ms);
+    metrics_record(METRIC_GATE_TO_PUSH, hal_micros() - lane.gate_edge_us);
+    lane.belt_held = true;
+  }
+  else if (dorm_box - 1 == lane_last_gate(lane.id)) {
+    // กรณีพัสดุไม่ใช่ของหอพักใดที่ประตูสุดท้าย - ส่งต่อไปปลายสายพาน
+    int removed = dequeueAt(lane, seq);          // ไม่มีประตูสำหรับหอพักนี้
+    TRACE_INFO(TR_PUSH_NO_FORM, seq, removed);
+    lane.parcels_completed++;
+
+    show_queue(lane);                            // แสดงสถานะคิว
+  }
+  PROBE_END(METRIC_PUSH_BOX, push);
+}
+
+/**
+ * ฟังก์ชันหาพัสดุที่ควรอยู่หน้าประตู ณ เวลาที่ IR ตรวจพบ
+ * เลือกพัสดุที่ยังไม่ผ่านประตูนี้และมีตำแหน่งใกล้ประตูที่สุดภายในระยะ GATE_TOLERANCE_MM
+ * @param lane สายพานของประตู
+ * @param gate ลำดับประตู (0-based)
+ * @param time_us เวลาที่ IR ประตูตรวจพบ (micros)
+ * @return seq ของพัสดุ หรือ queue_tail หากไม่มี
+ */
+uint32_t gate_candidate(const Lane &lane, int gate, uint32_t time_us) {
+  float belt_mm = belt_position_at(lane, time_us);
+  uint32_t best = lane.queue_tail;
+  float best_err = GATE_TOLERANCE_MM;
+
+  for (uint32_t seq = lane.queue_head; seq != lane.queue_tail; seq++) {
+    const ParcelSlot &slot = queue_slot(lane, seq);
+    if (!slot.active || slot.last_gate >= gate) continue;
+
+    float err = fabsf(belt_mm - slot.intake_mm - GATES[gate].position_mm);
+    if (err <= best_err) {
+      best_err = err;
+      best = seq;
+    }
+  }
+  return best;
+}
+
+/**
+ * ฟังก์ชันจัดการเมื่อพัสดุถึงประตู
+ * @param lane สายพานของประตู
+ * @param gate ลำดับประตู (0-based)
+ * @param seq ลำดับของพัสดุในคิว
+ */
+void gate_arrived(Lane &lane, int gate, uint32_t seq) {
+  queue_slot(lane, seq).last_gate = gate;       // พัสดุผ่านประตูนี้แล้ว
+  journal_log(lane.id, J_GATE, seq, 0, NULL, gate, belt_position_at(lane, hal_micros()));
+
+  TRACE_INFO(TR_GATE, gate + 1, seq);
+
+  push_box(lane, gate + 1, seq);                // ผลักพัสดุที่ประตู
+}
+
+/**
+ * ฟังก์ชันนำพัสดุที่เลยประตูสุดท้ายไปแล้วออกจากคิว
+ * (เช่น ถูกหยิบออกด้วยมือ ติดขัด หรือ IR ประตูสุดท้ายไม่ตรวจพบ)
+ */
+void queue_expire_lost(Lane &lane) {
+  float belt_mm = belt_position_at(lane, hal_micros());
+  float limit_mm = GATES[lane_last_gate(lane.id)].position_mm + GATE_TOLERANCE_MM;
+
+  for (uint32_t seq = lane.queue_head; seq != lane.queue_tail; seq++) {
+    ParcelSlot &slot = queue_slot(lane, seq);
+    if (slot.active && belt_mm - slot.intake_mm > limit_mm) {
+      TRACE_WARN(TR_PARCEL_LOST, seq, lane.id);
+      dequeueAt(lane, seq);
+    }
+  }
+}
+
+/**
+ * ฟังก์ชันจัดการเมื่อ IR หลักตรวจพบพัสดุใหม่
+ * หยุดสายพานและจองช่องในคิวไว้ก่อน ผล QR จะถูกเติมเมื่อ Pi ตอบกลับ
+ * @param lane สายพานของ IR หลัก
+ * @param time_us เวลาที่ IR หลักตรวจพบ (micros)
+ */
+void intake_triggered(Lane &lane, uint32_t time_us) {
+  // โหมดหยุดสแกน: สายพานหยุดอยู่ พัสดุใหม่เข้ามาทาง IR หลักไม่ได้ (เช่นพัสดุขยับหรือวางซ้อนด้วยมือ)
+  // ไม่รับ เพื่อไม่ให้ทับ intake_seq ของพัสดุที่กำลังสแกน (ซึ่งจะค้างรอผล QR ที่ไม่ถูกขอ)
+  if (lane.intake_state != INTAKE_IDLE) {
+    TRACE_WARN(TR_INTAKE_BUSY, lane.intake_seq, lane.id);
+    return;
+  }
+  if (!enqueue(lane, QR_PENDING, "")) return;   // คิวเต็ม
+  uint32_t seq = lane.queue_tail - 1;
+  queue_slot(lane, seq).intake_mm = belt_position_at(lane, time_us);
+  journal_log(lane.id, J_ENQUEUE, seq, QR_PENDING, NULL, -1, queue_slot(lane, seq).intake_mm);
+
+  // โหมดสแกนต่อเนื่อง - ส่งเวลาที่ตรวจพบให้ Pi เลือกภาพเอง โดยไม่หยุดสายพาน
+  if (scan_continuous) {
+    qr_request(lane, seq, true, time_us);
+    TRACE_INFO(TR_INTAKE, seq, 1);
+    return;
+  }
+
+  convayer_move(lane, 0);                       // หยุดสายพานทันที (เฉพาะสายพานนี้)
+  lane.intake_seq = seq;
+  lane.intake_state = INTAKE_SETTLING;
+  lane.intake_since = hal_millis();
+  TRACE_INFO(TR_INTAKE, seq, 0);
+}
+
+/**
+ * ฟังก์ชันอัพเดทขั้นตอนการสแกนพัสดุใหม่ (เรียกจาก task real-time)
+ * @param lane สายพาน
+ * @param now เวลาปัจจุบัน (millis)
+ */
+void intake_update(Lane &lane, unsigned long now) {
+  switch (lane.intake_state) {
+    case INTAKE_SETTLING:
+      if (now - lane.intake_since >= QR_SETTLE_MS) {  // รอให้พัสดุอยู่ในตำแหน่งที่เสถียร
+        qr_request(lane, lane.intake_seq, false, 0);  // 👈 ขอข้อมูลจาก Pi ผ่าน task comms
+        lane.intake_state = INTAKE_CAPTURING;
+        lane.intake_since = now;
+      }
+      break;
+    case INTAKE_CAPTURING:
+      if (now - lane.intake_since >= QR_CAPTURE_MS) {
+        lane.intake_state = INTAKE_IDLE;
+        conveyor_resume(lane);                   // เริ่มสายพานอีกครั้ง
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+ * ฟังก์ชันจัดการเมื่อ IR ประตูตรวจพบพัสดุ
+ * @param gate ลำดับประตู (0-based)
+ * @param time_us เวลาที่ IR ประตูตรวจพบ (micros)
+ */
+void gate_triggered(int gate, uint32_t time_us) {
+  Lane &lane = lanes[gate_lane(gate)];
+  if (lane.size == 0) return;                   // ไม่มีพัสดุในคิว
+
+  lane.gate_edge_us = time_us;
+  uint32_t seq = gate_candidate(lane, gate, time_us);
+  if (seq != lane.queue_tail) {
+    gate_arrived(lane, gate, seq);              // ผลักพัสดุที่ประตู
+  } else {
+    TRACE_WARN(TR_GATE_UNEXPECTED, gate + 1, lane.id);  // IR ซ้ำ หรือพัสดุที่ไม่อยู่ในคิว
+  }
+}
+
+// === เขียน journal ลง flash และกู้คืนคิว (task comms / setup) ===
+// task comms เก็บสำเนาของคิวที่สร้างจาก record เดียวกับที่เขียนลง flash (journal_state)
+// จึงเขียน snapshot ตอน compaction ได้โดยไม่ต้องแตะคิวของ task real-time
+// การลบ sector ทำให้ cache ของ flash หยุดชั่วขณะทั้งสอง core จึงลบ sector ถัดไปล่วงหน้าตอนคิวว่าง
+struct JournalSlot {
+  bool active;                 // ยังอยู่บนสายพาน
+  int16_t dorm;                // หมายเลขหอพัก
+  int8_t last_gate;            // ประตูล่าสุดที่ผ่าน
+  float intake_mm;             // ตำแหน่งสายพานตอนผ่าน IR หลัก
+  char tracking_number[TRACKING_MAX_LEN + 1];
+};
+
+struct JournalBelt {
+  float mm;                    // ตำแหน่งสายพานตอนเริ่มช่วง
+  uint32_t ms;                 // เวลาที่เริ่มช่วง (millis ของ boot ที่บันทึก)
+  int8_t direction;            // -1, 0, 1
+  uint8_t duty;                // duty ตอนเริ่มช่วง
+  uint8_t target;              // duty ที่ ramp เข้าหา
+};
+
+struct JournalLane {
+  JournalSlot slots[QUEUE_CAPACITY]; // ตำแหน่งจริงคือ seq & QUEUE_MASK เหมือนคิวหลัก
+  uint32_t tail;               // seq ถัดไปที่จะเขียน
+  float belt_mm;               // ตำแหน่งสายพานจาก record ล่าสุดของสายพานนี้
+  JournalBelt belt;            // ช่วงการเดินล่าสุด
+};
+
+struct JournalState {
+  JournalLane lanes[NUM_LANES];
+  uint8_t version;             // JOURNAL_VERSION ของ sector ที่อ่าน
+  uint32_t last_ms;            // เวลาของ J_BELT ล่าสุดของทุกสายพาน
+};
+
+static_assert(1 + NUM_LANES * (QUEUE_CAPACITY + 2) <= JOURNAL_RECORDS_PER_SECTOR, "snapshot must fit in one sector");
+
+JournalState journal_state;    // สำเนาของคิว (task comms)
+JournalLog queue_journal = { JOURNAL_LOG_QUEUE, 0, 2, 1, JOURNAL_RECORDS_PER_SECTOR, 0, false };
+
+/**
+ * ฟังก์ชันคำนวณตำแหน่งสายพาน ณ เวลา ms จากช่วงการเดิน (ramp เชิงเส้นแบบ belt_update แล้วคงที่ที่เป้าหมาย)
+ */
+float journal_belt_mm(const JournalBelt &belt, uint32_t ms) {
+  int32_t dt = (int32_t)(ms - belt.ms);
+  if (belt.direction == 0 || dt <= 0) return belt.mm;
+  float delta = (float)belt.target - belt.duty;
+  float ramp_ms = fabsf(delta) / BELT_RAMP_DUTY_PER_MS;
+  float duty_ms;                                 // พื้นที่ใต้กราฟ duty (duty x ms)
+  if (dt <= ramp_ms) {
+    duty_ms = dt * (belt.duty + (delta < 0 ? -0.5f : 0.5f) * BELT_RAMP_DUTY_PER_MS * dt);
+  } else {
+    duty_ms = ramp_ms * (belt.duty + belt.target) / 2 + (dt - ramp_ms) * belt.target;
+  }
+  return belt.mm + belt.direction * BELT_SPEED_MM_S * duty_ms / (255.0f * 1000.0f);
+}
+
+/**
+ * ฟังก์ชันหาตำแหน่งสายพานล่าสุดที่ทราบ: record ล่าสุดของสายพาน หรือช่วงการเดิน ณ J_BELT ล่าสุดของทุกสายพาน
+ * เลือกค่าที่ไปทางทิศการเดินมากกว่า (ทั้งสองค่าไม่เลยตำแหน่งจริง)
+ */
+float journal_belt_position(const JournalState &st, const JournalLane &jl) {
+  float mm = journal_belt_mm(jl.belt, st.last_ms);
+  return jl.belt.direction * (mm - jl.belt_mm) > 0 ? mm : jl.belt_mm;
+}
+
+/**
+ * ฟังก์ชันเปลี่ยนสำเนาของคิวตาม record (ใช้ทั้งตอนเขียนและตอนกู้คืน)
+ */
+void journal_apply(JournalState &st, const JournalRecord &rec) {
+  if (rec.lane >= NUM_LANES) return;             // journal จากผังสายพานอื่น
+  JournalLane &jl = st.lanes[rec.lane];
+  JournalSlot &slot = jl.slots[rec.seq & QUEUE_MASK];
+  switch (rec.type) {
+    case J_SECTOR:
+      memset(&st, 0, sizeof(st));
+      st.version = rec.dorm;
+      st.lanes[0].belt_mm = rec.mm;              // journal ก่อนมีหลายสายพานไม่มี J_BELT ใน snapshot
+      break;
+    case J_SLOT:
+    case J_ENQUEUE:
+      slot.active = true;
+      slot.dorm = rec.dorm;
+      slot.last_gate = rec.gate;
+      slot.intake_mm = rec.mm;
+      tracking_copy(slot.tracking_number, rec.tracking_number);
+      if (rec.type == J_ENQUEUE) {
+        jl.tail = rec.seq + 1;
+        jl.belt_mm = rec.mm;
+      }
+      break;
+    case J_SNAPSHOT_END:
+      jl.tail = rec.seq;
+      if (st.version >= JOURNAL_VERSION) jl.belt_mm = rec.mm;
+      break;
+    case J_QR:
+      if (st.version >= JOURNAL_VERSION) jl.belt_mm = rec.mm;
+      if (!slot.active) break;
+      slot.dorm = rec.dorm;
+      tracking_copy(slot.tracking_number, rec.tracking_number);
+      break;
+    case J_GATE:
+      if (slot.active) slot.last_gate = rec.gate;
+      jl.belt_mm = rec.mm;
+      break;
+    case J_DEQUEUE:
+      slot.active = false;
+      jl.belt_mm = rec.mm;
+      break;
+    case J_BELT:
+      jl.belt_mm = rec.mm;
+      if (st.version < JOURNAL_VERSION) break;   // journal เดิม: ตำแหน่งอย่างเดียว
+      jl.belt.mm = rec.mm;
+      jl.belt.ms = rec.seq;
+      jl.belt.direction = rec.gate;
+      jl.belt.duty = (uint16_t)rec.dorm & 0xFF;
+      jl.belt.target = (uint16_t)rec.dorm >> 8;
+      if ((int32_t)(rec.seq - st.last_ms) > 0) st.last_ms = rec.seq;
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+ * ฟังก์ชันเขียน snapshot ของ journal_state ลง sector ถัดไป (compaction)
+ */
+void journal_compact() {
+  JournalRecord rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.dorm = JOURNAL_VERSION;
+  rec.mm = journal_state.lanes[0].belt_mm;
+  journal_begin_sector(queue_journal, rec);
+
+  uint8_t parcels = 0;
+  for (uint8_t lane = 0; lane < NUM_LANES; lane++) {
+    JournalLane &jl = journal_state.lanes[lane];
+    jl.belt_mm = journal_belt_position(journal_state, jl);  // J_BELT ของสายพานอื่นใน snapshot อาจเก่ากว่า last_ms
+    memset(&rec, 0, sizeof(rec));
+    rec.type = J_BELT;
+    rec.lane = lane;
+    rec.seq = jl.belt.ms;
+    rec.gate = jl.belt.direction;
+    rec.dorm = jl.belt.duty | jl.belt.target << 8;
+    rec.mm = jl.belt.mm;
+    journal_append(queue_journal, rec);
+
+    for (uint32_t seq = jl.tail - QUEUE_CAPACITY; seq != jl.tail; seq++) {
+      const JournalSlot &slot = jl.slots[seq & QUEUE_MASK];
+      if (!slot.active) continue;
+      memset(&rec, 0, sizeof(rec));
+      rec.type = J_SLOT;
+      rec.lane = lane;
+      rec.seq = seq;
+      rec.dorm = slot.dorm;
+      rec.gate = slot.last_gate;
+      rec.mm = slot.intake_mm;
+      tracking_copy(rec.tracking_number, slot.tracking_number);
+      journal_append(queue_journal, rec);
+      parcels++;
+    }
+
+    memset(&rec, 0, sizeof(rec));
+    rec.type = J_SNAPSHOT_END;
+    rec.lane = lane;
+    rec.seq = jl.tail;
+    rec.mm = jl.belt_mm;
+    journal_append(queue_journal, rec);                         // snapshot สมบูรณ์เมื่อเขียนของสายพานสุดท้ายเสร็จ
+  }
+
+  TRACE_INFO(TR_JOURNAL_COMPACT, queue_journal.generation, parcels);
+}
+
+/**
+ * ฟังก์ชันตรวจสอบว่าสำเนาของคิวว่างหรือไม่
+ */
+bool journal_state_empty() {
+  for (uint8_t lane = 0; lane < NUM_LANES; lane++) {
+    for (uint8_t i = 0; i < QUEUE_CAPACITY; i++) {
+      if (journal_state.lanes[lane].slots[i].active) return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * ฟังก์ชันเขียน record จาก task real-time ลง flash (task comms)
+ */
+void journal_update() {
+  JournalRecord rec;
+  while (journal_queue.pop(rec)) {
+    journal_apply(journal_state, rec);
+    if (queue_journal.count >= JOURNAL_RECORDS_PER_SECTOR) {
+      journal_compact();                         // snapshot รวมผลของ record นี้แล้ว
+    } else {
+      journal_append(queue_journal, rec);
+    }
+  }
+
+  // ลบ sector ถัดไปของทั้งสอง log ล่วงหน้าขณะไม่มีพัสดุบนสายพาน
+  if (journal_state_empty()) {
+    journal_erase_ahead(queue_journal);
+    journal_erase_ahead(status_journal);
+  }
+}
+
+/**
+ * ฟังก์ชันแบ่ง partition ระหว่าง log คิวพัสดุ (ส่วนแรก) และ log สถานะ (ส่วนท้าย)
+ */
+void journal_partition() {
+  uint16_t sectors = hal_flash_size() / HAL_FLASH_SECTOR;  // ใช้ทั้ง partition
+  if (sectors < 4) sectors = 4;                  // ไม่มี partition - การอ่าน/เขียนล้มเหลวและถูก trace
+  status_journal.sectors = sectors / STATUS_JOURNAL_SHARE;
+  if (status_journal.sectors < 2) status_journal.sectors = 2;
+  queue_journal.first = 0;
+  queue_journal.sectors = sectors - status_journal.sectors;
+  status_journal.first = queue_journal.sectors;
+}
+
+/**
+ * ฟังก์ชันกู้คืนคิวพัสดุและคิวสถานะจาก flash (เรียกใน setup() ก่อนเริ่ม task)
+ * ตำแหน่งพัสดุถูกแปลงเป็นระยะจากตำแหน่งสายพานล่าสุดที่บันทึกไว้ เพราะ odometer เริ่มนับใหม่หลังรีเซ็ต
+ * พัสดุที่ยังรอผล QR จะถูกทำเครื่องหมายว่าไม่ทราบหอพัก (คำขอเดิมสูญหายไปแล้ว)
+ */
+void journal_restore() {
+  journal_partition();
+  if (!journal_load(queue_journal, journal_state, journal_apply, NUM_LANES - 1)) {
+    memset(&journal_state, 0, sizeof(journal_state));
+  }
+
+  // คัดลอกสำเนาลงคิวของแต่ละสายพาน แปลงตำแหน่งเป็น odometer ของรอบนี้
+  int restored_parcels = 0;
+  for (uint8_t i = 0; i < NUM_LANES; i++) {
+    Lane &lane = lanes[i];
+    JournalLane &jl = journal_state.lanes[i];
+    float belt_now = belt_position_at(lane, hal_micros());
+    jl.belt_mm = journal_belt_position(journal_state, jl);
+    lane.queue_tail = jl.tail;
+    lane.queue_head = lane.queue_tail;
+    lane.size = 0;
+    for (uint32_t seq = lane.queue_tail - QUEUE_CAPACITY; seq != lane.queue_tail; seq++) {
+      JournalSlot &js = jl.slots[seq & QUEUE_MASK];
+      ParcelSlot &slot = queue_slot(lane, seq);
+      slot.active = js.active;
+      if (!js.active) continue;
+
+      if (js.dorm == QR_PENDING) {
+        js.dorm = -2;                            // ไม่ทราบหอพัก
+        tracking_copy(js.tracking_number, TRACKING_NONE);
+      }
+      js.intake_mm = belt_now - (jl.belt_mm - js.intake_mm);
+
+      slot.dorm = js.dorm;
+      tracking_set(slot.tracking_number, js.tracking_number);
+      slot.triggered_at = hal_millis();
+      slot.triggered_us = hal_micros();
+      slot.intake_mm = js.intake_mm;
+      slot.last_gate = js.last_gate;
+      if (lane.size == 0) lane.queue_head = seq;
+      lane.size++;
+    }
+    jl.belt_mm = belt_now;
+    memset(&jl.belt, 0, sizeof(jl.belt));        // สายพานหยุดตอน boot
+    jl.belt.mm = belt_now;
+    jl.belt.ms = hal_millis();
+    restored_parcels += lane.size;
+  }
+  journal_state.version = JOURNAL_VERSION;
+  journal_state.last_ms = hal_millis();
+
+  TRACE_INFO(TR_JOURNAL_RESTORED, restored_parcels, queue_journal.generation);
+  journal_compact();                             // เริ่ม sector ใหม่จากสถานะที่กู้คืน
+  status_restore();
+}
+
+// === Task real-time / comms ===
+#define RT_TASK_CORE 1                 // core สำหรับ IR สายพาน และมอเตอร์
+#define RT_TASK_PRIORITY 5             // สูงกว่า task ของ Arduino/WiFi
+#define RT_TASK_STACK 6144
+#define RT_TASK_PERIOD_MS 1            // ปลุกอย่างน้อยทุก 1 ms เพื่ออัพเดท state machine
+#define COMMS_TASK_CORE 0              // core สำหรับ UART กับ Pi
+#define COMMS_TASK_PRIORITY 1
+#define COMMS_TASK_STACK 8192
+#define COMMS_TASK_PERIOD_MS 2
+
+hal_task_t comms_task_handle = NULL;
+unsigned long metrics_sent_at = 0;     // เวลาที่ส่ง metrics ล่าสุด (millis)
+
+/**
+ * ฟังก์ชันทำงานหนึ่งรอบของ task real-time
+ * @param now เวลาปัจจุบัน (millis)
+ */
+void rt_iteration(unsigned long now) {
+  // เติมผล QR ที่ task comms ได้รับ และตรวจสอบคำขอที่หมดเวลา
+  QrResult result;
+  while (comms_to_rt.pop(result)) {
+    qr_apply_result(result);
+  }
+  recent_sweep(now);                            // ลบหมายเลขติดตามที่หมดอายุ
+  pusher_update(now);                           // มอเตอร์ผลักของทุกสายพาน
+
+  // ทุกสายพานทำงานในรอบเดียวกัน สายพานที่หยุดรอไม่ทำให้สายพานอื่นรอ
+  for (int i = 0; i < NUM_LANES; i++) {
+    Lane &lane = lanes[i];
+    qr_check_timeouts(lane, now);
+    intake_update(lane, now);
+    belt_update(lane, now);                     // ramp ความเร็วสายพานตามโปรไฟล์
+    if (lane.belt_held && !belt_blocked(lane)) {
+      conveyor_resume(lane);                    // เริ่มสายพานเมื่อผลักเสร็จ
+    }
+  }
+
+  // ประมวลผลขอบสัญญาณ IR ตามลำดับเวลาที่เกิด
+  IrEvent ev;
+  while (ir_next_edge(ev)) {
+    if (ev.level != LOW) continue;              // สนใจเฉพาะตอนพัสดุเข้ามา (สัญญาณ active low)
+
+    metrics_record(METRIC_IR_EDGE, hal_micros() - ev.time_us);
+
+    if (ev.sensor < IR_SENSOR_G1) {
+      intake_triggered(lanes[ev.sensor - IR_SENSOR_MAIN], ev.time_us);  // IR หลัก - พัสดุใหม่
+    } else {
+      gate_triggered(ev.sensor - IR_SENSOR_G1, ev.time_us); // IR ประตู
+    }
+  }
+
+  for (int i = 0; i < NUM_LANES; i++) {
+    Lane &lane = lanes[i];
+    queue_expire_lost(lane);                    // ล้างพัสดุที่เลยปลายสายพาน
+
+    // หยุดสายพานหากพัสดุจะถึงประตูแรกก่อนได้ผล QR (เกิดได้บ่อยในโหมดสแกนต่อเนื่อง)
+    if (!lane.belt_held && qr_pending_at_gate(lane)) {
+      TRACE_WARN(TR_QR_LATE, lane.id, 0);
+      convayer_move(lane, 0);
+      lane.belt_held = true;
+    }
+    // หยุดสายพานหากพัสดุเข้าใกล้ประตูที่ก้านผลักยังดึงกลับไม่สุด
+    if (!lane.belt_held && pusher_holds_belt(lane)) {
+      convayer_move(lane, 0);
+      lane.belt_held = true;
+    }
+  }
+
+  throughput_update(now);
+}
+
+/**
+ * Task real-time - ถูกปลุกโดย ISR ของ IR หรือทุก RT_TASK_PERIOD_MS
+ */
+void rt_task(void *arg) {
+  (void)arg;
+  uint32_t last_start_us = hal_micros();
+  for (;;) {
+    uint32_t start_us = hal_micros();
+    metrics_record(METRIC_RT_PERIOD, start_us - last_start_us);
+    last_start_us = start_us;
+
+    PROBE_BEGIN(loop);
+    rt_iteration(hal_millis());
+    PROBE_END(METRIC_RT_LOOP, loop);
+    hal_task_wait(RT_TASK_PERIOD_MS);
+  }
+}
+
+/**
+ * ฟังก์ชันส่งสรุป latency ของทุก probe ไป Pi แล้วเริ่มช่วงใหม่ (task comms)
+ * ส่งเป็น MSG_METRICS (ประมาณ 40 ไบต์ต่อ probe) Pi แปลงเป็น JSON สำหรับ dashboard
+ * @param now เวลาปัจจุบัน (millis)
+ */
+void metrics_update(unsigned long now) {
+  if (now - metrics_sent_at < METRICS_PERIOD_MS) return;
+
+  uint32_t epoch = metrics_epoch;
+  frame_begin(pi_frame, MSG_METRICS);
+  frame_u32(pi_frame, now - metrics_sent_at);
+  frame_u8(pi_frame, METRIC_COUNT);
+
+  for (uint8_t id = 0; id < METRIC_COUNT; id++) {
+    const LatencyHist &h = metrics[id];
+    bool valid = h.epoch == epoch && h.count > 0; // probe ที่ไม่มีค่าในช่วงนี้
+    frame_str(pi_frame, METRICS[id].name);
+    frame_str(pi_frame, METRICS[id].unit);
+    frame_u32(pi_frame, valid ? h.count : 0);
+    frame_u32(pi_frame, valid ? h.min : 0);
+    frame_u32(pi_frame, valid ? metrics_percentile(h, 50) : 0);
+    frame_u32(pi_frame, valid ? metrics_percentile(h, 99) : 0);
+    frame_u32(pi_frame, valid ? h.max : 0);
+  }
+
+  if (frame_send(pi_frame) == 0) {
+    TRACE_WARN(TR_METRICS_TOO_LONG, PI_FRAME_MAX, 0);
+  }
+
+  const LatencyHist &loop = metrics[METRIC_RT_LOOP];
+  const LatencyHist &edge = metrics[METRIC_IR_EDGE];
+  TRACE_INFO(TR_RT_STATS, loop.epoch == epoch ? loop.max / 1000 : 0, edge.epoch == epoch ? edge.max : 0);
+  if (ir_event_dropped > 0) TRACE_WARN(TR_IR_DROPPED, ir_event_dropped, 0);
+
+  metrics_sent_at = now;
+  metrics_epoch = epoch + 1;                     // ผู้เขียนแต่ละ probe จะล้าง histogram เอง
+}
+
+/**
+ * ฟังก์ชันทำงานหนึ่งรอบของ task comms
+ * @param now เวลาปัจจุบัน (millis)
+ */
+void comms_iteration(unsigned long now) {
+  pi_poll();                                    // รับผล QR / ack จาก Pi
+  comms_drain();                                // ส่งคำขอ QR / สถานะจาก task real-time
+  status_update(now);                           // ส่งชุดสถานะขาออก
+  dorm_sync_update(now);                        // ขอตารางหอพักหากยังไม่มี
+  journal_update();                             // เขียนการเปลี่ยนแปลงของคิวลง flash
+  metrics_update(now);                          // ส่งสรุป latency ไป Pi
+  trace_drain();                                // ส่ง trace ออกทาง Serial
+}
+
+/**
+ * Task comms - UART กับ Pi และคิวสถานะขาออก
+ */
+void comms_task(void *arg) {
+  (void)arg;
+  for (;;) {
+    comms_iteration(hal_millis());
+    hal_task_wait(COMMS_TASK_PERIOD_MS);
+  }
+}
+
+/**
+ * ฟังก์ชัน Setup - ทำงานครั้งเดียวเมื่อเริ่มต้น
+ */
+void setup() {
+  // เริ่มต้น Serial communication
+  hal_debug_begin(DEBUG_BAUD);                  // Serial หลักสำหรับ trace
+  metrics_cycles_per_us = hal_cpu_mhz();        // ใช้แปลงตัวนับรอบ CPU เป็นเวลา
+  hal_pi_begin(PI_BAUD);                       // Serial2 สำหรับติดต่อ Raspberry Pi (RX=16, TX=17)
+
+  // ตั้งค่าขา IR Sensor เป็น INPUT
+  for (int i = 0; i < NUM_LANES; i++) {
+    hal_pin_mode(LANES[i].intake_pin, INPUT);        // IR sensor หลักของแต่ละสายพาน
+  }
+  for (int i = 0; i < NUM_GATES; i++) {
+    hal_pin_mode(GATES[i].ir_pin, INPUT);            // IR sensor ประตู
+  }
+
+  // เปิด Interrupt จับขอบสัญญาณ IR ทั้งขาขึ้นและขาลง
+  for (uint8_t i = 0; i < NUM_IR_SENSORS; i++) {
+    ir_state[i] = hal_digital_read(ir_pin(i));       // ระดับเริ่มต้น
+    ir_last_edge_us[i] = hal_micros();
+    ir_raw_us[i] = ir_sampled_us[i] = ir_last_edge_us[i];
+    ir_raw_level[i] = ir_state[i];
+    ir_debounce_us[i] = IR_DEBOUNCE_US;
+  }
+  IrAttach<NUM_IR_SENSORS>::run();
+
+#ifdef BELT_ENCODER_PIN
+  hal_pin_mode(BELT_ENCODER_PIN, INPUT_PULLUP);
+  hal_attach_interrupt(BELT_ENCODER_PIN, belt_encoder_isr, RISING);
+#endif
+
+  // ตั้งค่าขามอเตอร์สายพานเป็น OUTPUT และ PWM สำหรับควบคุมความเร็ว
+  for (int i = 0; i < NUM_LANES; i++) {
+    lanes[i].id = i;
+    hal_pin_mode(LANES[i].belt_in1, OUTPUT);
+    hal_pin_mode(LANES[i].belt_in2, OUTPUT);
+    hal_pwm_setup(LANES[i].belt_ena, LANES[i].pwm_channel, 5000, 8); // ความถี่ 5kHz, ความละเอียด 8 บิต
+  }
+
+  // ตั้งค่าขามอเตอร์ผลักทุกตัวเป็น OUTPUT
+  for (int i = 0; i < NUM_GATES; i++) {
+    hal_pin_mode(GATES[i].motor_in_a, OUTPUT);
+    hal_pin_mode(GATES[i].motor_in_b, OUTPUT);
+    hal_digital_write(GATES[i].motor_in_a, LOW);     // ตั้งค่าเริ่มต้นเป็น LOW
+    hal_digital_write(GATES[i].motor_in_b, LOW);
+
+    // feedback ปลายทาง (ไม่บังคับ) - ขา ADC ของ current sense ไม่ต้องตั้งค่า
+    if (GATES[i].feedback == PUSHER_FB_LIMIT) {
+      hal_pin_mode(GATES[i].sense_out, INPUT_PULLUP);
+      hal_pin_mode(GATES[i].sense_in, INPUT_PULLUP);
+    }
+    pushers[i].feedback_ok = GATES[i].feedback != PUSHER_FB_NONE;
+    pushers[i].sense_level[0] = pushers[i].sense_level[1] = 0xFF;  // บันทึกค่าแรกที่อ่านได้เสมอ
+  }
+
+  journal_restore();                           // กู้คืนพัสดุที่ค้างบนสายพานก่อนรีเซ็ต
+
+  for (int i = 0; i < NUM_LANES; i++) {
+    convayer_move(lanes[i], 0);                // หยุดสายพานเริ่มต้น
+    convayer_move(lanes[i], 1);                // เริ่มการทำงานสายพาน
+  }
+
+  // แยกงาน real-time กับงานสื่อสารไปคนละ core
+  hal_task_create(comms_task, "comms", COMMS_TASK_STACK, COMMS_TASK_PRIORITY,
+                  COMMS_TASK_CORE, &comms_task_handle);
+  hal_task_create(rt_task, "rt", RT_TASK_STACK, RT_TASK_PRIORITY,
+                  RT_TASK_CORE, &rt_task_handle);
+}
+
+/**
+ * ฟังก์ชัน Loop หลัก - งานทั้งหมดทำใน rt_task และ comms_task
+ */
+void loop() {
+  hal_task_wait(1000);
+}
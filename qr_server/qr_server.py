@@ -1,11 +1,15 @@
 import cv2
 import threading
+import queue
+import collections
 import serial
 import json
+import struct
 import psycopg2
 from pyzbar.pyzbar import decode
 from qreader import QReader
 import time
+import os
 
 # ===================================
 # QR Reader และ Camera Setup
@@ -17,31 +21,52 @@ qreader = QReader(model_size='n')  # model_size 'n' = nano model (เล็ก
 IMAGE_WIDTH = 1280
 IMAGE_HEIGHT = 720
 
-# วนลูปเพื่อเชื่อมต่อกล้อง (retry จนกว่าจะสำเร็จ)
-while True:
-    try:
-        cap = cv2.VideoCapture(0)  # เปิดกล้องตัวที่ 0 (default camera)
-        break
-    except Exception as e:
-        print(f"⚠️ Camera init error: {e}, retrying...")
-        time.sleep(2)  # รอ 2 วินาทีก่อน retry
-        continue
+# กล้องของแต่ละสายพาน (ลำดับต้องตรงกับ LANES ใน main.cpp) - หนึ่งกล้องต่อสายพาน
+LANE_CAMERAS = [int(i) for i in os.environ.get("LANE_CAMERAS", "0").split(",")]
+
+def open_camera(index):
+    """
+    เปิดกล้องและตั้งค่าความละเอียด (retry จนกว่าจะสำเร็จ)
+    """
+    while True:
+        try:
+            cam = cv2.VideoCapture(index)
+            break
+        except Exception as e:
+            print(f"⚠️ Camera {index} init error: {e}, retrying...")
+            time.sleep(2)  # รอ 2 วินาทีก่อน retry
+            continue
+    cam.set(cv2.CAP_PROP_FRAME_WIDTH, IMAGE_WIDTH)
+    cam.set(cv2.CAP_PROP_FRAME_HEIGHT, IMAGE_HEIGHT)
+    return cam
+
+caps = [open_camera(index) for index in LANE_CAMERAS]
+
+# frame ล่าสุดที่ capture ได้ของแต่ละสายพาน
+last_frames = [None] * len(caps)
 
-# ตั้งค่าความละเอียดของกล้อง
-cap.set(cv2.CAP_PROP_FRAME_WIDTH, IMAGE_WIDTH)
-cap.set(cv2.CAP_PROP_FRAME_HEIGHT, IMAGE_HEIGHT)
+# ===================================
+# Frame History (โหมดสแกนต่อเนื่อง)
+# ===================================
+# เก็บภาพล่าสุดพร้อมเวลา เพื่อเลือกภาพรอบเวลาที่ IR ตรวจพบโดยไม่ต้องหยุดสายพาน
+FRAME_HISTORY = 15          # จำนวนภาพที่เก็บย้อนหลัง
+CAPTURE_OFFSET_S = 0.30     # เวลาจาก IR ตรวจพบจนพัสดุอยู่กลางภาพ (ปรับตามความเร็วสายพาน)
+CAPTURE_WINDOW_S = 0.20     # ช่วงเวลารอบจุดเป้าหมายที่ใช้เลือกภาพ
 
-# ตัวแปรเก็บ frame ล่าสุดที่ capture ได้
-last_frame = None
+frame_histories = [collections.deque(maxlen=FRAME_HISTORY) for _ in caps]
+frame_lock = threading.Lock()
 
 # ===================================
 # Serial Communication Setup
 # ===================================
+SERIAL_BAUD = 115200
+# พอร์ตที่ต่อกับ ESP32 - ตั้ง SERIAL_PORT เป็น PTY ของ tools/sim (--pi external) เพื่อทดสอบกับสายพานจำลอง
+SERIAL_PORT = os.environ.get("SERIAL_PORT", "/dev/ttyS0")
 # วนลูปเพื่อเชื่อมต่อ Serial Port (retry จนกว่าจะสำเร็จ)
 while True:
     try:
-        # เปิดการเชื่อมต่อ Serial ที่ /dev/ttyS0 ด้วย baud rate 115200
-        ser = serial.Serial('/dev/ttyS0', 115200, timeout=1)
+        # เปิดการเชื่อมต่อ Serial (baud ต้องตรงกับ PI_BAUD ใน main.cpp)
+        ser = serial.Serial(SERIAL_PORT, SERIAL_BAUD, timeout=1)
         break
     except Exception as e:
         print(f"⚠️ Serial init error: {e}, retrying...")
@@ -68,24 +93,55 @@ conn = psycopg2.connect(
 )
 conn.autocommit = True  # เปิด autocommit สำหรับ updates
 
+# lock สำหรับใช้ connection ร่วมกันระหว่าง thread บันทึกสถานะ และ QR worker
+db_lock = threading.Lock()
+
 # ===================================
 # Camera Thread Function
 # ===================================
-def camera_loop():
+def camera_loop(lane):
     """
-    ฟังก์ชันที่ทำงานใน thread แยก เพื่อ capture ภาพจากกล้องอย่างต่อเนื่อง
-    และเก็บ frame ล่าสุดไว้ในตัวแปร global last_frame
+    ฟังก์ชันที่ทำงานใน thread แยก (หนึ่ง thread ต่อสายพาน) เพื่อ capture ภาพจากกล้องอย่างต่อเนื่อง
+    และเก็บ frame ล่าสุดไว้ใน last_frames[lane]
     """
-    global last_frame
     while True:
-        ret, frame = cap.read()  # อ่าน frame จากกล้อง
+        ret, frame = caps[lane].read()  # อ่าน frame จากกล้อง
         if ret:  # ถ้าอ่านสำเร็จ
             # ตัด frame ให้เหลือแค่ส่วนซ้าย (crop จากขวา)
             # frame[:, 0:1050] หมายถึง เอาทุก row แต่ column 0-1050
-            last_frame = frame[:, 0:1050]
+            last_frames[lane] = frame[:, 0:1050]
+            with frame_lock:
+                frame_histories[lane].append((time.monotonic(), last_frames[lane]))
 
-# เริ่ม thread สำหรับ camera loop
-threading.Thread(target=camera_loop, daemon=True).start()
+def frames_around(lane, target):
+    """
+    รอจนมีภาพครอบคลุมช่วงเวลาเป้าหมาย แล้วคืนภาพในช่วง CAPTURE_WINDOW_S
+    เรียงจากภาพที่ใกล้เวลาเป้าหมายที่สุด
+    Args:
+        lane: สายพาน (กล้องที่ใช้)
+        target: เวลาเป้าหมาย (time.monotonic())
+    Returns:
+        list: ภาพที่เรียงตามความใกล้เวลาเป้าหมาย
+    """
+    # รอให้กล้องเก็บภาพหลังเวลาเป้าหมายครบช่วง
+    wait = target + CAPTURE_WINDOW_S / 2 - time.monotonic()
+    if wait > 0:
+        time.sleep(wait)
+
+    with frame_lock:
+        history = list(frame_histories[lane])
+
+    candidates = [(abs(ts - target), frame) for ts, frame in history
+                  if abs(ts - target) <= CAPTURE_WINDOW_S / 2]
+    if not candidates and history:
+        # ไม่มีภาพในช่วง - ใช้ภาพที่ใกล้ที่สุดแทน
+        candidates = [min(((abs(ts - target), frame) for ts, frame in history), key=lambda c: c[0])]
+    candidates.sort(key=lambda c: c[0])
+    return [frame for _, frame in candidates]
+
+# เริ่ม thread สำหรับ camera loop ของทุกสายพาน
+for lane in range(len(caps)):
+    threading.Thread(target=camera_loop, args=(lane,), daemon=True).start()
 
 # ===================================
 # QR Code Reading Functions
@@ -138,113 +194,487 @@ def read_qr_code1(frame):
 # ===================================
 # QR Code Processing Function
 # ===================================
-def process_qr(qr_text: str) -> int:
+def mark_scanned(qr_text: str):
     """
-    ประมวลผล QR code text และคืนค่า mapped_label
+    อัปเดต status ของ tracking_number เป็น 'scanned' (ทำหลังตอบ ESP32 แล้ว จึงไม่อยู่ในเส้นทางของผล QR)
     Args:
         qr_text: ข้อความใน QR Code
-    Returns:
-        int: 
-        -1: QR ไม่อยู่ใน tracking_numbers หรือไม่พบ user
-        -2: ไม่พบ QR code
-        >=0: หมายเลขห้องพักของ user
     """
     if not qr_text:
-        return -2  # ไม่พบ QR code
-
-    with conn.cursor() as cur:
-        # 1️⃣ ตรวจสอบว่า tracking_number นี้มีในฐานข้อมูลหรือไม่
-        cur.execute("SELECT user_id, status FROM tracking_numbers WHERE tracking_number = %s", (qr_text,))
-        row = cur.fetchone()
-        if not row:
-            return -1  # ไม่พบ tracking_number
-
-        user_id, status = row
-        
-        # 2️⃣ อัปเดต status เป็น 'scanned' พร้อมเวลาปัจจุบัน
-        cur.execute("UPDATE tracking_numbers SET status='scanned', updated_at=NOW() WHERE tracking_number=%s", (qr_text,))
-
-        # 3️⃣ ดึงหมายเลขห้องพักจากตาราง users
-        cur.execute("SELECT dorm_number FROM users WHERE id=%s", (user_id,))
-        dorm_row = cur.fetchone()
-        if not dorm_row:
-            return -1  # ไม่พบข้อมูล user
-
-        dorm_number = dorm_row[0]
-        try:
-            return int(dorm_number)  # แปลงเป็น integer
-        except ValueError:
-            return -1  # แปลงไม่ได้
+        return
+    try:
+        with db_lock, conn.cursor() as cur:
+            cur.execute("UPDATE tracking_numbers SET status='scanned', updated_at=NOW() WHERE tracking_number=%s", (qr_text,))
+    except Exception as e:
+        print(f"❌ DB scanned update error: {e}")
 
 # ===================================
-# Main Loop
+# Status Codes จาก ESP32
 # ===================================
-print("✅ Raspberry Pi QR Serial Server with DB started...")
+# ESP32 ส่งรหัสสถานะแบบตัวเลขแทนข้อความ เพื่อไม่ต้องสร้าง string บน heap
+STATUS_DELIVERED = 1
 
-while True:
-    # ตรวจสอบว่ามีข้อมูลเข้ามาทาง Serial หรือไม่
-    if ser.in_waiting:
+def status_from_code(code, dorm):
+    """
+    แปลงรหัสสถานะจาก ESP32 เป็นข้อความที่บันทึกในฐานข้อมูล
+    Returns:
+        str: ข้อความสถานะ หรือ None ถ้าไม่รู้จักรหัส
+    """
+    if code == STATUS_DELIVERED:
+        return f"delivered to dorm {dorm}"
+    return None
+
+def apply_status_batch(events):
+    """
+    บันทึกชุดสถานะจาก ESP32 ลงฐานข้อมูลใน transaction เดียว
+    Args:
+        events: list ของ {"trackingNumber", "code", "dorm"} หรือ {"trackingNumber", "status"}
+    Returns:
+        bool: True ถ้าบันทึกสำเร็จ (ส่ง ack ได้)
+    """
+    rows = []
+    for ev in events:
+        tracking_number = ev.get("trackingNumber")
+        status = ev.get("status") or status_from_code(ev.get("code"), ev.get("dorm"))
+        if tracking_number and status:
+            rows.append((status, tracking_number))
+        else:
+            print(f"⚠️ Skipping invalid status event: {ev}")
+
+    with db_lock, conn.cursor() as cur:
         try:
-            # อ่านข้อมูลจาก Serial และแปลงเป็น string
-            cmd = ser.readline().decode().strip()
+            cur.execute("BEGIN")
+            cur.executemany("""
+                UPDATE tracking_numbers 
+                SET status=%s, updated_at=NOW() 
+                WHERE tracking_number=%s
+            """, rows)
+            cur.execute("COMMIT")
         except Exception as e:
-            print(f"⚠️ Serial read error: {e}")
-            continue
+            cur.execute("ROLLBACK")
+            print(f"❌ DB batch update error: {e}")
+            return False
+
+    print(f"✅ Applied status batch with {len(rows)} update(s)")
+    return True
+
+# ===================================
+# Latency Metrics จาก ESP32
+# ===================================
+# ESP32 ส่งสรุป latency (min/p50/p99/max) ของแต่ละขั้นตอนทุก 10 วินาที
+# เก็บสรุปล่าสุดเป็นไฟล์ JSON ให้ dashboard อ่าน
+METRICS_PATH = "/app/output/metrics.json"
+
+def save_metrics(data):
+    """
+    บันทึก metrics ล่าสุดลงไฟล์ (เขียนไฟล์ชั่วคราวแล้ว rename เพื่อไม่ให้ผู้อ่านเห็นไฟล์ครึ่งเดียว)
+    """
+    data["received_at"] = time.time()
+    try:
+        tmp_path = METRICS_PATH + ".tmp"
+        with open(tmp_path, "w") as f:
+            json.dump(data, f)
+        os.replace(tmp_path, METRICS_PATH)
+    except OSError as e:
+        print(f"⚠️ Metrics write error: {e}")
+
+    summary = ", ".join(
+        f"{p['name']} p50={p['p50']}{p['unit']} p99={p['p99']}{p['unit']}"
+        for p in data.get("probes", []) if p.get("n")
+    )
+    print(f"📊 Metrics: {summary}")
+
+# ===================================
+# Binary Frame Protocol (COBS + CRC16)
+# ===================================
+# กรอบบน Serial: COBS(payload) ตามด้วย 0x00 โดย payload = [ชนิด:1][เนื้อหา][CRC-16/CCITT:2]
+# ตัวเลขเป็น little-endian - รูปแบบเนื้อหาของแต่ละชนิดต้องตรงกับส่วนกรอบข้อความไบนารีใน main.cpp
+MSG_QR_REQUEST = 0x01      # lane:1 seq:4 age_ms:4
+MSG_STATUS_BATCH = 0x02    # batch:2 count:1 {code:1 dorm:2 len:1 tracking}...
+MSG_METRICS = 0x03         # window_ms:4 count:1 {len:1 name len:1 unit n:4 min:4 p50:4 p99:4 max:4}...
+MSG_DORM_SYNC = 0x04       # version:4
+MSG_QR_RESULT = 0x81       # lane:1 seq:4 len:1 qr_text
+MSG_ACK = 0x82             # batch:2
+MSG_DORM_FULL = 0x83       # version:4 part:2 parts:2 {hash:4 dorm:1}...
+MSG_DORM_DELTA = 0x84      # base:4 version:4 {hash:4 dorm:1}...
+PI_FRAME_MAX = 1024        # ความยาว payload สูงสุดที่ ESP32 รับได้
+PI_NO_AGE = 0xFFFFFFFF     # MSG_QR_REQUEST: เก็บภาพทันที
+
+# lock สำหรับเขียน Serial จากหลาย thread
+ser_lock = threading.Lock()
+
+def crc16_ccitt(data):
+    """
+    CRC-16/CCITT (poly 0x1021, ค่าเริ่มต้น 0xFFFF) - ต้องตรงกับ crc16_ccitt ใน main.cpp
+    """
+    crc = 0xFFFF
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+        crc &= 0xFFFF
+    return crc
+
+def cobs_encode(data):
+    """
+    เข้ารหัส COBS (ผลลัพธ์ไม่มีไบต์ 0x00 และยังไม่รวมตัวคั่น)
+    """
+    out = bytearray(b"\x00")
+    code_pos = 0
+    for b in data:
+        if b == 0:
+            out[code_pos] = len(out) - code_pos
+            code_pos = len(out)
+            out.append(0)
+        else:
+            out.append(b)
+            if len(out) - code_pos == 0xFF:  # ช่วงยาวสุด 254 ไบต์
+                out[code_pos] = 0xFF
+                code_pos = len(out)
+                out.append(0)
+    out[code_pos] = len(out) - code_pos
+    return bytes(out)
+
+def cobs_decode(data):
+    """
+    ถอดรหัส COBS
+    Returns:
+        bytes: payload หรือ None หากรหัสไม่ถูกต้อง
+    """
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        i += 1
+        if code == 0 or i + code - 1 > len(data):
+            return None
+        out += data[i:i + code - 1]
+        i += code - 1
+        if code < 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+def send_frame(msg_type, body=b""):
+    """
+    ส่งกรอบหนึ่งกรอบไป ESP32 ทาง Serial
+    """
+    payload = bytes([msg_type]) + body
+    payload += struct.pack("<H", crc16_ccitt(payload))
+    with ser_lock:
+        ser.write(cobs_encode(payload) + b"\x00")
+
+def parse_frame(frame):
+    """
+    ตรวจสอบและแยกกรอบที่ได้รับ (ไม่รวมตัวคั่น)
+    Returns:
+        tuple: (ชนิด, เนื้อหา) หรือ None หากกรอบเสีย
+    """
+    payload = cobs_decode(frame)
+    if not payload or len(payload) < 3:
+        return None
+    if crc16_ccitt(payload[:-2]) != struct.unpack_from("<H", payload, len(payload) - 2)[0]:
+        return None
+    return payload[0], payload[1:-2]
+
+def read_str(body, pos):
+    """
+    อ่านสตริงแบบ [len:1][ข้อความ]
+    Returns:
+        tuple: (ข้อความ, ตำแหน่งถัดไป)
+    """
+    n = body[pos]
+    return body[pos + 1:pos + 1 + n].decode("utf-8", "replace"), pos + 1 + n
+
+def parse_status_batch(body):
+    """
+    แปลง MSG_STATUS_BATCH เป็น (batch, events) ในรูปแบบที่ apply_status_batch ใช้
+    """
+    batch, count = struct.unpack_from("<HB", body)
+    pos = 3
+    events = []
+    for _ in range(count):
+        code, dorm = struct.unpack_from("<Bh", body, pos)
+        tracking_number, pos = read_str(body, pos + 3)
+        events.append({"trackingNumber": tracking_number, "code": code, "dorm": dorm})
+    return batch, events
+
+def parse_metrics(body):
+    """
+    แปลง MSG_METRICS เป็น dict รูปแบบเดียวกับไฟล์ metrics.json
+    """
+    window_ms, count = struct.unpack_from("<IB", body)
+    pos = 5
+    probes = []
+    for _ in range(count):
+        name, pos = read_str(body, pos)
+        unit, pos = read_str(body, pos)
+        n, vmin, p50, p99, vmax = struct.unpack_from("<5I", body, pos)
+        pos += 20
+        probes.append({"name": name, "unit": unit, "n": n, "min": vmin,
+                       "p50": p50, "p99": p99, "max": vmax})
+    return {"type": "metrics", "window_ms": window_ms, "probes": probes}
+
+def send_qr_result(lane, seq, qr_text):
+    """
+    ส่งผล QR กลับ ESP32 (qr_text ว่าง = เกิดข้อผิดพลาด)
+    """
+    text = (qr_text or "").encode()[:255]
+    send_frame(MSG_QR_RESULT, struct.pack("<BIB", lane, seq, len(text)) + text)
 
-        # === คำสั่ง READ_QR ===
-        if cmd == "READ_QR":
-            # ตรวจสอบสถานะกล้อง
-            if not cap.isOpened():
-                response = {"error": "Cannot open camera"}
-            elif last_frame is None:
-                response = {"error": "Failed to capture image"}
-            else:
-                # ลองอ่าน QR ด้วยวิธีที่ 1 (pyzbar) ก่อน
-                qr_text = read_qr_code1(last_frame)
-                
-                # ถ้าอ่านไม่ได้ ลองด้วยวิธีที่ 2 (YOLOv7)
-                if not qr_text:
-                    qr_text = read_qr_code2(last_frame)
-                
-                # ประมวลผล QR code และได้ mapped_label
-                mapped_label = process_qr(qr_text)
-
-                # ถ้าไม่พบ QR code (-2) ให้บันทึกภาพไว้ debug
-                if mapped_label == -2:
-                    cv2.imwrite("/app/output/debug_last_frame.jpg", last_frame)
-                    print("⚠️ No QR detected → saved debug_last_frame.jpg")
-
-                # สร้าง response object
-                response = {"qr_text": qr_text or "No QR code detected", "mapped_label": mapped_label}
-                print(f"📡 QR: {qr_text}, mapped_label: {mapped_label}")
-
-            # ส่ง response กลับทาง Serial ในรูปแบบ JSON
-            ser.write((json.dumps(response) + "\n").encode())
-        
-        # === ลองแปลงคำสั่งเป็น JSON ===
+# ===================================
+# Dorm Table Sync (ตารางหอพักบน ESP32)
+# ===================================
+# ESP32 เก็บตาราง hash ของหมายเลขติดตาม → หมายเลขหอพัก และหาหอพักเองเมื่อได้ข้อความ QR
+# Pi ส่งตารางทั้งหมดเมื่อ ESP32 ขอ (dorm_sync) แล้วส่งเฉพาะส่วนที่เปลี่ยน (dorm_delta) ทุก DORM_SYNC_PERIOD_S
+# แต่ละรายการในกรอบคือ hash:4 dorm:1
+DORM_SYNC_PERIOD_S = 2       # ระยะเวลาตรวจการเปลี่ยนแปลงในฐานข้อมูล
+DORM_CHUNK = 128             # จำนวนรายการต่อกรอบ (ไม่เกิน PI_FRAME_MAX)
+DORM_DELETE = 0xFF           # ลบ hash ออกจากตาราง
+DORM_AMBIGUOUS = 0xFE        # hash ชนกัน - ESP32 ถือว่าไม่ทราบหอพัก
+TRACKING_MAX_LEN = 39        # ESP32 ปฏิเสธหมายเลขติดตามที่ยาวเกินนี้ (TRACKING_MAX_LEN ใน main.cpp)
+
+dorm_lock = threading.Lock()
+dorm_version = int.from_bytes(os.urandom(4), "little") or 1  # เริ่มจากค่าสุ่ม เพื่อให้ ESP32 รู้ว่า Pi เริ่มใหม่
+dorm_table = {}              # hash → หอพัก ที่ส่งให้ ESP32 แล้ว
+
+def tracking_hash(text):
+    """
+    hash (FNV-1a 32 บิต) ของหมายเลขติดตาม - ต้องตรงกับ tracking_hash ใน main.cpp (ไม่คืนค่า 0)
+    """
+    h = 2166136261
+    for b in text.encode():
+        h = ((h ^ b) * 16777619) & 0xFFFFFFFF
+    return h or 1
+
+def load_dorm_table():
+    """
+    อ่านหมายเลขติดตามที่ยังไม่ส่งถึงพร้อมหอพักจากฐานข้อมูล
+    Returns:
+        dict: hash → หมายเลขหอพัก (DORM_AMBIGUOUS หาก hash ชนกันหรือหมายเลขเดียวกันมีหลายหอพัก)
+    """
+    with db_lock, conn.cursor() as cur:
+        cur.execute("""
+            SELECT tn.tracking_number, u.dorm_number
+            FROM tracking_numbers tn JOIN users u ON u.id = tn.user_id
+            WHERE tn.status NOT LIKE 'delivered%'
+        """)
+        rows = cur.fetchall()
+
+    table = {}
+    texts = {}
+    for tracking_number, dorm_number in rows:
         try:
-            data = json.loads(cmd)
-        except json.JSONDecodeError:
-            print(f"⚠️ Invalid JSON from ESP32: {cmd}")
+            dorm = int(dorm_number)
+        except (TypeError, ValueError):
+            continue  # แปลงไม่ได้ - ESP32 จะถือว่าไม่ทราบหอพักเหมือนเดิม
+        if not 0 <= dorm < DORM_AMBIGUOUS:
             continue
+        if len(tracking_number.encode()) > TRACKING_MAX_LEN:
+            continue  # ESP32 ไม่ค้นตารางด้วยหมายเลขที่ยาวเกิน
+        h = tracking_hash(tracking_number)
+        if h in table and (texts[h] != tracking_number or table[h] != dorm):
+            table[h] = DORM_AMBIGUOUS
+        else:
+            table.setdefault(h, dorm)
+            texts[h] = tracking_number
+    return table
+
+def encode_entries(entries):
+    """
+    แปลงรายการ (hash, หอพัก) เป็นเนื้อหาของกรอบ
+    """
+    return b"".join(struct.pack("<IB", h, dorm) for h, dorm in entries)
+
+def send_dorm_full():
+    """
+    ส่งตารางหอพักทั้งหมดไป ESP32 เรียงตาม hash แบ่งเป็นหลาย part
+    """
+    global dorm_version, dorm_table
+    with dorm_lock:
+        try:
+            dorm_table = load_dorm_table()
+        except Exception as e:
+            print(f"❌ Dorm table load error: {e}")
+            return
+        dorm_version = (dorm_version + 1) & 0xFFFFFFFF or 1
+        entries = sorted(dorm_table.items())
+        parts = max(1, (len(entries) + DORM_CHUNK - 1) // DORM_CHUNK)
+        for part in range(parts):
+            chunk = entries[part * DORM_CHUNK:(part + 1) * DORM_CHUNK]
+            send_frame(MSG_DORM_FULL, struct.pack("<IHH", dorm_version, part, parts) + encode_entries(chunk))
+    print(f"📒 Sent dorm table v{dorm_version} ({len(entries)} entries, {parts} parts)")
 
-        # === คำสั่ง Update Status ===
-        if data.get("type") == "update_status":
-            tracking_number = data.get("trackingNumber")
-            status = data.get("status")
-
-            # ตรวจสอบว่ามีข้อมูลครบถ้วน
-            if tracking_number and status:
-                try:
-                    with conn.cursor() as cur:
-                        # อัปเดต status ในฐานข้อมูล
-                        cur.execute("""
-                            UPDATE tracking_numbers 
-                            SET status=%s, updated_at=NOW() 
-                            WHERE tracking_number=%s
-                        """, (status, tracking_number))
-                        print(f"✅ Updated {tracking_number} → {status}")
-                except Exception as e:
-                    print(f"❌ DB update error: {e}")
-            else:
-                print("⚠️ Missing fields in update_status request")
\ No newline at end of file
+def dorm_sync_loop():
+    """
+    ฟังก์ชันที่ทำงานใน thread แยก เพื่อส่งการเปลี่ยนแปลงของตารางหอพักไป ESP32
+    """
+    global dorm_version, dorm_table
+    while True:
+        time.sleep(DORM_SYNC_PERIOD_S)
+        with dorm_lock:
+            try:
+                table = load_dorm_table()
+            except Exception as e:
+                print(f"❌ Dorm table load error: {e}")
+                continue
+            changes = [(h, dorm) for h, dorm in table.items() if dorm_table.get(h) != dorm]
+            changes += [(h, DORM_DELETE) for h in dorm_table if h not in table]
+            for i in range(0, len(changes), DORM_CHUNK):
+                base = dorm_version
+                dorm_version = (dorm_version + 1) & 0xFFFFFFFF or 1
+                send_frame(MSG_DORM_DELTA, struct.pack("<II", base, dorm_version) +
+                           encode_entries(changes[i:i + DORM_CHUNK]))
+            dorm_table = table
+        if changes:
+            print(f"📒 Sent dorm delta v{dorm_version} ({len(changes)} change(s))")
+
+# ===================================
+# QR Request Worker
+# ===================================
+# คิวของคำขอ (seq, frame, target) ที่รอประมวลผล แยกตามสายพาน
+# (คิวเดียวร่วมกันทำให้คำขอของสายพานหนึ่งรอหลังภาพที่อ่านยากของอีกสายพาน)
+qr_requests = [queue.Queue() for _ in caps]
+
+def qr_worker(lane):
+    """
+    ฟังก์ชันที่ทำงานใน thread แยก เพื่อประมวลผลคำขอ READ_QR ของสายพานหนึ่งทีละรายการ
+    ภาพถูก snapshot ไว้ตั้งแต่ตอนรับคำสั่ง จึงไม่ขึ้นกับความเร็วของการประมวลผล
+
+    Args:
+        lane: สายพาน (คิวและกล้องที่ใช้)
+    """
+    while True:
+        seq, frame, target = qr_requests[lane].get()
+
+        if frame is None:
+            # โหมดสแกนต่อเนื่อง - ลอง pyzbar กับทุกภาพในช่วงเวลา เริ่มจากภาพที่ใกล้ที่สุด
+            frames = frames_around(lane, target)
+            if not frames:
+                print(f"⚠️ QR[{lane}:{seq}]: Failed to capture image")
+                send_qr_result(lane, seq, None)
+                continue
+            frame = frames[0]
+            qr_text = None
+            for candidate in frames:
+                qr_text = read_qr_code1(candidate)
+                if qr_text:
+                    frame = candidate
+                    break
+        else:
+            # ลองอ่าน QR ด้วยวิธีที่ 1 (pyzbar) ก่อน
+            qr_text = read_qr_code1(frame)
+
+        # ถ้าอ่านไม่ได้ ลองด้วยวิธีที่ 2 (YOLOv7) กับภาพที่ใกล้ที่สุด
+        if not qr_text:
+            qr_text = read_qr_code2(frame)
+
+        # ส่งผลพร้อม lane และ seq เพื่อให้ ESP32 จับคู่กับพัสดุได้
+        # ESP32 หาหอพักจากตารางของตัวเอง จึงส่งเฉพาะข้อความ QR ได้ทันทีโดยไม่ต้องค้นฐานข้อมูล
+        print(f"📡 QR[{lane}:{seq}]: {qr_text}")
+        send_qr_result(lane, seq, qr_text or "No QR code detected")
+
+        # ถ้าไม่พบ QR code ให้บันทึกภาพไว้ debug
+        if not qr_text:
+            cv2.imwrite(f"/app/output/debug_last_frame_{lane}.jpg", frame)
+            print(f"⚠️ No QR detected → saved debug_last_frame_{lane}.jpg")
+
+        mark_scanned(qr_text)
+
+# เริ่ม thread สำหรับประมวลผล QR หนึ่ง thread ต่อสายพาน (สายพานที่ภาพอ่านยากไม่ทำให้สายพานอื่นรอ)
+for lane in range(len(caps)):
+    threading.Thread(target=qr_worker, args=(lane,), daemon=True).start()
+
+# ส่งตารางหอพักทั้งหมดตอนเริ่มต้น (ESP32 อาจมีตารางจาก Pi รอบก่อน) แล้วเริ่มส่ง delta
+threading.Thread(target=send_dorm_full, daemon=True).start()
+threading.Thread(target=dorm_sync_loop, daemon=True).start()
+
+# คิวของชุดสถานะที่รอบันทึก - thread อ่าน Serial ไม่ต้องรอ transaction ของฐานข้อมูล
+status_batches = queue.Queue()
+
+def status_worker():
+    """
+    ฟังก์ชันที่ทำงานใน thread แยก เพื่อบันทึกชุดสถานะจาก ESP32 ลงฐานข้อมูลทีละชุดตามลำดับที่ได้รับ
+    ส่ง ack หลัง COMMIT สำเร็จเท่านั้น หากล้มเหลว ESP32 จะส่งชุดเดิมซ้ำเอง
+    """
+    while True:
+        batch, events = status_batches.get()
+        if apply_status_batch(events):
+            send_frame(MSG_ACK, struct.pack("<H", batch))
+
+threading.Thread(target=status_worker, daemon=True).start()
+
+# ===================================
+# Main Loop
+# ===================================
+print("✅ Raspberry Pi QR Serial Server with DB started...")
+
+rx_buf = b""
+
+def handle_frame(msg_type, body):
+    """
+    จัดการกรอบหนึ่งกรอบจาก ESP32
+    """
+    # === คำขออ่าน QR: สายพาน seq และเวลาที่ผ่านไปตั้งแต่ IR ตรวจพบ (PI_NO_AGE = เก็บภาพทันที) ===
+    if msg_type == MSG_QR_REQUEST:
+        received_at = time.monotonic()
+        lane, seq, age_ms = struct.unpack_from("<BII", body)
+
+        # ตรวจสอบสถานะกล้องของสายพาน
+        if lane >= len(caps):
+            print(f"⚠️ No camera for lane {lane}")
+            send_qr_result(lane, seq, None)
+        elif not caps[lane].isOpened():
+            print(f"⚠️ Cannot open camera of lane {lane}")
+            send_qr_result(lane, seq, None)
+        elif last_frames[lane] is None:
+            print(f"⚠️ Failed to capture image (lane {lane})")
+            send_qr_result(lane, seq, None)
+        elif age_ms != PI_NO_AGE:
+            # โหมดสแกนต่อเนื่อง - ให้ worker เลือกภาพรอบเวลาที่ IR ตรวจพบ
+            target = received_at - age_ms / 1000.0 + CAPTURE_OFFSET_S
+            qr_requests[lane].put((seq, None, target))
+        else:
+            # snapshot ภาพทันที แล้วส่งให้ worker ประมวลผลโดยไม่บล็อกการรับคำสั่ง
+            qr_requests[lane].put((seq, last_frames[lane].copy(), None))
+
+    # === ชุดสถานะ (status_worker ตอบ ack หลังบันทึกเพื่อให้ ESP32 หยุดส่งซ้ำ) ===
+    elif msg_type == MSG_STATUS_BATCH:
+        status_batches.put(parse_status_batch(body))
+
+    # === สรุป latency จาก ESP32 ===
+    elif msg_type == MSG_METRICS:
+        save_metrics(parse_metrics(body))
+
+    # === ESP32 ขอตารางหอพักทั้งหมด ===
+    elif msg_type == MSG_DORM_SYNC:
+        version, = struct.unpack_from("<I", body)
+        if version != dorm_version:
+            threading.Thread(target=send_dorm_full, daemon=True).start()
+
+    else:
+        print(f"⚠️ Unknown frame type from ESP32: {msg_type:#04x}")
+
+while True:
+    try:
+        # อ่านข้อมูลที่มีอยู่ (รออย่างน้อยหนึ่งไบต์ไม่เกิน timeout ของ Serial)
+        chunk = ser.read(ser.in_waiting or 1)
+    except Exception as e:
+        print(f"⚠️ Serial read error: {e}")
+        continue
+    rx_buf += chunk
+
+    # แยกกรอบตามตัวคั่น 0x00
+    *frames, rx_buf = rx_buf.split(b"\x00")
+    if len(rx_buf) > PI_FRAME_MAX * 2:
+        rx_buf = b""  # ไม่พบตัวคั่น - ทิ้งข้อมูลเสีย
+    for frame in frames:
+        if not frame:
+            continue
+        parsed = parse_frame(frame)
+        if parsed is None:
+            print(f"⚠️ Bad frame from ESP32 ({len(frame)} bytes)")
+            continue
+        try:
+            handle_frame(*parsed)
+        except struct.error as e:
+            print(f"⚠️ Truncated frame type {parsed[0]:#04x}: {e}")
@@ -0,0 +1,67 @@
+/**
+ * Benchmark โปรไฟล์ความเร็วสายพาน: soft-start + ลดความเร็วก่อนประตู เทียบกับการเปิด/ปิด PWM เต็มแบบเดิม
+ *
+ * build สองแบบจาก source เดียว (ดู tools/Makefile):
+ *   bench_belt        ค่าใน main.cpp (ramp จาก BELT_DUTY_MIN, ช้าลงใน BELT_SLOW_ZONE_MM ก่อนประตูที่ต้องผลัก)
+ *   bench_belt_bang   duty 0 ↔ 255 ทันที ไม่มีช่วงช้า (ledcWrite(0, 255) แบบเดิม)
+ * รันสายพานจำลองทั้งพัสดุห่างกันสม่ำเสมอและพัสดุรอต่อกัน แล้วรายงานเวลาต่อพัสดุ และการกระตุกของสายพาน
+ * (จำนวนครั้งที่ความเร็วเพิ่มเกินครึ่งหนึ่งของความเร็วเต็มภายใน 1 ms ขณะมีพัสดุบนสายพาน และความเร่งสูงสุด)
+ * การหยุดสายพานหยุดทันทีทั้งสองแบบ
+ *
+ * build:  make -C tools bench
+ */
+#include "host_sim.h"
+
+#include <sys/wait.h>
+
+#define BELT_BENCH_PARCELS 40
+
+/**
+ * ฟังก์ชันรันหนึ่งรูปแบบการมาของพัสดุ แล้วพิมพ์หนึ่งแถว
+ * @param spacing_ms ระยะเวลาระหว่างพัสดุ (0 = รอต่อกันทั้งหมด)
+ */
+void run_belt(const char *name, uint32_t spacing_ms) {
+  for (int i = 0; i < BELT_BENCH_PARCELS; i++) add_parcel(sim_parcels, 1000 + i * spacing_ms, SIM_DORMS[i % 4], 0);
+  sim_pushers_init();
+  firmware_boot();
+
+  float last_speed = 0, max_accel = 0;
+  int hard_starts = 0;
+  uint32_t last_arrival = sim_parcels.back().arrive_ms;
+  uint32_t limit_ms = last_arrival + SIM_TIMEOUT_MS + BELT_BENCH_PARCELS * 5000;  // พัสดุที่รอต่อกันใช้เวลาหลังมาถึง
+  do {
+    sim_step();
+    float speed = lanes[0].belt_speed_mm_s;
+    bool loaded = lanes[0].size > 0;
+    if (loaded && speed - last_speed > BELT_SPEED_MM_S / 2) hard_starts++;
+    if (loaded && speed > last_speed) max_accel = std::max(max_accel, (speed - last_speed) * 1000);
+    last_speed = speed;
+  } while (!sim_done() && hal_millis() <= limit_ms);
+
+  SimTally t = sim_tally(false);
+  double latency = 0;
+  for (size_t i = 0; i < t.latency_ms.size(); i++) latency += t.latency_ms[i];
+  printf("  %-9s %-9s %5.1f parcels/min  %6.0f ms per parcel  intake→exit mean %6.0f ms  "
+         "hard starts %3d  peak accel %6.0f mm/s²  correct %d/%d\n",
+         BELT_DUTY_MIN == BELT_DUTY_CRUISE ? "bang-bang" : "ramp", name, t.per_min,
+         t.per_min > 0 ? 60000.0 / t.per_min : 0.0, t.latency_ms.empty() ? 0.0 : latency / t.latency_ms.size(),
+         hard_starts, max_accel, t.correct, BELT_BENCH_PARCELS);
+}
+
+int main() {
+  // แต่ละรูปแบบใน process แยก เพราะ setup() ไม่รีเซ็ตตัวแปร global ทั้งหมด
+  const uint32_t spacings[] = { 2500, 0 };
+  const char *names[] = { "steady", "burst" };
+  for (int i = 0; i < 2; i++) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+      run_belt(names[i], spacings[i]);
+      fflush(stdout);
+      _exit(0);
+    }
+    int status = 0;
+    if (pid < 0 || waitpid(pid, &status, 0) < 0) return 1;
+  }
+  return 0;
+}
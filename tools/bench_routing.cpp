@@ -0,0 +1,102 @@
+/**
+ * Benchmark การตัดสินใจที่ประตูจากตารางประตู (GATES) ของผังต่าง ๆ
+ *
+ * build ได้สามผังจาก source เดียว (ดู tools/Makefile):
+ *   bench_routing       ผังจริง 3 ประตู (LANE_LAYOUT 1)
+ *   bench_routing_g8    tools/layouts/gates8.h  - 8 ประตู ประตูละ 2 หอพัก
+ *   bench_routing_g16   tools/layouts/gates16.h - 16 ประตู ประตูละ 3 หอพัก
+ * คิวเต็ม (MAX_DORM) โดยพัสดุกระจายอยู่หน้าประตูต่าง ๆ แล้วจับเวลาการตัดสินใจหนึ่งครั้งต่อขอบ IR ประตู:
+ * หาพัสดุหน้าประตู (gate_candidate) แล้วตรวจว่าประตูรับหอพักของพัสดุหรือไม่ (gate_accepts)
+ * ผลการตัดสินใจถูกเทียบกับการหาแบบตรงไปตรงมาจากตารางก่อนจับเวลา และจับเวลา rt_iteration() ตอนสายพานว่างด้วย
+ *
+ * build:  make -C tools bench
+ */
+#include "host_hal.h"
+
+#include <time.h>
+
+#define ROUTING_DECISIONS 10000000
+#define ROUTING_IDLE_ITERATIONS 1000000
+
+uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * ฟังก์ชันจำนวนหอพักที่ผังนี้มีประตูรับ (หอพักเกินจากนี้ไปปลายสายพาน)
+ */
+int routed_dorms() {
+  int dorms = 0;
+  for (int g = 0; g < NUM_GATES; g++) {
+    for (int d = 0; d < 64; d++) {
+      if (gate_accepts(g, d) && d + 1 > dorms) dorms = d + 1;
+    }
+  }
+  return dorms;
+}
+
+int main() {
+  firmware_boot();
+  Lane &lane = lanes[0];
+  const int gates = LANES[0].gate_count;
+  const int dorms = routed_dorms();
+
+  // คิวเต็ม: พัสดุเป็นของหอพักสุ่ม (บางชิ้นไม่มีประตูรับ) ชิ้นแรก ๆ อยู่หน้าประตูละชิ้น
+  // ที่เหลืออยู่ระหว่างประตู (125 mm ก่อนถึงประตู เกิน GATE_TOLERANCE_MM)
+  uint32_t rng = 1;
+  uint32_t t_us = hal_micros();
+  float belt_mm = belt_position_at(lane, t_us);
+  int at_gate[MAX_DORM];
+  for (int i = 0; i < MAX_DORM; i++) {
+    rng = rng * 1103515245u + 12345u;
+    int dorm = (rng >> 8) % (dorms + 2);
+    CHECK(enqueue(lane, dorm, "TH0000000000"));
+    at_gate[i] = i < gates ? i : -1;
+    float pos_mm = GATES[LANES[0].first_gate + i % gates].position_mm - (i < gates ? 0 : 125);
+    queue_slot(lane, lane.queue_tail - 1).intake_mm = belt_mm - pos_mm;
+  }
+
+  // ตรวจการตัดสินใจทุกประตูกับการหาจากตารางตรง ๆ
+  for (int g = 0; g < gates; g++) {
+    int gate = LANES[0].first_gate + g;
+    uint32_t seq = gate_candidate(lane, gate, t_us);
+    int want = -1;
+    for (int i = 0; i < MAX_DORM && want < 0; i++) want = at_gate[i] == g ? i : -1;
+    CHECK(want < 0 ? seq == lane.queue_tail : seq == lane.queue_head + want);
+    if (want >= 0) {
+      int dorm = queue_slot(lane, seq).dorm;
+      CHECK(gate_accepts(gate, dorm) == ((GATES[gate].dorm_mask >> dorm) & 1));
+    }
+  }
+
+  uint64_t t0 = now_ns();
+  int pushes = 0;
+  for (int i = 0; i < ROUTING_DECISIONS; i++) {
+    int gate = LANES[0].first_gate + i % gates;
+    uint32_t seq = gate_candidate(lane, gate, t_us);
+    if (seq != lane.queue_tail) pushes += gate_accepts(gate, queue_slot(lane, seq).dorm);
+  }
+  double decision_ns = (double)(now_ns() - t0) / ROUTING_DECISIONS;
+
+  // rt_iteration() ของสายพานว่าง - ต้นทุนต่อรอบที่ไม่ขึ้นกับการตัดสินใจ
+  while (dequeue(lane) != -1) {}
+  t0 = now_ns();
+  for (int i = 0; i < ROUTING_IDLE_ITERATIONS; i++) {
+    sim_us += 1000;
+    rt_iteration(hal_millis());
+    if ((i & 255) == 255) {
+      JournalRecord rec;
+      while (journal_queue.pop(rec)) {}
+      TraceRecord tr;
+      while (trace_rings[RT_TASK_CORE].pop(tr)) {}
+    }
+  }
+  double idle_ns = (double)(now_ns() - t0) / ROUTING_IDLE_ITERATIONS;
+
+  printf("routing: %2d gates, dorms 0-%d, queue of %d: %.1f ns per gate decision (%d pushes), "
+         "idle rt_iteration %.1f ns - %s\n", gates, dorms - 1, MAX_DORM, decision_ns, pushes, idle_ns,
+         check_failures ? "FAILED" : "ok");
+  return check_failures ? 1 : 0;
+}
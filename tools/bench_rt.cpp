@@ -0,0 +1,137 @@
+/**
+ * Benchmark latency ของ task real-time บน FreeRTOS จำลองด้วย POSIX thread (tools/host_rtos.h)
+ *
+ * setup() สร้าง task comms และ task real-time เป็น thread จริงที่ทำงานพร้อมกัน
+ * thread แทน interrupt เปลี่ยนขา IR หลักและขา IR ประตูแบบสุ่ม (มีสัญญาณกระพริบเป็นช่วง ๆ) แล้วเรียก ISR
+ * thread แทน Pi ตอบคำขอ QR (อ่านไม่ได้) หลัง BENCH_RT_QR_MS และ ack ชุดสถานะทันที
+ * รัน BENCH_RT_SECONDS (น้อยกว่า METRICS_PERIOD_MS ข้อมูลทั้งหมดจึงอยู่ใน histogram ช่วงเดียว)
+ * แล้วรายงาน count/p50/p99/max ของรอบ task real-time, ขอบ IR → ประมวลผล และช่วงห่างระหว่างรอบ
+ * บน Linux ที่ไม่มีสิทธิ์ SCHED_FIFO ตัวเลขเป็นของ scheduler ปกติ (ดูบรรทัด "priority")
+ *
+ * build:  make -C tools bench
+ */
+#include "host_rtos.h"
+
+#define BENCH_RT_SECONDS 5
+#define BENCH_RT_EDGE_US 2000  // ช่วงห่างเฉลี่ยระหว่างขอบ IR
+#define BENCH_RT_BOUNCE 8      // จำนวนขอบในหนึ่งช่วงกระพริบ
+#define BENCH_RT_QR_MS 150     // เวลาที่ Pi ใช้อ่าน QR
+
+volatile bool bench_running = true;
+
+/**
+ * Thread แทน interrupt ของ IR: ขอบสุ่มทุก ~BENCH_RT_EDGE_US บาง sensor กระพริบถี่ ๆ (เร็วกว่า debounce)
+ */
+void *bench_ir_thread(void *) {
+  uint32_t rng = 1;
+  uint8_t level[NUM_IR_SENSORS];
+  for (int i = 0; i < NUM_IR_SENSORS; i++) level[i] = HIGH;
+  while (bench_running) {
+    rng = rng * 1103515245u + 12345u;
+    uint8_t sensor = (rng >> 8) % NUM_IR_SENSORS;
+    int edges = (rng >> 16) % 16 == 0 ? BENCH_RT_BOUNCE : 1;
+    for (int e = 0; e < edges; e++) {
+      level[sensor] = !level[sensor];
+      rtos_set_ir(sensor, level[sensor]);
+      if (e + 1 < edges) usleep(50);
+    }
+    usleep(BENCH_RT_EDGE_US / 2 + (rng >> 4) % BENCH_RT_EDGE_US);
+  }
+  return NULL;
+}
+
+struct BenchReply {
+  uint32_t due_ms;
+  std::vector<uint8_t> wire;
+};
+
+/**
+ * ฟังก์ชันเข้ารหัส payload ของ Pi แล้วเก็บไว้ส่งเมื่อถึงเวลา
+ */
+void bench_queue_reply(std::vector<BenchReply> &replies, PiFrame &f, uint32_t delay_ms) {
+  BenchReply r;
+  r.due_ms = hal_millis() + delay_ms;
+  r.wire.resize(PI_WIRE_MAX);
+  r.wire.resize(frame_encode(f, r.wire.data(), r.wire.size()));
+  replies.push_back(r);
+}
+
+/**
+ * Thread แทน Raspberry Pi: ตอบคำขอ QR ว่าอ่านไม่ได้ และ ack ทุกชุดสถานะ
+ */
+void *bench_pi_thread(void *) {
+  std::vector<uint8_t> in;
+  std::vector<BenchReply> replies;
+  PiFrame f;
+  while (bench_running) {
+    rtos_pi_take(in);
+    size_t start = 0;
+    for (size_t i = 0; i < in.size(); i++) {
+      if (in[i] != 0) continue;
+      uint8_t *frame = in.data() + start;
+      size_t n = cobs_decode(frame, i - start);
+      start = i + 1;
+      if (n < 3 || crc16_ccitt(frame, n - 2) != rd_u16(frame + n - 2)) continue;
+      if (frame[0] == MSG_QR_REQUEST) {
+        frame_begin(f, MSG_QR_RESULT);
+        frame_u8(f, frame[1]);
+        frame_u32(f, rd_u32(frame + 2));
+        frame_str(f, TRACKING_UNREAD);
+        bench_queue_reply(replies, f, BENCH_RT_QR_MS);
+      } else if (frame[0] == MSG_STATUS_BATCH) {
+        frame_begin(f, MSG_ACK);
+        frame_u16(f, rd_u16(frame + 1));
+        bench_queue_reply(replies, f, 0);
+      }
+    }
+    in.erase(in.begin(), in.begin() + start);
+
+    for (size_t i = 0; i < replies.size(); ) {
+      if ((int32_t)(hal_millis() - replies[i].due_ms) < 0) {
+        i++;
+        continue;
+      }
+      rtos_pi_send(replies[i].wire.data(), replies[i].wire.size());
+      replies.erase(replies.begin() + i);
+    }
+    usleep(1000);
+  }
+  return NULL;
+}
+
+/**
+ * ฟังก์ชันพิมพ์หนึ่งแถวของ histogram
+ */
+void print_metric(uint8_t id) {
+  const LatencyHist &h = metrics[id];
+  bool valid = h.epoch == metrics_epoch && h.count > 0;
+  printf("  %-10s %8u samples  p50 %8u  p99 %8u  max %8u %s\n", METRICS[id].name, valid ? h.count : 0,
+         valid ? metrics_percentile(h, 50) : 0, valid ? metrics_percentile(h, 99) : 0, valid ? h.max : 0,
+         METRICS[id].unit);
+}
+
+int main() {
+  rtos_boot();
+  pthread_t ir, pi;
+  pthread_create(&ir, NULL, bench_ir_thread, NULL);
+  pthread_create(&pi, NULL, bench_pi_thread, NULL);
+  sleep(BENCH_RT_SECONDS);
+  bench_running = false;
+  pthread_join(ir, NULL);
+  pthread_join(pi, NULL);
+
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  printf("rt task latency, %d s wall time, %ld CPUs, IR edge every ~%d us\n", BENCH_RT_SECONDS, cpus,
+         BENCH_RT_EDGE_US);
+  for (int i = 0; i < rtos_task_count; i++) {
+    printf("  task %-6s core %u (CPU %ld)  priority %u  %s\n", rtos_tasks[i].name, rtos_tasks[i].core,
+           rtos_tasks[i].core % cpus, rtos_tasks[i].priority,
+           rtos_tasks[i].realtime ? "SCHED_FIFO" : "SCHED_OTHER (no realtime privilege)");
+  }
+  print_metric(METRIC_RT_LOOP);
+  print_metric(METRIC_IR_EDGE);
+  print_metric(METRIC_RT_PERIOD);
+  printf("  ir events dropped %u  trace bytes %u\n", (unsigned)ir_event_dropped, (unsigned)rtos_debug_bytes);
+  fflush(stdout);
+  _exit(0);                                      // task ของ firmware ไม่มีวันจบ
+}
@@ -0,0 +1,62 @@
+/**
+ * Benchmark อัตราการคัดแยกผิดเทียบกับระยะห่างระหว่างพัสดุและความคลาดเคลื่อนของความเร็วสายพาน
+ *
+ * พัสดุทุกชิ้นรออยู่ต้นสายพาน และถูกวางทันทีที่ชิ้นก่อนหน้าห่างออกไป sim_gap_mm (ระยะห่างจริงบนสายพาน)
+ * รันทุกคู่ของระยะห่าง × slip (ความเร็วจริง / ค่าที่ calibrate) ทั้งโหมดหยุดสแกนและโหมดสแกนต่อเนื่อง
+ * แล้วรายงานสัดส่วนพัสดุที่ไปผิดที่ (ผลักผิดประตู + ไปปลายสายพานแทนประตู) และอัตราการส่ง
+ * แต่ละรันอยู่ใน process แยก (fork) เพราะ setup() ไม่รีเซ็ตตัวแปร global ทั้งหมด
+ *
+ * build:  make -C tools bench
+ */
+#include "host_sim.h"
+
+#include <sys/wait.h>
+
+#define SPACING_PARCELS 60
+
+const float SPACING_GAPS_MM[] = { 45, 50, 60, 80, 120, 200 };
+const float SPACING_SLIPS[] = { 1.0f, 0.97f, 0.94f };
+
+/**
+ * ฟังก์ชันรันหนึ่งคู่ระยะห่าง/slip แล้วพิมพ์หนึ่งแถว
+ */
+void run_spacing(float gap_mm, float slip, bool continuous) {
+  sim_gap_mm = gap_mm;
+  sim_slip = slip;
+  for (int i = 0; i < SPACING_PARCELS; i++) {
+    int dorm = i % 5 == 4 ? -1 : SIM_DORMS[sim_rand() % 4];
+    add_parcel(sim_parcels, 1000, dorm, 0);
+  }
+  sim_pushers_init();
+  firmware_boot();
+  scan_continuous = continuous;
+  do {
+    sim_step();
+  } while (!sim_done() && hal_millis() <= 1000 + SPACING_PARCELS * 10000);
+  SimTally t = sim_tally(false);
+  int wrong = t.misrouted + t.missed + t.stranded;
+  printf("  %-10s gap %5.0f mm  slip %.2f  wrong %5.1f%% (misrouted %2d  missed %2d  stranded %2d)  %5.1f parcels/min\n",
+         continuous ? "continuous" : "stop", gap_mm, slip, 100.0 * wrong / SPACING_PARCELS, t.misrouted, t.missed,
+         t.stranded, t.per_min);
+}
+
+int main() {
+  printf("misroute rate vs parcel spacing, %d parcels (parcel %.0f mm long, gate tolerance %.0f mm)\n",
+         SPACING_PARCELS, PARCEL_LEN_MM, GATE_TOLERANCE_MM);
+  for (int mode = 0; mode < 2; mode++) {
+    for (size_t s = 0; s < sizeof(SPACING_SLIPS) / sizeof(SPACING_SLIPS[0]); s++) {
+      for (size_t g = 0; g < sizeof(SPACING_GAPS_MM) / sizeof(SPACING_GAPS_MM[0]); g++) {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+          run_spacing(SPACING_GAPS_MM[g], SPACING_SLIPS[s], mode == 1);
+          fflush(stdout);
+          _exit(0);
+        }
+        int status = 0;
+        if (pid < 0 || waitpid(pid, &status, 0) < 0) return 1;
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,130 @@
+/**
+ * Benchmark เวลาต่อรอบของ loop: trace แบบ binary ลง ring buffer เทียบกับ Serial.println แบบเดิม
+ *
+ * รันสายพานจำลองกับ firmware ที่ TRACE_LEVEL_DEBUG (ทุกเหตุการณ์ที่โค้ดเดิมเคยพิมพ์)
+ *   binary: เวลา CPU จริงของ rt_iteration + comms_iteration ต่อรอบ (รวมการ push ลง ring และ trace_drain)
+ *   text:   เวลาเดียวกัน + เวลาที่ Serial.println บล็อกเมื่อ TX FIFO (UART_FIFO_BYTES) เต็ม
+ *           ทุก record ที่เกิดในรอบถูกนับเป็นข้อความหนึ่งบรรทัด ส่งออกที่ 115200 baud (8N1 = 10 bit/ไบต์)
+ * เวลา CPU วัดบน host (เร็วกว่า ESP32) ส่วนที่บล็อกของ UART ไม่ขึ้นกับ CPU จึงเป็นตัวกำหนดผลต่าง
+ *
+ * build:  make -C tools bench
+ */
+#include "host_sim.h"
+
+#include <time.h>
+
+#define UART_BAUD 115200
+#define UART_FIFO_BYTES 128    // TX FIFO ของ UART0 บน ESP32 (Serial ไม่มี buffer ใน RAM เพิ่มโดยค่าเริ่มต้น)
+#define TEXT_LINE_BASE 26      // ข้อความเฉลี่ยของบรรทัดเดิม ไม่รวมตัวเลข (เช่น "📦 Queue size: " + "\r\n")
+#define BENCH_PARCELS 120
+
+/**
+ * ฟังก์ชันเวลา CPU จริงเป็นนาโนวินาที
+ */
+uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * ฟังก์ชันจำนวนตัวอักษรของตัวเลขเมื่อพิมพ์เป็นข้อความ
+ */
+int text_digits(int32_t v) {
+  char buf[16];
+  return snprintf(buf, sizeof(buf), "%d", (int)v);
+}
+
+double fifo_bytes = 0;         // ไบต์ที่ค้างใน TX FIFO (โมเดลของ Serial.println)
+uint64_t fifo_at_us = 0;       // เวลาเสมือนที่อัพเดท fifo_bytes ล่าสุด
+
+/**
+ * ฟังก์ชันเวลาที่ Serial.println บล็อกเมื่อเขียนข้อความ len ไบต์ลง TX FIFO
+ * @return ไมโครวินาทีที่ loop ต้องรอ
+ */
+double text_write_block_us(int len) {
+  const double us_per_byte = 10e6 / UART_BAUD;
+  fifo_bytes = std::max(0.0, fifo_bytes - (sim_us - fifo_at_us) / us_per_byte);
+  fifo_at_us = sim_us;
+  double over = fifo_bytes + len - UART_FIFO_BYTES;
+  fifo_bytes = std::min<double>(fifo_bytes + len, UART_FIFO_BYTES);
+  return over > 0 ? over * us_per_byte : 0;
+}
+
+/**
+ * ฟังก์ชันรวม record ใหม่ใน ring ของ core หนึ่ง (ตั้งแต่ head เดิม) เป็นเวลาที่ text logging บล็อก
+ */
+double text_block_since(uint8_t core, uint32_t head) {
+  double blocked = 0;
+  const SpscRing<TraceRecord, TRACE_CAPACITY> &ring = trace_rings[core];
+  for (uint32_t h = head; h != ring.head; h++) {
+    const TraceRecord &rec = ring.items[h & (TRACE_CAPACITY - 1)];
+    blocked += text_write_block_us(TEXT_LINE_BASE + text_digits(rec.a) + text_digits(rec.b));
+  }
+  return blocked;
+}
+
+/**
+ * ฟังก์ชันพิมพ์ค่าเฉลี่ย p99 และสูงสุดของเวลาต่อรอบ
+ */
+void report(const char *name, std::vector<double> &us) {
+  std::sort(us.begin(), us.end());
+  double sum = 0;
+  size_t over_ms = 0;
+  for (size_t i = 0; i < us.size(); i++) {
+    sum += us[i];
+    over_ms += us[i] >= 1000;
+  }
+  printf("  %-7s mean %8.2f us  p99 %8.2f us  max %9.2f us  iterations over 1 ms: %zu\n", name,
+         sum / us.size(), percentile(us, 99), us.back(), over_ms);
+}
+
+int main() {
+  for (int i = 0; i < BENCH_PARCELS; i++) add_parcel(sim_parcels, 1000 + i * 2500, SIM_DORMS[i % 4], 0);
+  sim_pushers_init();
+  firmware_boot();
+
+  std::vector<double> binary_us, text_us;
+  std::vector<double> busy_binary_us, busy_text_us;   // เฉพาะรอบที่มี record (รอบที่พัสดุมีเหตุการณ์)
+  uint32_t last_arrival = sim_parcels.back().arrive_ms;
+  do {
+    sim_pi_update();
+    sim_belt_update();
+    sim_pushers_update();
+
+    // firmware_tick() แบบจับเวลา - ก่อน trace_drain() ของรอบนี้ record ใหม่ยังอยู่ใน ring
+    sim_us = (sim_us / 1000 + 1) * 1000;
+    uint32_t rt_head = trace_rings[RT_TASK_CORE].head;
+    uint64_t t0 = now_ns();
+    sim_core = RT_TASK_CORE;
+    rt_iteration(hal_millis());
+    uint64_t t1 = now_ns();
+    double blocked = text_block_since(RT_TASK_CORE, rt_head);
+    uint32_t records = trace_rings[RT_TASK_CORE].head - rt_head;
+    uint32_t comms_head = trace_rings[COMMS_TASK_CORE].head;
+    sim_core = COMMS_TASK_CORE;
+    uint64_t t2 = now_ns();
+    comms_iteration(hal_millis());
+    uint64_t t3 = now_ns();
+    // record ที่ trace_drain() ส่งออกไปแล้วในรอบเดียวกันยังอยู่ใน items[] (ring ไม่ถูกเขียนทับ)
+    blocked += text_block_since(COMMS_TASK_CORE, comms_head);
+
+    double cpu_us = ((t1 - t0) + (t3 - t2)) / 1000.0;
+    binary_us.push_back(cpu_us);
+    text_us.push_back(cpu_us + blocked);         // loop() เดิมทำทั้งสองงานในรอบเดียว
+    if (records + trace_rings[COMMS_TASK_CORE].head - comms_head > 0) {
+      busy_binary_us.push_back(cpu_us);
+      busy_text_us.push_back(cpu_us + blocked);
+    }
+  } while (!sim_done() && hal_millis() <= last_arrival + SIM_TIMEOUT_MS);
+
+  SimTally t = sim_tally(false);
+  printf("loop time per 1 ms iteration, %d parcels (%d correct), %zu iterations, %zu trace records\n",
+         BENCH_PARCELS, t.correct, binary_us.size(), traces.size());
+  report("binary", binary_us);
+  report("text", text_us);
+  printf("iterations that emitted trace records (%zu)\n", busy_binary_us.size());
+  report("binary", busy_binary_us);
+  report("text", busy_text_us);
+  return 0;
+}
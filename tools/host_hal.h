@@ -0,0 +1,318 @@
+/**
+ * HAL ของ firmware บน host (เวลาเสมือน) - ใช้ร่วมกันโดยทุกเครื่องมือใน tools/
+ *
+ * include main.cpp ที่ compile ด้วย -DHAL_HOST แล้วให้ implementation ของ hal_*:
+ *   - เวลาเสมือนทีละ 1 ms (firmware_tick เรียก rt_iteration แล้ว comms_iteration)
+ *   - ขา IR/feedback เสมือน, ADC, flash ในหน่วยความจำ (ตัดไฟได้ด้วย flash_budget)
+ *   - Serial2 เป็น buffer ในหน่วยความจำ หรือ PTY (pty_master) ให้โปรแกรมอื่นเป็น Pi
+ *   - trace ที่ firmware ส่งออกถูกเก็บใน traces
+ * แต่ละเครื่องมือเป็น translation unit เดียว (include ไฟล์นี้ครั้งเดียว) ดู tools/Makefile
+ */
+#ifndef HOST_HAL_H
+#define HOST_HAL_H
+
+#include "../main.cpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+// ===================================
+// HAL บน host (เวลาเสมือน)
+// ===================================
+#define HOST_HEAP_SIZE (320 * 1024)    // ขนาด heap สมมติของ hal_free_heap() (DRAM ของ ESP32)
+#define HOST_FLASH_SIZE 0x160000       // ขนาด partition spiffs ของ partition table ค่าเริ่มต้น (1.375 MB)
+
+uint64_t sim_us = 0;                   // เวลาเสมือน (ไม่วนรอบ)
+uint8_t sim_core = 1;                  // core ของรอบที่กำลังทำงาน (เลือก ring ของ trace)
+uint8_t pin_level[256];                // ระดับขา input
+uint8_t pin_out[256];                  // ระดับขา output ล่าสุด
+uint32_t adc_mv[256];                  // แรงดันขา ADC (current sense ของมอเตอร์ผลัก)
+void (*pin_isr[256])(void);            // ISR ที่ผูกกับแต่ละขา
+std::vector<uint8_t> pi_rx;            // ไบต์ที่ Pi ส่งมาแต่ ESP32 ยังไม่ได้อ่าน
+size_t pi_rx_pos = 0;
+std::vector<uint8_t> pi_tx;            // ไบต์ที่ ESP32 ส่งไป Pi (ยังไม่ได้แยกกรอบ)
+int pty_master = -1;                   // >= 0: Serial2 ผ่าน PTY แทน pi_rx/pi_tx
+uint32_t pty_written = 0;              // ไบต์ที่ firmware เขียนลง PTY แล้ว
+uint32_t pty_dropped = 0;              // ไบต์ที่เขียนไม่ได้เพราะ PTY เต็ม (เหมือน TX ของ UART ล้น)
+uint8_t flash_mem[HOST_FLASH_SIZE];
+long flash_budget = -1;                // จำนวนไบต์ที่เขียน/ลบได้ก่อนไฟดับ (-1 = ไม่จำกัด)
+bool power_lost = false;               // ไฟดับแล้ว - flash ไม่เปลี่ยนอีก
+
+struct SimTrace {
+  uint64_t time_us;
+  uint8_t id;
+  int32_t a;
+  int32_t b;
+};
+
+std::vector<SimTrace> traces;          // trace ทั้งหมดที่ firmware ส่งออก
+bool open_loop = false;                // ปิด feedback ของมอเตอร์ผลักทุกตัวหลัง boot
+
+uint32_t hal_millis() { return (uint32_t)(sim_us / 1000); }
+uint32_t hal_micros() { return (uint32_t)sim_us; }
+uint32_t hal_cycles() { return (uint32_t)(sim_us * 240); }
+uint32_t hal_cpu_mhz() { return 240; }
+uint32_t hal_free_heap() { return HOST_HEAP_SIZE - (uint32_t)mallinfo2().uordblks; }
+void hal_pin_mode(uint8_t, uint8_t) {}
+int hal_digital_read(uint8_t pin) { return pin_level[pin]; }
+void hal_digital_write(uint8_t pin, uint8_t level) { pin_out[pin] = level; }
+void hal_attach_interrupt(uint8_t pin, void (*isr)(void), int) { pin_isr[pin] = isr; }
+uint32_t hal_analog_read_mv(uint8_t pin) { return adc_mv[pin]; }
+void hal_pwm_setup(uint8_t, uint8_t, uint32_t, uint8_t) {}
+void hal_pwm_write(uint8_t, uint32_t) {}
+void hal_pi_begin(uint32_t) {}
+int hal_pi_available() {
+  if (pty_master >= 0) {                         // อ่านทุกอย่างที่ PTY มีโดยไม่รอ
+    uint8_t buf[1024];
+    ssize_t n;
+    while ((n = read(pty_master, buf, sizeof(buf))) > 0) pi_rx.insert(pi_rx.end(), buf, buf + n);
+  }
+  return (int)(pi_rx.size() - pi_rx_pos);
+}
+size_t hal_pi_read_bytes(uint8_t *buf, size_t len) {
+  size_t n = std::min(len, pi_rx.size() - pi_rx_pos);
+  memcpy(buf, pi_rx.data() + pi_rx_pos, n);
+  pi_rx_pos += n;
+  if (pi_rx_pos == pi_rx.size()) {
+    pi_rx.clear();
+    pi_rx_pos = 0;
+  }
+  return n;
+}
+size_t hal_pi_write(const uint8_t *data, size_t len) {
+  if (pty_master < 0) {
+    pi_tx.insert(pi_tx.end(), data, data + len);
+    return len;
+  }
+  size_t done = 0;
+  while (done < len) {
+    ssize_t n = write(pty_master, data + done, len - done);
+    if (n <= 0) {
+      pty_dropped += len - done;                 // Pi ไม่อ่าน - ทิ้งส่วนที่เหลือ
+      break;
+    }
+    done += n;
+  }
+  pty_written += done;
+  return done;
+}
+void hal_debug_begin(uint32_t) {}
+int hal_debug_room() { return 1 << 16; }
+size_t hal_debug_write(const uint8_t *data, size_t len) {
+  // trace_drain() เขียนทีละ record เต็ม
+  if (len == TRACE_FRAME_SIZE && data[0] == TRACE_SYNC) {
+    SimTrace t;
+    t.id = data[1];
+    t.time_us = (sim_us & ~0xFFFFFFFFULL) | rd_u32(data + 2);
+    t.a = (int32_t)rd_u32(data + 6);
+    t.b = (int32_t)rd_u32(data + 10);
+    traces.push_back(t);
+  }
+  return len;
+}
+bool hal_task_create(void (*)(void *), const char *, uint32_t, uint8_t, uint8_t, hal_task_t *) { return true; }
+void hal_task_wait(uint32_t) {}
+void hal_task_notify_from_isr(hal_task_t) {}
+uint8_t hal_core_id() { return sim_core; }
+bool hal_flash_read(uint32_t offset, void *data, size_t len) {
+  if (offset + len > sizeof(flash_mem)) return false;
+  memcpy(data, flash_mem + offset, len);
+  return true;
+}
+bool hal_flash_write(uint32_t offset, const void *data, size_t len) {
+  if (offset + len > sizeof(flash_mem)) return false;
+  if (power_lost) return true;                   // firmware ไม่รู้ว่าไฟดับ
+  for (size_t i = 0; i < len; i++) {
+    if (flash_budget == 0) {                     // ไฟดับกลาง record
+      power_lost = true;
+      break;
+    }
+    if (flash_budget > 0) flash_budget--;
+    flash_mem[offset + i] &= ((const uint8_t *)data)[i];  // เขียนได้เฉพาะ 1 → 0
+  }
+  return true;
+}
+bool hal_flash_erase(uint32_t offset) {
+  if (offset + HAL_FLASH_SECTOR > sizeof(flash_mem)) return false;
+  if (power_lost) return true;
+  if (flash_budget >= 0 && flash_budget < HAL_FLASH_SECTOR) {
+    memset(flash_mem + offset, 0xFF, flash_budget); // ไฟดับระหว่างลบ - ลบได้เพียงบางส่วน
+    flash_budget = 0;
+    power_lost = true;
+    return true;
+  }
+  if (flash_budget > 0) flash_budget -= HAL_FLASH_SECTOR;
+  memset(flash_mem + offset, 0xFF, HAL_FLASH_SECTOR);
+  return true;
+}
+uint32_t hal_flash_size() { return sizeof(flash_mem); }
+
+/**
+ * ฟังก์ชันสร้าง PTY ให้ Serial2 ของ firmware (ฝั่ง master) - Pi เปิดฝั่ง slave เหมือนเปิด /dev/ttyS0
+ * @param slave_path รับ path ของฝั่ง slave (เช่น /dev/pts/3)
+ * @return false หากสร้าง PTY ไม่ได้
+ */
+bool pty_open(char *slave_path, size_t len) {
+  int fd = posix_openpt(O_RDWR | O_NOCTTY);
+  if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0 || ptsname_r(fd, slave_path, len) != 0) {
+    if (fd >= 0) close(fd);
+    return false;
+  }
+  // ตั้ง raw ที่ฝั่ง slave ตั้งแต่ต้น (ไม่ echo ไม่แปลง \n) เพราะกรอบ COBS เป็นไบนารี
+  int slave = open(slave_path, O_RDWR | O_NOCTTY);
+  struct termios tio;
+  if (slave < 0 || tcgetattr(slave, &tio) != 0) {
+    if (slave >= 0) close(slave);
+    close(fd);
+    return false;
+  }
+  cfmakeraw(&tio);
+  tcsetattr(slave, TCSANOW, &tio);
+  close(slave);
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+  pty_master = fd;
+  return true;
+}
+
+#define PTY_SETTLE_MS 50       // เวลารอสูงสุดให้ไบต์ข้าม PTY
+
+/**
+ * ฟังก์ชันรอให้ fd มีข้อมูลให้อ่าน (PTY ส่งข้อมูลข้ามฝั่งแบบ asynchronous)
+ */
+void pty_settle(int fd) {
+  struct pollfd p;
+  p.fd = fd;
+  p.events = POLLIN;
+  poll(&p, 1, PTY_SETTLE_MS);
+}
+
+// ===================================
+// Input ของลอจิกควบคุม
+// ===================================
+// รูปแบบไฟล์ .rec ต้องตรงกับ Recording ใน tools/trace_decode.py (อ่าน/เขียนใน tools/replay.cpp)
+// "PREC" version:1 แล้วตามด้วย record: [ชนิด:1][เวลาห่างจาก record ก่อนหน้า us: varint][ข้อมูล]
+#define REC_IR 1               // sensor:1 level:1
+#define REC_PI 2               // len:1 ไบต์ที่รับจาก Pi
+#define REC_FEEDBACK 3         // input:1 level:1 (feedback ของมอเตอร์ผลัก input = ประตู*2 + ปลายทาง)
+#define FEEDBACK_HIGH_MV (2 * PUSHER_STALL_MV) // แรงดันแทน "เกิน PUSHER_STALL_MV" ตอน replay
+
+struct InputEvent {
+  uint64_t time_us;
+  uint8_t kind;                // REC_IR / REC_PI / REC_FEEDBACK
+  uint8_t sensor;              // IR sensor หรือ input ของ feedback
+  uint8_t level;
+  std::vector<uint8_t> data;
+};
+
+std::vector<InputEvent> recorded;      // input ที่ส่งเข้า firmware แล้ว (สำหรับ --save)
+
+/**
+ * ฟังก์ชันส่ง input หนึ่งรายการเข้า firmware ณ เวลาปัจจุบัน
+ */
+void inject(const InputEvent &ev) {
+  if (ev.kind == REC_IR) {
+    if (ev.sensor >= NUM_IR_SENSORS) return;
+    uint8_t pin = ir_pin(ev.sensor);
+    pin_level[pin] = ev.level;
+    if (pin_isr[pin]) pin_isr[pin]();            // ISR อ่านเวลาจาก hal_micros()
+  } else if (ev.kind == REC_FEEDBACK) {
+    if (ev.sensor >= NUM_GATES * 2) return;
+    const GateConfig &gate = GATES[ev.sensor / 2];
+    if (gate.feedback == PUSHER_FB_CURRENT) adc_mv[gate.sense_out] = ev.level ? FEEDBACK_HIGH_MV : 0;
+    else if (gate.feedback == PUSHER_FB_LIMIT) pin_level[ev.sensor & 1 ? gate.sense_in : gate.sense_out] = ev.level;
+  } else {
+    pi_rx.insert(pi_rx.end(), ev.data.begin(), ev.data.end());
+  }
+  // เวลาใน .rec เหมือนที่ firmware บันทึก: IR = เวลาขอบสัญญาณ
+  // input ที่ firmware อ่านเองเป็นรอบ (Pi, feedback) = เวลาที่อ่าน ซึ่งคือรอบถัดไป
+  recorded.push_back(ev);
+  recorded.back().time_us = ev.kind == REC_IR ? sim_us : (sim_us / 1000 + 1) * 1000;
+}
+
+/**
+ * ฟังก์ชันเปลี่ยนระดับ IR เสมือน (ส่ง input เฉพาะเมื่อระดับเปลี่ยน)
+ */
+void set_ir(uint8_t sensor, uint8_t level) {
+  if (pin_level[ir_pin(sensor)] == level) return;
+  InputEvent ev;
+  ev.kind = REC_IR;
+  ev.sensor = sensor;
+  ev.level = level;
+  inject(ev);
+}
+
+// ===================================
+// รอบการทำงานของ firmware
+// ===================================
+/**
+ * ฟังก์ชันเริ่ม firmware ที่เวลาเสมือน 0
+ * @param keep_flash true = ใช้ flash เดิม (จำลองการรีเซ็ตหลังไฟดับ)
+ */
+void firmware_boot(bool keep_flash = false) {
+  sim_us = 0;
+  memset(pin_level, HIGH, sizeof(pin_level));    // IR active low - ไม่มีพัสดุ
+  memset(pin_out, 0, sizeof(pin_out));
+  memset(adc_mv, 0, sizeof(adc_mv));
+  if (!keep_flash) memset(flash_mem, 0xFF, sizeof(flash_mem));
+  flash_budget = -1;
+  power_lost = false;
+  pi_rx.clear();
+  pi_rx_pos = 0;
+  pi_tx.clear();
+  traces.clear();
+  recorded.clear();
+  setup();
+  for (int i = 0; open_loop && i < NUM_GATES; i++) pushers[i].feedback_ok = false;
+}
+
+/**
+ * ฟังก์ชันเดินเวลาเสมือนไปยังขอบมิลลิวินาทีถัดไป แล้วทำงานหนึ่งรอบของทั้งสอง task
+ */
+void firmware_tick() {
+  sim_us = (sim_us / 1000 + 1) * 1000;
+  sim_core = RT_TASK_CORE;
+  rt_iteration(hal_millis());
+  sim_core = COMMS_TASK_CORE;
+  comms_iteration(hal_millis());
+}
+
+/**
+ * ฟังก์ชันรันต่อโดยไม่มี input ใหม่ REPLAY_TAIL_MS นับจาก input สุดท้าย ให้พัสดุที่ค้างหมดเวลา
+ * (ใช้ทั้งตอน replay และตอนจบสถานการณ์ digest จึงเทียบกันได้)
+ */
+#define REPLAY_TAIL_MS 30000
+
+void firmware_drain() {
+  uint64_t end = (recorded.empty() ? sim_us : recorded.back().time_us) + REPLAY_TAIL_MS * 1000ULL;
+  while (sim_us < end) firmware_tick();
+}
+
+/**
+ * ฟังก์ชันนับ trace ตามชนิด
+ */
+int count_traces(uint8_t id) {
+  int n = 0;
+  for (size_t i = 0; i < traces.size(); i++) n += traces[i].id == id;
+  return n;
+}
+
+/**
+ * ฟังก์ชันตรวจเงื่อนไขของ test - พิมพ์ตำแหน่งและนับเมื่อไม่ผ่าน
+ */
+int check_failures = 0;
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+      fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+      check_failures++; \
+    } \
+  } while (0)
+
+#endif
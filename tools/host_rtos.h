@@ -0,0 +1,229 @@
+/**
+ * HAL ของ firmware บน host แบบเวลาจริง: task ของ FreeRTOS เป็น POSIX thread
+ *
+ * ต่างจาก host_hal.h (เวลาเสมือน ทุก task เรียกสลับกันใน thread เดียว) ไฟล์นี้ให้ setup() สร้าง task จริง
+ *   - hal_task_create: pthread ผูกกับ CPU (core % จำนวน CPU) และขอ SCHED_FIFO ตาม priority หากได้รับสิทธิ์
+ *   - hal_task_wait / hal_task_notify_from_isr: condition variable แทน task notification
+ *   - hal_micros / hal_cycles: CLOCK_MONOTONIC (ตัวนับรอบ = ns, hal_cpu_mhz() = 1000)
+ *   - ขา IR เป็นตัวแปรที่ thread อื่น (แทน interrupt) เขียนแล้วเรียก ISR เอง
+ *   - Serial2 เป็น buffer ในหน่วยความจำที่ล็อกด้วย mutex (rtos_pi_send / rtos_pi_take)
+ * ใช้วัด latency ของ task real-time เมื่อ task comms ทำงานพร้อมกันจริง (tools/bench_rt.cpp)
+ */
+#ifndef HOST_RTOS_H
+#define HOST_RTOS_H
+
+#include "../main.cpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HOST_HEAP_SIZE (320 * 1024)    // ขนาด heap สมมติของ hal_free_heap() (DRAM ของ ESP32)
+#define HOST_FLASH_SIZE 0x160000       // ขนาด partition spiffs ของ partition table ค่าเริ่มต้น (1.375 MB)
+
+struct RtosTask {
+  void (*fn)(void *);
+  const char *name;
+  uint8_t core;
+  uint8_t priority;
+  bool realtime;               // ได้ SCHED_FIFO จริง
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int notified;                // จำนวน notify ที่ยังไม่ได้รับ
+};
+
+RtosTask rtos_tasks[4];
+int rtos_task_count = 0;
+thread_local RtosTask *rtos_self = NULL;       // task ของ thread ปัจจุบัน
+thread_local uint8_t rtos_core = COMMS_TASK_CORE; // core ของ thread ที่ไม่ใช่ task (setup)
+uint64_t rtos_start_ns = 0;
+
+volatile uint8_t rtos_pin_level[256];          // ระดับขา input (thread ที่แทน interrupt เป็นผู้เขียน)
+void (*rtos_pin_isr[256])(void);               // ISR ที่ผูกกับแต่ละขา
+uint8_t rtos_flash[HOST_FLASH_SIZE];
+pthread_mutex_t rtos_pi_lock = PTHREAD_MUTEX_INITIALIZER;
+std::vector<uint8_t> rtos_pi_rx;               // Pi → ESP32
+std::vector<uint8_t> rtos_pi_tx;               // ESP32 → Pi
+volatile uint32_t rtos_debug_bytes = 0;        // ไบต์ของ trace ที่ task comms ส่งออก
+
+/**
+ * ฟังก์ชันเวลาจริงเป็นนาโนวินาทีนับจาก boot
+ */
+uint64_t rtos_now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec - rtos_start_ns;
+}
+
+uint32_t hal_millis() { return (uint32_t)(rtos_now_ns() / 1000000); }
+uint32_t hal_micros() { return (uint32_t)(rtos_now_ns() / 1000); }
+uint32_t hal_cycles() { return (uint32_t)rtos_now_ns(); }
+uint32_t hal_cpu_mhz() { return 1000; }
+uint32_t hal_free_heap() { return HOST_HEAP_SIZE - (uint32_t)mallinfo2().uordblks; }
+void hal_pin_mode(uint8_t, uint8_t) {}
+int hal_digital_read(uint8_t pin) { return rtos_pin_level[pin]; }
+void hal_digital_write(uint8_t, uint8_t) {}
+void hal_attach_interrupt(uint8_t pin, void (*isr)(void), int) { rtos_pin_isr[pin] = isr; }
+uint32_t hal_analog_read_mv(uint8_t) { return 0; }
+void hal_pwm_setup(uint8_t, uint8_t, uint32_t, uint8_t) {}
+void hal_pwm_write(uint8_t, uint32_t) {}
+void hal_pi_begin(uint32_t) {}
+int hal_pi_available() {
+  pthread_mutex_lock(&rtos_pi_lock);
+  int n = (int)rtos_pi_rx.size();
+  pthread_mutex_unlock(&rtos_pi_lock);
+  return n;
+}
+size_t hal_pi_read_bytes(uint8_t *buf, size_t len) {
+  pthread_mutex_lock(&rtos_pi_lock);
+  size_t n = std::min(len, rtos_pi_rx.size());
+  memcpy(buf, rtos_pi_rx.data(), n);
+  rtos_pi_rx.erase(rtos_pi_rx.begin(), rtos_pi_rx.begin() + n);
+  pthread_mutex_unlock(&rtos_pi_lock);
+  return n;
+}
+size_t hal_pi_write(const uint8_t *data, size_t len) {
+  pthread_mutex_lock(&rtos_pi_lock);
+  rtos_pi_tx.insert(rtos_pi_tx.end(), data, data + len);
+  pthread_mutex_unlock(&rtos_pi_lock);
+  return len;
+}
+void hal_debug_begin(uint32_t) {}
+int hal_debug_room() { return 1 << 16; }
+size_t hal_debug_write(const uint8_t *, size_t len) {
+  rtos_debug_bytes += len;
+  return len;
+}
+
+/**
+ * ฟังก์ชันเริ่ม thread ของ task: ผูก core แล้วเรียกฟังก์ชันของ task
+ */
+void *rtos_task_main(void *arg) {
+  RtosTask *task = (RtosTask *)arg;
+  rtos_self = task;
+  rtos_core = task->core;
+  task->fn(NULL);
+  return NULL;
+}
+
+bool hal_task_create(void (*fn)(void *), const char *name, uint32_t, uint8_t priority, uint8_t core,
+                     hal_task_t *handle) {
+  if (rtos_task_count >= (int)(sizeof(rtos_tasks) / sizeof(rtos_tasks[0]))) return false;
+  RtosTask *task = &rtos_tasks[rtos_task_count++];
+  task->fn = fn;
+  task->name = name;
+  task->core = core;
+  task->priority = priority;
+  task->notified = 0;
+  pthread_mutex_init(&task->lock, NULL);
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&task->cond, &attr);
+  if (handle) *handle = task;                    // ISR ใช้ handle ได้ก่อน task เริ่ม
+
+  if (pthread_create(&task->thread, NULL, rtos_task_main, task) != 0) return false;
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(core % sysconf(_SC_NPROCESSORS_ONLN), &cpus);
+  pthread_setaffinity_np(task->thread, sizeof(cpus), &cpus);
+  struct sched_param sp;
+  sp.sched_priority = sched_get_priority_min(SCHED_FIFO) + priority;
+  task->realtime = pthread_setschedparam(task->thread, SCHED_FIFO, &sp) == 0;  // ต้องมีสิทธิ์ (เช่น root)
+  return true;
+}
+
+void hal_task_wait(uint32_t timeout_ms) {
+  RtosTask *task = rtos_self;
+  if (!task) {                                   // loop() ของ Arduino
+    usleep(timeout_ms * 1000);
+    return;
+  }
+  struct timespec until;
+  clock_gettime(CLOCK_MONOTONIC, &until);
+  until.tv_nsec += (long)timeout_ms * 1000000L;
+  until.tv_sec += until.tv_nsec / 1000000000L;
+  until.tv_nsec %= 1000000000L;
+  pthread_mutex_lock(&task->lock);
+  while (task->notified == 0) {
+    if (pthread_cond_timedwait(&task->cond, &task->lock, &until) != 0) break;
+  }
+  task->notified = 0;
+  pthread_mutex_unlock(&task->lock);
+}
+
+void hal_task_notify_from_isr(hal_task_t handle) {
+  RtosTask *task = (RtosTask *)handle;
+  pthread_mutex_lock(&task->lock);
+  task->notified++;
+  pthread_cond_signal(&task->cond);
+  pthread_mutex_unlock(&task->lock);
+}
+
+uint8_t hal_core_id() { return rtos_core; }
+
+bool hal_flash_read(uint32_t offset, void *data, size_t len) {
+  if (offset + len > sizeof(rtos_flash)) return false;
+  memcpy(data, rtos_flash + offset, len);
+  return true;
+}
+bool hal_flash_write(uint32_t offset, const void *data, size_t len) {
+  if (offset + len > sizeof(rtos_flash)) return false;
+  for (size_t i = 0; i < len; i++) rtos_flash[offset + i] &= ((const uint8_t *)data)[i];
+  return true;
+}
+bool hal_flash_erase(uint32_t offset) {
+  if (offset + HAL_FLASH_SECTOR > sizeof(rtos_flash)) return false;
+  memset(rtos_flash + offset, 0xFF, HAL_FLASH_SECTOR);
+  return true;
+}
+uint32_t hal_flash_size() { return sizeof(rtos_flash); }
+
+/**
+ * ฟังก์ชันเริ่มนาฬิกาและสถานะของขา แล้วเรียก setup() ของ firmware (สร้าง task comms และ task real-time)
+ */
+void rtos_boot() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  rtos_start_ns = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+  for (int i = 0; i < 256; i++) rtos_pin_level[i] = HIGH;  // IR active low - ไม่มีพัสดุ
+  memset(rtos_flash, 0xFF, sizeof(rtos_flash));
+  setup();
+}
+
+/**
+ * ฟังก์ชันเปลี่ยนระดับขา IR แล้วเรียก ISR (แทน interrupt ของ GPIO)
+ */
+void rtos_set_ir(uint8_t sensor, uint8_t level) {
+  uint8_t pin = ir_pin(sensor);
+  rtos_pin_level[pin] = level;
+  if (rtos_pin_isr[pin]) rtos_pin_isr[pin]();
+}
+
+/**
+ * ฟังก์ชันส่งไบต์จาก Pi เข้า Serial2 ของ firmware
+ */
+void rtos_pi_send(const uint8_t *data, size_t len) {
+  pthread_mutex_lock(&rtos_pi_lock);
+  rtos_pi_rx.insert(rtos_pi_rx.end(), data, data + len);
+  pthread_mutex_unlock(&rtos_pi_lock);
+}
+
+/**
+ * ฟังก์ชันรับไบต์ทั้งหมดที่ firmware ส่งไป Pi
+ */
+void rtos_pi_take(std::vector<uint8_t> &out) {
+  pthread_mutex_lock(&rtos_pi_lock);
+  out.insert(out.end(), rtos_pi_tx.begin(), rtos_pi_tx.end());
+  rtos_pi_tx.clear();
+  pthread_mutex_unlock(&rtos_pi_lock);
+}
+
+#endif
@@ -0,0 +1,528 @@
+/**
+ * โลกจำลองของ firmware บน host: สายพาน พัสดุ มอเตอร์ผลัก และ Pi
+ *
+ * ใช้คู่กับ host_hal.h (include ก่อน) โดย tools/replay.cpp, tools/sim.cpp และ benchmark ใน tools/
+ * ทุกรอบ 1 ms เรียก sim_step(): Pi จำลอง → สายพาน → มอเตอร์ผลัก → firmware_tick()
+ * Pi จำลองคุยกับ firmware ผ่าน pi_tx/inject() หรือผ่านฝั่ง slave ของ PTY (sim_pi_fd)
+ */
+#ifndef HOST_SIM_H
+#define HOST_SIM_H
+
+#include "host_hal.h"
+
+// ===================================
+// สถานการณ์จำลอง (สายพาน พัสดุ และ Pi)
+// ===================================
+// ตำแหน่งจริงของพัสดุใช้ odometer ของ firmware คูณ slip (สายพานจริงช้ากว่าที่ firmware คิด)
+// IR เป็น LOW เมื่อมีพัสดุอยู่ในช่วง [ตำแหน่ง sensor, + PARCEL_LEN_MM]
+// Pi จำลองตอบผล QR หลัง PI_QR_LATENCY_MS ส่งตารางหอพักเมื่อถูกขอ และ ack ชุดสถานะทันที
+// มอเตอร์ผลักแต่ละตัวมีเวลา stroke จริงของตัวเอง (สุ่มรอบค่ากลาง) และแปรปรวนทุก stroke
+// พัสดุถูกผลักออกเมื่อก้านผลักเคลื่อนถึง SIM_PUSH_CONTACT ของ stroke และสร้าง feedback ตามตำแหน่งก้านผลัก
+#define PARCEL_LEN_MM 40.0f    // ความยาวพัสดุตามแนวสายพาน
+#define PARCEL_GAP_MM 80.0f    // ระยะห่างขั้นต่ำเมื่อวางพัสดุชิ้นถัดไป (ค่าเริ่มต้นของ sim_gap_mm)
+#define PUSH_REACH_MM 60.0f    // ระยะที่มอเตอร์ผลักถึงพัสดุ (รอบตำแหน่งประตู)
+#define BELT_END_MM 100.0f     // ระยะเลยประตูสุดท้ายที่พัสดุตกปลายสายพาน
+#define JAM_AT_MM 150.0f       // ตำแหน่งที่พัสดุติดขัด
+#define JAM_MS 6000            // เวลาก่อนพนักงานนำพัสดุที่ติดออก
+#define BOUNCE_MS 25           // double IR: สัญญาณหายไปแล้วกลับมา (เกิน IR_DEBOUNCE_US)
+#define PI_QR_LATENCY_MS 150   // เวลาที่ Pi ใช้อ่าน QR
+#define PI_ACK_LATENCY_MS 5
+#define SIM_TIMEOUT_MS 120000  // เวลาสูงสุดหลังพัสดุชิ้นสุดท้ายถูกวาง
+#define SIM_EXTEND_MS 1050.0f  // เวลาผลักออกสุดโดยเฉลี่ยของมอเตอร์ (ตารางประตูเผื่อไว้ 1800)
+#define SIM_RETRACT_MS 950.0f  // เวลาดึงกลับสุดโดยเฉลี่ย
+#define SIM_MOTOR_SPREAD 0.20f // มอเตอร์แต่ละตัวต่างจากค่าเฉลี่ยได้ ±20%
+#define SIM_STROKE_JITTER 0.05f // แต่ละ stroke ต่างกันได้ ±5%
+#define SIM_PUSH_CONTACT 0.6f  // สัดส่วนของ stroke ที่พัสดุพ้นสายพาน
+#define SIM_INRUSH_MS 60       // กระแส inrush ตอนเริ่มหมุน (เกิน PUSHER_STALL_MV)
+#define SIM_WEAR_PER_STROKE 0.05f // SIM_MOTOR_WEAR: ช้าลงต่อ stroke หลัง baseline
+#define SIM_WEAR_MAX 1.35f     // ยังไม่เกินเวลาสูงสุดในตารางประตู
+
+enum SimFlag {
+  SIM_DOUBLE_IR = 1,           // IR หลักกระพริบระหว่างพัสดุผ่าน
+  SIM_NO_REPLY = 2,            // Pi ไม่ตอบผล QR (QR timeout)
+  SIM_JAM = 4                  // พัสดุติดก่อนถึงประตูแรก
+};
+
+enum SimState {
+  SIM_WAITING,                 // ยังไม่ถูกวางบนสายพาน
+  SIM_ON_BELT,
+  SIM_PUSHED,                  // ถูกผลักออกที่ประตู exit_gate
+  SIM_BELT_END,                // ตกปลายสายพาน
+  SIM_REMOVED                  // พนักงานนำออก (ติดขัด)
+};
+
+struct SimParcel {
+  uint8_t lane;
+  uint32_t arrive_ms;          // เวลาที่พร้อมวางบนสายพาน
+  char tracking[TRACKING_MAX_LEN + 1];
+  int dorm;                    // หอพักจริง (-1 = ไม่อยู่ในตาราง, -2 = QR อ่านไม่ได้)
+  uint8_t flags;               // SimFlag
+  SimState state;
+  float entry_mm;              // odometer ของสายพานตอนวาง
+  float stuck_mm;              // ตำแหน่งที่หยุดอยู่ (ติดขัด) หรือ -1
+  uint64_t intake_us;
+  uint64_t exit_us;
+  int exit_gate;
+};
+
+enum SimMotor {
+  SIM_MOTOR_OK,
+  SIM_MOTOR_WEAR,              // มอเตอร์ประตูแรกของทุกสายพานช้าลงเรื่อย ๆ
+  SIM_MOTOR_DEAD_SWITCH        // สวิตช์ผลักออกสุดของประตูแรกไม่ทำงาน
+};
+
+struct SimPusher {
+  float pos;                   // 0 = ดึงกลับสุด, 1 = ผลักออกสุด
+  int dir;                     // ทิศทางที่ firmware สั่ง (1=ผลัก, -1=ดึงกลับ, 0=หยุด)
+  float extend_ms;             // เวลา stroke จริงของมอเตอร์นี้
+  float retract_ms;
+  float stroke_ms;             // เวลาของ stroke ปัจจุบัน
+  uint64_t dir_since_us;       // เวลาที่เริ่มทิศทางปัจจุบัน
+  uint64_t cycle_start_us;     // เวลาที่เริ่มผลักออก
+  bool pushed;                 // ผลักพัสดุใน stroke นี้แล้ว
+  int strokes;
+  int short_strokes;           // เปลี่ยนทิศก่อนถึงปลายทาง
+  uint32_t driven_ms;          // เวลาที่มอเตอร์ถูกขับ
+  uint32_t stalled_ms;         // เวลาที่ถูกขับค้างที่ปลายทาง
+  uint8_t fb[2];               // ค่า feedback ที่ส่งเข้า firmware แล้ว
+};
+
+struct PendingReply {
+  uint64_t due_us;
+  std::vector<uint8_t> wire;   // กรอบที่เข้ารหัสแล้ว
+};
+
+std::vector<SimParcel> sim_parcels;
+std::vector<PendingReply> sim_replies;
+SimPusher sim_pushers[NUM_GATES];
+std::vector<double> sim_cycles_ms;               // เวลาตั้งแต่เริ่มผลักจนดึงกลับเสร็จ
+SimMotor sim_motor = SIM_MOTOR_OK;
+float sim_slip = 1.0f;
+float sim_gap_mm = PARCEL_GAP_MM;
+PiFrame sim_frame;                               // กรอบขาออกของ Pi จำลอง
+int sim_pi_fd = -1;                              // >= 0: Pi จำลองคุยผ่านฝั่ง slave ของ PTY
+std::vector<uint8_t> sim_pi_in;                  // ไบต์จาก PTY ที่ Pi จำลองยังไม่ได้แยกกรอบ
+// test แทนพฤติกรรมของ Pi จำลองได้: คืน true = จัดการกรอบนี้เองแล้ว (ชนิด, เนื้อหา, ความยาวเนื้อหา)
+bool (*sim_pi_hook)(uint8_t type, const uint8_t *body, size_t len) = NULL;
+uint32_t sim_rng = 12345;
+
+/**
+ * ฟังก์ชันสุ่มแบบกำหนด seed (ผลเหมือนเดิมทุกครั้ง)
+ */
+uint32_t sim_rand() {
+  sim_rng = sim_rng * 1103515245u + 12345u;
+  return sim_rng >> 8;
+}
+
+/**
+ * ฟังก์ชันเพิ่มพัสดุในสถานการณ์ (สายพานวนตามลำดับพัสดุ)
+ */
+void add_parcel(std::vector<SimParcel> &parcels, uint32_t arrive_ms, int dorm, uint8_t flags) {
+  SimParcel p;
+  memset(&p, 0, sizeof(p));
+  p.lane = parcels.size() % NUM_LANES;
+  p.arrive_ms = arrive_ms;
+  snprintf(p.tracking, sizeof(p.tracking), "TH%010u", (unsigned)(sim_rand() % 1000000000u));
+  p.dorm = dorm;
+  p.flags = flags;
+  p.state = SIM_WAITING;
+  p.stuck_mm = -1;
+  p.exit_gate = -1;
+  parcels.push_back(p);
+}
+
+const int SIM_DORMS[] = { 10, 2, 6, 4 };         // 4 = ไม่มีประตูรับ → ปลายสายพาน
+
+/**
+ * ฟังก์ชันตำแหน่งจริงของพัสดุจากตำแหน่ง IR หลัก
+ */
+float sim_position(const SimParcel &p) {
+  if (p.stuck_mm >= 0) return p.stuck_mm;
+  return (belt_position_at(lanes[p.lane], hal_micros()) - p.entry_mm) * sim_slip;
+}
+
+/**
+ * ฟังก์ชันส่งกรอบจาก Pi จำลองหลังเวลาที่กำหนด
+ */
+void sim_reply(uint32_t delay_ms) {
+  PendingReply r;
+  r.due_us = sim_us + delay_ms * 1000ULL;
+  r.wire.resize(PI_WIRE_MAX);
+  r.wire.resize(frame_encode(sim_frame, r.wire.data(), r.wire.size()));
+  sim_replies.push_back(r);
+}
+
+/**
+ * ฟังก์ชันส่งตารางหอพักของพัสดุที่อยู่ในตาราง (dorm >= 0) เป็น MSG_DORM_FULL
+ */
+void sim_send_dorm_table() {
+  std::vector<std::pair<uint32_t, uint8_t> > entries;
+  for (size_t i = 0; i < sim_parcels.size(); i++) {
+    if (sim_parcels[i].dorm >= 0) entries.push_back(std::make_pair(tracking_hash(sim_parcels[i].tracking), (uint8_t)sim_parcels[i].dorm));
+  }
+  std::sort(entries.begin(), entries.end());
+  const size_t per_part = (PI_FRAME_MAX - 3 - 8) / DORM_ENTRY_SIZE;
+  uint16_t parts = (entries.size() + per_part - 1) / per_part;
+  if (parts == 0) parts = 1;
+  for (uint16_t part = 0; part < parts; part++) {
+    frame_begin(sim_frame, MSG_DORM_FULL);
+    frame_u32(sim_frame, 1);
+    frame_u16(sim_frame, part);
+    frame_u16(sim_frame, parts);
+    for (size_t i = part * per_part; i < entries.size() && i < (part + 1) * per_part; i++) {
+      frame_u32(sim_frame, entries[i].first);
+      frame_u8(sim_frame, entries[i].second);
+    }
+    sim_reply(1);
+  }
+}
+
+/**
+ * ฟังก์ชันหาพัสดุที่กล้องของสายพานเห็น ณ เวลาที่ IR หลักตรวจพบ (age_ms) หรือปัจจุบัน
+ */
+SimParcel *sim_camera_parcel(uint8_t lane, uint32_t age_ms) {
+  SimParcel *best = NULL;
+  uint64_t target = age_ms == PI_NO_AGE ? sim_us : sim_us - age_ms * 1000ULL;
+  uint64_t best_err = ~0ULL;
+  for (size_t i = 0; i < sim_parcels.size(); i++) {
+    SimParcel &p = sim_parcels[i];
+    if (p.lane != lane || p.state == SIM_WAITING || p.intake_us > target) continue;
+    if (target - p.intake_us < best_err) {
+      best_err = target - p.intake_us;
+      best = &p;
+    }
+  }
+  return best;
+}
+
+/**
+ * ฟังก์ชันจัดการกรอบหนึ่งกรอบที่ ESP32 ส่งมา (Pi จำลอง)
+ */
+void sim_pi_handle(uint8_t *frame, size_t len) {
+  size_t n = cobs_decode(frame, len);
+  if (n < 3 || crc16_ccitt(frame, n - 2) != rd_u16(frame + n - 2)) return;
+  const uint8_t *body = frame + 1;
+  if (sim_pi_hook && sim_pi_hook(frame[0], body, n - 3)) return;
+
+  switch (frame[0]) {
+    case MSG_QR_REQUEST: {
+      SimParcel *p = sim_camera_parcel(body[0], rd_u32(body + 5));
+      if (p && (p->flags & SIM_NO_REPLY)) break;
+      const char *text = !p || p->dorm == -2 ? TRACKING_UNREAD : p->tracking;
+      frame_begin(sim_frame, MSG_QR_RESULT);
+      frame_u8(sim_frame, body[0]);
+      frame_u32(sim_frame, rd_u32(body + 1));
+      frame_str(sim_frame, text);
+      sim_reply(PI_QR_LATENCY_MS);
+      break;
+    }
+    case MSG_STATUS_BATCH:
+      frame_begin(sim_frame, MSG_ACK);
+      frame_u16(sim_frame, rd_u16(body));
+      sim_reply(PI_ACK_LATENCY_MS);
+      break;
+    case MSG_DORM_SYNC:
+      sim_send_dorm_table();
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+ * ฟังก์ชันแยกกรอบที่ ESP32 ส่งมา และส่งกรอบของ Pi ที่ถึงเวลา
+ */
+void sim_pi_update() {
+  std::vector<uint8_t> &in = sim_pi_fd >= 0 ? sim_pi_in : pi_tx;
+  if (sim_pi_fd >= 0) {
+    uint8_t buf[1024];
+    ssize_t n;
+    while ((n = read(sim_pi_fd, buf, sizeof(buf))) > 0) in.insert(in.end(), buf, buf + n);
+  }
+  size_t start = 0;
+  for (size_t i = 0; i < in.size(); i++) {
+    if (in[i] != 0) continue;
+    if (i > start) sim_pi_handle(in.data() + start, i - start);
+    start = i + 1;
+  }
+  in.erase(in.begin(), in.begin() + start);
+
+  for (size_t i = 0; i < sim_replies.size(); ) {
+    if (sim_replies[i].due_us > sim_us) {
+      i++;
+      continue;
+    }
+    if (sim_pi_fd >= 0) {
+      if (write(sim_pi_fd, sim_replies[i].wire.data(), sim_replies[i].wire.size()) < 0) break;
+    } else {
+      InputEvent ev;
+      ev.kind = REC_PI;
+      ev.sensor = ev.level = 0;
+      ev.data = sim_replies[i].wire;
+      inject(ev);
+    }
+    sim_replies.erase(sim_replies.begin() + i);
+  }
+}
+
+/**
+ * ฟังก์ชันผลักพัสดุที่อยู่หน้าประตูออกจากสายพาน
+ */
+void sim_push_parcel(int gate) {
+  for (size_t i = 0; i < sim_parcels.size(); i++) {
+    SimParcel &p = sim_parcels[i];
+    if (p.state != SIM_ON_BELT || p.lane != gate_lane(gate)) continue;
+    if (fabsf(sim_position(p) - GATES[gate].position_mm) <= PUSH_REACH_MM) {
+      p.state = SIM_PUSHED;
+      p.exit_gate = gate;
+      p.exit_us = sim_us;
+      return;                                    // ผลักได้ครั้งละหนึ่งชิ้น
+    }
+  }
+}
+
+/**
+ * ฟังก์ชันส่ง feedback ของมอเตอร์ผลักเข้า firmware เมื่อค่าเปลี่ยน
+ */
+void sim_feedback(int gate, int input, uint8_t level) {
+  SimPusher &m = sim_pushers[gate];
+  if (m.fb[input] == level) return;
+  m.fb[input] = level;
+  InputEvent ev;
+  ev.kind = REC_FEEDBACK;
+  ev.sensor = gate * 2 + input;
+  ev.level = level;
+  inject(ev);
+}
+
+/**
+ * ฟังก์ชันสุ่มเวลา stroke จริงของมอเตอร์ทุกตัว
+ */
+void sim_pushers_init() {
+  for (int g = 0; g < NUM_GATES; g++) {
+    SimPusher &m = sim_pushers[g];
+    memset(&m, 0, sizeof(m));
+    m.extend_ms = SIM_EXTEND_MS * (1 - SIM_MOTOR_SPREAD + 2 * SIM_MOTOR_SPREAD * (sim_rand() % 1000) / 1000.0f);
+    m.retract_ms = SIM_RETRACT_MS * (1 - SIM_MOTOR_SPREAD + 2 * SIM_MOTOR_SPREAD * (sim_rand() % 1000) / 1000.0f);
+    m.fb[0] = m.fb[1] = HIGH;                    // ค่าเริ่มต้นของขาใน firmware_boot()
+  }
+  sim_cycles_ms.clear();
+}
+
+/**
+ * ฟังก์ชันอัพเดทมอเตอร์ผลักจำลองหนึ่งรอบ (1 ms) ตามคำสั่งล่าสุดของ firmware
+ */
+void sim_pushers_update() {
+  for (int g = 0; g < NUM_GATES; g++) {
+    SimPusher &m = sim_pushers[g];
+    const GateConfig &cfg = GATES[g];
+    int dir = pin_out[cfg.motor_in_a] == HIGH && pin_out[cfg.motor_in_b] == LOW ? 1
+            : pin_out[cfg.motor_in_a] == LOW && pin_out[cfg.motor_in_b] == HIGH ? -1 : 0;
+    bool first_gate = g == LANES[gate_lane(g)].first_gate;
+
+    if (dir != m.dir) {
+      if ((m.dir == 1 && m.pos < 1) || (m.dir == -1 && m.pos > 0)) m.short_strokes++;
+      if (m.dir == -1 && dir == 0) sim_cycles_ms.push_back((sim_us - m.cycle_start_us) / 1000.0);
+      if (dir == 1) {
+        m.cycle_start_us = sim_us;
+        m.pushed = false;
+        m.strokes++;
+      }
+      if (dir != 0) {
+        float jitter = 1 - SIM_STROKE_JITTER + 2 * SIM_STROKE_JITTER * (sim_rand() % 1000) / 1000.0f;
+        float wear = 1;
+        if (sim_motor == SIM_MOTOR_WEAR && first_gate && m.strokes > PUSHER_BASELINE_STROKES) {
+          wear = std::min(SIM_WEAR_MAX, 1 + SIM_WEAR_PER_STROKE * (m.strokes - PUSHER_BASELINE_STROKES));
+        }
+        m.stroke_ms = (dir > 0 ? m.extend_ms : m.retract_ms) * jitter * wear;
+      }
+      m.dir = dir;
+      m.dir_since_us = sim_us;
+    }
+
+    if (dir != 0) {
+      bool at_end = dir > 0 ? m.pos >= 1 : m.pos <= 0;
+      m.driven_ms++;
+      if (at_end) m.stalled_ms++;
+      m.pos = std::max(0.0f, std::min(1.0f, m.pos + dir / m.stroke_ms));
+    }
+    if (dir == 1 && !m.pushed && m.pos >= SIM_PUSH_CONTACT) {
+      m.pushed = true;
+      sim_push_parcel(g);
+    }
+
+    if (cfg.feedback == PUSHER_FB_LIMIT) {
+      bool dead = sim_motor == SIM_MOTOR_DEAD_SWITCH && first_gate;
+      sim_feedback(g, 0, m.pos >= 1 && !dead ? LOW : HIGH);
+      sim_feedback(g, 1, m.pos <= 0 ? LOW : HIGH);
+    } else if (cfg.feedback == PUSHER_FB_CURRENT) {
+      bool inrush = sim_us - m.dir_since_us < SIM_INRUSH_MS * 1000ULL;
+      bool stalled = dir > 0 ? m.pos >= 1 : m.pos <= 0;
+      sim_feedback(g, 0, dir != 0 && (inrush || stalled));
+    }
+  }
+}
+
+/**
+ * ฟังก์ชันอัพเดทสายพานจำลองหนึ่งรอบ: วางพัสดุ ย้ายพัสดุ และคำนวณระดับ IR
+ */
+void sim_belt_update() {
+  for (int lane = 0; lane < NUM_LANES; lane++) {
+    // วางพัสดุชิ้นถัดไปเมื่อสายพานเดินและชิ้นก่อนหน้าห่างพอ
+    SimParcel *next = NULL;
+    float last_pos = 1e9f;
+    for (size_t i = 0; i < sim_parcels.size(); i++) {
+      SimParcel &p = sim_parcels[i];
+      if (p.lane != lane) continue;
+      if (p.state == SIM_ON_BELT) last_pos = std::min(last_pos, sim_position(p));
+      if (p.state == SIM_WAITING && !next) next = &p;
+    }
+    if (next && hal_millis() >= next->arrive_ms && lanes[lane].belt_direction == 1 && last_pos >= sim_gap_mm) {
+      next->state = SIM_ON_BELT;
+      next->entry_mm = belt_position_at(lanes[lane], hal_micros());
+      next->intake_us = sim_us;
+    }
+
+    // ระดับ IR หลักและ IR ประตูจากตำแหน่งพัสดุ
+    bool intake_low = false;
+    bool gate_low[NUM_GATES] = { false };
+    for (size_t i = 0; i < sim_parcels.size(); i++) {
+      SimParcel &p = sim_parcels[i];
+      if (p.lane != lane || p.state != SIM_ON_BELT) continue;
+      float pos = sim_position(p);
+
+      if ((p.flags & SIM_JAM) && p.stuck_mm < 0 && pos >= JAM_AT_MM) {
+        p.stuck_mm = JAM_AT_MM;                  // ติดขัด
+        p.exit_us = sim_us + JAM_MS * 1000ULL;   // เวลาที่พนักงานนำออก
+      }
+      if (p.stuck_mm >= 0 && sim_us >= p.exit_us) {
+        p.state = SIM_REMOVED;
+        continue;
+      }
+      if (pos > GATES[lane_last_gate(lane)].position_mm + BELT_END_MM) {
+        p.state = SIM_BELT_END;
+        p.exit_us = sim_us;
+        continue;
+      }
+
+      uint64_t since = sim_us - p.intake_us;
+      bool bounce = (p.flags & SIM_DOUBLE_IR) && since >= BOUNCE_MS * 1000ULL && since < 2 * BOUNCE_MS * 1000ULL;
+      if (pos <= PARCEL_LEN_MM && !bounce) intake_low = true;
+      for (int g = LANES[lane].first_gate; g <= lane_last_gate(lane); g++) {
+        if (pos >= GATES[g].position_mm && pos <= GATES[g].position_mm + PARCEL_LEN_MM) gate_low[g] = true;
+      }
+    }
+    set_ir(IR_SENSOR_MAIN + lane, intake_low ? LOW : HIGH);
+    for (int g = LANES[lane].first_gate; g <= lane_last_gate(lane); g++) {
+      set_ir(IR_SENSOR_G1 + g, gate_low[g] ? LOW : HIGH);
+    }
+  }
+}
+
+/**
+ * ฟังก์ชันหาค่า percentile จากรายการที่เรียงแล้ว
+ */
+double percentile(const std::vector<double> &sorted, int pct) {
+  if (sorted.empty()) return 0;
+  size_t i = (sorted.size() * pct + 99) / 100;
+  return sorted[i == 0 ? 0 : i - 1];
+}
+
+/**
+ * ฟังก์ชันรันโลกจำลองและ firmware หนึ่งรอบ (1 ms)
+ */
+void sim_step() {
+  sim_pi_update();
+  sim_belt_update();
+  sim_pushers_update();
+  firmware_tick();
+}
+
+/**
+ * ฟังก์ชันรันหนึ่งรอบเมื่อ Pi จำลองคุยผ่าน PTY (sim_pi_fd)
+ * kernel ส่งไบต์ข้าม PTY แบบ asynchronous จึงรอให้ไบต์ที่ส่งในรอบนี้ถึงอีกฝั่งก่อนเดินเวลาเสมือนต่อ
+ */
+void sim_step_pty() {
+  size_t replies = sim_replies.size();
+  uint32_t written = pty_written;
+  sim_step();
+  if (pty_written != written) pty_settle(sim_pi_fd);
+  if (sim_replies.size() < replies) pty_settle(pty_master);
+}
+
+/**
+ * ฟังก์ชันตรวจว่าพัสดุทุกชิ้นออกจากสายพานแล้ว และมอเตอร์ผลักทุกตัวกลับสู่ตำแหน่งพัก
+ */
+bool sim_done() {
+  for (size_t i = 0; i < sim_parcels.size(); i++) {
+    if (sim_parcels[i].state == SIM_WAITING || sim_parcels[i].state == SIM_ON_BELT) return false;
+  }
+  for (int g = 0; g < NUM_GATES; g++) {
+    if (pushers[g].state != PUSHER_IDLE) return false;  // รอ stroke สุดท้าย
+  }
+  return true;
+}
+
+struct SimTally {
+  int correct;
+  int misrouted;               // ผลักออกผิดประตู
+  int missed;                  // ควรออกที่ประตูแต่ไปปลายสายพาน
+  int removed;
+  int stranded;
+  double per_min;              // พัสดุที่ออกจากสายพานต่อนาที
+  std::vector<double> latency_ms;  // intake → ออกจากสายพาน (เรียงแล้ว)
+};
+
+/**
+ * ฟังก์ชันเทียบปลายทางจริงของพัสดุกับหอพักจริง
+ * @param verbose true = พิมพ์ปลายทางของพัสดุทีละชิ้น
+ */
+SimTally sim_tally(bool verbose) {
+  SimTally t;
+  t.correct = t.misrouted = t.missed = t.removed = t.stranded = 0;
+  uint64_t first_us = ~0ULL, last_us = 0;
+  for (size_t i = 0; i < sim_parcels.size(); i++) {
+    const SimParcel &p = sim_parcels[i];
+    bool routable = p.dorm >= 0 && !(p.flags & SIM_NO_REPLY);
+    int want_gate = -1;
+    for (int g = LANES[p.lane].first_gate; routable && g <= lane_last_gate(p.lane); g++) {
+      if (gate_accepts(g, p.dorm)) {
+        want_gate = g;
+        break;
+      }
+    }
+    if (verbose) {
+      printf("  %-13s lane %d dorm %3d flags %d  %s", p.tracking, p.lane, p.dorm, p.flags,
+             p.state == SIM_PUSHED ? "gate" : p.state == SIM_BELT_END ? "belt end" :
+             p.state == SIM_REMOVED ? "removed" : "stranded");
+      if (p.state == SIM_PUSHED) printf(" %d", p.exit_gate + 1);
+      printf(" (want %s%d)\n", want_gate < 0 ? "belt end " : "gate ", want_gate + 1);
+    }
+    switch (p.state) {
+      case SIM_PUSHED:
+        if (p.exit_gate == want_gate) t.correct++;
+        else t.misrouted++;
+        break;
+      case SIM_BELT_END:
+        if (want_gate < 0) t.correct++;
+        else t.missed++;
+        break;
+      case SIM_REMOVED:
+        t.removed++;
+        break;
+      default:
+        t.stranded++;
+        continue;
+    }
+    if (p.state == SIM_REMOVED) continue;
+    first_us = std::min(first_us, p.intake_us);
+    last_us = std::max(last_us, p.exit_us);
+    t.latency_ms.push_back((p.exit_us - p.intake_us) / 1000.0);
+  }
+  std::sort(t.latency_ms.begin(), t.latency_ms.end());
+  double minutes = last_us > first_us ? (last_us - first_us) / 60e6 : 0;
+  t.per_min = minutes > 0 ? (t.correct + t.misrouted + t.missed) / minutes : 0;
+  return t;
+}
+
+#endif
@@ -0,0 +1,19 @@
+/**
+ * ผังสำหรับ host benchmark (-DHOST_LAYOUT='"tools/layouts/gates16.h"'): สายพานเดียว 16 ประตู ประตูละ 3 หอพัก
+ * ประตู n รับหอพัก 3n ถึง 3n+2 (หอพัก 0-47) ห่างกัน 250 mm ไม่มี feedback ของมอเตอร์ผลัก
+ * ขาเสมือนของประตูเกิน 32 ขาของหนึ่งสายพาน จึงใช้ช่วงขาของสายพานถัดไป (ผังนี้มีสายพานเดียว)
+ */
+#define LAYOUT_GATE(n) \
+  { VPIN(0, 4 + (n) * 3), VPIN(0, 5 + (n) * 3), VPIN(0, 6 + (n) * 3), 1800, 1700, PUSHER_FB_NONE, NO_PIN, NO_PIN, \
+    300 + (n) * 250, dorm_bit(3 * (n)) | dorm_bit(3 * (n) + 1) | dorm_bit(3 * (n) + 2) }
+
+constexpr LaneConfig LANES[] = {
+  { VPIN(0, 0), VPIN(0, 1), VPIN(0, 2), VPIN(0, 3), 0, 0, 16 },
+};
+
+constexpr GateConfig GATES[] = {
+  LAYOUT_GATE(0),  LAYOUT_GATE(1),  LAYOUT_GATE(2),  LAYOUT_GATE(3),
+  LAYOUT_GATE(4),  LAYOUT_GATE(5),  LAYOUT_GATE(6),  LAYOUT_GATE(7),
+  LAYOUT_GATE(8),  LAYOUT_GATE(9),  LAYOUT_GATE(10), LAYOUT_GATE(11),
+  LAYOUT_GATE(12), LAYOUT_GATE(13), LAYOUT_GATE(14), LAYOUT_GATE(15),
+};
@@ -0,0 +1,17 @@
+/**
+ * ผังสำหรับ host benchmark (-DHOST_LAYOUT='"tools/layouts/gates8.h"'): สายพานเดียว 8 ประตู ประตูละ 2 หอพัก
+ * ประตู n รับหอพัก 2n และ 2n+1 (หอพัก 0-15) ห่างกัน 250 mm ไม่มี feedback ของมอเตอร์ผลัก
+ * ประตูสุดท้ายเป็นปลายสายพานเหมือนผังจริง
+ */
+#define LAYOUT_GATE(n) \
+  { VPIN(0, 4 + (n) * 3), VPIN(0, 5 + (n) * 3), VPIN(0, 6 + (n) * 3), 1800, 1700, PUSHER_FB_NONE, NO_PIN, NO_PIN, \
+    300 + (n) * 250, dorm_bit(2 * (n)) | dorm_bit(2 * (n) + 1) }
+
+constexpr LaneConfig LANES[] = {
+  { VPIN(0, 0), VPIN(0, 1), VPIN(0, 2), VPIN(0, 3), 0, 0, 8 },
+};
+
+constexpr GateConfig GATES[] = {
+  LAYOUT_GATE(0), LAYOUT_GATE(1), LAYOUT_GATE(2), LAYOUT_GATE(3),
+  LAYOUT_GATE(4), LAYOUT_GATE(5), LAYOUT_GATE(6), LAYOUT_GATE(7),
+};
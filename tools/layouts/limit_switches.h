@@ -0,0 +1,15 @@
+/**
+ * ผังสายพานจริง (LANE_LAYOUT 1) ที่ติดตั้งสวิตช์ปลายทางของมอเตอร์ผลักครบทุกประตู
+ * (-DHOST_LAYOUT='"tools/layouts/limit_switches.h"') ขาและตารางเหมือน GATES ของบอร์ดจริงทุกอย่าง
+ * ยกเว้น feedback เป็น PUSHER_FB_LIMIT ที่ขา PUSHERn_END_OUT / PUSHERn_END_IN
+ * ใช้ทดสอบการหยุด stroke ที่ปลายทาง การเรียนรู้เวลา stroke และการกลับไปใช้เวลาคงที่บนผังสายพานเดียว
+ */
+constexpr LaneConfig LANES[] = {
+  { IR_DIGITAL_PIN, IN1, IN2, ENA, 0, 0, 3 },
+};
+
+constexpr GateConfig GATES[] = {
+  { IR_DIGITAL_PING1, MOTOR0_IN_A, MOTOR0_IN_B, 1800, 1700, PUSHER_FB_LIMIT, PUSHER0_END_OUT, PUSHER0_END_IN, 300, dorm_bit(10) },
+  { IR_DIGITAL_PING2, MOTOR1_IN_A, MOTOR1_IN_B, 1800, 1700, PUSHER_FB_LIMIT, PUSHER1_END_OUT, PUSHER1_END_IN, 550, dorm_bit(2) },
+  { IR_DIGITAL_PING3, MOTOR2_IN_A, MOTOR2_IN_B, 1800, 1650, PUSHER_FB_LIMIT, PUSHER2_END_OUT, PUSHER2_END_IN, 800, dorm_bit(6) },
+};
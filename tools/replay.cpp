@@ -0,0 +1,352 @@
+/**
+ * Replay และ benchmark ของลอจิกคัดแยกพัสดุบน host
+ *
+ * ใช้ HAL เวลาเสมือน (tools/host_hal.h) และโลกจำลอง สายพาน พัสดุ และ Pi (tools/host_sim.h)
+ * task real-time และ task comms ถูกเรียกสลับกันทีละรอบ (rt_iteration / comms_iteration)
+ * ผลลัพธ์จึงขึ้นกับ input เท่านั้น รันซ้ำกี่ครั้งก็ได้ผลเดียวกัน
+ *
+ * สองโหมด:
+ *   replay <file.rec>           รัน input ที่บันทึกจากหน้างาน (firmware -DRECORD_INPUTS และ
+ *                               tools/trace_decode.py --record) แล้วพิมพ์การตัดสินใจของลอจิก
+ *   replay --scenario <name>    รันสถานการณ์จำลอง (สายพาน พัสดุ และ Pi) แล้วรายงานการคัดแยก
+ *                               อัตราการส่ง และ latency เทียบกับหอพักจริงของพัสดุ (all = ทุกสถานการณ์)
+ *          --save <file.rec>    บันทึก input ของสถานการณ์เป็นไฟล์ .rec (ใช้ตรวจว่า replay ได้ผลเดิม)
+ *          --verbose            แสดงปลายทางของพัสดุทีละชิ้น
+ *   --open-loop                 ปิด feedback ของมอเตอร์ผลักทุกตัวหลัง boot (ใช้เวลาคงที่ในตาราง)
+ *                               ใช้เทียบ cycle time กับการหยุดที่ปลายทาง (ต้องใช้ตอน replay ไฟล์ที่บันทึกด้วย)
+ *   --continuous                เริ่มในโหมดสแกนต่อเนื่อง (scan_continuous) ใช้เทียบ parcels/min กับโหมดหยุดสแกน
+ *                               (ต้องใช้ตอน replay ไฟล์ที่บันทึกในโหมดนี้ด้วย)
+ *
+ * build:  make -C tools        (replay, replay_l2, replay_l4 ใน tools/build/ - ดู tools/Makefile)
+ */
+#include "host_sim.h"
+
+#include <chrono>
+#include <sys/wait.h>
+
+// ===================================
+// ไฟล์ .rec
+// ===================================
+/**
+ * ฟังก์ชันอ่านไฟล์ .rec
+ * @return false หากไฟล์ไม่ถูกต้อง
+ */
+bool rec_load(const char *path, std::vector<InputEvent> &events) {
+  FILE *f = fopen(path, "rb");
+  if (!f) return false;
+  std::vector<uint8_t> buf;
+  uint8_t chunk[4096];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) buf.insert(buf.end(), chunk, chunk + n);
+  fclose(f);
+
+  if (buf.size() < 5 || memcmp(buf.data(), "PREC\x01", 5) != 0) return false;
+  uint64_t t = 0;
+  size_t pos = 5;
+  while (pos < buf.size()) {
+    InputEvent ev;
+    ev.kind = buf[pos++];
+    uint64_t dt = 0;
+    for (int shift = 0; pos < buf.size(); shift += 7) {
+      uint8_t b = buf[pos++];
+      dt |= (uint64_t)(b & 0x7F) << shift;
+      if (!(b & 0x80)) break;
+    }
+    t += dt;
+    ev.time_us = t;
+    ev.sensor = ev.level = 0;
+    if ((ev.kind == REC_IR || ev.kind == REC_FEEDBACK) && pos + 2 <= buf.size()) {
+      ev.sensor = buf[pos];
+      ev.level = buf[pos + 1];
+      pos += 2;
+    } else if (ev.kind == REC_PI && pos < buf.size() && pos + 1 + buf[pos] <= buf.size()) {
+      ev.data.assign(buf.begin() + pos + 1, buf.begin() + pos + 1 + buf[pos]);
+      pos += 1 + buf[pos];
+    } else {
+      return false;                              // ไฟล์ถูกตัด
+    }
+    events.push_back(ev);
+  }
+  return true;
+}
+
+/**
+ * ฟังก์ชันเขียนไฟล์ .rec
+ */
+bool rec_save(const char *path, const std::vector<InputEvent> &events) {
+  FILE *f = fopen(path, "wb");
+  if (!f) return false;
+  fwrite("PREC\x01", 1, 5, f);
+  uint64_t prev = 0;
+  for (size_t i = 0; i < events.size(); i++) {
+    const InputEvent &ev = events[i];
+    size_t done = 0;
+    do {                                         // ไบต์จาก Pi ยาวเกิน 255 แบ่งเป็นหลาย record เวลาเดียวกัน
+      fputc(ev.kind, f);
+      for (uint64_t dt = ev.time_us - prev; ; dt >>= 7) {
+        fputc(dt >= 0x80 ? (dt & 0x7F) | 0x80 : dt, f);
+        if (dt < 0x80) break;
+      }
+      prev = ev.time_us;
+      if (ev.kind != REC_PI) {
+        fputc(ev.sensor, f);
+        fputc(ev.level, f);
+        break;
+      }
+      size_t n = std::min<size_t>(ev.data.size() - done, 255);
+      fputc((int)n, f);
+      fwrite(ev.data.data() + done, 1, n, f);
+      done += n;
+    } while (done < ev.data.size());
+  }
+  return fclose(f) == 0;
+}
+
+// ===================================
+// การตัดสินใจของลอจิก (จาก trace)
+// ===================================
+struct DecisionInfo {
+  uint8_t id;
+  const char *format;          // a, b
+};
+
+const DecisionInfo DECISIONS[] = {
+  { TR_INTAKE,             "intake       seq %d (continuous=%d)" },
+  { TR_QR_RESULT,          "qr result    seq %d dorm %d" },
+  { TR_QR_TIMEOUT,         "qr timeout   seq %d lane %d" },
+  { TR_TRACKING_DUPLICATE, "duplicate    seq %d re-read as seq %d" },
+  { TR_GATE,               "gate %d       seq %d" },
+  { TR_PUSH_DORM,          "push         gate %d dorm %d" },
+  { TR_PUSH_NO_FORM,       "to belt end  seq %d dorm %d" },
+  { TR_PARCEL_LOST,        "lost         seq %d lane %d" },
+  { TR_GATE_UNEXPECTED,    "unexpected   gate %d lane %d" },
+  { TR_QUEUE_FULL,         "queue full   %d parcels lane %d" },
+  { TR_QR_LATE,            "qr late      lane %d%.0d" },
+  { TR_PUSHER_MISS,        "pusher %d     end-stop not reached (direction %d)" },
+  { TR_PUSHER_FEEDBACK_LOST, "pusher %d     feedback lost after %d misses" },
+  { TR_PUSHER_WORN,        "pusher %d     worn, stroke at %d%% of baseline" },
+};
+
+/**
+ * ฟังก์ชันหารูปแบบข้อความของการตัดสินใจ
+ * @return NULL หาก trace นี้ไม่ใช่การตัดสินใจ
+ */
+const char *decision_format(uint8_t id) {
+  for (size_t i = 0; i < sizeof(DECISIONS) / sizeof(DECISIONS[0]); i++) {
+    if (DECISIONS[i].id == id) return DECISIONS[i].format;
+  }
+  return NULL;
+}
+
+/**
+ * ฟังก์ชันพิมพ์การตัดสินใจทั้งหมด และ digest สำหรับเทียบผลระหว่างการรัน/เวอร์ชันของ firmware
+ */
+void print_decisions(bool verbose) {
+  uint32_t digest = 2166136261u;                 // FNV-1a ของ (เวลา, id, a, b)
+  int count = 0;
+  for (size_t i = 0; i < traces.size(); i++) {
+    const SimTrace &t = traces[i];
+    const char *format = decision_format(t.id);
+    if (!format) continue;
+    uint32_t fields[4] = { (uint32_t)(t.time_us / 1000), t.id, (uint32_t)t.a, (uint32_t)t.b };
+    for (int k = 0; k < 4; k++) {
+      for (int byte = 0; byte < 4; byte++) digest = (digest ^ ((fields[k] >> (byte * 8)) & 0xFF)) * 16777619u;
+    }
+    count++;
+    if (verbose) {
+      printf("%12.6f  ", t.time_us / 1e6);
+      printf(format, t.a, t.b);
+      printf("\n");
+    }
+  }
+  printf("%d decisions, digest %08x\n", count, digest);
+}
+
+// ===================================
+// Replay จากไฟล์ .rec
+// ===================================
+/**
+ * ฟังก์ชันรัน input ที่บันทึกไว้ตามเวลาเดิม แล้วรันต่ออีก tail_ms ให้สถานะนิ่ง
+ */
+int replay_file(const char *path) {
+  std::vector<InputEvent> events;
+  if (!rec_load(path, events)) {
+    fprintf(stderr, "%s: not a valid .rec file\n", path);
+    return 1;
+  }
+
+  firmware_boot();
+  // ไฟล์ .rec เริ่มนับเวลาตั้งแต่ ESP32 boot - ข้ามช่วงก่อน input แรกทีละ tick ตามปกติ
+  for (size_t i = 0; i < events.size(); i++) {
+    // input ที่ firmware อ่านเป็นรอบต้องพร้อมก่อนรอบที่อ่าน จึงส่งเข้าก่อนหนึ่งรอบ
+    uint64_t at = events[i].time_us;
+    if (events[i].kind != REC_IR) at = at >= 1000 ? at - 1000 : 0;
+    while (sim_us / 1000 < at / 1000) firmware_tick();
+    if (at > sim_us) sim_us = at;
+    inject(events[i]);
+  }
+  firmware_drain();
+
+  printf("replayed %zu inputs from %s (%.1f s)\n", events.size(), path, sim_us / 1e6);
+  print_decisions(true);
+  return 0;
+}
+
+// ===================================
+// สถานการณ์จำลอง
+// ===================================
+struct Scenario {
+  const char *name;
+  const char *description;
+  void (*build)(std::vector<SimParcel> &parcels);
+  float slip;                  // ตำแหน่งจริง / odometer ของ firmware
+  SimMotor motor;
+};
+
+void build_steady(std::vector<SimParcel> &ps) {
+  for (int i = 0; i < 40; i++) add_parcel(ps, 1000 + i * 2500, SIM_DORMS[i % 4], 0);
+}
+void build_burst(std::vector<SimParcel> &ps) {
+  for (int i = 0; i < 24; i++) add_parcel(ps, 1000, SIM_DORMS[sim_rand() % 4], 0);
+}
+void build_same_dorm(std::vector<SimParcel> &ps) {
+  for (int i = 0; i < 16; i++) add_parcel(ps, 1000, 10, 0);
+}
+void build_unknown(std::vector<SimParcel> &ps) {
+  for (int i = 0; i < 18; i++) add_parcel(ps, 1000 + i * 1500, i % 3 == 0 ? -2 : i % 3 == 1 ? -1 : SIM_DORMS[i % 4], 0);
+}
+void build_double_ir(std::vector<SimParcel> &ps) {
+  for (int i = 0; i < 16; i++) add_parcel(ps, 1000 + i * 2000, SIM_DORMS[i % 3], i % 2 ? SIM_DOUBLE_IR : 0);
+}
+void build_qr_timeout(std::vector<SimParcel> &ps) {
+  for (int i = 0; i < 16; i++) add_parcel(ps, 1000 + i * 2000, SIM_DORMS[i % 3], i % 4 == 1 ? SIM_NO_REPLY : 0);
+}
+void build_worn(std::vector<SimParcel> &ps) {
+  for (int i = 0; i < 32 * NUM_LANES; i++) add_parcel(ps, 1000 + i * 2000 / NUM_LANES, 10, 0);
+}
+void build_jam(std::vector<SimParcel> &ps) {
+  for (int i = 0; i < 16; i++) add_parcel(ps, 1000 + i * 1500, SIM_DORMS[i % 3], i == 3 ? SIM_JAM : 0);
+}
+
+const Scenario SCENARIOS[] = {
+  { "steady",     "40 parcels every 2.5 s, mixed dorms",                  build_steady,     1.00f, SIM_MOTOR_OK },
+  { "burst",      "24 parcels ready at once (loader limited)",            build_burst,      1.00f, SIM_MOTOR_OK },
+  { "same_dorm",  "16 back-to-back parcels for the first gate",           build_same_dorm,  1.00f, SIM_MOTOR_OK },
+  { "unknown",    "unreadable QR (-2) and tracking not in table (-1)",     build_unknown,    1.00f, SIM_MOTOR_OK },
+  { "double_ir",  "intake IR drops out and re-triggers on every 2nd",     build_double_ir,  1.00f, SIM_MOTOR_OK },
+  { "qr_timeout", "Pi never answers every 4th request",                   build_qr_timeout, 1.00f, SIM_MOTOR_OK },
+  { "jam",        "4th parcel sticks before gate 1 and is removed later", build_jam,        1.00f, SIM_MOTOR_OK },
+  { "slip",       "steady load on a belt 6% slower than calibrated",      build_steady,     0.94f, SIM_MOTOR_OK },
+  { "worn",       "gate 1 motor slows 5% per stroke after its baseline",  build_worn,       1.00f, SIM_MOTOR_WEAR },
+  { "dead_switch","gate 1 end-stop never closes (falls back to timing)",  build_worn,       1.00f, SIM_MOTOR_DEAD_SWITCH },
+};
+
+/**
+ * ฟังก์ชันรันสถานการณ์และรายงานผล
+ * @return จำนวนพัสดุที่ไปผิดที่
+ */
+int run_scenario(const Scenario &sc, const char *save_path, bool verbose) {
+  sim_rng = 12345;
+  sim_parcels.clear();
+  sim_replies.clear();
+  sc.build(sim_parcels);
+  sim_slip = sc.slip;
+  sim_motor = sc.motor;
+  sim_pushers_init();
+
+  std::chrono::steady_clock::time_point wall_start = std::chrono::steady_clock::now();
+  firmware_boot();
+  uint32_t last_arrival = 0;
+  for (size_t i = 0; i < sim_parcels.size(); i++) last_arrival = std::max(last_arrival, sim_parcels[i].arrive_ms);
+
+  do {
+    sim_step();
+  } while (!sim_done() && hal_millis() <= last_arrival + SIM_TIMEOUT_MS);
+  firmware_drain();                              // Pi จำลองหยุดตอบ เหมือนตอน replay จากไฟล์
+  uint64_t ticks = sim_us / 1000;
+  double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+
+  SimTally t = sim_tally(verbose);
+  printf("%-11s %s\n", sc.name, sc.description);
+  printf("  parcels %zu  correct %d  misrouted %d  missed %d  removed %d  stranded %d\n",
+         sim_parcels.size(), t.correct, t.misrouted, t.missed, t.removed, t.stranded);
+  printf("  throughput %.1f parcels/min over %d lane(s)%s  intake→exit p50 %.0f ms  p99 %.0f ms  max %.0f ms\n",
+         t.per_min, NUM_LANES, scan_continuous ? " (continuous scan)" : "", percentile(t.latency_ms, 50), percentile(t.latency_ms, 99),
+         t.latency_ms.empty() ? 0.0 : t.latency_ms.back());
+  printf("  firmware: qr timeouts %d  duplicates %d  lost %d  unexpected gate %d  qr late %d\n",
+         count_traces(TR_QR_TIMEOUT), count_traces(TR_TRACKING_DUPLICATE), count_traces(TR_PARCEL_LOST),
+         count_traces(TR_GATE_UNEXPECTED), count_traces(TR_QR_LATE));
+
+  // มอเตอร์ผลัก: เวลาต่อรอบ และเวลาที่ถูกขับค้างที่ปลายทาง (สูญเปล่าเมื่อใช้เวลาคงที่)
+  std::sort(sim_cycles_ms.begin(), sim_cycles_ms.end());
+  double cycle_sum = 0;
+  uint32_t driven = 0, stalled = 0;
+  int short_strokes = 0;
+  for (size_t i = 0; i < sim_cycles_ms.size(); i++) cycle_sum += sim_cycles_ms[i];
+  for (int g = 0; g < NUM_GATES; g++) {
+    driven += sim_pushers[g].driven_ms;
+    stalled += sim_pushers[g].stalled_ms;
+    short_strokes += sim_pushers[g].short_strokes;
+  }
+  printf("  pushers%s: %zu cycles  mean %.0f ms  p99 %.0f ms  stalled at end %.0f%% of drive time  short strokes %d\n",
+         open_loop ? " (open loop)" : "", sim_cycles_ms.size(),
+         sim_cycles_ms.empty() ? 0.0 : cycle_sum / sim_cycles_ms.size(), percentile(sim_cycles_ms, 99),
+         driven ? 100.0 * stalled / driven : 0.0, short_strokes);
+  printf("            end-stop misses %d  feedback lost %d  worn %d\n", count_traces(TR_PUSHER_MISS),
+         count_traces(TR_PUSHER_FEEDBACK_LOST), count_traces(TR_PUSHER_WORN));
+  printf("  sim %.1f s in %.3f s wall (%.0fx real time, %.2f us/tick)  ", sim_us / 1e6, wall_s,
+         wall_s > 0 ? sim_us / 1e6 / wall_s : 0.0, ticks ? wall_s * 1e6 / ticks : 0.0);
+  print_decisions(false);
+
+  if (save_path) {
+    if (rec_save(save_path, recorded)) printf("  saved %zu inputs to %s\n", recorded.size(), save_path);
+    else fprintf(stderr, "%s: cannot write\n", save_path);
+  }
+  return t.misrouted;
+}
+
+int main(int argc, char **argv) {
+  const char *scenario = NULL;
+  const char *save_path = NULL;
+  const char *rec_path = NULL;
+  bool verbose = false;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--scenario") && i + 1 < argc) scenario = argv[++i];
+    else if (!strcmp(argv[i], "--save") && i + 1 < argc) save_path = argv[++i];
+    else if (!strcmp(argv[i], "--verbose")) verbose = true;
+    else if (!strcmp(argv[i], "--open-loop")) open_loop = true;
+    else if (!strcmp(argv[i], "--continuous")) scan_continuous = true;
+    else rec_path = argv[i];
+  }
+
+  if (rec_path && !scenario) return replay_file(rec_path);
+  if (!scenario) {
+    fprintf(stderr, "usage: %s <file.rec> | --scenario <all", argv[0]);
+    for (size_t i = 0; i < sizeof(SCENARIOS) / sizeof(SCENARIOS[0]); i++) fprintf(stderr, "|%s", SCENARIOS[i].name);
+    fprintf(stderr, "> [--save file.rec] [--verbose] [--open-loop] [--continuous]\n");
+    return 2;
+  }
+
+  // ตัวแปร global ของ firmware ไม่ถูกรีเซ็ตโดย setup() - รันแต่ละสถานการณ์ใน process ลูก
+  // เพื่อให้ทุกสถานการณ์เริ่มจากสถานะเดียวกับการ boot จริง
+  int failed = 0;
+  bool found = false;
+  for (size_t i = 0; i < sizeof(SCENARIOS) / sizeof(SCENARIOS[0]); i++) {
+    if (strcmp(scenario, "all") != 0 && strcmp(scenario, SCENARIOS[i].name) != 0) continue;
+    found = true;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+      int misrouted = run_scenario(SCENARIOS[i], strcmp(scenario, "all") ? save_path : NULL, verbose);
+      fflush(stdout);
+      _exit(misrouted > 0 ? 1 : 0);
+    }
+    int status = 0;
+    if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) failed++;
+  }
+  if (!found) {
+    fprintf(stderr, "unknown scenario: %s\n", scenario);
+    return 2;
+  }
+  return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,107 @@
+/**
+ * Simulator สายพานบน host: firmware ทั้งตัว (main.cpp -DHAL_HOST) กับสายพานจำลองที่ปล่อยพัสดุต่อเนื่อง
+ * Serial2 ของ firmware เป็น PTY จริง (เหมือน /dev/ttyS0 ของ Pi) Pi จึงเป็นโปรแกรมของจริงได้
+ *
+ *   sim [--pi builtin]          Pi จำลองใน process เดียวกันคุยผ่านฝั่ง slave ของ PTY (เร็วกว่าเวลาจริง)
+ *   sim --pi external           พิมพ์ path ของ PTY แล้วเดินเวลาจริง ให้ Pi ของจริงเปิด เช่น
+ *                               SERIAL_PORT=/dev/pts/3 python3 qr_server/qr_server.py
+ *                               (Pi ของจริงไม่รู้จักหมายเลขพัสดุจำลอง จึงรายงานเฉพาะการตัดสินใจของ firmware)
+ *       --rate <n>              พัสดุต่อนาทีรวมทุกสายพาน (สุ่มแบบ Poisson, ค่าเริ่มต้น 30)
+ *       --parcels <n>           จำนวนพัสดุ (ค่าเริ่มต้น 60)
+ *       --unknown <pct>         สัดส่วนพัสดุที่ไม่อยู่ในตารางหอพัก (ค่าเริ่มต้น 10)
+ *       --slip <f>              ความเร็วจริงของสายพาน / ค่าที่ calibrate (ค่าเริ่มต้น 1.0)
+ *       --seed <n>              seed ของการสุ่ม
+ *       --verbose               แสดงปลายทางของพัสดุทีละชิ้น
+ *
+ * build:  make -C tools        (ดู tools/Makefile)
+ */
+#include "host_sim.h"
+
+#include <math.h>
+#include <time.h>
+
+/**
+ * ฟังก์ชันเวลาจริงเป็นไมโครวินาที
+ */
+uint64_t wall_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+int main(int argc, char **argv) {
+  bool external = false;
+  bool verbose = false;
+  double rate = 30;
+  int count = 60;
+  int unknown_pct = 10;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--pi") && i + 1 < argc) external = !strcmp(argv[++i], "external");
+    else if (!strcmp(argv[i], "--rate") && i + 1 < argc) rate = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--parcels") && i + 1 < argc) count = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--unknown") && i + 1 < argc) unknown_pct = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--slip") && i + 1 < argc) sim_slip = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--seed") && i + 1 < argc) sim_rng = strtoul(argv[++i], NULL, 0);
+    else if (!strcmp(argv[i], "--verbose")) verbose = true;
+    else {
+      fprintf(stderr, "usage: %s [--pi builtin|external] [--rate n] [--parcels n] [--unknown pct] "
+                      "[--slip f] [--seed n] [--verbose]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (rate <= 0 || count <= 0) {
+    fprintf(stderr, "--rate and --parcels must be positive\n");
+    return 2;
+  }
+
+  // พัสดุมาถึงแบบ Poisson: ระยะห่างระหว่างชิ้นเป็น exponential รอบค่าเฉลี่ย 60000/rate ms
+  double t_ms = 1000;
+  for (int i = 0; i < count; i++) {
+    int dorm = (int)(sim_rand() % 100) < unknown_pct ? -1 : SIM_DORMS[sim_rand() % 4];
+    add_parcel(sim_parcels, (uint32_t)t_ms, dorm, 0);
+    t_ms += -log((sim_rand() % 10000 + 1) / 10001.0) * 60000.0 / rate;
+  }
+  sim_pushers_init();
+
+  char slave_path[64];
+  firmware_boot();
+  if (!pty_open(slave_path, sizeof(slave_path))) {
+    perror("pty");
+    return 1;
+  }
+  if (external) {
+    printf("Pi serial port: %s\n", slave_path);
+    printf("  SERIAL_PORT=%s python3 qr_server/qr_server.py\n", slave_path);
+    fflush(stdout);
+  } else {
+    sim_pi_fd = open(slave_path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (sim_pi_fd < 0) {
+      perror(slave_path);
+      return 1;
+    }
+  }
+
+  uint64_t wall_start = wall_us();
+  uint32_t last_arrival = sim_parcels.back().arrive_ms;
+  do {
+    if (!external) {
+      sim_step_pty();
+    } else {
+      sim_step();
+      int64_t ahead = (int64_t)sim_us - (int64_t)(wall_us() - wall_start);
+      if (ahead > 0) usleep(ahead);              // Pi ของจริงเดินตามเวลาจริง
+    }
+  } while (!sim_done() && hal_millis() <= last_arrival + SIM_TIMEOUT_MS);
+
+  printf("%d lane(s)  %d parcels at %.0f/min  Pi %s over %s  sim %.1f s in %.1f s wall\n", NUM_LANES, count, rate,
+         external ? "external" : "builtin", slave_path, sim_us / 1e6, (wall_us() - wall_start) / 1e6);
+  printf("  firmware: intakes %d  gates %d  to belt end %d  qr timeouts %d  lost %d  dorm syncs %d  pty dropped %u\n",
+         count_traces(TR_INTAKE), count_traces(TR_PUSH_DORM), count_traces(TR_PUSH_NO_FORM),
+         count_traces(TR_QR_TIMEOUT), count_traces(TR_PARCEL_LOST), count_traces(TR_DORM_SYNC_DONE), pty_dropped);
+  SimTally t = sim_tally(verbose);
+  if (external) return 0;                        // Pi ของจริงไม่รู้หอพักจริงของพัสดุจำลอง
+  printf("  parcels: correct %d  misrouted %d  missed %d  stranded %d  throughput %.1f/min  "
+         "intake→exit p50 %.0f ms  p99 %.0f ms\n", t.correct, t.misrouted, t.missed, t.stranded, t.per_min,
+         percentile(t.latency_ms, 50), percentile(t.latency_ms, 99));
+  return t.misrouted + t.missed + t.stranded > 0 ? 1 : 0;
+}
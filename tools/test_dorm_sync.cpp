@@ -0,0 +1,170 @@
+/**
+ * Test การ sync ตารางหอพักบนอุปกรณ์ (MSG_DORM_SYNC / MSG_DORM_FULL / MSG_DORM_DELTA)
+ *
+ * build ด้วย DORM_CACHE_CAPACITY เล็ก (ดู tools/Makefile) เพื่อทดสอบตารางเต็มด้วยรายการไม่มาก
+ *   - sync ครั้งแรกหลายพาร์ต แล้วค้นหอพักได้ทุกรายการ
+ *   - delta ไม่ต่อเนื่อง → ขอตารางใหม่ ระหว่างรับ (และเมื่อ part หาย) ยังค้นจากตารางเดิมได้ครบ
+ *   - ยังไม่ได้รับครบ → ขอซ้ำทุก DORM_SYNC_RETRY_MS แม้จะมีตารางเดิมอยู่แล้ว
+ *   - ได้รับครบ → สลับเป็นตารางใหม่ หยุดขอซ้ำ และ delta ต่อจาก version ใหม่ได้
+ *   - ตารางเกินความจุ → TR_DORM_CACHE_FULL และเก็บเท่าที่จุได้
+ *
+ * build:  make -C tools check
+ */
+#include "host_hal.h"
+
+#include <algorithm>
+#include <string>
+
+typedef std::vector<std::pair<uint32_t, uint8_t> > DormEntries;
+
+/**
+ * ฟังก์ชันนับกรอบชนิดที่ต้องการที่ firmware ส่งไป Pi แล้วล้าง buffer
+ */
+int take_frames(uint8_t type) {
+  int count = 0;
+  size_t start = 0;
+  for (size_t i = 0; i < pi_tx.size(); i++) {
+    if (pi_tx[i] != 0) continue;
+    std::vector<uint8_t> frame(pi_tx.begin() + start, pi_tx.begin() + i);
+    start = i + 1;
+    size_t n = cobs_decode(frame.data(), frame.size());
+    if (n >= 3 && crc16_ccitt(frame.data(), n - 2) == rd_u16(frame.data() + n - 2) && frame[0] == type) count++;
+  }
+  pi_tx.clear();
+  return count;
+}
+
+/**
+ * ฟังก์ชันส่งกรอบจาก Pi เข้า firmware แล้วรันหนึ่งรอบ
+ */
+void pi_send(PiFrame &f) {
+  InputEvent ev;
+  ev.kind = REC_PI;
+  ev.sensor = ev.level = 0;
+  ev.data.resize(PI_WIRE_MAX);
+  ev.data.resize(frame_encode(f, ev.data.data(), ev.data.size()));
+  inject(ev);
+  firmware_tick();
+}
+
+void tick_ms(int ms) {
+  for (int i = 0; i < ms; i++) firmware_tick();
+}
+
+std::string tracking(char prefix, int i) {
+  char text[TRACKING_MAX_LEN + 1];
+  snprintf(text, sizeof(text), "T%c%08d", prefix, i);
+  return text;
+}
+
+/**
+ * ฟังก์ชันสร้างตาราง (เรียงตาม hash เหมือน Pi)
+ */
+DormEntries make_table(char prefix, int count, int dorm_offset) {
+  DormEntries entries;
+  for (int i = 0; i < count; i++) {
+    entries.push_back(std::make_pair(tracking_hash(tracking(prefix, i).c_str()), (uint8_t)((i + dorm_offset) % 10)));
+  }
+  std::sort(entries.begin(), entries.end());
+  return entries;
+}
+
+/**
+ * ฟังก์ชันส่งตารางทั้งหมดเป็น MSG_DORM_FULL
+ * @param parts จำนวน part
+ * @param skip part ที่ทำหาย (-1 = ไม่มี)
+ * @param last part สุดท้ายที่ส่ง (ที่เหลือยังไม่มาถึง)
+ */
+void send_full(const DormEntries &entries, uint32_t version, int parts, int skip, int last) {
+  size_t per_part = (entries.size() + parts - 1) / parts;
+  for (int part = 0; part <= last && part < parts; part++) {
+    if (part == skip) continue;
+    PiFrame f;
+    frame_begin(f, MSG_DORM_FULL);
+    frame_u32(f, version);
+    frame_u16(f, part);
+    frame_u16(f, parts);
+    for (size_t i = part * per_part; i < entries.size() && i < (part + 1) * per_part; i++) {
+      frame_u32(f, entries[i].first);
+      frame_u8(f, entries[i].second);
+    }
+    pi_send(f);
+  }
+}
+
+/**
+ * ฟังก์ชันนับหมายเลขที่ค้นได้หอพักตรงตามที่สร้าง
+ */
+int lookups_ok(char prefix, int count, int dorm_offset) {
+  int ok = 0;
+  for (int i = 0; i < count; i++) ok += dorm_lookup(tracking(prefix, i).c_str()) == (i + dorm_offset) % 10;
+  return ok;
+}
+
+int main() {
+  const int n = DORM_CACHE_CAPACITY / 2;
+  DormEntries table_a = make_table('A', n, 0);
+  DormEntries table_b = make_table('B', n, 3);
+
+  // sync ครั้งแรก
+  firmware_boot();
+  tick_ms(10);
+  CHECK(take_frames(MSG_DORM_SYNC) == 1);
+  send_full(table_a, 1, 3, -1, 2);
+  CHECK(dorm_cache_ready && dorm_cache_version == 1 && lookups_ok('A', n, 0) == n);
+  tick_ms(DORM_SYNC_RETRY_MS + 10);
+  CHECK(take_frames(MSG_DORM_SYNC) == 0);
+
+  // delta ไม่ต่อเนื่อง → ขอตารางใหม่ ได้รับเพียง part แรก
+  PiFrame f;
+  frame_begin(f, MSG_DORM_DELTA);
+  frame_u32(f, 7);
+  frame_u32(f, 8);
+  pi_send(f);
+  CHECK(take_frames(MSG_DORM_SYNC) == 1);
+  send_full(table_b, 2, 3, -1, 0);
+  CHECK(lookups_ok('A', n, 0) == n && lookups_ok('B', n, 3) == 0);
+
+  // ยังไม่ครบ → ขอซ้ำแม้มีตารางเดิม
+  tick_ms(DORM_SYNC_RETRY_MS + 10);
+  int retries = take_frames(MSG_DORM_SYNC);
+  CHECK(retries == 1);
+
+  // part หายระหว่างทาง → ตารางเดิมยังใช้ได้ และขอซ้ำอีก
+  int errors = count_traces(TR_DORM_SYNC_ERROR);
+  send_full(table_b, 2, 3, 1, 2);
+  CHECK(count_traces(TR_DORM_SYNC_ERROR) == errors + 1);
+  CHECK(dorm_cache_version == 1 && lookups_ok('A', n, 0) == n && lookups_ok('B', n, 3) == 0);
+  tick_ms(DORM_SYNC_RETRY_MS + 10);
+  retries += take_frames(MSG_DORM_SYNC);
+  CHECK(retries == 2);
+
+  // ได้รับครบ → ตารางใหม่ หยุดขอซ้ำ
+  send_full(table_b, 2, 3, -1, 2);
+  CHECK(dorm_cache_version == 2 && lookups_ok('B', n, 3) == n && lookups_ok('A', n, 0) == 0);
+  tick_ms(DORM_SYNC_RETRY_MS + 10);
+  CHECK(take_frames(MSG_DORM_SYNC) == 0);
+
+  // delta ต่อจาก version ใหม่: เพิ่มหนึ่งรายการ ลบหนึ่งรายการ
+  frame_begin(f, MSG_DORM_DELTA);
+  frame_u32(f, 2);
+  frame_u32(f, 3);
+  frame_u32(f, tracking_hash(tracking('A', 0).c_str()));
+  frame_u8(f, 0);
+  frame_u32(f, tracking_hash(tracking('B', 1).c_str()));
+  frame_u8(f, DORM_DELETE);
+  pi_send(f);
+  CHECK(dorm_cache_version == 3 && dorm_lookup(tracking('A', 0).c_str()) == 0);
+  CHECK(dorm_lookup(tracking('B', 1).c_str()) == -1 && lookups_ok('B', n, 3) == n - 1);
+  CHECK(take_frames(MSG_DORM_SYNC) == 0);
+
+  // ตารางเกินความจุ
+  DormEntries table_c = make_table('C', DORM_CACHE_CAPACITY + 10, 0);
+  send_full(table_c, 4, 4, -1, 3);
+  CHECK(count_traces(TR_DORM_CACHE_FULL) > 0);
+  CHECK(dorm_cache_version == 4 && dorm_cache->size == DORM_CACHE_CAPACITY);
+
+  printf("dorm sync: capacity %d, %d entries per table, %d retries while a table was live - %s\n",
+         DORM_CACHE_CAPACITY, n, retries, check_failures ? "FAILED" : "ok");
+  return check_failures ? 1 : 0;
+}
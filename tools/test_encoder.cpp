@@ -0,0 +1,79 @@
+/**
+ * Test ตำแหน่งสายพานจาก encoder (BELT_ENCODER_PIN) เมื่อสายพานเปลี่ยนทิศ
+ *
+ * encoder นับพัลส์ได้อย่างเดียวไม่บอกทิศ firmware ต้องสะสมพัลส์ของแต่ละช่วงตามทิศที่สั่งเดิน:
+ *   - เดินหน้าระหว่าง ramp (duty เปลี่ยนหลายครั้ง) นับครบทุกพัลส์
+ *   - หลังหยุด พัลส์ที่สายพานไหลต่อนับตามทิศเดิม และตำแหน่งไม่กลับเครื่องหมาย
+ *   - ถอยหลังลดตำแหน่งเฉพาะพัลส์ของช่วงถอยหลัง (พฤติกรรมเดิมกลับเครื่องหมายทั้ง odometer)
+ *   - ระยะของพัสดุในคิวตามการเดินหน้า/ถอยหลังจริง
+ *
+ * build:  make -C tools check (build ด้วย -DBELT_ENCODER_PIN ดู Makefile)
+ */
+#include "host_hal.h"
+
+/**
+ * ฟังก์ชันส่งพัลส์ของ encoder ทีละพัลส์ต่อมิลลิวินาที (ให้ belt_update ramp ระหว่างนั้น)
+ */
+void pulses(int count) {
+  for (int i = 0; i < count; i++) {
+    belt_encoder_isr();
+    firmware_tick();
+  }
+}
+
+/**
+ * ฟังก์ชันตรวจตำแหน่งสายพานและระยะของพัสดุ
+ */
+bool check_position(const char *step, float expect_mm, uint32_t seq, float expect_parcel_mm) {
+  const Lane &lane = lanes[0];
+  float mm = belt_position_at(lane, hal_micros());
+  float parcel_mm = mm - queue_slot(lane, seq).intake_mm;
+  bool ok = fabsf(mm - expect_mm) < 0.01f && fabsf(parcel_mm - expect_parcel_mm) < 0.01f;
+  CHECK(ok);
+  printf("encoder: %-34s belt %7.1f mm (want %7.1f)  parcel %6.1f mm (want %6.1f) - %s\n", step, mm, expect_mm,
+         parcel_mm, expect_parcel_mm, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+int main() {
+  firmware_boot();
+  Lane &lane = lanes[0];
+  float start_mm = belt_position_at(lane, hal_micros());
+
+  // พัสดุที่ตำแหน่งปัจจุบัน (ไม่ผ่าน IR - ตรวจเฉพาะระยะ)
+  uint32_t seq = lane.queue_tail;
+  ParcelSlot &slot = queue_slot(lane, seq);
+  memset(&slot, 0, sizeof(slot));
+  slot.active = true;
+  slot.dorm = -2;
+  slot.intake_mm = start_mm;
+  slot.last_gate = -1;
+
+  float mm = start_mm;
+  convayer_move(lane, 1);
+  pulses(100);
+  mm += 100 * BELT_MM_PER_PULSE;
+  check_position("forward 100 pulses while ramping", mm, seq, mm - start_mm);
+
+  convayer_move(lane, 0);
+  pulses(4);
+  mm += 4 * BELT_MM_PER_PULSE;
+  check_position("stop, coast 4 pulses", mm, seq, mm - start_mm);
+
+  convayer_move(lane, -1);
+  pulses(30);
+  mm -= 30 * BELT_MM_PER_PULSE;
+  check_position("reverse 30 pulses", mm, seq, mm - start_mm);
+
+  convayer_move(lane, 0);
+  pulses(2);
+  mm -= 2 * BELT_MM_PER_PULSE;
+  check_position("stop after reverse, coast 2 pulses", mm, seq, mm - start_mm);
+
+  convayer_move(lane, 1);
+  pulses(50);
+  mm += 50 * BELT_MM_PER_PULSE;
+  check_position("forward again 50 pulses", mm, seq, mm - start_mm);
+
+  return check_failures ? 1 : 0;
+}
@@ -0,0 +1,249 @@
+/**
+ * Test กรอบข้อความไบนารีระหว่าง ESP32 กับ Pi (COBS + CRC-16/CCITT)
+ *
+ *   - round trip: frame_encode → cobs_decode ได้ payload เดิมทุกความยาวและเนื้อหา
+ *     (ศูนย์ล้วน, ไม่มีศูนย์, ช่วงไม่มีศูนย์ยาว 253/254/255/508/509 ไบต์, payload ยาวสุด)
+ *     ข้อมูลบนสายไม่มีศูนย์ก่อนตัวคั่น และยาวไม่เกิน PI_WIRE_MAX
+ *   - กรอบเสียผ่านทางรับจริงของ firmware (pi_poll): ทุกการกลับบิตหนึ่งบิต และการสุ่มทำลายหลายไบต์
+ *     ต้องได้ TR_PI_FRAME_BAD และไม่มีผล (ใช้ MSG_DORM_DELTA - version ของตารางต้องไม่เปลี่ยน)
+ *     แล้วกรอบที่ถูกต้องที่ตามมาต้องมีผลทันที (กลับมาตรงกรอบได้เอง)
+ *   - ขยะที่มีตัวคั่นปน และกรอบที่ยาวเกิน buffer รับ (PI_FRAME_OVERFLOW) ตามด้วยกรอบที่ถูกต้อง
+ *   - throughput ของ encode/decode (MB/s ของ payload)
+ *
+ * build:  make -C tools check
+ */
+#include "host_hal.h"
+
+#include <time.h>
+
+#define FRAMES_RANDOM_TRIALS 3000
+#define FRAMES_BENCH_ROUNDS 20000
+
+uint32_t rng = 7;
+
+uint32_t rnd() {
+  rng = rng * 1103515245u + 12345u;
+  return rng >> 8;
+}
+
+/**
+ * ฟังก์ชันเข้ารหัส payload (ชนิด + เนื้อหา) แล้วถอดกลับ ตรวจว่าได้ payload เดิมและ CRC ถูกต้อง
+ * @return ความยาวบนสาย (0 หากข้อมูลเกิน)
+ */
+size_t round_trip(const std::vector<uint8_t> &payload) {
+  PiFrame f;
+  frame_begin(f, payload[0]);
+  frame_bytes(f, payload.data() + 1, payload.size() - 1);
+  std::vector<uint8_t> wire(PI_WIRE_MAX);
+  size_t len = frame_encode(f, wire.data(), wire.size());
+  CHECK(len > 0 && len <= PI_WIRE_MAX);
+  if (len == 0) return 0;
+  CHECK(wire[len - 1] == 0);
+  CHECK(std::find(wire.begin(), wire.begin() + len - 1, 0) == wire.begin() + len - 1);
+
+  size_t n = cobs_decode(wire.data(), len - 1);
+  CHECK(n == payload.size() + 2);
+  CHECK(n >= 3 && crc16_ccitt(wire.data(), n - 2) == rd_u16(wire.data() + n - 2));
+  CHECK(n >= 3 && std::equal(payload.begin(), payload.end(), wire.begin()));
+  return len;
+}
+
+/**
+ * ฟังก์ชันสร้าง payload ยาว len ไบต์ (รวมชนิด ไม่รวม CRC)
+ * @param fill ค่าที่เติม (-1 = สุ่ม)
+ */
+std::vector<uint8_t> make_payload(size_t len, int fill) {
+  std::vector<uint8_t> p(len);
+  for (size_t i = 0; i < len; i++) p[i] = fill >= 0 ? (uint8_t)fill : (uint8_t)rnd();
+  p[0] = MSG_DORM_DELTA;
+  return p;
+}
+
+/**
+ * ฟังก์ชันสร้างกรอบ MSG_DORM_DELTA ต่อจาก version ปัจจุบันของตาราง (ข้อมูลบนสายรวมตัวคั่น)
+ * hash ไม่มีไบต์ศูนย์ ส่วนที่ไม่มีศูนย์จึงยาวกว่า 254 ไบต์ (รหัส COBS 0xFF อยู่กลางกรอบ)
+ */
+std::vector<uint8_t> delta_wire(int entries) {
+  PiFrame f;
+  frame_begin(f, MSG_DORM_DELTA);
+  frame_u32(f, dorm_cache_version);
+  frame_u32(f, dorm_cache_version + 1);
+  for (int i = 0; i < entries; i++) {
+    frame_u32(f, 0x01010101u | rnd());
+    frame_u8(f, 1 + i % 9);
+  }
+  std::vector<uint8_t> wire(PI_WIRE_MAX);
+  wire.resize(frame_encode(f, wire.data(), wire.size()));
+  return wire;
+}
+
+/**
+ * ฟังก์ชันส่งข้อมูลจาก Pi เข้า firmware แล้วรันหนึ่งรอบ
+ */
+void pi_send_wire(const std::vector<uint8_t> &wire) {
+  InputEvent ev;
+  ev.kind = REC_PI;
+  ev.sensor = ev.level = 0;
+  ev.data = wire;
+  inject(ev);
+  firmware_tick();
+}
+
+/**
+ * ฟังก์ชันส่งกรอบที่ถูกทำลาย แล้วส่งกรอบเดิมที่ถูกต้อง
+ * @return true หากกรอบเสียถูกปฏิเสธ (มี TR_PI_FRAME_BAD และ version ไม่เปลี่ยน) และกรอบที่ตามมามีผล
+ */
+bool reject_then_accept(const std::vector<uint8_t> &good, const std::vector<uint8_t> &bad) {
+  uint32_t version = dorm_cache_version;
+  int errors = count_traces(TR_PI_FRAME_BAD);
+  pi_send_wire(bad);
+  bool rejected = dorm_cache_version == version && count_traces(TR_PI_FRAME_BAD) > errors;
+  pi_send_wire(good);
+  return rejected && dorm_cache_version == version + 1;
+}
+
+/**
+ * ฟังก์ชันนับ TR_PI_FRAME_BAD ตามชนิดข้อผิดพลาด
+ */
+int count_frame_errors(int32_t error) {
+  int n = 0;
+  for (size_t i = 0; i < traces.size(); i++) n += traces[i].id == TR_PI_FRAME_BAD && traces[i].a == error;
+  return n;
+}
+
+double elapsed_s(const timespec &a, const timespec &b) {
+  return (b.tv_sec - a.tv_sec) + (b.tv_nsec - a.tv_nsec) / 1e9;
+}
+
+int main() {
+  // round trip
+  const size_t max_payload = PI_FRAME_MAX - 2;
+  const size_t lengths[] = { 1, 2, 3, 252, 253, 254, 255, 256, 507, 508, 509, 510, 762, 763, max_payload };
+  int trips = 0;
+  size_t longest_wire = 0;
+  const int fills[] = { -1, 0, 0x55 };          // สุ่ม, ศูนย์ล้วน, ไม่มีศูนย์
+  for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+    for (size_t k = 0; k < sizeof(fills) / sizeof(fills[0]); k++) {
+      longest_wire = std::max(longest_wire, round_trip(make_payload(lengths[i], fills[k])));
+      trips++;
+    }
+  }
+  const size_t runs[] = { 253, 254, 255, 508, 509 };
+  for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+    for (size_t at = 2; at + runs[i] <= max_payload; at += 97) {
+      std::vector<uint8_t> p = make_payload(max_payload, -1);
+      for (size_t k = 1; k < p.size(); k++) if (p[k] == 0) p[k] = 1;
+      p[at - 1] = 0;                             // ช่วงไม่มีศูนย์ยาว runs[i] ไบต์คั่นด้วยศูนย์ทั้งสองข้าง
+      if (at + runs[i] < p.size()) p[at + runs[i]] = 0;
+      round_trip(p);
+      trips++;
+    }
+  }
+  for (int i = 0; i < 500; i++) {
+    std::vector<uint8_t> p = make_payload(1 + rnd() % max_payload, -1);
+    for (size_t k = 1; k < p.size(); k++) if (rnd() % 4 == 0) p[k] = 0;
+    round_trip(p);
+    trips++;
+  }
+  CHECK(longest_wire == PI_WIRE_MAX);           // payload ยาวสุดไม่มีศูนย์ใช้ buffer รับพอดี
+  PiFrame f;
+  frame_begin(f, MSG_DORM_DELTA);
+  std::vector<uint8_t> big(PI_FRAME_MAX, 1);
+  frame_bytes(f, big.data(), big.size());
+  CHECK(f.overflow && frame_encode(f, big.data(), big.size()) == 0);
+  printf("frames: %d round trips, longest on wire %zu of %d bytes\n", trips, longest_wire, PI_WIRE_MAX);
+
+  // ตารางหอพักว่างที่พร้อมรับ delta
+  firmware_boot();
+  frame_begin(f, MSG_DORM_FULL);
+  frame_u32(f, 1);
+  frame_u16(f, 0);
+  frame_u16(f, 1);
+  std::vector<uint8_t> wire(PI_WIRE_MAX);
+  wire.resize(frame_encode(f, wire.data(), wire.size()));
+  pi_send_wire(wire);
+  CHECK(dorm_cache_ready && dorm_cache_version == 1);
+
+  // กลับบิตทีละบิต (ไม่รวมตัวคั่น)
+  int flips = 0, flips_ok = 0;
+  std::vector<uint8_t> good = delta_wire(60);
+  for (size_t i = 0; i + 1 < good.size(); i++) {
+    for (int bit = 0; bit < 8; bit++) {
+      std::vector<uint8_t> bad = good;
+      bad[i] ^= 1 << bit;
+      flips_ok += reject_then_accept(good, bad);
+      flips++;
+      good = delta_wire(60);
+    }
+  }
+  CHECK(flips_ok == flips);
+
+  // สุ่มทำลายหลายไบต์ ตัด หรือแทรกไบต์
+  int trials_ok = 0;
+  for (int t = 0; t < FRAMES_RANDOM_TRIALS; t++) {
+    good = delta_wire(1 + rnd() % 150);
+    std::vector<uint8_t> bad = good;
+    bad.pop_back();
+    switch (t % 3) {
+      case 0:
+        for (int k = 1 + rnd() % 8; k > 0; k--) bad[rnd() % bad.size()] ^= 1 + rnd() % 255;
+        break;
+      case 1:
+        bad.resize(1 + rnd() % (bad.size() - 1));
+        break;
+      default:
+        bad.insert(bad.begin() + rnd() % bad.size(), 1 + rnd() % 255);
+        break;
+    }
+    bad.push_back(0);
+    trials_ok += reject_then_accept(good, bad);
+  }
+  CHECK(trials_ok == FRAMES_RANDOM_TRIALS);
+
+  // ขยะที่มีตัวคั่นปน (เช่นเริ่มฟังกลางกรอบ)
+  std::vector<uint8_t> garbage(3000);
+  for (size_t i = 0; i < garbage.size(); i++) garbage[i] = rnd() % 8 == 0 ? 0 : rnd();
+  garbage.push_back(0);
+  good = delta_wire(20);
+  CHECK(reject_then_accept(good, garbage));
+
+  // กรอบยาวเกิน buffer รับ
+  int overflows = count_frame_errors(PI_FRAME_OVERFLOW);
+  std::vector<uint8_t> flood(PI_WIRE_MAX * 2 + 100, 0x5A);
+  flood.push_back(0);
+  good = delta_wire(20);
+  CHECK(reject_then_accept(good, flood));
+  CHECK(count_frame_errors(PI_FRAME_OVERFLOW) > overflows);
+  CHECK(pi_rx_len == 0 && !pi_rx_overflow);
+
+  // กรอบที่มีผลทั้งหมด = delta ถูกต้องหนึ่งกรอบต่อการทดลอง
+  CHECK(dorm_cache_version == 1 + (uint32_t)(flips + FRAMES_RANDOM_TRIALS + 2));
+  printf("frames: %d single-bit flips, %d random corruptions rejected, resync after garbage and overflow\n",
+         flips, FRAMES_RANDOM_TRIALS);
+
+  // throughput ของ payload ยาวสุด (สุ่ม มีศูนย์ปน)
+  std::vector<uint8_t> payload = make_payload(max_payload, -1);
+  std::vector<uint8_t> out(PI_WIRE_MAX), in(PI_WIRE_MAX);
+  timespec t0, t1, t2;
+  size_t len = 0;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (int r = 0; r < FRAMES_BENCH_ROUNDS; r++) {
+    frame_begin(f, payload[0]);
+    frame_bytes(f, payload.data() + 1, payload.size() - 1);
+    len = frame_encode(f, out.data(), out.size());
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  size_t n = 0;
+  for (int r = 0; r < FRAMES_BENCH_ROUNDS; r++) {
+    memcpy(in.data(), out.data(), len);
+    n = cobs_decode(in.data(), len - 1);
+    CHECK(crc16_ccitt(in.data(), n - 2) == rd_u16(in.data() + n - 2));
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t2);
+  double mb = (double)max_payload * FRAMES_BENCH_ROUNDS / 1e6;
+  printf("frames: encode %.1f MB/s, decode + crc %.1f MB/s (%zu-byte payload)\n", mb / elapsed_s(t0, t1),
+         mb / elapsed_s(t1, t2), max_payload);
+
+  printf("frames: %s\n", check_failures ? "FAILED" : "ok");
+  return check_failures ? 1 : 0;
+}
@@ -0,0 +1,187 @@
+/**
+ * Test ของการจับขอบสัญญาณ IR: ISR → ring buffer → ir_next_edge() (debounce ทีละ sensor)
+ *
+ * แต่ละ trace คือรายการขอบสัญญาณดิบ (เวลา us, sensor, ระดับ) ที่ส่งเข้า ISR ตามเวลาจริง
+ * ฝั่งผู้อ่านเรียก ir_next_edge() ทุก 1 ms เหมือน task real-time แล้วเทียบกับขอบที่คาดว่าจะผ่าน debounce
+ *   - ขอบสะอาดของทุก sensor: ผ่านครบ และเวลาเป็นเวลาของ ISR ไม่ใช่เวลาที่ผู้อ่านมาอ่าน
+ *   - สัญญาณเด้งภายใน debounce: เหลือขอบเดียว และระดับสุดท้ายถูกต้องหลังหมดช่วง debounce
+ *   - ขอบสุดท้ายที่ถูกกรองใน debounce: การตรวจขาซ้ำใช้เวลาของ ISR ไม่ใช่เวลาที่ตรวจพบ
+ *   - debounce ต่างกันต่อ sensor: พัสดุสั้นบนสายพานเร็วผ่าน sensor ที่ตั้ง debounce ต่ำได้
+ *   - ring เต็มระหว่างผู้อ่านไม่ได้อ่าน: นับ event ที่ทิ้ง และระดับกลับมาตรงกับขาจริงด้วยการตรวจซ้ำ
+ *   - trace ของสายพานจำลองทั้งสถานการณ์ (host_sim.h): ทุกขอบผ่านด้วยเวลาเดิม
+ *
+ * build:  make -C tools check
+ */
+#include "host_sim.h"
+
+struct Edge {
+  uint32_t time_us;
+  uint8_t sensor;
+  uint8_t level;
+};
+
+/**
+ * ฟังก์ชันส่งขอบสัญญาณดิบเข้า ISR ตามเวลา และอ่านขอบที่ผ่าน debounce ทุก 1 ms
+ * @param raw ขอบดิบ (เรียงตามเวลา)
+ * @param until_us เวลาที่หยุดอ่าน
+ * @param consume_from_us ผู้อ่านเริ่มอ่านตั้งแต่เวลานี้ (จำลองผู้อ่านช้า/ไม่ว่าง)
+ */
+std::vector<Edge> run_trace(const std::vector<Edge> &raw, uint32_t until_us, uint32_t consume_from_us = 0) {
+  std::vector<Edge> accepted;
+  size_t next = 0;
+  while (sim_us < until_us) {
+    uint64_t tick_end = (sim_us / 1000 + 1) * 1000;
+    for (; next < raw.size() && raw[next].time_us < tick_end; next++) {
+      sim_us = raw[next].time_us;
+      uint8_t pin = ir_pin(raw[next].sensor);
+      pin_level[pin] = raw[next].level;
+      if (pin_isr[pin]) pin_isr[pin]();
+    }
+    sim_us = tick_end;
+    if (sim_us < consume_from_us) continue;
+    IrEvent ev;
+    while (ir_next_edge(ev)) {
+      Edge e = { ev.time_us, ev.sensor, ev.level };
+      accepted.push_back(e);
+    }
+  }
+  return accepted;
+}
+
+/**
+ * ฟังก์ชันเทียบขอบที่ได้กับที่คาด
+ */
+bool same_edges(const std::vector<Edge> &got, const std::vector<Edge> &want) {
+  if (got.size() != want.size()) {
+    fprintf(stderr, "  got %zu edges, want %zu\n", got.size(), want.size());
+    return false;
+  }
+  for (size_t i = 0; i < got.size(); i++) {
+    if (got[i].time_us != want[i].time_us || got[i].sensor != want[i].sensor || got[i].level != want[i].level) {
+      fprintf(stderr, "  edge %zu: got %u us sensor %d level %d, want %u us sensor %d level %d\n", i,
+              got[i].time_us, got[i].sensor, got[i].level, want[i].time_us, want[i].sensor, want[i].level);
+      return false;
+    }
+  }
+  return true;
+}
+
+void add_edge(std::vector<Edge> &edges, uint32_t time_us, uint8_t sensor, uint8_t level) {
+  Edge e = { time_us, sensor, level };
+  edges.push_back(e);
+}
+
+/**
+ * ฟังก์ชันพิมพ์ผลของแต่ละ trace
+ */
+void report(const char *name, int failures_before) {
+  printf("ir: %-58s %s\n", name, check_failures > failures_before ? "FAILED" : "ok");
+}
+
+int main() {
+  // 1. ขอบสะอาดของทุก sensor (พัสดุผ่านทีละตัว) - ผ่านครบด้วยเวลาของ ISR
+  firmware_boot();
+  int failures = check_failures;
+  std::vector<Edge> raw;
+  for (int s = 0; s < NUM_IR_SENSORS; s++) {
+    uint32_t t = 100000 + s * 250000 + 137;      // ไม่ตรงขอบมิลลิวินาที
+    add_edge(raw, t, s, LOW);
+    add_edge(raw, t + 120333, s, HIGH);
+  }
+  CHECK(same_edges(run_trace(raw, 100000 + NUM_IR_SENSORS * 250000), raw));
+  report("clean edges on every sensor keep ISR timestamps", failures);
+
+  // 2. สัญญาณเด้งภายใน debounce (ขอบของพัสดุขรุขระ) - เหลือขอบเดียวต่อการเปลี่ยนระดับ
+  firmware_boot();
+  failures = check_failures;
+  raw.clear();
+  add_edge(raw, 100000, IR_SENSOR_MAIN, LOW);
+  add_edge(raw, 100400, IR_SENSOR_MAIN, HIGH);
+  add_edge(raw, 101100, IR_SENSOR_MAIN, LOW);
+  add_edge(raw, 103000, IR_SENSOR_MAIN, HIGH);
+  add_edge(raw, 103050, IR_SENSOR_MAIN, LOW);
+  add_edge(raw, 300000, IR_SENSOR_MAIN, HIGH);
+  add_edge(raw, 300200, IR_SENSOR_MAIN, LOW);    // เด้งตอนพัสดุพ้น - ระดับสุดท้ายคือ HIGH
+  add_edge(raw, 300900, IR_SENSOR_MAIN, HIGH);
+  std::vector<Edge> got = run_trace(raw, 400000);
+  CHECK(got.size() == 2 && got[0].level == LOW && got[0].time_us == 100000);
+  CHECK(got.size() == 2 && got[1].level == HIGH && got[1].time_us == 300000);
+  CHECK(ir_state[IR_SENSOR_MAIN] == HIGH);
+  report("bounces inside the debounce window collapse to one edge", failures);
+
+  // 2b. พัสดุถัดไปมาถึงภายใน debounce ของขอบก่อนหน้า - ring กรองทิ้ง การตรวจขาซ้ำพบภายหลัง
+  firmware_boot();
+  failures = check_failures;
+  raw.clear();
+  add_edge(raw, 100000, IR_SENSOR_MAIN, LOW);
+  add_edge(raw, 250000, IR_SENSOR_MAIN, HIGH);
+  add_edge(raw, 257321, IR_SENSOR_MAIN, LOW);    // 7 ms หลังขอบก่อนหน้า (debounce 20 ms)
+  got = run_trace(raw, 400000);
+  CHECK(same_edges(got, raw));                   // ขอบที่ 3 ได้เวลาของ ISR ไม่ใช่ ~270000
+  report("a final edge filtered by debounce keeps its ISR timestamp", failures);
+
+  // 3. debounce ต่อ sensor: พัสดุ 40 mm ห่างกัน 20 mm บนสายพาน 4 m/s (10 ms / 5 ms)
+  firmware_boot();
+  failures = check_failures;
+  ir_debounce_us[IR_SENSOR_G1] = 2000;           // ประตูแรกตั้ง debounce ต่ำสำหรับสายพานเร็ว
+  raw.clear();
+  for (int i = 0; i < 20; i++) {
+    uint32_t t = 100000 + i * 15000;
+    add_edge(raw, t, IR_SENSOR_MAIN, LOW);
+    add_edge(raw, t + 10000, IR_SENSOR_MAIN, HIGH);
+    add_edge(raw, t + 333, IR_SENSOR_G1, LOW);
+    add_edge(raw, t + 10333, IR_SENSOR_G1, HIGH);
+  }
+  got = run_trace(raw, 500000);
+  int main_low = 0, gate_low = 0;
+  for (size_t i = 0; i < got.size(); i++) {
+    if (got[i].level != LOW) continue;
+    main_low += got[i].sensor == IR_SENSOR_MAIN;
+    gate_low += got[i].sensor == IR_SENSOR_G1;
+  }
+  CHECK(gate_low == 20);                         // ทุกชิ้นถูกนับที่ประตู
+  CHECK(main_low < 20);                          // debounce 20 ms ของ IR หลักรวมพัสดุที่ชิดกัน
+  report("per-sensor debounce passes short parcels on a fast belt", failures);
+
+  // 4. ring เต็ม (ผู้อ่านไม่ว่าง 50 ms) - นับที่ทิ้ง และระดับกลับมาตรงกับขาจริง
+  firmware_boot();
+  failures = check_failures;
+  raw.clear();
+  for (int i = 0; i < IR_EVENT_CAPACITY * 2; i++) {
+    add_edge(raw, 100000 + i * 100, IR_SENSOR_G1 + i % NUM_GATES, i / NUM_GATES % 2 ? HIGH : LOW);
+  }
+  add_edge(raw, 130000, IR_SENSOR_MAIN, LOW);    // ขอบสุดท้ายหลัง ring เต็ม
+  uint32_t dropped = ir_event_dropped;          // setup() ไม่รีเซ็ตตัวนับ
+  got = run_trace(raw, 200000, 150000);
+  CHECK(ir_event_dropped - dropped == (uint32_t)(IR_EVENT_CAPACITY * 2 + 1 - IR_EVENT_CAPACITY));
+  for (int s = 0; s < NUM_IR_SENSORS; s++) CHECK(ir_state[s] == pin_level[ir_pin(s)]);
+  // ขอบของ IR หลักหายไปกับ ring ที่เต็ม: เวลาเป็นครั้งล่าสุดที่ขายังอยู่ระดับเดิม (ไม่ช้ากว่าขอบจริง)
+  bool main_resync = false;
+  for (size_t i = 0; i < got.size(); i++) {
+    if (got[i].sensor != IR_SENSOR_MAIN) continue;
+    main_resync = true;
+    CHECK(got[i].level == LOW && got[i].time_us <= 130000);
+  }
+  CHECK(main_resync);
+  report("ring overflow is counted and levels resync from the pins", failures);
+
+  // 5. trace ของสายพานจำลองทั้งสถานการณ์ - ทุกขอบห่างกันเกิน debounce จึงต้องผ่านครบด้วยเวลาเดิม
+  failures = check_failures;
+  for (int i = 0; i < 40; i++) add_parcel(sim_parcels, 1000 + i * 2500, SIM_DORMS[i % 4], 0);
+  sim_pushers_init();
+  firmware_boot();
+  do {
+    sim_step();
+  } while (!sim_done() && hal_millis() < 300000);
+  raw.clear();
+  for (size_t i = 0; i < recorded.size(); i++) {
+    if (recorded[i].kind == REC_IR) add_edge(raw, (uint32_t)recorded[i].time_us, recorded[i].sensor, recorded[i].level);
+  }
+  firmware_boot();
+  CHECK(raw.size() > 200);
+  CHECK(same_edges(run_trace(raw, raw.back().time_us + 1000), raw));
+  char name[64];
+  snprintf(name, sizeof(name), "%zu edges from a simulated 40-parcel run replay exactly", raw.size());
+  report(name, failures);
+  return check_failures ? 1 : 0;
+}
@@ -0,0 +1,143 @@
+/**
+ * Test การกู้คืนคิวจาก journal หลังไฟดับขณะสายพานเดิน
+ *
+ * แต่ละกรณีรันสายพานจำลองจนถึงเวลาสุ่ม แล้วตัดไฟ
+ *   - กรณีคู่: ตัดไฟระหว่างรอบ (ทุก record ของรอบก่อนหน้าถูกเขียนแล้ว)
+ *   - กรณีคี่: ตัดไฟระหว่างเขียน/ลบ flash (flash_budget สุ่ม) record หรือ sector ที่ไม่ครบถูกทิ้ง
+ * แล้ว boot ใหม่จาก flash เดิมและตรวจว่า
+ *   - พัสดุที่อยู่บนสายพานทั้งก่อนและหลังรอบที่ไฟดับถูกกู้คืนทุกชิ้น และไม่มีพัสดุที่ไม่อยู่ในทั้งสองช่วง
+ *   - หอพักและหมายเลขติดตามเป็นค่าก่อนหรือหลังรอบนั้น (รอผล QR → ไม่ทราบหอพัก)
+ *   - ระยะจาก IR หลักของพัสดุที่กู้คืนไม่ยาวกว่าความจริง และไม่สั้นกว่าตอนเขียน flash ครบครั้งสุดท้าย
+ *     (ตำแหน่งสายพานคำนวณจากช่วงการเดินใน J_BELT - ไม่มี record ระหว่างสายพานเดิน)
+ *   - boot ซ้ำอีกครั้งได้คิวเดิม (snapshot ที่เขียนหลังกู้คืนถูกต้อง)
+ * แต่ละกรณีอยู่ใน process แยก (fork) เพราะ setup() ไม่รีเซ็ตตัวแปร global ทั้งหมด
+ *
+ * build:  make -C tools check
+ */
+#include "host_sim.h"
+
+#include <map>
+#include <string>
+#include <sys/wait.h>
+
+#define JOURNAL_CASES 80
+#define JOURNAL_PARCELS 40
+#define JOURNAL_SPACING_MS 2500
+#define JOURNAL_TICK_MM 0.5f   // ระยะที่สายพานเดินได้ในหนึ่งรอบ (1 ms) และความคลาดของ float
+
+struct SeenParcel {
+  int dorm;
+  std::string tracking;
+  float distance_mm;           // ระยะที่สายพานเดินตั้งแต่พัสดุผ่าน IR หลัก
+};
+
+typedef std::map<uint64_t, SeenParcel> QueueView; // (สายพาน << 32 | seq) → พัสดุ
+
+/**
+ * ฟังก์ชันอ่านพัสดุที่อยู่ในคิวของทุกสายพาน
+ */
+QueueView queue_view() {
+  QueueView view;
+  for (int l = 0; l < NUM_LANES; l++) {
+    const Lane &lane = lanes[l];
+    float belt_mm = belt_position_at(lane, hal_micros());
+    for (uint32_t seq = lane.queue_head; seq != lane.queue_tail; seq++) {
+      const ParcelSlot &slot = queue_slot(lane, seq);
+      if (!slot.active) continue;
+      SeenParcel p;
+      p.dorm = slot.dorm == QR_PENDING ? -2 : slot.dorm;
+      p.tracking = slot.dorm == QR_PENDING ? TRACKING_NONE : slot.tracking_number.text;
+      p.distance_mm = belt_mm - slot.intake_mm;
+      view[(uint64_t)l << 32 | seq] = p;
+    }
+  }
+  return view;
+}
+
+/**
+ * ฟังก์ชันรันหนึ่งกรณี
+ * @return true หากทุกเงื่อนไขผ่าน (พิมพ์ผลสรุปหนึ่งบรรทัด)
+ */
+bool run_case(int index) {
+  for (int i = 0; i < JOURNAL_PARCELS; i++) {
+    int dorm = i % 7 == 6 ? -1 : SIM_DORMS[i % 4];
+    add_parcel(sim_parcels, 1000 + i * JOURNAL_SPACING_MS, dorm, 0);
+  }
+  sim_pushers_init();
+  firmware_boot();
+  for (int i = 0; i < index; i++) sim_rand();
+  uint32_t cut_ms = 3000 + sim_rand() % (JOURNAL_PARCELS * JOURNAL_SPACING_MS);
+  bool mid_write = index % 2 == 1;
+
+  QueueView before, after;
+  QueueView written, written_before;             // คิวตอนเขียน flash ครั้งล่าสุด (ก่อน/รวมรอบที่ไฟดับ)
+  int moving = 0;
+  for (;;) {
+    before = queue_view();
+    written_before = written;
+    uint16_t sector = queue_journal.sector, count = queue_journal.count;
+    if (mid_write && hal_millis() >= cut_ms && flash_budget < 0) flash_budget = sim_rand() % 200;
+    sim_step();
+    if (queue_journal.sector != sector || queue_journal.count != count) written = queue_view();
+    if (mid_write ? power_lost : hal_millis() >= cut_ms) break;
+    if (hal_millis() > cut_ms + 60000) break;    // ไม่มีการเขียน flash หลังเวลาตัดไฟ
+  }
+  after = queue_view();
+  const QueueView &durable = mid_write ? written_before : written;  // record ของรอบที่ไฟดับอาจไม่ครบ
+  for (int l = 0; l < NUM_LANES; l++) moving += lanes[l].belt_direction != 0;
+  uint32_t at_ms = hal_millis();
+
+  firmware_boot(true);
+  int failures = check_failures;
+  QueueView restored = queue_view();
+  float worst_mm = 0;
+  for (QueueView::const_iterator it = restored.begin(); it != restored.end(); ++it) {
+    QueueView::const_iterator b = before.find(it->first), a = after.find(it->first);
+    CHECK(b != before.end() || a != after.end());
+    if (b == before.end() && a == after.end()) continue;
+    const SeenParcel &r = it->second;
+    const SeenParcel &pb = b != before.end() ? b->second : a->second;
+    const SeenParcel &pa = a != after.end() ? a->second : b->second;
+    CHECK((r.dorm == pb.dorm && r.tracking == pb.tracking) || (r.dorm == pa.dorm && r.tracking == pa.tracking));
+    QueueView::const_iterator w = durable.find(it->first);
+    if (w != durable.end()) CHECK(r.distance_mm >= w->second.distance_mm - JOURNAL_TICK_MM);
+    CHECK(r.distance_mm <= pa.distance_mm + JOURNAL_TICK_MM);
+    worst_mm = std::max(worst_mm, pa.distance_mm - r.distance_mm);
+  }
+  for (QueueView::const_iterator it = before.begin(); it != before.end(); ++it) {
+    if (after.count(it->first)) CHECK(restored.count(it->first) == 1);
+  }
+
+  // boot ซ้ำจาก snapshot ที่เขียนตอนกู้คืน
+  firmware_boot(true);
+  QueueView again = queue_view();
+  CHECK(again.size() == restored.size());
+  for (QueueView::const_iterator it = restored.begin(); it != restored.end(); ++it) {
+    QueueView::const_iterator g = again.find(it->first);
+    CHECK(g != again.end() && g->second.dorm == it->second.dorm && g->second.tracking == it->second.tracking &&
+          fabsf(g->second.distance_mm - it->second.distance_mm) <= JOURNAL_TICK_MM);
+  }
+
+  bool ok = check_failures == failures;
+  printf("journal %2d: %-13s at %6u ms  belts moving %d  parcels before %zu after %zu restored %zu  "
+         "position lag %5.1f mm - %s\n", index, mid_write ? "mid-write cut" : "clean cut", at_ms, moving,
+         before.size(), after.size(), restored.size(), worst_mm, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+int main() {
+  int failed = 0;
+  for (int i = 0; i < JOURNAL_CASES; i++) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+      bool ok = run_case(i);
+      fflush(stdout);
+      _exit(ok ? 0 : 1);
+    }
+    int status = 0;
+    if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) failed++;
+  }
+  printf("journal: %d power cuts, %d failed\n", JOURNAL_CASES, failed);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,170 @@
+/**
+ * Test ของ histogram latency (metrics) และข้อความ MSG_METRICS
+ *
+ *   - ขอบของทุกช่อง: metrics_bucket(metrics_bucket_max(b)) == b และค่าถัดไปอยู่ช่อง b + 1
+ *   - percentile จาก histogram เทียบกับค่าจริงจากข้อมูลที่เรียงแล้ว (nearest rank) ของหลายการกระจาย
+ *     ต้องไม่ต่ำกว่าค่าจริง และเกินไม่เกินความกว้างของช่อง (< 25% หรือตรงทุกค่าเมื่อต่ำกว่า 8)
+ *   - กรอบ MSG_METRICS ที่ task comms ส่งทุก METRICS_PERIOD_MS: ชื่อ หน่วย และค่าของ probe ตรงกับ histogram
+ *   - การเริ่มช่วงใหม่: probe ที่ไม่มีค่าในช่วงถัดไปส่งเป็น 0 และค่าแรกของช่วงใหม่ล้างค่าเดิม
+ *
+ * build:  make -C tools check
+ */
+#include "host_hal.h"
+
+#include <algorithm>
+#include <string>
+
+#define METRICS_SAMPLES 50000  // ไม่เกินค่าสูงสุดของช่อง (uint16_t)
+
+struct MetricsRow {
+  std::string name;
+  std::string unit;
+  uint32_t count, min, p50, p99, max;
+};
+
+uint32_t rng = 3;
+
+uint32_t rnd() {
+  rng = rng * 1103515245u + 12345u;
+  return rng >> 8;
+}
+
+/**
+ * ฟังก์ชันสุ่มค่าตามการกระจายที่ใช้ทดสอบ
+ * @param dist 0 = ค่าน้อย (0-15), 1 = สม่ำเสมอ 0-2000, 2 = log-uniform ถึง 2^31, 3 = หางยาว (1% ช้ากว่า 100 เท่า)
+ */
+uint32_t sample(int dist) {
+  switch (dist) {
+    case 0: return rnd() % 16;
+    case 1: return rnd() % 2001;
+    case 2: return (rnd() | 1) >> (rnd() % 24) << (rnd() % 8);
+    default: return rnd() % 100 == 0 ? 50000 + rnd() % 50000 : 400 + rnd() % 200;
+  }
+}
+
+/**
+ * ฟังก์ชันแยกกรอบ MSG_METRICS ล่าสุดที่ firmware ส่งไป Pi (ทิ้งกรอบอื่น)
+ * @return false หากยังไม่มี
+ */
+bool take_metrics_frame(std::vector<MetricsRow> &rows, uint32_t &period_ms) {
+  bool found = false;
+  size_t start = 0;
+  for (size_t i = 0; i < pi_tx.size(); i++) {
+    if (pi_tx[i] != 0) continue;
+    std::vector<uint8_t> frame(pi_tx.begin() + start, pi_tx.begin() + i);
+    start = i + 1;
+    size_t n = cobs_decode(frame.data(), frame.size());
+    if (n < 3 || crc16_ccitt(frame.data(), n - 2) != rd_u16(frame.data() + n - 2)) continue;
+    if (frame[0] != MSG_METRICS) continue;
+    const uint8_t *p = frame.data() + 1;
+    period_ms = rd_u32(p);
+    uint8_t count = p[4];
+    p += 5;
+    rows.clear();
+    for (uint8_t id = 0; id < count; id++) {
+      MetricsRow row;
+      row.name.assign((const char *)p + 1, p[0]);
+      p += 1 + p[0];
+      row.unit.assign((const char *)p + 1, p[0]);
+      p += 1 + p[0];
+      row.count = rd_u32(p);
+      row.min = rd_u32(p + 4);
+      row.p50 = rd_u32(p + 8);
+      row.p99 = rd_u32(p + 12);
+      row.max = rd_u32(p + 16);
+      p += 20;
+      rows.push_back(row);
+    }
+    CHECK(p == frame.data() + n - 2);            // ความยาวตรงกับ payload พอดี
+    found = true;
+  }
+  pi_tx.erase(pi_tx.begin(), pi_tx.begin() + start);
+  return found;
+}
+
+/**
+ * ฟังก์ชันรัน firmware จนกว่าจะส่ง MSG_METRICS
+ */
+bool tick_until_metrics(std::vector<MetricsRow> &rows, uint32_t &period_ms) {
+  for (int i = 0; i <= METRICS_PERIOD_MS; i++) {
+    firmware_tick();
+    if (take_metrics_frame(rows, period_ms)) return true;
+  }
+  return false;
+}
+
+int main() {
+  // ขอบของทุกช่อง
+  for (int b = 0; b < METRICS_BUCKETS; b++) {
+    uint32_t top = metrics_bucket_max(b);
+    CHECK(metrics_bucket(top) == b);
+    if (b + 1 < METRICS_BUCKETS) CHECK(metrics_bucket(top + 1) == b + 1);
+  }
+  CHECK(metrics_bucket_max(METRICS_BUCKETS - 1) == 0xFFFFFFFFu);
+
+  // percentile เทียบกับค่าจริง
+  const uint8_t pcts[] = { 1, 50, 90, 99, 100 };
+  const char *dists[] = { "small", "uniform", "log-uniform", "long tail" };
+  double worst_error = 0;
+  for (int dist = 0; dist < 4; dist++) {
+    metrics_epoch++;
+    std::vector<uint32_t> values;
+    for (int i = 0; i < METRICS_SAMPLES; i++) {
+      uint32_t v = sample(dist);
+      values.push_back(v);
+      metrics_record(METRIC_QR_RESPONSE, v);
+    }
+    const LatencyHist &h = metrics[METRIC_QR_RESPONSE];
+    std::sort(values.begin(), values.end());
+    CHECK(h.count == METRICS_SAMPLES && h.min == values.front() && h.max == values.back());
+    printf("metrics %-11s", dists[dist]);
+    for (size_t i = 0; i < sizeof(pcts); i++) {
+      size_t rank = ((uint64_t)values.size() * pcts[i] + 99) / 100;
+      uint32_t exact = values[rank - 1];
+      uint32_t got = metrics_percentile(h, pcts[i]);
+      CHECK(got >= exact);
+      CHECK(exact < 8 ? got == exact : got - exact <= exact / 4);
+      if (exact > 0) worst_error = std::max(worst_error, (double)(got - exact) / exact);
+      printf("  p%-3u %9u (exact %9u)", pcts[i], got, exact);
+    }
+    printf("\n");
+  }
+  printf("metrics: worst percentile error %.1f%%\n", worst_error * 100);
+
+  // กรอบ MSG_METRICS จาก task comms (histogram ของการทดสอบข้างบนเป็นของช่วงก่อน)
+  firmware_boot();
+  metrics_epoch++;
+  const uint32_t handoff[] = { 120, 80, 95, 3000, 101 };
+  for (size_t i = 0; i < sizeof(handoff) / sizeof(handoff[0]); i++) metrics_record(METRIC_QR_HANDOFF, handoff[i]);
+  std::vector<MetricsRow> rows;
+  uint32_t period_ms = 0;
+  CHECK(tick_until_metrics(rows, period_ms));
+  CHECK(rows.size() == METRIC_COUNT && period_ms == METRICS_PERIOD_MS);
+  for (size_t id = 0; id < rows.size() && id < METRIC_COUNT; id++) {
+    CHECK(rows[id].name == METRICS[id].name && rows[id].unit == METRICS[id].unit);
+  }
+  if (rows.size() == METRIC_COUNT) {
+    const MetricsRow &r = rows[METRIC_QR_HANDOFF];
+    CHECK(r.count == 5 && r.min == 80 && r.max == 3000);
+    CHECK(r.p50 >= 101 && r.p50 <= 101 + 101 / 4 && r.p99 == 3000);
+    CHECK(rows[METRIC_QR_RESPONSE].count == 0 && rows[METRIC_QR_RESPONSE].max == 0);
+  }
+
+  // ช่วงถัดไป: probe ที่ไม่มีค่าใหม่ส่งเป็น 0 ค่าแรกของช่วงใหม่ล้างค่าเดิม
+  CHECK(tick_until_metrics(rows, period_ms));
+  CHECK(period_ms == METRICS_PERIOD_MS);
+  if (rows.size() == METRIC_COUNT) {
+    CHECK(rows[METRIC_QR_HANDOFF].count == 0 && rows[METRIC_QR_HANDOFF].p99 == 0);
+  }
+  metrics_record(METRIC_QR_HANDOFF, 42);
+  const LatencyHist &h = metrics[METRIC_QR_HANDOFF];
+  CHECK(h.count == 1 && h.min == 42 && h.max == 42 && metrics_percentile(h, 99) == 42);
+  CHECK(tick_until_metrics(rows, period_ms));
+  if (rows.size() == METRIC_COUNT) {
+    const MetricsRow &r = rows[METRIC_QR_HANDOFF];
+    CHECK(r.count == 1 && r.min == 42 && r.p50 == 42 && r.p99 == 42 && r.max == 42);
+  }
+
+  printf("metrics: %d probes, frame every %u ms - %s\n", METRIC_COUNT, period_ms, check_failures ? "FAILED" : "ok");
+  return check_failures ? 1 : 0;
+}
@@ -0,0 +1,127 @@
+/**
+ * Test ของโปรโตคอล QR แบบหลายคำขอพร้อมกันผ่าน PTY จริง (Serial2 ของ firmware ↔ ฝั่ง slave ของ Pi)
+ *
+ * Pi ของ test เก็บคำขอ QR ไว้จนมีค้าง PTY_TEST_BATCH คำขอ (หรือคำขอเก่าสุดรอนานเกิน PTY_TEST_HOLD_MS)
+ * แล้วตอบกลับทั้งชุดในลำดับย้อนกลับ พัสดุที่มี SIM_NO_REPLY ไม่ได้รับคำตอบเลย ตรวจว่า
+ *   - firmware มีคำขอค้างพร้อมกันหลายคำขอจริง และได้รับคำตอบไม่เรียงลำดับ
+ *   - ทุกคำตอบถูกจับคู่ด้วย lane/seq → พัสดุทุกชิ้นไปถูกประตู (ไม่มี TR_QR_STALE)
+ *   - คำขอที่ไม่ได้คำตอบจบด้วย TR_QR_TIMEOUT และพัสดุไปปลายสายพาน
+ *   - สถานะ (MSG_STATUS_BATCH) และตารางหอพัก (MSG_DORM_SYNC) ยังใช้ Pi จำลองเดิมบน PTY เดียวกัน
+ *
+ * build:  make -C tools check
+ */
+#include "host_sim.h"
+
+#include <string>
+
+#define PTY_TEST_PARCELS 30
+#define PTY_TEST_SPACING_MS 1200
+#define PTY_TEST_BATCH 3       // ตอบเมื่อมีคำขอค้างเท่านี้
+#define PTY_TEST_HOLD_MS 2000  // หรือเมื่อคำขอเก่าสุดรอนานเท่านี้ (ต่ำกว่า QR_TIMEOUT_MS)
+
+struct HeldRequest {
+  uint8_t lane;
+  uint32_t seq;
+  uint64_t at_us;
+  std::string text;
+};
+
+std::vector<HeldRequest> held;
+int requests = 0, dropped = 0, answered = 0, reordered = 0;
+
+/**
+ * ฟังก์ชันตอบคำขอที่เก็บไว้ทั้งหมดในลำดับย้อนกลับ (คำขอล่าสุดได้คำตอบก่อน)
+ */
+void release_held() {
+  for (size_t i = held.size(); i-- > 0; ) {
+    frame_begin(sim_frame, MSG_QR_RESULT);
+    frame_u8(sim_frame, held[i].lane);
+    frame_u32(sim_frame, held[i].seq);
+    frame_str(sim_frame, held[i].text.c_str());
+    sim_reply(1);
+    answered++;
+    reordered += i > 0;
+  }
+  held.clear();
+}
+
+/**
+ * ฟังก์ชันรับคำขอ QR แทน Pi จำลอง: อ่าน QR ทันที (กล้องเห็นพัสดุตอนนี้) แต่เก็บคำตอบไว้ก่อน
+ */
+bool hold_qr_requests(uint8_t type, const uint8_t *body, size_t len) {
+  if (type != MSG_QR_REQUEST || len < 9) return false;
+  requests++;
+  SimParcel *p = sim_camera_parcel(body[0], rd_u32(body + 5));
+  if (p && (p->flags & SIM_NO_REPLY)) {
+    dropped++;
+    return true;
+  }
+  HeldRequest r;
+  r.lane = body[0];
+  r.seq = rd_u32(body + 1);
+  r.at_us = sim_us;
+  r.text = !p || p->dorm == -2 ? TRACKING_UNREAD : p->tracking;
+  held.push_back(r);
+  if (held.size() >= PTY_TEST_BATCH) release_held();
+  return true;
+}
+
+/**
+ * ฟังก์ชันจำนวนพัสดุในคิวที่ยังรอผล QR
+ */
+int pending_in_firmware() {
+  int pending = 0;
+  for (int l = 0; l < NUM_LANES; l++) {
+    const Lane &lane = lanes[l];
+    for (uint32_t seq = queue_next_active(lane, lane.queue_head); seq != lane.queue_tail;
+         seq = queue_next_active(lane, seq + 1)) {
+      pending += queue_slot(lane, seq).dorm == QR_PENDING;
+    }
+  }
+  return pending;
+}
+
+int main() {
+  int no_reply = 0;
+  for (int i = 0; i < PTY_TEST_PARCELS; i++) {
+    uint8_t flags = i % 7 == 3 ? SIM_NO_REPLY : 0;
+    no_reply += flags != 0;
+    add_parcel(sim_parcels, 1000 + i * PTY_TEST_SPACING_MS, i % 5 == 4 ? -1 : SIM_DORMS[i % 4], flags);
+  }
+  sim_pushers_init();
+  firmware_boot();
+
+  char slave_path[64];
+  if (!pty_open(slave_path, sizeof(slave_path))) {
+    perror("pty");
+    return 1;
+  }
+  sim_pi_fd = open(slave_path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (sim_pi_fd < 0) {
+    perror(slave_path);
+    return 1;
+  }
+  sim_pi_hook = hold_qr_requests;
+
+  int max_pending = 0;
+  uint32_t last_arrival = sim_parcels.back().arrive_ms;
+  do {
+    if (!held.empty() && sim_us - held.front().at_us >= PTY_TEST_HOLD_MS * 1000ULL) release_held();
+    sim_step_pty();
+    max_pending = std::max(max_pending, pending_in_firmware());
+  } while (!sim_done() && hal_millis() <= last_arrival + SIM_TIMEOUT_MS);
+
+  SimTally t = sim_tally(false);
+  CHECK(requests == PTY_TEST_PARCELS);
+  CHECK(dropped == no_reply && answered == PTY_TEST_PARCELS - no_reply);
+  CHECK(max_pending >= PTY_TEST_BATCH);          // หลายคำขอค้างพร้อมกันใน firmware
+  CHECK(reordered > 0);
+  CHECK(count_traces(TR_QR_STALE) == 0);
+  CHECK(count_traces(TR_QR_TIMEOUT) == no_reply);
+  CHECK(count_traces(TR_DORM_SYNC_DONE) >= 1);
+  CHECK(t.correct == PTY_TEST_PARCELS && t.misrouted == 0 && t.missed == 0 && t.stranded == 0);
+  CHECK(pty_dropped == 0);
+  printf("pty: %d QR requests over %s, up to %d in flight, %d answered out of order, %d unanswered timed out - %s\n",
+         requests, slave_path, max_pending, reordered, dropped, check_failures ? "FAILED" : "ok");
+  return check_failures ? 1 : 0;
+}
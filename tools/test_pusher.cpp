@@ -0,0 +1,168 @@
+/**
+ * Test ของ state machine มอเตอร์ผลัก (ผลักออก → ดึงกลับ → หยุดพัก → ว่าง) ด้วยนาฬิกาเสมือน
+ *
+ * เรียก pusher_start() / pusher_update() โดยตรงทีละ 1 ms แล้วตรวจ:
+ *   - เวลาของแต่ละขั้นตอนและขา IN_A/IN_B ของ L298N เมื่อใช้เวลาคงที่ (ไม่มี feedback)
+ *   - pusher_start() ไม่บล็อก และมอเตอร์ทุกตัวทำงานพร้อมกันได้โดยไม่รบกวนกัน
+ *   - คำสั่งที่มาระหว่างมอเตอร์ทำงานถูกเก็บไว้ (pending) และเริ่มทันทีหลังหยุดพัก
+ *   - stroke หยุดเมื่อสวิตช์ปลายทางทำงาน (PUSHER_FB_LIMIT) แทนการรอเวลาสูงสุด
+ *
+ * build:  make -C tools check
+ */
+#include "host_hal.h"
+
+struct Transition {
+  uint32_t at_ms;
+  PusherState state;
+};
+
+std::vector<Transition> history[NUM_GATES];
+PusherState seen[NUM_GATES];   // สถานะล่าสุดที่บันทึกใน history
+
+/**
+ * ฟังก์ชันบันทึกสถานะของมอเตอร์ที่เปลี่ยนไป
+ */
+void record() {
+  for (int g = 0; g < NUM_GATES; g++) {
+    if (pushers[g].state != seen[g]) {
+      seen[g] = pushers[g].state;
+      Transition t = { hal_millis(), seen[g] };
+      history[g].push_back(t);
+    }
+  }
+}
+
+/**
+ * ฟังก์ชันสั่งผลักแล้วบันทึกสถานะ
+ */
+void start(int gate, uint32_t extend_ms, uint32_t retract_ms) {
+  pusher_start(gate + 1, extend_ms, retract_ms);
+  record();
+}
+
+/**
+ * ฟังก์ชันเดินนาฬิกาเสมือน ms มิลลิวินาที และบันทึกการเปลี่ยนสถานะของทุกมอเตอร์
+ */
+void advance(uint32_t ms) {
+  for (uint32_t i = 0; i < ms; i++) {
+    sim_us += 1000;
+    pusher_update(hal_millis());
+    record();
+  }
+}
+
+/**
+ * ฟังก์ชันทิศทางที่ขา L298N ของมอเตอร์ถูกสั่ง (1=ผลัก, -1=ดึงกลับ, 0=หยุด)
+ */
+int motor_dir(int gate) {
+  uint8_t a = pin_out[GATES[gate].motor_in_a], b = pin_out[GATES[gate].motor_in_b];
+  return a == HIGH && b == LOW ? 1 : a == LOW && b == HIGH ? -1 : 0;
+}
+
+/**
+ * ฟังก์ชันเริ่มใหม่: ทุกมอเตอร์ว่าง ไม่มีประวัติ
+ */
+void reset(bool feedback) {
+  firmware_boot();
+  for (int g = 0; g < NUM_GATES; g++) {
+    pushers[g].feedback_ok = feedback && GATES[g].feedback != PUSHER_FB_NONE;
+    history[g].clear();
+    seen[g] = PUSHER_IDLE;
+  }
+}
+
+/**
+ * ฟังก์ชันตรวจลำดับสถานะและเวลาของหนึ่งรอบการผลัก (เวลาคงที่)
+ */
+void check_cycle(int gate, size_t from, uint32_t start_ms, uint32_t extend_ms, uint32_t retract_ms) {
+  const std::vector<Transition> &h = history[gate];
+  CHECK(h.size() >= from + 4);
+  if (h.size() < from + 4) return;
+  CHECK(h[from].state == PUSHER_EXTEND && h[from].at_ms == start_ms);
+  CHECK(h[from + 1].state == PUSHER_RETRACT && h[from + 1].at_ms == start_ms + extend_ms);
+  CHECK(h[from + 2].state == PUSHER_BRAKE && h[from + 2].at_ms == start_ms + extend_ms + retract_ms);
+  CHECK(h[from + 3].at_ms == start_ms + extend_ms + retract_ms + PUSHER_BRAKE_MS);
+}
+
+int main() {
+  // 1. เวลาคงที่: แต่ละขั้นตอนยาวตามตาราง และขามอเตอร์ตรงกับสถานะ
+  reset(false);
+  uint64_t before = sim_us;
+  start(0, 1800, 1700);
+  CHECK(sim_us == before);                       // ไม่บล็อก
+  CHECK(pushers[0].state == PUSHER_EXTEND && motor_dir(0) == 1);
+  advance(1799);
+  CHECK(pushers[0].state == PUSHER_EXTEND && motor_dir(0) == 1);
+  advance(1);
+  CHECK(pushers[0].state == PUSHER_RETRACT && motor_dir(0) == -1);
+  advance(1700);
+  CHECK(pushers[0].state == PUSHER_BRAKE && motor_dir(0) == 0);
+  advance(PUSHER_BRAKE_MS);
+  CHECK(pushers[0].state == PUSHER_IDLE && motor_dir(0) == 0);
+  check_cycle(0, 0, 0, 1800, 1700);
+  printf("pusher: fixed timing extend 1800 / retract 1700 / brake %d ms - %s\n", PUSHER_BRAKE_MS,
+         check_failures ? "FAILED" : "ok");
+
+  // 2. ทุกมอเตอร์ทำงานพร้อมกัน (เริ่มห่างกัน 100 ms) และจบตามเวลาของตัวเอง
+  reset(false);
+  int failures = check_failures;
+  for (int g = 0; g < NUM_GATES; g++) {
+    start(g, GATES[g].extend_ms, GATES[g].retract_ms);
+    advance(100);
+  }
+  int moving = 0;
+  for (int g = 0; g < NUM_GATES; g++) moving += pushers[g].state == PUSHER_EXTEND;
+  CHECK(moving == NUM_GATES);
+  advance(4000);
+  for (int g = 0; g < NUM_GATES; g++) {
+    check_cycle(g, 0, g * 100, GATES[g].extend_ms, GATES[g].retract_ms);
+    CHECK(pushers[g].state == PUSHER_IDLE);
+  }
+  printf("pusher: %d motors overlapping, each on its own schedule - %s\n", NUM_GATES,
+         check_failures > failures ? "FAILED" : "ok");
+
+  // 3. คำสั่งที่มาระหว่างทำงานถูกเก็บไว้ และเริ่มรอบถัดไปทันทีหลังหยุดพัก
+  reset(false);
+  failures = check_failures;
+  start(0, 1000, 900);
+  advance(300);
+  start(0, 1000, 900);
+  start(0, 1000, 900);
+  CHECK(pushers[0].pending == 2);
+  advance(3 * (1000 + 900 + PUSHER_BRAKE_MS));
+  CHECK(pushers[0].state == PUSHER_IDLE && pushers[0].pending == 0);
+  uint32_t cycle = 1000 + 900 + PUSHER_BRAKE_MS;
+  CHECK(history[0].size() == 10);                // (ผลักออก, ดึงกลับ, หยุดพัก) x 3 แล้วว่าง
+  for (int c = 0; c < 3; c++) check_cycle(0, c * 3, c * cycle, 1000, 900);
+  printf("pusher: 2 pushes queued behind a running one, run back to back - %s\n",
+         check_failures > failures ? "FAILED" : "ok");
+
+  // 4. สวิตช์ปลายทาง: stroke จบเมื่อถึงปลายทาง ไม่รอเวลาสูงสุดในตาราง
+  int limit_gate = -1;
+  for (int g = 0; g < NUM_GATES && limit_gate < 0; g++) {
+    if (GATES[g].feedback == PUSHER_FB_LIMIT) limit_gate = g;
+  }
+  if (limit_gate >= 0) {
+    reset(true);
+    failures = check_failures;
+    const GateConfig &cfg = GATES[limit_gate];
+    start(limit_gate, cfg.extend_ms, cfg.retract_ms);
+    advance(600);
+    pin_level[cfg.sense_out] = LOW;              // ถึงปลายทางผลักออกที่ 600 ms
+    pin_level[cfg.sense_in] = HIGH;
+    advance(20);
+    CHECK(pushers[limit_gate].state == PUSHER_RETRACT);
+    CHECK(history[limit_gate][1].at_ms >= 600 && history[limit_gate][1].at_ms <= 610);
+    pin_level[cfg.sense_out] = HIGH;
+    advance(480);
+    pin_level[cfg.sense_in] = LOW;               // ถึงปลายทางดึงกลับ 500 ms หลังเริ่มดึงกลับ
+    advance(20 + PUSHER_BRAKE_MS);
+    CHECK(pushers[limit_gate].state == PUSHER_IDLE);
+    CHECK(pushers[limit_gate].misses[0] == 0 && pushers[limit_gate].misses[1] == 0);
+    uint32_t cycle_ms = history[limit_gate].back().at_ms;
+    CHECK(cycle_ms < cfg.extend_ms);             // ทั้งรอบสั้นกว่าเวลาผลักออกสูงสุดอย่างเดียว
+    printf("pusher: limit switches end a cycle after %u ms instead of %d ms - %s\n", cycle_ms,
+           cfg.extend_ms + cfg.retract_ms + PUSHER_BRAKE_MS, check_failures > failures ? "FAILED" : "ok");
+  }
+  return check_failures ? 1 : 0;
+}
@@ -0,0 +1,135 @@
+/**
+ * Test และ benchmark ของคิวพัสดุ (ring buffer + tombstone) เทียบกับโมเดลอ้างอิง
+ *
+ * สุ่ม enqueue / dequeueAt (กลางคิว, seq ที่ถูกนำออกแล้ว, seq นอกช่วง) / dequeue หลายล้านครั้ง
+ * หลังทุกครั้งเทียบ size ลำดับของพัสดุที่เหลือ หอพัก และหมายเลขติดตามกับ std::deque
+ * แล้วจับเวลาต่อคู่ enqueue + dequeueAt โดยไม่ตรวจ
+ *
+ * build:  make -C tools check
+ */
+#include "host_hal.h"
+
+#include <deque>
+#include <time.h>
+
+#define TEST_OPS 3000000
+#define BENCH_OPS 10000000
+
+struct ModelParcel {
+  uint32_t seq;
+  int dorm;
+  char tracking[TRACKING_MAX_LEN + 1];
+};
+
+std::deque<ModelParcel> model;
+uint32_t rng = 1;
+
+uint32_t rnd() {
+  rng = rng * 1103515245u + 12345u;
+  return rng >> 8;
+}
+
+/**
+ * ฟังก์ชันทิ้ง record ของ journal และ trace ที่คิวส่งออก (task comms ไม่ได้ทำงานใน test นี้)
+ */
+void drain_side_queues() {
+  JournalRecord rec;
+  while (journal_queue.pop(rec)) {}
+  TraceRecord t;
+  for (int core = 0; core < 2; core++) {
+    while (trace_rings[core].pop(t)) {}
+  }
+}
+
+/**
+ * ฟังก์ชันเทียบคิวของสายพานกับโมเดลทั้งหมด
+ */
+bool queue_matches(const Lane &lane) {
+  if (lane.size != (int)model.size()) return false;
+  if (lane.queue_tail - lane.queue_head > QUEUE_CAPACITY) return false;
+  if (lane.queue_head != lane.queue_tail && !queue_slot(lane, lane.queue_head).active) return false;  // ต้องคืน tombstone ที่หัวคิว
+  uint32_t seq = queue_next_active(lane, lane.queue_head);
+  for (size_t i = 0; i < model.size(); i++) {
+    if (seq != model[i].seq) return false;
+    const ParcelSlot &slot = queue_slot(lane, seq);
+    if (slot.dorm != model[i].dorm || strcmp(slot.tracking_number.text, model[i].tracking) != 0) return false;
+    seq = queue_next_active(lane, seq + 1);
+  }
+  return seq == lane.queue_tail;
+}
+
+uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int main() {
+  firmware_boot();
+  Lane &lane = lanes[0];
+
+  int enqueued = 0, removed_mid = 0, rejected = 0, full = 0;
+  for (int op = 0; op < TEST_OPS && check_failures == 0; op++) {
+    uint32_t r = rnd() % 100;
+    if (r < 45) {                                // enqueue
+      ModelParcel p;
+      p.dorm = rnd() % 16;
+      snprintf(p.tracking, sizeof(p.tracking), "TH%08u", rnd() % 100000000u);
+      // tombstone กลางคิวถูกคืนเมื่อหัวคิวเลื่อนผ่านเท่านั้น ช่วง seq จึงจำกัดด้วย QUEUE_CAPACITY ด้วย
+      uint32_t span = model.empty() ? 0 : lane.queue_tail - model.front().seq;
+      bool room = model.size() < MAX_DORM && span < QUEUE_CAPACITY;
+      bool ok = enqueue(lane, p.dorm, p.tracking);
+      CHECK(ok == room);
+      if (ok) {
+        p.seq = lane.queue_tail - 1;
+        model.push_back(p);
+        enqueued++;
+      } else {
+        full++;
+      }
+    } else if (r < 80 && !model.empty()) {       // dequeueAt กลางคิว (ประตูที่ผลักไม่เรียงลำดับ)
+      size_t i = rnd() % model.size();
+      CHECK(dequeueAt(lane, model[i].seq) == model[i].dorm);
+      model.erase(model.begin() + i);
+      removed_mid++;
+    } else if (r < 90) {                         // seq ที่ไม่อยู่ในคิว: นำออกแล้ว หรือนอกช่วง
+      uint32_t seq = lane.queue_tail - QUEUE_CAPACITY * 2 + rnd() % (QUEUE_CAPACITY * 3);
+      bool present = false;
+      for (size_t i = 0; i < model.size(); i++) present |= model[i].seq == seq;
+      if (!present) {
+        CHECK(dequeueAt(lane, seq) == -1);
+        rejected++;
+      }
+    } else {                                     // dequeue หัวคิว
+      int dorm = dequeue(lane);
+      if (model.empty()) {
+        CHECK(dorm == -1);
+      } else {
+        CHECK(dorm == model.front().dorm);
+        model.pop_front();
+      }
+    }
+    CHECK(queue_matches(lane));
+    drain_side_queues();
+  }
+  printf("queue: %d ops (%d enqueued, %d removed mid-queue, %d full, %d invalid seq rejected) - %s\n",
+         TEST_OPS, enqueued, removed_mid, full, rejected, check_failures ? "FAILED" : "ok");
+
+  // benchmark: คิวเต็มครึ่งหนึ่ง แล้วเพิ่ม/นำออกกลางคิวสลับกัน
+  while (dequeue(lane) != -1) {}
+  for (int i = 0; i < MAX_DORM / 2; i++) enqueue(lane, 1, "TH00000000");
+  drain_side_queues();
+  uint64_t t0 = now_ns();
+  int bench_full = 0;
+  for (int i = 0; i < BENCH_OPS; i++) {
+    bench_full += !enqueue(lane, 2, "TH00000001");
+    uint32_t seq = queue_next_active(lane, lane.queue_head);
+    if (i & 1) seq = queue_next_active(lane, seq + 1);   // สลับนำออกหัวคิวกับชิ้นที่สอง (tombstone)
+    dequeueAt(lane, seq);
+    if ((i & 31) == 31) drain_side_queues();
+  }
+  CHECK(bench_full == 0 && lane.size == MAX_DORM / 2);
+  double ns = (double)(now_ns() - t0) / BENCH_OPS;
+  printf("queue: enqueue + dequeueAt %.1f ns per pair on the host (%d pairs)\n", ns, BENCH_OPS);
+  return check_failures ? 1 : 0;
+}
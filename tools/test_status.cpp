@@ -0,0 +1,174 @@
+/**
+ * Test และ benchmark ของสถานะขาออก (คิวสถานะ → MSG_STATUS_BATCH → ack) ที่ไม่จองหน่วยความจำ heap
+ *
+ * build ด้วย -DHEAP_CHECK (ดู tools/Makefile) แล้วตรวจ
+ *   - ทางสถานะทั้งหมดต่อพัสดุหนึ่งชิ้น (status_enqueue → status_update → status_ack) เรียก malloc 0 ครั้ง
+ *     นับด้วย malloc ของ test ที่ครอบ malloc ของ glibc
+ *   - สายพานจำลองทั้งรอบ: status_heap_delta ของ firmware เป็น 0 และ Pi ได้รับสถานะของทุกชิ้นที่ส่งถึงหอพัก
+ *   - รีเซ็ตระหว่างรอ ack: เหตุการณ์ที่ยังไม่ได้รับ ack (รวมชุดที่ส่งไปแล้ว) กลับมาในคิวและถูกส่งใหม่
+ *     เหตุการณ์ที่ได้รับ ack แล้วไม่กลับมา และกู้คืนได้หลัง log สถานะวนครบทุก sector
+ *   - เวลาเข้ารหัสชุดเต็ม (STATUS_BATCH_MAX เหตุการณ์) ต่อชุดบน host
+ *
+ * build:  make -C tools check
+ */
+#include "host_sim.h"
+
+#include <time.h>
+
+#define STATUS_TEST_PARCELS 10000
+#define STATUS_BENCH_BATCHES 1000000
+#define STATUS_WRAP_EVENTS 3000 // เหตุการณ์ที่ ack แล้วก่อนรีเซ็ต (log สถานะวนเกินหนึ่งรอบ)
+
+extern "C" void *__libc_malloc(size_t size);
+bool count_mallocs = false;
+uint32_t mallocs = 0;
+
+/**
+ * ฟังก์ชัน malloc ของ test: นับการจองระหว่าง count_mallocs แล้วส่งต่อให้ glibc
+ */
+extern "C" void *malloc(size_t size) {
+  if (count_mallocs) mallocs++;
+  return __libc_malloc(size);
+}
+
+uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * ฟังก์ชันตรวจว่าคิวสถานะมีเหตุการณ์ของพัสดุ first..first+count-1 ตามลำดับ (dorm = ลำดับ % 16)
+ */
+bool status_pending(int first, int count) {
+  if ((int)(status_tail - status_head) != count) return false;
+  char tracking[TRACKING_MAX_LEN + 1];
+  for (int i = 0; i < count; i++) {
+    const StatusEvent &ev = status_queue[(status_head + i) & STATUS_QUEUE_MASK];
+    snprintf(tracking, sizeof(tracking), "TH%010d", first + i);
+    if (strcmp(ev.tracking_number, tracking) != 0 || ev.dorm != (first + i) % 16) return false;
+  }
+  return true;
+}
+
+/**
+ * ฟังก์ชันเพิ่มเหตุการณ์ของพัสดุ first..first+count-1
+ */
+void status_offer(int first, int count) {
+  char tracking[TRACKING_MAX_LEN + 1];
+  for (int i = first; i < first + count; i++) {
+    snprintf(tracking, sizeof(tracking), "TH%010d", i);
+    status_enqueue(tracking, STATUS_DELIVERED, i % 16);
+  }
+}
+
+/**
+ * ฟังก์ชันทิ้ง trace ที่ค้างใน ring (task comms ไม่ได้ทำงานในส่วนนี้ของ test)
+ */
+void drain_traces() {
+  TraceRecord t;
+  for (int core = 0; core < 2; core++) {
+    while (trace_rings[core].pop(t)) {}
+  }
+}
+
+int main() {
+  // 1. ทางสถานะต่อพัสดุหนึ่งชิ้น: ไม่มี malloc
+  firmware_boot();
+  pi_tx.reserve(64 * 1024);                      // buffer ของ host HAL เอง ไม่นับเป็นของ firmware
+  int failures = check_failures;
+  char tracking[TRACKING_MAX_LEN + 1];
+  uint32_t sent = 0;
+  count_mallocs = true;
+  for (int i = 0; i < STATUS_TEST_PARCELS; i++) {
+    snprintf(tracking, sizeof(tracking), "TH%010d", i);
+    status_enqueue(tracking, STATUS_DELIVERED, i % 16);
+    sim_us += 600 * 1000ULL;                     // เกิน STATUS_FLUSH_MS - ส่งทันที
+    status_update(hal_millis());
+    if (status_inflight > 0) {
+      sent += status_inflight;
+      status_ack(status_batch_id);
+    }
+    pi_tx.clear();
+    drain_traces();
+  }
+  count_mallocs = false;
+  CHECK(mallocs == 0);
+  CHECK(sent == STATUS_TEST_PARCELS && status_head == status_tail);
+  CHECK(status_heap_delta == 0);
+  printf("status: %d parcels enqueued, sent and acked with %u mallocs - %s\n", STATUS_TEST_PARCELS, mallocs,
+         check_failures > failures ? "FAILED" : "ok");
+
+  // 2. สายพานจำลองทั้งรอบ: Pi จำลองได้รับสถานะของทุกชิ้นที่ไปถึงหอพัก
+  failures = check_failures;
+  int32_t delta_before = status_heap_delta;
+  for (int i = 0; i < 40; i++) add_parcel(sim_parcels, 1000 + i * 2500, SIM_DORMS[i % 4], 0);
+  sim_pushers_init();
+  firmware_boot();
+  do {
+    sim_step();
+  } while (!sim_done() && hal_millis() < 300000);
+  firmware_drain();
+  CHECK(status_heap_delta == delta_before);
+  CHECK(status_head == status_tail && status_inflight == 0);
+  CHECK(count_traces(TR_STATUS_SENT) > 0 && count_traces(TR_STATUS_RETRY) == 0);
+  SimTally t = sim_tally(false);
+  CHECK(t.correct == 40);
+  printf("status: simulated run of 40 parcels, heap delta %d bytes - %s\n", (int)(status_heap_delta - delta_before),
+         check_failures > failures ? "FAILED" : "ok");
+
+  // 3. รีเซ็ตระหว่างรอ ack
+  failures = check_failures;
+  firmware_boot();
+  status_offer(0, 5);
+  sim_us += 600 * 1000ULL;
+  status_update(hal_millis());                   // ชุดแรกส่งไปแล้ว ไม่ได้รับ ack
+  CHECK(status_inflight == 5);
+  status_offer(5, 2);
+  status_enqueue("TH0000000006", STATUS_DELIVERED, 6 + 16);  // รวมกับเหตุการณ์ที่ยังไม่ได้ส่ง
+  status_enqueue("TH0000000006", STATUS_DELIVERED, 6);
+  drain_traces();
+  firmware_boot(true);
+  trace_drain();
+  CHECK(count_traces(TR_STATUS_RESTORED) == 1);
+  CHECK(status_inflight == 0 && status_pending(0, 7));
+  sim_us += 600 * 1000ULL;
+  status_update(hal_millis());
+  CHECK(status_inflight == 7 && !pi_tx.empty());  // ส่งใหม่ทั้งหมดเป็นชุดเดียว
+  status_ack(status_batch_id);
+  firmware_boot(true);
+  CHECK(status_head == status_tail);
+
+  for (int i = 0; i < STATUS_WRAP_EVENTS; i++) {
+    status_offer(100 + i, 1);
+    sim_us += 600 * 1000ULL;
+    status_update(hal_millis());
+    status_ack(status_batch_id);
+  }
+  uint32_t generation = status_journal.generation;
+  status_offer(100 + STATUS_WRAP_EVENTS, 3);
+  firmware_boot(true);
+  CHECK(generation > status_journal.sectors);    // log สถานะวนใช้ sector ซ้ำแล้ว
+  CHECK(status_pending(100 + STATUS_WRAP_EVENTS, 3));
+  printf("status: unacked events survive a reset, %u log generations - %s\n", generation,
+         check_failures > failures ? "FAILED" : "ok");
+
+  // 4. เวลาเข้ารหัสชุดเต็ม
+  for (uint32_t i = 0; i < STATUS_BATCH_MAX; i++) {
+    StatusEvent &ev = status_queue[i];
+    snprintf(ev.tracking_number, sizeof(ev.tracking_number), "TH%010u", i * 7919u);
+    ev.code = STATUS_DELIVERED;
+    ev.dorm = i;
+  }
+  uint8_t buf[STATUS_MSG_BUFFER];
+  size_t len = encode_status_batch(buf, sizeof(buf), 0, 0, STATUS_BATCH_MAX);
+  size_t total = 0;
+  uint64_t t0 = now_ns();
+  for (int i = 0; i < STATUS_BENCH_BATCHES; i++) {
+    total += encode_status_batch(buf, sizeof(buf), (uint16_t)i, 0, STATUS_BATCH_MAX);
+  }
+  double ns = (double)(now_ns() - t0) / STATUS_BENCH_BATCHES;
+  CHECK(len > 0 && total == len * STATUS_BENCH_BATCHES);
+  printf("status: encode a %d-event batch (%zu bytes on the wire) in %.1f ns on the host\n", STATUS_BATCH_MAX, len, ns);
+  return check_failures ? 1 : 0;
+}
@@ -0,0 +1,165 @@
+/**
+ * Test ของสถานะขาออกผ่านสาย UART ที่ไม่เสถียร: ชุดสถานะ → Pi → ack โดยสุ่มทิ้งและทำกรอบเสียทั้งสองทิศ
+ *
+ * Pi ของ test ตรวจ CRC ทิ้งกรอบเสีย บันทึกชุดที่ได้รับครั้งแรก (ชุดที่ส่งซ้ำมีหมายเลขเดิม) แล้ว ack ทุกกรอบที่ถูกต้อง
+ * ฝั่ง firmware รับเหตุการณ์สถานะเร็วที่สุดเท่าที่คิวสถานะมีที่ว่าง ตรวจว่า
+ *   - ทุกเหตุการณ์ถูกบันทึกที่ Pi ครั้งเดียวพอดี ด้วยหอพักที่ถูกต้อง ไม่มีเหตุการณ์ทิ้งเพราะคิวเต็ม
+ *   - ack ที่เสียไม่ถูกนับ (firmware ส่งซ้ำจนได้ ack ที่ถูกต้อง)
+ * แล้วรายงานเหตุการณ์ต่อวินาทีที่ไปถึง Pi ของแต่ละสภาพสาย
+ *
+ * build:  make -C tools check
+ */
+#include "host_hal.h"
+
+#include <map>
+#include <string>
+
+#define LINK_EVENTS 2000
+#define LINK_LATENCY_MS 5      // เวลาที่ Pi ใช้บันทึกชุดลงฐานข้อมูลก่อน ack
+
+struct LinkCase {
+  const char *name;
+  int drop_pct;                // โอกาสที่กรอบหายในแต่ละทิศ
+  int corrupt_pct;             // โอกาสที่กรอบมีไบต์เสียในแต่ละทิศ
+};
+
+const LinkCase LINK_CASES[] = {
+  { "clean link", 0, 0 },
+  { "10% frames dropped", 10, 0 },
+  { "10% frames corrupted", 0, 10 },
+  { "20% dropped + 20% corrupted", 20, 20 },
+};
+
+struct PendingAck {
+  uint64_t due_us;
+  std::vector<uint8_t> wire;
+};
+
+uint32_t rng = 7;
+
+uint32_t rnd() {
+  rng = rng * 1103515245u + 12345u;
+  return rng >> 8;
+}
+
+/**
+ * ฟังก์ชันทำให้กรอบที่เข้ารหัสแล้วหายหรือเสียตามสภาพสาย
+ * @return false หากกรอบหาย
+ */
+bool link_pass(std::vector<uint8_t> &wire, const LinkCase &link, int &dropped, int &corrupted) {
+  if ((int)(rnd() % 100) < link.drop_pct) {
+    dropped++;
+    return false;
+  }
+  if ((int)(rnd() % 100) < link.corrupt_pct && wire.size() > 1) {
+    size_t i = rnd() % (wire.size() - 1);        // ไม่แตะตัวคั่นท้ายกรอบ
+    uint8_t flipped = wire[i] ^ (1 << (rnd() % 8));
+    wire[i] = flipped ? flipped : wire[i] ^ 0xFF; // ไม่สร้างตัวคั่น 0 กลางกรอบ
+    corrupted++;
+  }
+  return true;
+}
+
+/**
+ * ฟังก์ชันรันหนึ่งสภาพสาย
+ */
+void run_link(const LinkCase &link) {
+  firmware_boot();
+  int failures = check_failures;
+  std::map<std::string, std::vector<int> > applied;  // หมายเลขติดตาม → หอพักที่บันทึก (ทุกครั้ง)
+  std::vector<PendingAck> acks;
+  std::vector<uint8_t> from_esp;
+  PiFrame ack;
+  int last_batch = -1, batches = 0, duplicates = 0, rejected = 0;
+  int dropped = 0, corrupted = 0;
+  int offered = 0;
+  uint32_t head0 = status_head, tail0 = status_tail, retries = 0;
+  uint64_t done_us = 0;
+
+  while (done_us == 0 && sim_us < 3600 * 1000000ULL) {
+    // firmware: เหตุการณ์ใหม่เมื่อคิวสถานะยังมีที่ (รวมที่ค้างอยู่ระหว่าง task) ไม่เกินคิวระหว่าง task ต่อรอบ
+    for (int n = 0; n < TASK_QUEUE_CAPACITY && offered < LINK_EVENTS &&
+                    (tail0 + offered) - status_head < STATUS_QUEUE_CAPACITY; n++) {
+      char tracking[TRACKING_MAX_LEN + 1];
+      snprintf(tracking, sizeof(tracking), "TH%010d", offered);
+      updateTrackingStatusOnServer(tracking, STATUS_DELIVERED, offered % 16);
+      offered++;
+    }
+    firmware_tick();
+
+    // ESP32 → Pi
+    from_esp.insert(from_esp.end(), pi_tx.begin(), pi_tx.end());
+    pi_tx.clear();
+    size_t start = 0;
+    for (size_t i = 0; i < from_esp.size(); i++) {
+      if (from_esp[i] != 0) continue;
+      std::vector<uint8_t> wire(from_esp.begin() + start, from_esp.begin() + i + 1);
+      start = i + 1;
+      if (!link_pass(wire, link, dropped, corrupted)) continue;
+      size_t n = cobs_decode(wire.data(), wire.size() - 1);
+      if (n < 6 || crc16_ccitt(wire.data(), n - 2) != rd_u16(wire.data() + n - 2) || wire[0] != MSG_STATUS_BATCH) {
+        rejected++;
+        continue;
+      }
+      const uint8_t *body = wire.data() + 1;
+      uint16_t batch = rd_u16(body);
+      if (batch != last_batch) {                 // ชุดที่ส่งซ้ำถูกบันทึกไปแล้ว
+        size_t pos = 3;
+        for (int e = 0; e < body[2]; e++) {
+          int dorm = (int16_t)rd_u16(body + pos + 1);
+          uint8_t len = body[pos + 3];
+          applied[std::string((const char *)body + pos + 4, len)].push_back(dorm);
+          pos += 4 + len;
+        }
+        last_batch = batch;
+        batches++;
+      } else {
+        duplicates++;
+      }
+      frame_begin(ack, MSG_ACK);
+      frame_u16(ack, batch);
+      PendingAck a;
+      a.due_us = sim_us + LINK_LATENCY_MS * 1000ULL;
+      a.wire.resize(PI_WIRE_MAX);
+      a.wire.resize(frame_encode(ack, a.wire.data(), a.wire.size()));
+      if (link_pass(a.wire, link, dropped, corrupted)) acks.push_back(a);
+    }
+    from_esp.erase(from_esp.begin(), from_esp.begin() + start);
+
+    // Pi → ESP32
+    for (size_t i = 0; i < acks.size(); ) {
+      if (acks[i].due_us > sim_us) {
+        i++;
+        continue;
+      }
+      InputEvent ev;
+      ev.kind = REC_PI;
+      ev.sensor = ev.level = 0;
+      ev.data = acks[i].wire;
+      inject(ev);
+      acks.erase(acks.begin() + i);
+    }
+    if (offered == LINK_EVENTS && status_head - head0 == LINK_EVENTS) done_us = sim_us;
+  }
+  retries = count_traces(TR_STATUS_RETRY);
+
+  int exactly_once = 0;
+  for (int i = 0; i < LINK_EVENTS; i++) {
+    char tracking[TRACKING_MAX_LEN + 1];
+    snprintf(tracking, sizeof(tracking), "TH%010d", i);
+    std::map<std::string, std::vector<int> >::const_iterator it = applied.find(tracking);
+    exactly_once += it != applied.end() && it->second.size() == 1 && it->second[0] == i % 16;
+  }
+  CHECK(done_us > 0);
+  CHECK(exactly_once == LINK_EVENTS && (int)applied.size() == LINK_EVENTS);
+  CHECK(count_traces(TR_STATUS_FULL) == 0 && count_traces(TR_COMMS_FULL) == 0);
+  CHECK(link.drop_pct + link.corrupt_pct > 0 || (retries == 0 && duplicates == 0));
+  printf("status link: %-28s %6.1f events/s  %4d batches  %3d dropped %3d corrupted  %3u retries  "
+         "%3d duplicate batches ignored - %s\n", link.name, LINK_EVENTS / (done_us / 1e6), batches, dropped, corrupted,
+         retries, duplicates, check_failures > failures ? "FAILED" : "ok");
+}
+
+int main() {
+  for (size_t i = 0; i < sizeof(LINK_CASES) / sizeof(LINK_CASES[0]); i++) run_link(LINK_CASES[i]);
+  return check_failures ? 1 : 0;
+}
@@ -0,0 +1,171 @@
+/**
+ * Test ความยาวของหมายเลขติดตามตั้งแต่ผล QR จนถึงคิว, journal และชุดสถานะ
+ *
+ * หมายเลขติดตามของผู้ให้บริการต่าง ๆ (ยาวสุด TRACKING_MAX_LEN) ต้องผ่านทุกทางโดยไม่ถูกตัด:
+ *   ผล QR → หอพักจากตารางบนอุปกรณ์ → ช่องในคิว → journal (กู้คืนหลัง boot ใหม่) → MSG_STATUS_BATCH
+ * หมายเลขที่ยาวเกินต้องถูกปฏิเสธพร้อม TR_TRACKING_TOO_LONG และไม่ทราบหอพัก
+ * แม้ตารางหอพักจะมี hash ของหมายเลขที่ตัดเหลือ TRACKING_MAX_LEN ตัวอักษร (พฤติกรรมเดิมจะส่งไปหอพักนั้น)
+ *
+ * build:  make -C tools check
+ */
+#include "host_hal.h"
+
+#include <algorithm>
+#include <string>
+
+struct TrackingCase {
+  const char *carrier;
+  std::string text;
+  int dorm;                    // หอพักในตาราง (-1 = ยาวเกิน ต้องไม่ทราบหอพัก)
+};
+
+/**
+ * ฟังก์ชันหากรอบชนิดที่ต้องการที่ firmware ส่งไป Pi (ทิ้งกรอบอื่น)
+ * @param body เนื้อหาของกรอบ (ไม่รวมชนิดและ CRC)
+ */
+bool take_frame(uint8_t type, std::vector<uint8_t> &body) {
+  bool found = false;
+  size_t start = 0;
+  for (size_t i = 0; i < pi_tx.size() && !found; i++) {
+    if (pi_tx[i] != 0) continue;
+    std::vector<uint8_t> frame(pi_tx.begin() + start, pi_tx.begin() + i);
+    start = i + 1;
+    size_t n = cobs_decode(frame.data(), frame.size());
+    if (n < 3 || crc16_ccitt(frame.data(), n - 2) != rd_u16(frame.data() + n - 2) || frame[0] != type) continue;
+    body.assign(frame.begin() + 1, frame.begin() + n - 2);
+    found = true;
+  }
+  pi_tx.erase(pi_tx.begin(), pi_tx.begin() + start);
+  return found;
+}
+
+/**
+ * ฟังก์ชันส่งกรอบจาก Pi เข้า firmware
+ */
+void pi_send(PiFrame &f) {
+  InputEvent ev;
+  ev.kind = REC_PI;
+  ev.sensor = ev.level = 0;
+  ev.data.resize(PI_WIRE_MAX);
+  ev.data.resize(frame_encode(f, ev.data.data(), ev.data.size()));
+  inject(ev);
+}
+
+void tick_ms(int ms) {
+  for (int i = 0; i < ms; i++) firmware_tick();
+}
+
+int main() {
+  std::vector<TrackingCase> cases;
+  TrackingCase c;
+  c = { "Thailand Post", "EX123456789TH", 10 }; cases.push_back(c);
+  c = { "J&T", "820012345678", 2 }; cases.push_back(c);
+  c = { "Shopee", "SPXTH041234567890", 6 }; cases.push_back(c);
+  c = { "UPS", "1Z999AA10123456784", 10 }; cases.push_back(c);
+  c = { "FedEx Ground", "9622001900000000000000776632517510", 2 }; cases.push_back(c);
+  c = { "USPS IMpb+ZIP", "42094110123492612903246000000000000012", 6 }; cases.push_back(c);
+  c = { "max length", std::string(TRACKING_MAX_LEN - 5, '7') + "ABCDE", 10 }; cases.push_back(c);
+  c = { "too long", std::string(TRACKING_MAX_LEN, '7') + "ZZ", -1 }; cases.push_back(c);
+
+  firmware_boot();
+
+  // ตารางหอพัก: ทุกหมายเลขที่ใช้ได้ และ hash ของหมายเลขที่ยาวเกินเมื่อถูกตัด (ต้องไม่ถูกใช้)
+  std::vector<std::pair<uint32_t, uint8_t> > entries;
+  for (size_t i = 0; i < cases.size(); i++) {
+    if (cases[i].dorm >= 0) entries.push_back(std::make_pair(tracking_hash(cases[i].text.c_str()), cases[i].dorm));
+  }
+  std::string truncated = cases.back().text.substr(0, TRACKING_MAX_LEN);
+  entries.push_back(std::make_pair(tracking_hash(truncated.c_str()), (uint8_t)6));
+  std::sort(entries.begin(), entries.end());
+  PiFrame f;
+  frame_begin(f, MSG_DORM_FULL);
+  frame_u32(f, 1);
+  frame_u16(f, 0);
+  frame_u16(f, 1);
+  for (size_t i = 0; i < entries.size(); i++) {
+    frame_u32(f, entries[i].first);
+    frame_u8(f, entries[i].second);
+  }
+  pi_send(f);
+  tick_ms(10);
+  CHECK(dorm_cache_ready && dorm_cache->size == entries.size());
+
+  // พัสดุหนึ่งชิ้นต่อหมายเลข ผ่าน IR หลักแล้วตอบคำขอ QR
+  Lane &lane = lanes[0];
+  std::vector<uint32_t> seqs;
+  for (size_t i = 0; i < cases.size(); i++) {
+    set_ir(IR_SENSOR_MAIN, LOW);
+    tick_ms(30);
+    set_ir(IR_SENSOR_MAIN, HIGH);
+    std::vector<uint8_t> req;
+    for (int ms = 0; ms < 1000 && !take_frame(MSG_QR_REQUEST, req); ms++) firmware_tick();
+    CHECK(req.size() >= 5 && req[0] == 0);
+    if (req.size() < 5) continue;
+    uint32_t seq = rd_u32(req.data() + 1);
+    seqs.push_back(seq);
+
+    frame_begin(f, MSG_QR_RESULT);
+    frame_u8(f, 0);
+    frame_u32(f, seq);
+    frame_str(f, cases[i].text.c_str());
+    pi_send(f);
+    tick_ms(400);
+
+    const ParcelSlot &slot = queue_slot(lane, seq);
+    bool too_long = cases[i].dorm < 0;
+    CHECK(slot.active && slot.dorm == cases[i].dorm);
+    CHECK(too_long ? strcmp(slot.tracking_number.text, TRACKING_NONE) == 0
+                   : cases[i].text == slot.tracking_number.text);
+    CHECK(too_long ? slot.tracking_number.hash == 0
+                   : slot.tracking_number.hash == tracking_hash(cases[i].text.c_str()));
+    printf("tracking: %-13s %2zu chars  dorm %3d  stored \"%s\"\n", cases[i].carrier, cases[i].text.size(),
+           slot.dorm, slot.tracking_number.text);
+  }
+  CHECK(count_traces(TR_TRACKING_TOO_LONG) == 1);
+  CHECK(count_traces(TR_QR_TIMEOUT) == 0);
+
+  // ชุดสถานะขาออกมีหมายเลขเต็ม
+  pi_tx.clear();
+  for (size_t i = 0; i < cases.size(); i++) {
+    if (cases[i].dorm >= 0) updateTrackingStatusOnServer(cases[i].text.c_str(), STATUS_DELIVERED, cases[i].dorm);
+  }
+  std::vector<std::string> sent;
+  std::vector<uint8_t> batch;
+  for (int ms = 0; ms < 2000 && sent.size() < cases.size() - 1; ms++) {
+    firmware_tick();
+    while (take_frame(MSG_STATUS_BATCH, batch)) {
+      size_t pos = 3;
+      for (int e = 0; e < batch[2] && pos + 4 <= batch.size(); e++) {
+        sent.push_back(std::string((const char *)batch.data() + pos + 4, batch[pos + 3]));
+        pos += 4 + batch[pos + 3];
+      }
+      frame_begin(f, MSG_ACK);
+      frame_u16(f, rd_u16(batch.data()));
+      pi_send(f);
+    }
+  }
+  for (size_t i = 0; i < cases.size(); i++) {
+    if (cases[i].dorm >= 0) CHECK(std::count(sent.begin(), sent.end(), cases[i].text) == 1);
+  }
+  CHECK(count_traces(TR_STATUS_TOO_LONG) == 0);
+
+  // journal: หมายเลขเต็มของพัสดุที่ยังอยู่บนสายพานหลัง boot ใหม่
+  std::vector<std::string> before;
+  for (size_t i = 0; i < seqs.size(); i++) {
+    const ParcelSlot &slot = queue_slot(lane, seqs[i]);
+    before.push_back(slot.active && queue_contains(lane, seqs[i]) ? slot.tracking_number.text : "");
+  }
+  firmware_boot(true);
+  int restored = 0;
+  for (size_t i = 0; i < seqs.size(); i++) {
+    if (before[i].empty()) continue;
+    const ParcelSlot &slot = queue_slot(lane, seqs[i]);
+    CHECK(slot.active && before[i] == slot.tracking_number.text);
+    restored++;
+  }
+  CHECK(!before.empty() && !before[before.size() - 2].empty());  // หมายเลขยาวสุดยังอยู่บนสายพาน
+
+  printf("tracking: %zu ids up to %d chars, %zu status events, %d restored from journal - %s\n", cases.size(),
+         TRACKING_MAX_LEN, sent.size(), restored, check_failures ? "FAILED" : "ok");
+  return check_failures ? 1 : 0;
+}
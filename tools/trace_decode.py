@@ -0,0 +1,219 @@
+import argparse
+import struct
+import sys
+
+import serial
+
+# ===================================
+# ตัวแปลง trace แบบ binary จาก ESP32 เป็นข้อความ
+# ===================================
+# อ่าน record จาก Serial (USB) ของ ESP32 หรือจากไฟล์ที่บันทึกไว้ แล้วพิมพ์ทีละบรรทัด
+# รูปแบบ record: [0xA5][id][time_us:4][a:4][b:4] (little-endian) ดู trace_drain() ใน main.cpp
+#
+# ใช้งาน:
+#   python3 trace_decode.py /dev/ttyUSB0        (อ่านจากพอร์ตโดยตรง)
+#   python3 trace_decode.py capture.bin         (อ่านจากไฟล์)
+#   python3 trace_decode.py /dev/ttyUSB0 --baud 921600 --record field.rec
+#       (firmware ที่ compile ด้วย -DRECORD_INPUTS: แยก input ลงไฟล์ .rec สำหรับ tools/replay.cpp
+#        บันทึกจนกด Ctrl-C)
+
+TRACE_SYNC = 0xA5
+FRAME = struct.Struct('<BBIii')
+
+# ต้องเรียงตรงกับ enum TraceId ใน main.cpp
+TRACE_EVENTS = [
+    "trace dropped {a} records on core {b}",
+    "Queue full ({a} parcels) on lane {b}, cannot enqueue",
+    "Invalid index: seq {a} (lane {b})",
+    "Queue empty (lane {a})",
+    "Duplicate tracking number: seq {a} re-read as seq {b}",
+    "Comms queue full, dropped message type {a} ({b})",
+    "Message type {a} too short ({b} bytes)",
+    "QR result: seq {a} dorm {b}",
+    "RT queue full, QR result dropped: seq {a}",
+    "Stale QR response: seq {a} (lane {b})",
+    "QR timeout for seq {a} (lane {b})",
+    "Sent status batch {a} ({b} events)",
+    "Status queue full, dropping update for dorm {a}",
+    "Status batch retry: {a}",
+    "Status message too long at {a}",
+    "Frame from Pi ({a} bytes, type {b})",
+    "Bad frame from Pi (error {a}, {b})",
+    "belt move {a} (lane {b})",
+    "queue: seq {a} dorm {b}",
+    "Throughput: {a_100} parcels/min, all lanes (continuous={b})",
+    "push box: seq {a} dorm {b}",
+    "push dorm: gate {a} dorm {b}",
+    "push box no form: seq {a} dorm {b}",
+    "Gate {a}: seq {b}",
+    "Parcel lost: seq {a} (lane {b})",
+    "IR triggered: seq {a} (continuous={b})",
+    "Unexpected parcel at gate {a} (lane {b})",
+    "QR result late, holding belt of lane {a}",
+    "RT loop max: {a} us, IR edge latency max: {b} us",
+    "IR events dropped: {a}",
+    "Metrics message too long (buffer {a})",
+    "Journal restored {a} parcels (generation {b})",
+    "Journal compacted: generation {a}, {b} parcels",
+    "Journal flash error at offset {a}",
+    "Journal queue full, dropped record type {a} (seq {b})",
+    "Recent tracking set full ({a} entries)",
+    "Dorm table sync requested (version {a})",
+    "Dorm table synced: {a} entries (version {b})",
+    "Dorm table delta: {a} change(s) (version {b})",
+    "Dorm table part {a} out of order (expected {b})",
+    "Dorm table full ({a} entries)",
+    "Lane {a} throughput: {b_100} parcels/min",
+    "Pusher stroke: motor {a} reached end in {b} ms (negative motor = retract)",
+    "Pusher {a}: end-stop not reached (direction {b})",
+    "Pusher {a}: feedback lost after {b} misses, using fixed timing",
+    "Pusher {a} baseline: extend {b_lo} ms, retract {b_hi} ms",
+    "Pusher {a} worn: stroke time at {b}% of baseline",
+    "Tracking number too long: seq {a} ({b} characters)",
+    "IR triggered while scanning seq {a}, ignored (lane {b})",
+    "Status queue restored {a} unacked events (generation {b})",
+    "IR edge: sensor {a} level {b}",
+    "Pi bytes ({a_len})",
+    "Pusher feedback: input {a} level {b}",
+]
+
+TR_TRACE_DROPPED = 0
+TR_REC_IR = TRACE_EVENTS.index("IR edge: sensor {a} level {b}")
+TR_REC_PI = TR_REC_IR + 1
+TR_REC_FEEDBACK = TR_REC_IR + 2
+
+# ===================================
+# ไฟล์ input สำหรับ replay (.rec) - ต้องตรงกับ rec_load() ใน tools/replay.cpp
+# ===================================
+# "PREC" version:1 แล้วตามด้วย record: [ชนิด:1][เวลาห่างจาก record ก่อนหน้า us: varint][ข้อมูล]
+#   REC_IR  sensor:1 level:1
+#   REC_PI  len:1 ไบต์ที่รับจาก Pi
+#   REC_FEEDBACK  input:1 level:1 (feedback ของมอเตอร์ผลัก input = ประตู*2 + ปลายทาง)
+REC_MAGIC = b"PREC\x01"
+REC_IR = 1
+REC_PI = 2
+REC_FEEDBACK = 3
+
+
+def varint(v):
+    out = bytearray()
+    while v >= 0x80:
+        out.append(v & 0x7F | 0x80)
+        v >>= 7
+    out.append(v)
+    return bytes(out)
+
+
+class Recording:
+    """เก็บ record ของ input เรียงตามเวลา แล้วเขียนเป็นไฟล์ .rec"""
+
+    def __init__(self):
+        self.events = []        # (เวลา us แบบไม่วนรอบ, ชนิด, ข้อมูล)
+        self.last = None
+        self.base = 0
+        self.dropped = 0
+
+    def unwrap(self, time_us):
+        # micros() วนรอบทุก ~71 นาที และ record จากสอง core อาจสลับลำดับเล็กน้อย
+        if self.last is not None and time_us < self.last and self.last - time_us > 1 << 31:
+            self.base += 1 << 32
+        self.last = time_us
+        return self.base + time_us
+
+    def add(self, event_id, time_us, a, b):
+        t = self.unwrap(time_us)
+        if event_id == TR_REC_IR:
+            self.events.append((t, REC_IR, bytes((a & 0xFF, b & 0xFF))))
+        elif event_id == TR_REC_FEEDBACK:
+            self.events.append((t, REC_FEEDBACK, bytes((a & 0xFF, b & 0xFF))))
+        else:
+            raw = struct.pack('<ii', a, b)
+            self.events.append((t, REC_PI, raw[1:1 + raw[0]]))
+
+    def save(self, path):
+        self.events.sort(key=lambda e: e[0])        # stable - ลำดับไบต์ในเวลาเดียวกันคงเดิม
+        merged = []
+        for t, kind, data in self.events:
+            if merged and kind == REC_PI and merged[-1][1] == REC_PI and merged[-1][0] == t \
+                    and len(merged[-1][2]) + len(data) <= 255:
+                merged[-1] = (t, kind, merged[-1][2] + data)
+            else:
+                merged.append((t, kind, data))
+
+        with open(path, 'wb') as f:
+            f.write(REC_MAGIC)
+            prev = 0
+            for t, kind, data in merged:
+                f.write(bytes((kind,)) + varint(t - prev))
+                f.write(data if kind != REC_PI else bytes((len(data),)) + data)
+                prev = t
+        return len(merged)
+
+
+def decode_records(read):
+    """แยก record ออกจาก stream คืน (id, time_us, a, b) ทีละ record (resync เมื่อข้อมูลเสีย)"""
+    buf = b''
+    while True:
+        chunk = read()
+        if not chunk:
+            return
+        buf += chunk
+        while len(buf) >= FRAME.size:
+            if buf[0] != TRACE_SYNC or buf[1] >= len(TRACE_EVENTS):
+                buf = buf[1:]  # ไม่ใช่จุดเริ่ม record - เลื่อนไปหนึ่งไบต์
+                continue
+            _, event_id, time_us, a, b = FRAME.unpack_from(buf)
+            buf = buf[FRAME.size:]
+            yield event_id, time_us, a, b
+
+
+def format_record(event_id, time_us, a, b):
+    text = TRACE_EVENTS[event_id].format(a=a, b=b, a_100=a / 100.0, b_100=b / 100.0, a_len=a & 0xFF,
+                                        b_lo=b & 0xFFFF, b_hi=(b >> 16) & 0xFFFF)
+    return f"{time_us / 1e6:12.6f} {text}"
+
+
+def decode_stream(read):
+    """แยก record ออกจาก stream และคืนข้อความทีละบรรทัด"""
+    for record in decode_records(read):
+        yield format_record(*record)
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('source', help='serial port (/dev/...) หรือไฟล์ที่บันทึกไว้')
+    parser.add_argument('--baud', type=int, default=115200, help='ต้องตรงกับ DEBUG_BAUD ใน main.cpp')
+    parser.add_argument('--record', metavar='FILE', help='เขียน input (RECORD_INPUTS) ลงไฟล์ .rec')
+    args = parser.parse_args()
+
+    if args.source.startswith('/dev/'):
+        src = serial.Serial(args.source, args.baud)  # อ่านแบบรอจนมีข้อมูล
+        read = lambda: src.read(max(1, src.in_waiting))
+    else:
+        src = open(args.source, 'rb')
+        read = lambda: src.read(4096)
+
+    recording = Recording() if args.record else None
+    try:
+        for record in decode_records(read):
+            event_id = record[0]
+            if event_id in (TR_REC_IR, TR_REC_PI, TR_REC_FEEDBACK):
+                if recording:
+                    recording.add(*record)
+                continue                # ไม่พิมพ์ input ดิบ
+            if recording and event_id == TR_TRACE_DROPPED:
+                recording.dropped += record[2]
+            print(format_record(*record), flush=True)
+    except KeyboardInterrupt:
+        pass
+
+    if recording:
+        count = recording.save(args.record)
+        print(f"saved {count} input records to {args.record}", file=sys.stderr)
+        if recording.dropped:
+            print(f"warning: {recording.dropped} trace records were dropped - replay is incomplete",
+                  file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()